@@ -386,6 +386,7 @@ static int __init omap1_system_dma_init(void)
 	pdata->set_dma_chain_ch		= NULL;
 	p->dma_context_save		= NULL;
 	p->dma_context_restore		= NULL;
+	p->release_parked_lch		= NULL;
 
 	if (cpu_is_omap15xx())
 		d->dma_chan_count = 9;
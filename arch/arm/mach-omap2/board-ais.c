@@ -19,6 +19,7 @@
 #include "parrot-common.h"
 #include <../drivers/parrot/input/touchscreen/atmel_mxt_ts.h>
 #include <../drivers/parrot/i2c/smsc-82514-usb-hub.h>
+#include <../drivers/parrot/parrot_async.h>
 #include <linux/pwm_backlight.h>
 
 
@@ -367,8 +368,24 @@ static void __init omap_ais_devwb_miscellaneous( void )
 
 
 
+/*
+ * Boot steps probed by built-in drivers on this board: EHCI waits for the
+ * hub, the touchscreen for the LVDS link.
+ */
+static unsigned long ais_async_steps __initdata =
+#ifdef CONFIG_PARROT_MCLAREN_INPUT
+	PARROT_ASYNC(PARROT_ASYNC_LVDS) |
+#endif
+#ifdef CONFIG_PARROT_SMSC_USB82514_USB_HUB
+	PARROT_ASYNC(PARROT_ASYNC_USB_HUB) |
+#endif
+	0;
+
 static void __init omap_ais_init(void)
 {
+	/* before fc6100_mod_common_init() schedules EHCI */
+	parrot_async_expect(ais_async_steps);
+
 	fc6100_gpio.dev.platform_data = ais_pins;
 	fc6100_mod_common_init(WB_AIS_CONFIG);
 
@@ -166,7 +166,7 @@ static struct spi_board_info fc6100_spi_board_info[] __initdata = {
 		.bus_num		= 1,
 		.chip_select		= 0,
 		.max_speed_hz		= 30000000,
-		.controller_data 	= &fc6100_mcspi_config,
+		.controller_data 	= &fc6100_mcspi_sync_config,
 		.mode			= SPI_MODE_3,
 	}
 #elif defined(CONFIG_SERIAL_MAX3100) || defined(CONFIG_SERIAL_MAX3100_MODULE)
@@ -175,7 +175,7 @@ static struct spi_board_info fc6100_spi_board_info[] __initdata = {
 		.bus_num		= 1,
 		.chip_select		= 0,
 		.max_speed_hz		= 3000000,
-		.controller_data 	= &fc6100_mcspi_config,
+		.controller_data 	= &fc6100_mcspi_sync_config,
 		.mode			= SPI_MODE_0,		  //see diagramm in datasheet p3
 		.platform_data		  = &max3100_plat_data,
 
@@ -45,6 +45,7 @@
 #include <linux/io.h>
 
 #include <plat/clock.h>
+#include <plat/control.h>
 
 #include "clock.h"
 
@@ -158,6 +159,12 @@ static void _write_clksel_reg(struct clk *clk, u32 field_val)
 	__raw_writel(v, clk->clksel_reg);
 
 	v = __raw_readl(clk->clksel_reg); /* OCP barrier */
+
+	/* DEVCONF0/1 are part of the CORE off context */
+	if (cpu_is_omap34xx() &&
+	    clk->clksel_reg >= OMAP343X_CTRL_REGADDR(0) &&
+	    clk->clksel_reg < OMAP343X_CTRL_REGADDR(OMAP343X_CONTROL_MEM_WKUP))
+		omap3_control_mark_dirty(OMAP3_CTX_CONTROL);
 }
 
 /**
@@ -13,6 +13,7 @@
 #undef DEBUG
 
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/io.h>
 
 #include <plat/common.h>
@@ -28,6 +29,13 @@
 static void __iomem *omap2_ctrl_base;
 static void __iomem *omap4_ctrl_pad_base;
 
+/*
+ * Parts of the OMAP3 CORE off-mode context written since they were last
+ * saved. Set after the register write, so that a save which clears it
+ * before reading the registers never misses a change.
+ */
+static u32 omap3_ctx_dirty = OMAP3_CTX_PADCONF | OMAP3_CTX_CONTROL;
+
 #if defined(CONFIG_ARCH_OMAP3) && defined(CONFIG_PM)
 struct omap3_scratchpad {
 	u32 boot_config_ptr;
@@ -177,19 +185,74 @@ u32 omap_ctrl_readl(u16 offset)
 	return __raw_readl(OMAP_CTRL_REGADDR(offset));
 }
 
+/* Core pads, the ones saved to the scratchpad by START_PADCONF_SAVE */
+static inline bool omap3_ctrl_is_padconf(u16 offset)
+{
+	return (offset >= OMAP2_CONTROL_PADCONFS &&
+		offset < OMAP2_CONTROL_GENERAL) ||
+	       (offset >= OMAP343X_PADCONF_ETK_CLK &&
+		offset < OMAP343X_CONTROL_MEM_WKUP);
+}
+
+static inline void omap3_ctrl_touch(u16 offset)
+{
+	if (omap3_ctrl_is_padconf(offset)) {
+		omap3_ctx_dirty |= OMAP3_CTX_PADCONF;
+		/* SYS_NIRQ is part of control_context as well */
+		if ((offset & ~0x3) == OMAP343X_CONTROL_PADCONF_SYSNIRQ)
+			omap3_ctx_dirty |= OMAP3_CTX_CONTROL;
+	} else if (offset < OMAP343X_CONTROL_MEM_WKUP &&
+		   offset != OMAP343X_CONTROL_PADCONF_OFF) {
+		/* the scratchpad and the wakeup module are not saved */
+		omap3_ctx_dirty |= OMAP3_CTX_CONTROL;
+	}
+}
+
 void omap_ctrl_writeb(u8 val, u16 offset)
 {
 	__raw_writeb(val, OMAP_CTRL_REGADDR(offset));
+	omap3_ctrl_touch(offset);
 }
 
 void omap_ctrl_writew(u16 val, u16 offset)
 {
 	__raw_writew(val, OMAP_CTRL_REGADDR(offset));
+	omap3_ctrl_touch(offset);
 }
 
 void omap_ctrl_writel(u32 val, u16 offset)
 {
 	__raw_writel(val, OMAP_CTRL_REGADDR(offset));
+	omap3_ctrl_touch(offset);
+}
+EXPORT_SYMBOL(omap_ctrl_writel);
+
+/**
+ * omap3_control_mark_dirty - flag parts of the CORE context as changed
+ * @ctx: OMAP3_CTX_* mask
+ *
+ * For writers that do not go through omap_ctrl_write*(), such as the mux
+ * code. Call it after the register write.
+ */
+void omap3_control_mark_dirty(u32 ctx)
+{
+	omap3_ctx_dirty |= ctx;
+}
+EXPORT_SYMBOL(omap3_control_mark_dirty);
+
+/**
+ * omap3_control_ctx_test_and_clear - fetch and forget context changes
+ * @ctx: OMAP3_CTX_* mask
+ *
+ * Returns the parts of @ctx written since the last call. The caller must
+ * save them before interrupts are enabled again.
+ */
+u32 omap3_control_ctx_test_and_clear(u32 ctx)
+{
+	u32 dirty = omap3_ctx_dirty & ctx;
+
+	omap3_ctx_dirty &= ~ctx;
+	return dirty;
 }
 
 /*
@@ -427,6 +490,9 @@ void omap3_control_save_context(void)
 
 void omap3_control_restore_context(void)
 {
+	/* Writing back the saved values is not a change */
+	u32 dirty = omap3_ctx_dirty;
+
 	omap_ctrl_writel(control_context.sysconfig, OMAP2_CONTROL_SYSCONFIG);
 	omap_ctrl_writel(control_context.devconf0, OMAP2_CONTROL_DEVCONF0);
 	omap_ctrl_writel(control_context.mem_dftrw0,
@@ -480,6 +546,7 @@ void omap3_control_restore_context(void)
 	omap_ctrl_writel(control_context.csi, OMAP343X_CONTROL_CSI);
 	omap_ctrl_writel(control_context.padconf_sys_nirq,
 					OMAP343X_CONTROL_PADCONF_SYSNIRQ);
+	omap3_ctx_dirty = dirty;
 	return;
 }
 #endif /* CONFIG_ARCH_OMAP3 && CONFIG_PM */
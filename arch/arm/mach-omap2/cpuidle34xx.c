@@ -24,6 +24,10 @@
 
 #include <linux/sched.h>
 #include <linux/cpuidle.h>
+#include <linux/ktime.h>
+#include <linux/pm_qos_params.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <plat/prcm.h>
 #include <plat/irqs.h>
@@ -47,6 +51,22 @@
 
 #define OMAP3_STATE_MAX OMAP3_STATE_C7
 
+/*
+ * Measured latencies, in usec. Entry is the time spent in omap_sram_idle()
+ * before the WFI (context save), exit the time after it (restore). The
+ * peak of entry + exit decays by 1/16 per sample so that a one-off slow
+ * transition does not disable a state forever.
+ */
+struct omap3_cx_latency {
+	u32 count;
+	u32 entry_avg;
+	u32 entry_max;
+	u32 exit_avg;
+	u32 exit_max;
+	u32 peak;
+	u32 qos_demoted;
+};
+
 struct omap3_processor_cx {
 	u8 valid;
 	u8 type;
@@ -56,6 +76,8 @@ struct omap3_processor_cx {
 	u32 core_state;
 	u32 threshold;
 	u32 flags;
+	struct omap3_cx_latency lat;
+	struct cpuidle_state *state;
 };
 
 struct omap3_processor_cx omap3_power_states[OMAP3_MAX_STATES];
@@ -86,6 +108,44 @@ static struct cpuidle_params cpuidle_params_table[] = {
 	{1, 10000, 30000, 300000},
 };
 
+/*
+ * Latency used to choose states: the board figure, or what was measured
+ * if that is worse. The hardware part of the wakeup (PRCM, DPLL relock,
+ * voltage ramp) can't be measured from here, the board figure covers it.
+ */
+static inline u32 omap3_cx_latency(struct omap3_processor_cx *cx)
+{
+	return max(cx->sleep_latency + cx->wakeup_latency, cx->lat.peak);
+}
+
+static void omap3_cx_record(struct omap3_processor_cx *cx, ktime_t start,
+			    ktime_t end)
+{
+	struct omap3_cx_latency *lat = &cx->lat;
+	u32 entry, exit;
+	s64 us;
+
+	us = ktime_us_delta(omap_sram_idle_stamp.wfi_enter, start);
+	entry = us > 0 ? us : 0;
+	us = ktime_us_delta(end, omap_sram_idle_stamp.wfi_exit);
+	exit = us > 0 ? us : 0;
+
+	if (lat->count++) {
+		lat->entry_avg += ((s32)entry - (s32)lat->entry_avg) / 8;
+		lat->exit_avg += ((s32)exit - (s32)lat->exit_avg) / 8;
+	} else {
+		lat->entry_avg = entry;
+		lat->exit_avg = exit;
+	}
+	lat->entry_max = max(lat->entry_max, entry);
+	lat->exit_max = max(lat->exit_max, exit);
+	lat->peak = max(entry + exit, lat->peak - lat->peak / 16);
+
+	/* let the governor see it too */
+	if (cx->state)
+		cx->state->exit_latency = omap3_cx_latency(cx);
+}
+
 static int omap3_idle_bm_check(void)
 {
 	if (!omap3_can_sleep())
@@ -119,17 +179,17 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 			struct cpuidle_state *state)
 {
 	struct omap3_processor_cx *cx = cpuidle_get_statedata(state);
-	struct timespec ts_preidle, ts_postidle, ts_idle;
+	ktime_t preidle, postidle;
 	u32 mpu_state = cx->mpu_state, core_state = cx->core_state;
 
 	current_cx_state = *cx;
 
-	/* Used to keep track of the total time in idle */
-	getnstimeofday(&ts_preidle);
-
 	local_irq_disable();
 	local_fiq_disable();
 
+	/* Used to keep track of the total time in idle */
+	preidle = ktime_get();
+
 	pwrdm_set_next_pwrst(mpu_pd, mpu_state);
 	pwrdm_set_next_pwrst(core_pd, core_state);
 
@@ -149,14 +209,32 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 		pwrdm_for_each_clkdm(core_pd, _cpuidle_allow_idle);
 	}
 
-return_sleep_time:
-	getnstimeofday(&ts_postidle);
-	ts_idle = timespec_sub(ts_postidle, ts_preidle);
+	postidle = ktime_get();
+	omap3_cx_record(cx, preidle, postidle);
+	goto out;
 
+return_sleep_time:
+	postidle = ktime_get();
+out:
 	local_irq_enable();
 	local_fiq_enable();
 
-	return ts_idle.tv_nsec / NSEC_PER_USEC + ts_idle.tv_sec * USEC_PER_SEC;
+	return ktime_us_delta(postidle, preidle);
+}
+
+/*
+ * A state is allowed if it is valid and wakes up within the PM QoS
+ * CPU_DMA_LATENCY limit (omap_pm_set_max_mpu_wakeup_lat(), ALSA periods).
+ */
+static bool omap3_cx_allowed(struct omap3_processor_cx *cx, s32 max_lat)
+{
+	if (!cx->valid)
+		return false;
+	if (cx->type != OMAP3_STATE_C1 && omap3_cx_latency(cx) > max_lat) {
+		cx->lat.qos_demoted++;
+		return false;
+	}
+	return true;
 }
 
 /**
@@ -164,20 +242,21 @@ return_sleep_time:
  * @dev: cpuidle device
  * @state: Currently selected c-state
  *
- * If the current state is valid, it is returned back to the caller.
- * Else, this function searches for a lower c-state which is still
- * valid (as defined in omap3_power_states[]).
+ * If the current state is allowed, it is returned back to the caller.
+ * Else, this function searches for a lower c-state which is valid (as
+ * defined in omap3_power_states[]) and meets the wakeup latency limit.
  */
 static struct cpuidle_state *next_valid_state(struct cpuidle_device *dev,
 						struct cpuidle_state *curr)
 {
 	struct cpuidle_state *next = NULL;
 	struct omap3_processor_cx *cx;
+	s32 max_lat = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
 
 	cx = (struct omap3_processor_cx *)cpuidle_get_statedata(curr);
 
-	/* Check if current state is valid */
-	if (cx->valid) {
+	/* Check if current state is allowed */
+	if (omap3_cx_allowed(cx, max_lat)) {
 		return curr;
 	} else {
 		u8 idx = OMAP3_STATE_MAX;
@@ -206,13 +285,13 @@ static struct cpuidle_state *next_valid_state(struct cpuidle_device *dev,
 			struct omap3_processor_cx *cx;
 
 			cx = cpuidle_get_statedata(&dev->states[idx]);
-			if (cx->valid) {
+			if (omap3_cx_allowed(cx, max_lat)) {
 				next = &dev->states[idx];
 				break;
 			}
 		}
 		/*
-		 * C1 and C2 are always valid.
+		 * C1 is always allowed.
 		 * So, no need to check for 'next==NULL' outside this loop.
 		 */
 	}
@@ -417,6 +496,53 @@ struct cpuidle_driver omap3_idle_driver = {
  * Registers the OMAP3 specific cpuidle driver with the cpuidle
  * framework with the valid set of states.
  */
+#ifdef CONFIG_DEBUG_FS
+static int omap3_cpuidle_lat_show(struct seq_file *s, void *unused)
+{
+	int i;
+
+	seq_printf(s, "pm_qos cpu_dma_latency: %d us\n",
+		   pm_qos_request(PM_QOS_CPU_DMA_LATENCY));
+	seq_printf(s, "state valid  board  entry(avg/max)   exit(avg/max)"
+		   "    peak   used    count  qos_demoted\n");
+
+	for (i = OMAP3_STATE_C1; i < OMAP3_MAX_STATES; i++) {
+		struct omap3_processor_cx *cx = &omap3_power_states[i];
+		struct omap3_cx_latency lat = cx->lat;
+
+		seq_printf(s, "C%d    %5u %6u %7u/%-7u %7u/%-7u %7u %6u %8u %12u\n",
+			   i + 1, cx->valid,
+			   cx->sleep_latency + cx->wakeup_latency,
+			   lat.entry_avg, lat.entry_max,
+			   lat.exit_avg, lat.exit_max,
+			   lat.peak, omap3_cx_latency(cx),
+			   lat.count, lat.qos_demoted);
+	}
+
+	return 0;
+}
+
+static int omap3_cpuidle_lat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, omap3_cpuidle_lat_show, NULL);
+}
+
+static const struct file_operations omap3_cpuidle_lat_fops = {
+	.open		= omap3_cpuidle_lat_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void __init omap3_cpuidle_debugfs_init(void)
+{
+	debugfs_create_file("cpuidle_latency", S_IRUGO, NULL, NULL,
+			    &omap3_cpuidle_lat_fops);
+}
+#else
+static inline void omap3_cpuidle_debugfs_init(void) {}
+#endif
+
 int __init omap3_idle_init(void)
 {
 	int i, count = 0;
@@ -439,7 +565,8 @@ int __init omap3_idle_init(void)
 		if (!cx->valid)
 			continue;
 		cpuidle_set_statedata(state, cx);
-		state->exit_latency = cx->sleep_latency + cx->wakeup_latency;
+		cx->state = state;
+		state->exit_latency = omap3_cx_latency(cx);
 		state->target_residency = cx->threshold;
 		state->flags = cx->flags;
 		state->enter = (state->flags & CPUIDLE_FLAG_CHECK_BM) ?
@@ -462,6 +589,8 @@ int __init omap3_idle_init(void)
 		return -EIO;
 	}
 
+	omap3_cpuidle_debugfs_init();
+
 	return 0;
 }
 #else
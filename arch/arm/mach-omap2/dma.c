@@ -32,6 +32,14 @@
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/device.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/scatterlist.h>
+#include <linux/dma-mapping.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <plat/irqs.h>
 #include <plat/omap_hwmod.h>
@@ -1152,6 +1160,557 @@ void omap_dma_set_sglist_fastmode(int lch, int fastmode)
 }
 EXPORT_SYMBOL(omap_dma_set_sglist_fastmode);
 
+/* Descriptor lists */
+
+/*
+ * Parked channel sets, how many channels they may hold in all, and how long
+ * they stay programmed unused. The channels are shared with every other
+ * omap_request_dma() user: room for one set of the largest size only.
+ */
+#define OMAP_DMA_DESC_POOL_SIZE		4
+#define OMAP_DMA_DESC_POOL_MAX_LCH	OMAP_DMA_DESC_MAX_LCH
+#define OMAP_DMA_DESC_POOL_TIMEOUT	(2 * HZ)
+
+#define OMAP_DMA_DESC_ERR_IRQ		(OMAP2_DMA_TRANS_ERR_IRQ |	\
+					 OMAP2_DMA_SECURE_ERR_IRQ |	\
+					 OMAP2_DMA_SUPERVISOR_ERR_IRQ |	\
+					 OMAP2_DMA_MISALIGNED_ERR_IRQ)
+
+struct omap_dma_desc_pool_entry {
+	int dev_id;
+	int num_lch;			/* 0 if the entry is free */
+	int lch[OMAP_DMA_DESC_MAX_LCH];
+	struct omap_dma_channel_params params;
+	unsigned long expires;
+};
+
+static struct omap_dma_desc_pool_entry dma_desc_pool[OMAP_DMA_DESC_POOL_SIZE];
+static int dma_desc_pool_lch;
+static DEFINE_MUTEX(dma_desc_pool_mutex);
+
+/* Protects the lists state, taken from the DMA interrupt */
+static DEFINE_SPINLOCK(dma_desc_lock);
+
+static struct {
+	u32 allocs;
+	u32 pool_hits;
+	u32 pool_released;
+	u32 submits;
+	u32 descs;
+	u32 reloads;
+	u32 periods;
+	u32 errors;
+	u64 setup_ns;		/* channels requested and programmed */
+	u64 reuse_ns;		/* channels taken from the pool */
+	u64 load_ns;		/* transfers loaded in the channels */
+} dma_desc_stats;
+
+static void omap_dma_desc_pool_expire(struct work_struct *work);
+static DECLARE_DELAYED_WORK(dma_desc_pool_work, omap_dma_desc_pool_expire);
+
+/* Fields the channels are programmed with, addresses and counts excepted */
+static bool omap_dma_desc_params_equal(const struct omap_dma_channel_params *a,
+				       const struct omap_dma_channel_params *b)
+{
+	return a->data_type == b->data_type &&
+		a->src_port == b->src_port && a->src_amode == b->src_amode &&
+		a->src_ei == b->src_ei && a->src_fi == b->src_fi &&
+		a->dst_port == b->dst_port && a->dst_amode == b->dst_amode &&
+		a->dst_ei == b->dst_ei && a->dst_fi == b->dst_fi &&
+		a->trigger == b->trigger && a->sync_mode == b->sync_mode &&
+		a->src_or_dst_synch == b->src_or_dst_synch &&
+		a->read_prio == b->read_prio &&
+		a->write_prio == b->write_prio &&
+		a->burst_mode == b->burst_mode;
+}
+
+static void omap_dma_desc_release(int *lch, int num_lch)
+{
+	while (num_lch--)
+		omap_free_dma(lch[num_lch]);
+}
+
+static int omap_dma_desc_pool_flush(bool all)
+{
+	int i, left = 0, released = 0;
+
+	mutex_lock(&dma_desc_pool_mutex);
+	for (i = 0; i < OMAP_DMA_DESC_POOL_SIZE; i++) {
+		struct omap_dma_desc_pool_entry *e = &dma_desc_pool[i];
+
+		if (!e->num_lch)
+			continue;
+		if (all || time_after_eq(jiffies, e->expires)) {
+			omap_dma_desc_release(e->lch, e->num_lch);
+			dma_desc_pool_lch -= e->num_lch;
+			released += e->num_lch;
+			e->num_lch = 0;
+			dma_desc_stats.pool_released++;
+		} else {
+			left++;
+		}
+	}
+	mutex_unlock(&dma_desc_pool_mutex);
+
+	if (left)
+		schedule_delayed_work(&dma_desc_pool_work,
+				      OMAP_DMA_DESC_POOL_TIMEOUT);
+
+	return released;
+}
+
+/* omap_request_dma() ran out of channels: give back the parked ones */
+static int omap_dma_desc_pool_release(void)
+{
+	return omap_dma_desc_pool_flush(true);
+}
+
+static void omap_dma_desc_pool_expire(struct work_struct *work)
+{
+	omap_dma_desc_pool_flush(false);
+}
+
+static void omap_dma_desc_irq(int lch, u16 ch_status, void *data);
+
+static bool omap_dma_desc_pool_get(struct omap_dma_desc_list *list,
+				   const char *dev_name)
+{
+	int i, j;
+
+	mutex_lock(&dma_desc_pool_mutex);
+	for (i = 0; i < OMAP_DMA_DESC_POOL_SIZE; i++) {
+		struct omap_dma_desc_pool_entry *e = &dma_desc_pool[i];
+
+		if (e->num_lch != list->num_lch || e->dev_id != list->dev_id ||
+		    !omap_dma_desc_params_equal(&e->params, &list->params))
+			continue;
+
+		for (j = 0; j < e->num_lch; j++) {
+			list->lch[j] = e->lch[j];
+			dma_chan[e->lch[j]].dev_name = dev_name;
+			omap_set_dma_callback(e->lch[j], omap_dma_desc_irq,
+					      list);
+		}
+		dma_desc_pool_lch -= e->num_lch;
+		e->num_lch = 0;
+		mutex_unlock(&dma_desc_pool_mutex);
+		return true;
+	}
+	mutex_unlock(&dma_desc_pool_mutex);
+
+	return false;
+}
+
+static void omap_dma_desc_pool_put(struct omap_dma_desc_list *list)
+{
+	struct omap_dma_desc_pool_entry *e;
+	int i;
+
+	for (i = 0; i < list->num_lch; i++)
+		omap_set_dma_callback(list->lch[i], NULL, NULL);
+
+	mutex_lock(&dma_desc_pool_mutex);
+	for (;;) {
+		struct omap_dma_desc_pool_entry *old = NULL;
+
+		e = NULL;
+		for (i = 0; i < OMAP_DMA_DESC_POOL_SIZE; i++) {
+			struct omap_dma_desc_pool_entry *c = &dma_desc_pool[i];
+
+			if (!c->num_lch) {
+				if (!e)
+					e = c;
+			} else if (!old || time_before(c->expires,
+						       old->expires)) {
+				old = c;
+			}
+		}
+		if (!old || (e && dma_desc_pool_lch + list->num_lch <=
+				  OMAP_DMA_DESC_POOL_MAX_LCH))
+			break;
+
+		/* pool full, the oldest set makes room */
+		omap_dma_desc_release(old->lch, old->num_lch);
+		dma_desc_pool_lch -= old->num_lch;
+		old->num_lch = 0;
+		dma_desc_stats.pool_released++;
+	}
+	dma_desc_pool_lch += list->num_lch;
+	e->dev_id = list->dev_id;
+	e->num_lch = list->num_lch;
+	memcpy(e->lch, list->lch, sizeof(e->lch));
+	e->params = list->params;
+	e->expires = jiffies + OMAP_DMA_DESC_POOL_TIMEOUT;
+	mutex_unlock(&dma_desc_pool_mutex);
+
+	schedule_delayed_work(&dma_desc_pool_work, OMAP_DMA_DESC_POOL_TIMEOUT);
+}
+
+static int omap_dma_desc_request(struct omap_dma_desc_list *list,
+				 const char *dev_name)
+{
+	int i, ret;
+
+	for (i = 0; i < list->num_lch; i++) {
+		int lch;
+
+		ret = omap_request_dma(list->dev_id, dev_name,
+				       omap_dma_desc_irq, list, &lch);
+		if (ret) {
+			omap_dma_desc_release(list->lch, i);
+			return ret;
+		}
+		omap_set_dma_params(lch, &list->params);
+		omap_set_dma_src_burst_mode(lch, list->params.burst_mode);
+		omap_set_dma_dest_burst_mode(lch, list->params.burst_mode);
+		list->lch[i] = lch;
+	}
+
+	return 0;
+}
+
+/*
+ * Loads the next batch of transfers, one per channel, each channel linked
+ * to the next one. Only the last transfer of the batch interrupts, or each
+ * period of a cyclic list. Called with dma_desc_lock held.
+ */
+static void omap_dma_desc_load(struct omap_dma_desc_list *list)
+{
+	bool cyclic = list->flags & OMAP_DMA_DESC_CYCLIC;
+	int i, n = min(list->num_desc - list->next, list->num_lch);
+	ktime_t start = ktime_get();
+
+	for (i = 0; i < n; i++) {
+		struct omap_dma_desc *desc = &list->desc[list->next + i];
+		int lch = list->lch[i];
+		u32 l;
+
+		/* the channel may hold an address of another transfer */
+		dma_write(desc->src ? desc->src : list->params.src_start,
+			  CSSA(lch));
+		dma_write(desc->dst ? desc->dst : list->params.dst_start,
+			  CDSA(lch));
+		dma_write(desc->elem_count, CEN(lch));
+		dma_write(desc->frame_count, CFN(lch));
+		dma_write(0, CDAC(lch));
+
+		/* as for chained transfers */
+		l = dma_read(CCR(lch));
+		if (!(l & (1 << 24)))
+			l &= ~(1 << 25);
+		else
+			l |= (1 << 25);
+		dma_write(l, CCR(lch));
+
+		if (cyclic || i == n - 1)
+			dma_chan[lch].enabled_irqs |= OMAP_DMA_BLOCK_IRQ;
+		else
+			dma_chan[lch].enabled_irqs &= ~OMAP_DMA_BLOCK_IRQ;
+		omap2_enable_channel_irq(lch);
+
+		l = dma_read(CLNK_CTRL(lch));
+		l &= ~(0x1f | (1 << 15));
+		if (i < n - 1)
+			l |= list->lch[i + 1] | (1 << 15);
+		else if (cyclic)
+			l |= list->lch[0] | (1 << 15);
+		dma_write(l, CLNK_CTRL(lch));
+
+		dma_chan[lch].flags |= OMAP_DMA_ACTIVE;
+	}
+
+	list->next += n;
+	list->batch = n;
+	dma_desc_stats.load_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/* Called with dma_desc_lock held */
+static void omap_dma_desc_halt(struct omap_dma_desc_list *list)
+{
+	u32 sys_cf;
+	int i;
+
+	if (p->errata & DMA_SYSCONFIG_ERRATA)
+		dma_ocpsysconfig_errata(&sys_cf, false);
+
+	/* unlink first so that a stopped channel starts nothing */
+	for (i = 0; i < list->num_lch; i++)
+		omap2_disable_lnk(list->lch[i]);
+	for (i = 0; i < list->num_lch; i++)
+		omap_stop_dma(list->lch[i]);
+
+	if (p->errata & DMA_SYSCONFIG_ERRATA)
+		dma_ocpsysconfig_errata(&sys_cf, true);
+
+	list->active = 0;
+}
+
+static void omap_dma_desc_irq(int lch, u16 ch_status, void *data)
+{
+	struct omap_dma_desc_list *list = data;
+	void (*callback)(struct omap_dma_desc_list *list, int index,
+			 int status, void *data);
+	unsigned long flags;
+	int i, index, status = 0;
+
+	spin_lock_irqsave(&dma_desc_lock, flags);
+	if (!list->active) {
+		spin_unlock_irqrestore(&dma_desc_lock, flags);
+		return;
+	}
+
+	for (i = 0; i < list->num_lch; i++)
+		if (list->lch[i] == lch)
+			break;
+
+	callback = list->callback;
+	if (ch_status & OMAP_DMA_DESC_ERR_IRQ) {
+		index = list->next - list->batch + i;
+		status = -EIO;
+		dma_desc_stats.errors++;
+		omap_dma_desc_halt(list);
+	} else if (!(ch_status & OMAP_DMA_BLOCK_IRQ)) {
+		/* a dropped event, already reported */
+		spin_unlock_irqrestore(&dma_desc_lock, flags);
+		return;
+	} else if (list->flags & OMAP_DMA_DESC_CYCLIC) {
+		index = i;
+		dma_desc_stats.periods++;
+	} else if (list->next < list->num_desc) {
+		/* the batch is done and all its channels idle */
+		dma_desc_stats.reloads++;
+		omap_dma_desc_load(list);
+		omap_start_dma(list->lch[0]);
+		spin_unlock_irqrestore(&dma_desc_lock, flags);
+		return;
+	} else {
+		index = list->num_desc - 1;
+		list->active = 0;
+	}
+	spin_unlock_irqrestore(&dma_desc_lock, flags);
+
+	if (callback)
+		callback(list, index, status, list->data);
+}
+
+struct omap_dma_desc_list *omap_dma_desc_list_alloc(int dev_id,
+		const char *dev_name, struct omap_dma_channel_params *params,
+		int num_lch, int max_desc)
+{
+	struct omap_dma_desc_list *list;
+	unsigned long flags;
+	ktime_t start;
+	bool pooled;
+	int ret;
+
+	if (num_lch < 1 || num_lch > OMAP_DMA_DESC_MAX_LCH || max_desc < 1)
+		return ERR_PTR(-EINVAL);
+
+	/* omap_start_dma() rewrites the link of the first channel */
+	if (p->errata & DMA_CHAINING_ERRATA)
+		num_lch = 1;
+
+	list = kzalloc(sizeof(*list), GFP_KERNEL);
+	if (!list)
+		return ERR_PTR(-ENOMEM);
+	list->desc = kcalloc(max_desc, sizeof(*list->desc), GFP_KERNEL);
+	if (!list->desc) {
+		kfree(list);
+		return ERR_PTR(-ENOMEM);
+	}
+	list->params = *params;
+	list->max_desc = max_desc;
+	list->num_lch = num_lch;
+	list->dev_id = dev_id;
+
+	start = ktime_get();
+	pooled = omap_dma_desc_pool_get(list, dev_name);
+	if (!pooled) {
+		/* omap_request_dma() takes the parked channels if needed */
+		ret = omap_dma_desc_request(list, dev_name);
+		if (ret) {
+			kfree(list->desc);
+			kfree(list);
+			return ERR_PTR(ret);
+		}
+	}
+
+	spin_lock_irqsave(&dma_desc_lock, flags);
+	dma_desc_stats.allocs++;
+	if (pooled) {
+		dma_desc_stats.pool_hits++;
+		dma_desc_stats.reuse_ns +=
+			ktime_to_ns(ktime_sub(ktime_get(), start));
+	} else {
+		dma_desc_stats.setup_ns +=
+			ktime_to_ns(ktime_sub(ktime_get(), start));
+	}
+	spin_unlock_irqrestore(&dma_desc_lock, flags);
+
+	return list;
+}
+EXPORT_SYMBOL(omap_dma_desc_list_alloc);
+
+void omap_dma_desc_list_free(struct omap_dma_desc_list *list)
+{
+	omap_dma_desc_list_stop(list);
+	omap_dma_desc_pool_put(list);
+	kfree(list->desc);
+	kfree(list);
+}
+EXPORT_SYMBOL(omap_dma_desc_list_free);
+
+int omap_dma_desc_list_add(struct omap_dma_desc_list *list,
+		dma_addr_t src, dma_addr_t dst, int elem_count,
+		int frame_count)
+{
+	struct omap_dma_desc *desc;
+
+	if (list->active)
+		return -EBUSY;
+	/* CEN is 24 bits, CFN 16 bits */
+	if (elem_count < 1 || elem_count > 0xffffff ||
+	    frame_count < 1 || frame_count > 0xffff)
+		return -EINVAL;
+	if (list->num_desc >= list->max_desc)
+		return -ENOSPC;
+	/* the ring is closed in hardware */
+	if ((list->flags & OMAP_DMA_DESC_CYCLIC) &&
+	    list->num_desc >= list->num_lch)
+		return -ENOSPC;
+
+	desc = &list->desc[list->num_desc++];
+	desc->src = src;
+	desc->dst = dst;
+	desc->elem_count = elem_count;
+	desc->frame_count = frame_count;
+
+	return 0;
+}
+EXPORT_SYMBOL(omap_dma_desc_list_add);
+
+/* Number of params.elem_count frames in len bytes */
+static int omap_dma_desc_frames(struct omap_dma_desc_list *list, size_t len)
+{
+	size_t frame = list->params.elem_count << list->params.data_type;
+
+	if (!frame || !len || len % frame)
+		return -EINVAL;
+
+	return len / frame;
+}
+
+int omap_dma_desc_list_prep_sg(struct omap_dma_desc_list *list,
+		struct scatterlist *sg, int nents, dma_addr_t dev_addr)
+{
+	bool dev_src = list->params.src_or_dst_synch == OMAP_DMA_SRC_SYNC;
+	struct scatterlist *s;
+	int i, ret = -EINVAL;
+
+	if (list->active)
+		return -EBUSY;
+
+	list->num_desc = 0;
+	list->flags &= ~OMAP_DMA_DESC_CYCLIC;
+
+	for_each_sg(sg, s, nents, i) {
+		ret = omap_dma_desc_frames(list, sg_dma_len(s));
+		if (ret < 0)
+			break;
+		ret = omap_dma_desc_list_add(list,
+				dev_src ? dev_addr : sg_dma_address(s),
+				dev_src ? sg_dma_address(s) : dev_addr,
+				list->params.elem_count, ret);
+		if (ret)
+			break;
+	}
+	if (ret)
+		list->num_desc = 0;
+
+	return ret;
+}
+EXPORT_SYMBOL(omap_dma_desc_list_prep_sg);
+
+int omap_dma_desc_list_prep_cyclic(struct omap_dma_desc_list *list,
+		dma_addr_t buf, size_t buf_len, size_t period_len,
+		dma_addr_t dev_addr)
+{
+	bool dev_src = list->params.src_or_dst_synch == OMAP_DMA_SRC_SYNC;
+	int i, frames, periods, ret = 0;
+
+	if (list->active)
+		return -EBUSY;
+	/* omap_start_dma() would drop the self link of a single channel */
+	if (p->errata & DMA_CHAINING_ERRATA)
+		return -EINVAL;
+	if (!period_len || buf_len % period_len)
+		return -EINVAL;
+	periods = buf_len / period_len;
+	if (periods > list->num_lch)
+		return -EINVAL;
+	frames = omap_dma_desc_frames(list, period_len);
+	if (frames < 0)
+		return frames;
+
+	list->num_desc = 0;
+	list->flags |= OMAP_DMA_DESC_CYCLIC;
+
+	for (i = 0; i < periods && !ret; i++) {
+		dma_addr_t addr = buf + i * period_len;
+
+		ret = omap_dma_desc_list_add(list,
+				dev_src ? dev_addr : addr,
+				dev_src ? addr : dev_addr,
+				list->params.elem_count, frames);
+	}
+	if (ret)
+		list->num_desc = 0;
+
+	return ret;
+}
+EXPORT_SYMBOL(omap_dma_desc_list_prep_cyclic);
+
+int omap_dma_desc_list_submit(struct omap_dma_desc_list *list,
+		void (*callback)(struct omap_dma_desc_list *list, int index,
+				 int status, void *data),
+		void *data)
+{
+	unsigned long flags;
+
+	if (!list->num_desc)
+		return -EINVAL;
+
+	spin_lock_irqsave(&dma_desc_lock, flags);
+	if (list->active) {
+		spin_unlock_irqrestore(&dma_desc_lock, flags);
+		return -EBUSY;
+	}
+	list->callback = callback;
+	list->data = data;
+	list->next = 0;
+	list->active = 1;
+	dma_desc_stats.submits++;
+	dma_desc_stats.descs += list->num_desc;
+
+	omap_dma_desc_load(list);
+	omap_start_dma(list->lch[0]);
+	spin_unlock_irqrestore(&dma_desc_lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(omap_dma_desc_list_submit);
+
+void omap_dma_desc_list_stop(struct omap_dma_desc_list *list)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dma_desc_lock, flags);
+	if (list->active)
+		omap_dma_desc_halt(list);
+	spin_unlock_irqrestore(&dma_desc_lock, flags);
+}
+EXPORT_SYMBOL(omap_dma_desc_list_stop);
+
 static int omap2_dma_handle_ch(int ch)
 {
 	u32 status = dma_read(CSR(ch));
@@ -1350,6 +1909,7 @@ static int __init omap2_system_dma_init_dev(struct omap_hwmod *oh, void *user)
 	p->set_dma_chain_ch	= set_dma_chain_ch;
 	p->dma_context_save	= omap2_dma_context_save;
 	p->dma_context_restore	= omap2_dma_context_restore;
+	p->release_parked_lch	= omap_dma_desc_pool_release;
 	p->clear_lch_regs	= NULL;
 	p->get_gdma_dev		= NULL;
 	p->set_gdma_dev		= NULL;
@@ -1436,3 +1996,243 @@ static int __init omap2_system_dma_init(void)
 	return ret;
 }
 arch_initcall(omap2_system_dma_init);
+
+#ifdef CONFIG_DEBUG_FS
+static u64 omap_dma_desc_avg(u64 total, u32 count)
+{
+	if (count)
+		do_div(total, count);
+	return total;
+}
+
+static int omap_dma_desc_stats_show(struct seq_file *s, void *unused)
+{
+	unsigned long flags;
+	typeof(dma_desc_stats) st;
+
+	spin_lock_irqsave(&dma_desc_lock, flags);
+	st = dma_desc_stats;
+	spin_unlock_irqrestore(&dma_desc_lock, flags);
+
+	seq_printf(s, "lists allocated:    %u\n", st.allocs);
+	seq_printf(s, "  from pool:        %u\n", st.pool_hits);
+	seq_printf(s, "pool sets released: %u\n", st.pool_released);
+	seq_printf(s, "submits:            %u\n", st.submits);
+	seq_printf(s, "transfers:          %u\n", st.descs);
+	seq_printf(s, "batch reloads:      %u\n", st.reloads);
+	seq_printf(s, "cyclic periods:     %u\n", st.periods);
+	seq_printf(s, "errors:             %u\n", st.errors);
+	seq_printf(s, "channel setup (ns): %llu\n",
+		   omap_dma_desc_avg(st.setup_ns, st.allocs - st.pool_hits));
+	seq_printf(s, "pool reuse (ns):    %llu\n",
+		   omap_dma_desc_avg(st.reuse_ns, st.pool_hits));
+	seq_printf(s, "batch load (ns):    %llu\n",
+		   omap_dma_desc_avg(st.load_ns, st.submits + st.reloads));
+
+	return 0;
+}
+
+static int omap_dma_desc_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, omap_dma_desc_stats_show, NULL);
+}
+
+static const struct file_operations omap_dma_desc_stats_fops = {
+	.open		= omap_dma_desc_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * memcpy benchmark: the same copies with one channel requested and
+ * programmed per transfer, then with a descriptor list.
+ */
+#define OMAP_DMA_BENCH_XFERS	16
+#define OMAP_DMA_BENCH_SIZE	4096
+
+static void omap_dma_bench_lch_cb(int lch, u16 ch_status, void *data)
+{
+	if (ch_status & (OMAP_DMA_BLOCK_IRQ | OMAP_DMA_DESC_ERR_IRQ))
+		complete(data);
+}
+
+static void omap_dma_bench_list_cb(struct omap_dma_desc_list *list,
+				   int index, int status, void *data)
+{
+	complete(data);
+}
+
+static int omap_dma_bench_xfer(struct omap_dma_channel_params *params,
+			       dma_addr_t src, dma_addr_t dst,
+			       struct completion *done, s64 *setup)
+{
+	ktime_t start = ktime_get();
+	int lch, ret;
+
+	ret = omap_request_dma(0, "dma bench", omap_dma_bench_lch_cb, done,
+			       &lch);
+	if (ret)
+		return ret;
+	params->src_start = src;
+	params->dst_start = dst;
+	omap_set_dma_params(lch, params);
+	omap_start_dma(lch);
+	*setup += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (!wait_for_completion_timeout(done, HZ)) {
+		omap_stop_dma(lch);
+		ret = -ETIMEDOUT;
+	}
+	omap_free_dma(lch);
+	INIT_COMPLETION(*done);
+
+	return ret;
+}
+
+static int omap_dma_bench_list(struct omap_dma_desc_list *list,
+			       dma_addr_t src, dma_addr_t dst,
+			       struct completion *done, bool prepare,
+			       s64 *setup)
+{
+	ktime_t start = ktime_get();
+	int i, ret = 0;
+
+	for (i = 0; prepare && i < OMAP_DMA_BENCH_XFERS && !ret; i++)
+		ret = omap_dma_desc_list_add(list,
+				src + i * OMAP_DMA_BENCH_SIZE,
+				dst + i * OMAP_DMA_BENCH_SIZE,
+				OMAP_DMA_BENCH_SIZE / 4, 1);
+	if (!ret)
+		ret = omap_dma_desc_list_submit(list, omap_dma_bench_list_cb,
+						done);
+	*setup = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (ret)
+		return ret;
+
+	if (!wait_for_completion_timeout(done, HZ)) {
+		omap_dma_desc_list_stop(list);
+		ret = -ETIMEDOUT;
+	}
+	INIT_COMPLETION(*done);
+
+	return ret;
+}
+
+static int omap_dma_bench_show(struct seq_file *s, void *unused)
+{
+	struct omap_dma_channel_params params = {
+		.data_type	= OMAP_DMA_DATA_TYPE_S32,
+		.elem_count	= OMAP_DMA_BENCH_SIZE / 4,
+		.frame_count	= 1,
+		.src_amode	= OMAP_DMA_AMODE_POST_INC,
+		.dst_amode	= OMAP_DMA_AMODE_POST_INC,
+		.sync_mode	= OMAP_DMA_SYNC_ELEMENT,
+	};
+	const size_t len = OMAP_DMA_BENCH_XFERS * OMAP_DMA_BENCH_SIZE;
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct omap_dma_desc_list *list;
+	dma_addr_t src, dst;
+	u8 *src_buf, *dst_buf;
+	ktime_t start;
+	s64 setup, alloc;
+	int i, ret;
+
+	src_buf = dma_alloc_coherent(NULL, 2 * len, &src, GFP_KERNEL);
+	if (!src_buf)
+		return -ENOMEM;
+	dst_buf = src_buf + len;
+	dst = src + len;
+	for (i = 0; i < len; i++)
+		src_buf[i] = i ^ (i >> 8);
+
+	seq_printf(s, "memcpy %d x %d bytes\n", OMAP_DMA_BENCH_XFERS,
+		   OMAP_DMA_BENCH_SIZE);
+	seq_printf(s, "%-24s %14s %10s  data\n", "", "setup(ns/xfer)",
+		   "total(us)");
+
+	memset(dst_buf, 0, len);
+	setup = 0;
+	start = ktime_get();
+	for (i = 0, ret = 0; i < OMAP_DMA_BENCH_XFERS && !ret; i++)
+		ret = omap_dma_bench_xfer(&params,
+				src + i * OMAP_DMA_BENCH_SIZE,
+				dst + i * OMAP_DMA_BENCH_SIZE, &done, &setup);
+	if (ret)
+		goto out;
+	seq_printf(s, "%-24s %14lld %10lld  %s\n", "channel per transfer",
+		   div_s64(setup, OMAP_DMA_BENCH_XFERS),
+		   ktime_us_delta(ktime_get(), start),
+		   memcmp(src_buf, dst_buf, len) ? "BAD" : "ok");
+
+	start = ktime_get();
+	list = omap_dma_desc_list_alloc(0, "dma bench", &params,
+					OMAP_DMA_DESC_MAX_LCH,
+					OMAP_DMA_BENCH_XFERS);
+	alloc = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (IS_ERR(list)) {
+		ret = PTR_ERR(list);
+		goto out;
+	}
+
+	for (i = 0; i < 2 && !ret; i++) {
+		memset(dst_buf, 0, len);
+		start = ktime_get();
+		ret = omap_dma_bench_list(list, src, dst, &done, !i, &setup);
+		if (ret)
+			break;
+		seq_printf(s, "%-24s %14lld %10lld  %s\n",
+			   i ? "desc list, resubmitted" : "desc list, prepared",
+			   div_s64(setup, OMAP_DMA_BENCH_XFERS),
+			   ktime_us_delta(ktime_get(), start),
+			   memcmp(src_buf, dst_buf, len) ? "BAD" : "ok");
+	}
+	omap_dma_desc_list_free(list);
+	seq_printf(s, "list alloc: %lld ns", alloc);
+
+	if (!ret) {
+		start = ktime_get();
+		list = omap_dma_desc_list_alloc(0, "dma bench", &params,
+						OMAP_DMA_DESC_MAX_LCH,
+						OMAP_DMA_BENCH_XFERS);
+		alloc = ktime_to_ns(ktime_sub(ktime_get(), start));
+		if (!IS_ERR(list)) {
+			omap_dma_desc_list_free(list);
+			seq_printf(s, ", again: %lld ns", alloc);
+		}
+	}
+	seq_printf(s, "\n");
+
+out:
+	if (ret)
+		seq_printf(s, "failed: %d\n", ret);
+	dma_free_coherent(NULL, 2 * len, src_buf, src);
+
+	return 0;
+}
+
+static int omap_dma_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, omap_dma_bench_show, NULL);
+}
+
+static const struct file_operations omap_dma_bench_fops = {
+	.open		= omap_dma_bench_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init omap_dma_desc_debugfs_init(void)
+{
+	if (!dma_chan)
+		return 0;
+
+	debugfs_create_file("omap_dma_desc", S_IRUGO, NULL, NULL,
+			    &omap_dma_desc_stats_fops);
+	debugfs_create_file("omap_dma_bench", S_IRUSR, NULL, NULL,
+			    &omap_dma_bench_fops);
+	return 0;
+}
+late_initcall(omap_dma_desc_debugfs_init);
+#endif
@@ -29,6 +29,7 @@
 
 #include <plat/cpu.h>
 #include <plat/clock.h>
+#include <plat/voltage.h>
 #include <asm/clkdev.h>
 
 #include "clock.h"
@@ -337,6 +338,9 @@ int omap3_noncore_dpll_program(struct clk *clk, u16 m, u8 n, u16 freqsel)
 
 	/* REVISIT: Set ramp-up delay? */
 
+	/* A voltage increase may still be ramping: it ran while in bypass */
+	omap_voltage_wait_ramp();
+
 	_omap3_noncore_dpll_lock(clk);
 
 	return 0;
@@ -17,6 +17,7 @@
 #include <mach/board-fc6100.h>
 #include <../drivers/parrot/usb/otg/dummy-smsc-usb43340.h>
 #include <../drivers/parrot/input/touchscreen/atmel_mxt_ts.h>
+#include <../drivers/parrot/parrot_async.h>
 
 #ifdef CONFIG_SERIAL_OMAP
 #include <plat/omap-serial.h>
@@ -443,6 +444,48 @@ static struct omap_musb_board_data musb_board_data = {
 	//.extvbus 		= 1,
 };
 
+/*
+ * The USB resets and registrations are async boot steps, overlapping the
+ * rest of the boot. They use __init code and data, which is fine:
+ * init_post() waits for the async threads before freeing it.
+ */
+static int __init fc6100_mod_usb0_start(void *unused)
+{
+	//Reset
+	if (gpio_is_valid(fc6100_usb_otg_data.gpio_reset)) {
+		msleep(20);
+		gpio_set_value(fc6100_usb_otg_data.gpio_reset, 1);
+	}
+
+	//Overcurrent and Pin id for USB 0
+	if (fc6100_mod_get_pcb_revision() >= FC6100_0_HW06)
+		fc6100_usb_otg_data.gpio_overcurrent = USB_0_OC_N;
+
+	if(fc6100_mod_get_pcb_revision() >= FC6100_0_HW03) {
+
+		/* PROTO HW03 and following */
+		if (0 && 
+				!parrot_force_usb_device)
+			/* force host mode : pin id to 0 */
+			parrot_gpio_out_init(USB_0_ID, 1);
+		else
+			/* keep the pin id value */
+			parrot_gpio_out_init(USB_0_ID, 0);
+	}
+
+	usb_musb_init(&musb_board_data);
+
+	return 0;
+}
+
+/* After the USB hub, if the board has one, so that it enumerates once */
+static int __init fc6100_mod_usb1_start(void *unused)
+{
+	usb_ehci_init(&ehci_pdata);
+
+	return 0;
+}
+
 static int __init fc6100_mod_usb_init(int config_mask)
 {
 
@@ -469,31 +512,12 @@ static int __init fc6100_mod_usb_init(int config_mask)
 		omap_mux_init_signal("hsusb0_data6.hsusb0_data6", OMAP_PIN_INPUT);
 		omap_mux_init_signal("hsusb0_data7.hsusb0_data7", OMAP_PIN_INPUT);
 
-		//Reset
-		if (gpio_is_valid(fc6100_usb_otg_data.gpio_reset)){
-
+		//Reset, released by fc6100_mod_usb0_start()
+		if (gpio_is_valid(fc6100_usb_otg_data.gpio_reset))
 			parrot_gpio_out_init(fc6100_usb_otg_data.gpio_reset, 0);
-			mdelay(20);
-			gpio_set_value(fc6100_usb_otg_data.gpio_reset, 1);
-		}
-
-		//Overcurrent and Pin id for USB 0
-		if (fc6100_mod_get_pcb_revision() >= FC6100_0_HW06)
-			fc6100_usb_otg_data.gpio_overcurrent = USB_0_OC_N;
 
-		if(fc6100_mod_get_pcb_revision() >= FC6100_0_HW03) {
-
-			/* PROTO HW03 and following */
-			if (0 && 
-					!parrot_force_usb_device)
-				/* force host mode : pin id to 0 */
-				parrot_gpio_out_init(USB_0_ID, 1);
-			else
-				/* keep the pin id value */
-				parrot_gpio_out_init(USB_0_ID, 0);
-		}
-
-		usb_musb_init(&musb_board_data);
+		parrot_async_run(PARROT_ASYNC_USB_PHY, 0,
+				 fc6100_mod_usb0_start, NULL);
 	}
 
 	// USB1
@@ -516,7 +540,9 @@ static int __init fc6100_mod_usb_init(int config_mask)
 		parrot_gpio_out_init(USB_1_ID, 1);
 	}
 
-	usb_ehci_init(&ehci_pdata);
+	parrot_async_run(PARROT_ASYNC_USB_HOST,
+			 PARROT_ASYNC(PARROT_ASYNC_USB_HUB),
+			 fc6100_mod_usb1_start, NULL);
 
 	return 0;
 }
@@ -539,6 +565,13 @@ struct omap2_mcspi_device_config fc6100_mcspi_config = {
 	.single_channel		= 1,  /* 0: slave, 1: master */
 };
 
+/* for drivers only using spi_sync() (KSZ8851SNL, MAX3100) */
+struct omap2_mcspi_device_config fc6100_mcspi_sync_config = {
+	.turbo_mode		= 0,
+	.single_channel		= 1,
+	.inline_sync		= 1,
+};
+
 static struct omap2_mcspi_platform_config fc6100_mcspi3_platform_data = {
 	.num_cs = 2,
 	.mode = OMAP2_MCSPI_MASTER,
@@ -288,6 +288,7 @@
 extern int board_rev;
 extern unsigned int board_config;
 extern struct omap2_mcspi_device_config fc6100_mcspi_config;
+extern struct omap2_mcspi_device_config fc6100_mcspi_sync_config;
 extern struct omap2_hsmmc_info mmc1_settings;
 extern struct omap2_hsmmc_info mmc2_settings;
 extern struct platform_device fc6100_gpio;
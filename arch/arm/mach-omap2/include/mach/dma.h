@@ -354,6 +354,135 @@ int omap_dma_sglist_is_paused(int lch);
  */
 void omap_dma_set_sglist_fastmode(int lch, int fastmode);
 
+/* Descriptor lists */
+#define OMAP_DMA_DESC_MAX_LCH		8
+
+/* omap_dma_desc_list flags */
+#define OMAP_DMA_DESC_CYCLIC		BIT(0)
+
+struct scatterlist;
+
+/* One transfer of a list, the rest comes from the list channel params */
+struct omap_dma_desc {
+	dma_addr_t src;
+	dma_addr_t dst;
+	int elem_count;
+	int frame_count;
+};
+
+struct omap_dma_desc_list {
+	struct omap_dma_channel_params params;	/* common to all transfers */
+	struct omap_dma_desc *desc;
+	int num_desc;
+	int max_desc;
+	unsigned int flags;
+
+	/*
+	 * Called from the DMA interrupt once the whole list is done, or after
+	 * each period of a cyclic list. index is the last completed transfer,
+	 * status 0 or -EIO.
+	 */
+	void (*callback)(struct omap_dma_desc_list *list, int index,
+			 int status, void *data);
+	void *data;
+
+	/* private */
+	int dev_id;
+	int lch[OMAP_DMA_DESC_MAX_LCH];
+	int num_lch;
+	int next;		/* first transfer not loaded yet */
+	int batch;		/* transfers loaded in the channels */
+	int active;
+};
+
+/**
+ * omap_dma_desc_list_alloc()	Prepare channels for a list of transfers
+ * @dev_id:	DMA request line, 0 for memory to memory
+ * @dev_name:	Name of the user
+ * @params:	Channel parameters common to all the transfers
+ * @num_lch:	Logical channels linked in hardware, 1 to
+ *		OMAP_DMA_DESC_MAX_LCH. A cyclic list has at most that many
+ *		periods, a longer list runs in batches of num_lch transfers
+ * @max_desc:	Maximum number of transfers in the list
+ *
+ * Channels are taken already programmed from the pool of lists freed
+ * earlier with the same @dev_id and @params when possible, so they must
+ * only be configured through @params. May sleep.
+ * Returns the list or an ERR_PTR().
+ */
+extern struct omap_dma_desc_list *omap_dma_desc_list_alloc(int dev_id,
+		const char *dev_name, struct omap_dma_channel_params *params,
+		int num_lch, int max_desc);
+
+/**
+ * omap_dma_desc_list_free()	Stop a list and release it
+ * @list:	The list
+ *
+ * Its channels go back to the pool, programmed. May sleep.
+ */
+extern void omap_dma_desc_list_free(struct omap_dma_desc_list *list);
+
+/**
+ * omap_dma_desc_list_add()	Append a transfer to a list
+ * @list:	An idle list
+ * @src:	Source address, params.src_start if 0
+ * @dst:	Destination address, params.dst_start if 0
+ * @elem_count:	Elements per frame
+ * @frame_count: Frames
+ */
+extern int omap_dma_desc_list_add(struct omap_dma_desc_list *list,
+		dma_addr_t src, dma_addr_t dst, int elem_count,
+		int frame_count);
+
+/**
+ * omap_dma_desc_list_prep_sg()	Fill a list from a mapped scatterlist
+ * @list:	An idle list, emptied first
+ * @sg:	The scatterlist, mapped with dma_map_sg()
+ * @nents:	Number of entries returned by dma_map_sg()
+ * @dev_addr:	Device FIFO address
+ *
+ * Frames are params.elem_count elements of params.data_type, each entry
+ * must hold whole frames. The device is the source if params are
+ * OMAP_DMA_SRC_SYNC.
+ */
+extern int omap_dma_desc_list_prep_sg(struct omap_dma_desc_list *list,
+		struct scatterlist *sg, int nents, dma_addr_t dev_addr);
+
+/**
+ * omap_dma_desc_list_prep_cyclic()	Fill a list with a ring of periods
+ * @list:	An idle list, emptied first
+ * @buf:	Ring buffer DMA address
+ * @buf_len:	Ring buffer length in bytes
+ * @period_len:	Period length in bytes, whole frames
+ * @dev_addr:	Device FIFO address
+ *
+ * The list loops until stopped, the callback is run for each period.
+ * Not available on parts with the channel chaining erratum (2420, 2430
+ * ES1.0).
+ */
+extern int omap_dma_desc_list_prep_cyclic(struct omap_dma_desc_list *list,
+		dma_addr_t buf, size_t buf_len, size_t period_len,
+		dma_addr_t dev_addr);
+
+/**
+ * omap_dma_desc_list_submit()	Start a prepared list
+ * @list:	An idle, non empty list
+ * @callback:	Completion callback, can be NULL
+ * @data:	Callback data
+ *
+ * A list can be submitted again once completed, without preparing it.
+ */
+extern int omap_dma_desc_list_submit(struct omap_dma_desc_list *list,
+		void (*callback)(struct omap_dma_desc_list *list, int index,
+				 int status, void *data),
+		void *data);
+
+/**
+ * omap_dma_desc_list_stop()	Abort a list, the callback is not run
+ * @list:	The list
+ */
+extern void omap_dma_desc_list_stop(struct omap_dma_desc_list *list);
+
 /* Chaining APIs */
 extern int omap_request_dma_chain(int dev_id, const char *dev_name,
 				  void (*callback) (int lch, u16 ch_status,
@@ -32,6 +32,7 @@
 #define INTC_MIR_CLEAR0		0x0088
 #define INTC_MIR_SET0		0x008c
 #define INTC_PENDING_IRQ0	0x0098
+#define INTC_ILR0		0x0100
 /* Number of IRQ state bits in each MIR register */
 #define IRQ_BITS_PER_REG	32
 
@@ -228,9 +229,30 @@ void __init omap_init_irq(void)
 }
 
 #ifdef CONFIG_ARCH_OMAP3
-void omap_intc_save_context(void)
+/*
+ * The ILRs hold most of the context but only change through
+ * intc_bank_write_ilr(), they are saved again only after that.
+ */
+static bool intc_ilr_dirty = true;
+
+static void intc_bank_write_ilr(u32 val, struct omap_irq_bank *bank, int irq)
+{
+	intc_bank_write_reg(val, bank, INTC_ILR0 + 0x4 * irq);
+	intc_ilr_dirty = true;
+}
+
+/**
+ * omap_intc_save_context - save the INTC context for CORE off
+ *
+ * The ILRs are only read if they were written since the last save, the
+ * mask registers always are. Returns 1 for a full save, 0 otherwise.
+ */
+int omap_intc_save_context(void)
 {
 	int ind = 0, i = 0;
+	bool ilr = intc_ilr_dirty;
+
+	intc_ilr_dirty = false;
 	for (ind = 0; ind < ARRAY_SIZE(irq_banks); ind++) {
 		struct omap_irq_bank *bank = irq_banks + ind;
 		intc_context[ind].sysconfig =
@@ -241,14 +263,16 @@ void omap_intc_save_context(void)
 			intc_bank_read_reg(bank, INTC_IDLE);
 		intc_context[ind].threshold =
 			intc_bank_read_reg(bank, INTC_THRESHOLD);
-		for (i = 0; i < INTCPS_NR_IRQS; i++)
+		for (i = 0; ilr && i < INTCPS_NR_IRQS; i++)
 			intc_context[ind].ilr[i] =
-				intc_bank_read_reg(bank, (0x100 + 0x4*i));
+				intc_bank_read_reg(bank, INTC_ILR0 + 0x4 * i);
 		for (i = 0; i < INTCPS_NR_MIR_REGS; i++)
 			intc_context[ind].mir[i] =
 				intc_bank_read_reg(&irq_banks[0], INTC_MIR0 +
 				(0x20 * i));
 	}
+
+	return ilr;
 }
 
 void omap_intc_restore_context(void)
@@ -268,12 +292,13 @@ void omap_intc_restore_context(void)
 		intc_bank_write_reg(intc_context[ind].threshold,
 					bank, INTC_THRESHOLD);
 		for (i = 0; i < INTCPS_NR_IRQS; i++)
-			intc_bank_write_reg(intc_context[ind].ilr[i],
-				bank, (0x100 + 0x4*i));
+			intc_bank_write_ilr(intc_context[ind].ilr[i], bank, i);
 		for (i = 0; i < INTCPS_NR_MIR_REGS; i++)
 			intc_bank_write_reg(intc_context[ind].mir[i],
 				 &irq_banks[0], INTC_MIR0 + (0x20 * i));
 	}
+	/* the ILRs are back to what was saved */
+	intc_ilr_dirty = false;
 	/* MIRs are saved and restore with other PRCM registers */
 }
 
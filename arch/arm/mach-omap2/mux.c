@@ -64,6 +64,9 @@ static void omap_mux_write(struct omap_mux_partition *partition, u16 val,
 		__raw_writeb(val, partition->base + reg);
 	else
 		__raw_writew(val, partition->base + reg);
+
+	/* SYS_NIRQ is also saved with the control module context */
+	omap3_control_mark_dirty(OMAP3_CTX_PADCONF | OMAP3_CTX_CONTROL);
 }
 
 static void omap_mux_write_array(struct omap_mux_partition *partition,
@@ -13,6 +13,7 @@
 #include <linux/interrupt.h>
 #include <linux/regulator/machine.h>
 #include <linux/regulator/fixed.h>
+#include <linux/regulator/tps65023.h>
 #include <linux/mmc/host.h>
 
 #include <linux/switch.h>
@@ -368,12 +369,29 @@ static struct omap_volt_vc_data vc_config = {
  */
 static unsigned long omap_tps65023_vsel_to_uv(const u8 vsel)
 {
-	return ((vsel * 2500) + 800000);
+	if (vsel >= TPS65023_VDCDC1_MAX_VSEL)
+		return TPS65023_VDCDC1_MAX_UV;
+	return (vsel * TPS65023_VDCDC1_STEP_UV) + TPS65023_VDCDC1_MIN_UV;
 }
 
 static u8 omap_tps65023_uv_to_vsel(unsigned long uV)
 {
-	return DIV_ROUND_UP(uV - 800000, 2500);
+	unsigned long vsel;
+
+	if (uV <= TPS65023_VDCDC1_MIN_UV)
+		return 0;
+	vsel = DIV_ROUND_UP(uV - TPS65023_VDCDC1_MIN_UV,
+			    TPS65023_VDCDC1_STEP_UV);
+	/* the last step is 1.55 V -> 1.6 V */
+	if (vsel >= TPS65023_VDCDC1_MAX_VSEL)
+		return TPS65023_VDCDC1_MAX_VSEL;
+	return vsel;
+}
+
+/* The TPS65023 is on I2C1, not on the SR I2C: the VC can't reach it */
+static int omap_tps65023_set_vsel(u8 vsel)
+{
+	return tps65023_dcdc1_set_vsel(vsel);
 }
 
 #define omap_tps65023_onforce_cmd 	not_used_on_omap3
@@ -393,11 +411,12 @@ static u8 not_used_on_omap3(const u8 vsel)
 static struct omap_volt_pmic_info omap_pmic_mpu = { /* and iva */
 	.name = "mpu_info",
 	.slew_rate = 14400, /* maximum 14.4mV/us */
-	.step_size = 2500, /* 25 mV */ 
+	.step_size = 25000, /* 25 mV */
 	.i2c_addr = 0x48,
 	.i2c_vreg = 0x6, /* (vdd0) VDCDC1 -> VDD1_CORE -> VDD_MPU */
 	.vsel_to_uv = omap_tps65023_vsel_to_uv,
 	.uv_to_vsel = omap_tps65023_uv_to_vsel,
+	.set_vsel = omap_tps65023_set_vsel,
 	.onforce_cmd = omap_tps65023_onforce_cmd,
 	.on_cmd = omap_tps65023_on_cmd,
 	.sleepforce_cmd = omap_tps65023_sleepforce_cmd,
@@ -414,7 +433,7 @@ static struct omap_volt_pmic_info omap_pmic_mpu = { /* and iva */
 static struct omap_volt_pmic_info omap_pmic_core = { 
 	.name = "core_info",
 	.slew_rate = 14400, /* maximum 14.4mV/us */
-	.step_size = 2500, /* 25 mV */ 
+	.step_size = 25000, /* 25 mV */
 	.i2c_addr = 0x48,
 	.i2c_vreg = 0x6, /* (vdd1) VDD2 -> VDD2_CORE -> VDD_CORE */
 	.vsel_to_uv = omap_tps65023_vsel_to_uv,
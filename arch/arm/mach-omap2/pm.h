@@ -13,6 +13,7 @@
 
 #include <plat/powerdomain.h>
 #include <linux/init.h>
+#include <linux/ktime.h>
 
 #ifdef CONFIG_PM_DEBUG
 extern u32 enable_off_mode;
@@ -28,6 +29,13 @@ extern void *omap3_secure_ram_storage;
 extern void omap3_pm_off_mode_enable(int);
 extern void omap4_pm_off_mode_enable(int);
 extern void omap_sram_idle(void);
+
+/* Time of the WFI entry and return in the last omap_sram_idle() */
+struct omap_sram_idle_stamp {
+	ktime_t wfi_enter;
+	ktime_t wfi_exit;
+};
+extern struct omap_sram_idle_stamp omap_sram_idle_stamp;
 extern int omap3_can_sleep(void);
 extern int set_pwrdm_state(struct powerdomain *pwrdm, u32 state);
 #ifdef CONFIG_PM
@@ -29,6 +29,10 @@
 #include <linux/clk.h>
 #include <linux/delay.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <plat/sram.h>
 #include <plat/clockdomain.h>
@@ -42,6 +46,7 @@
 #include <plat/usb.h>
 #include <plat/smartreflex.h>
 #include <plat/voltage.h>
+#include <plat/vrfb.h>
 
 #include <asm/tlbflush.h>
 
@@ -117,44 +122,135 @@ static void omap3_disable_io_chain(void)
 				       PM_WKEN);
 }
 
-static void omap3_core_save_context(void)
+/*
+ * Cost of the CORE off-mode context handling, per part. A part is
+ * "skipped" when it did not change since the last save (for the INTC,
+ * when only the mask registers were read).
+ */
+enum {
+	OMAP3_CTX_COST_PADCONF,
+	OMAP3_CTX_COST_INTC,
+	OMAP3_CTX_COST_GPMC,
+	OMAP3_CTX_COST_CONTROL,
+	OMAP3_CTX_COST_SECURE,
+	OMAP3_CTX_COST_RESTORE,
+	OMAP3_CTX_COST_MAX,
+};
+
+struct omap3_ctx_cost {
+	const char *name;
+	u32 saved;
+	u32 skipped;
+	u32 max_ns;
+	u64 total_ns;
+};
+
+static struct omap3_ctx_cost omap3_ctx_cost[OMAP3_CTX_COST_MAX] = {
+	[OMAP3_CTX_COST_PADCONF]	= { .name = "padconf" },
+	[OMAP3_CTX_COST_INTC]		= { .name = "intc" },
+	[OMAP3_CTX_COST_GPMC]		= { .name = "gpmc" },
+	[OMAP3_CTX_COST_CONTROL]	= { .name = "control" },
+	[OMAP3_CTX_COST_SECURE]		= { .name = "secure_ram" },
+	[OMAP3_CTX_COST_RESTORE]	= { .name = "restore" },
+};
+
+/*
+ * The timekeeping is suspended on the system suspend path, the costs are
+ * only measured from idle.
+ */
+static inline ktime_t omap3_ctx_time(void)
 {
-	u32 control_padconf_off;
+	return timekeeping_suspended ? ktime_set(0, 0) : ktime_get();
+}
 
-	/* Save the padconf registers */
-	control_padconf_off = omap_ctrl_readl(OMAP343X_CONTROL_PADCONF_OFF);
-	control_padconf_off |= START_PADCONF_SAVE;
-	omap_ctrl_writel(control_padconf_off, OMAP343X_CONTROL_PADCONF_OFF);
-	/* wait for the save to complete */
-	while (!(omap_ctrl_readl(OMAP343X_CONTROL_GENERAL_PURPOSE_STATUS)
-			& PADCONF_SAVE_DONE))
-		udelay(1);
+/* Accounts the time since @start to @part, returns the current time */
+static ktime_t omap3_ctx_account(int part, ktime_t start, bool saved)
+{
+	struct omap3_ctx_cost *cost = &omap3_ctx_cost[part];
+	ktime_t now = omap3_ctx_time();
+	u32 ns;
 
-	/*
-	 * Force write last pad into memory, as this can fail in some
-	 * cases according to erratas 1.157, 1.185
-	 */
-	omap_ctrl_writel(omap_ctrl_readl(OMAP343X_PADCONF_ETK_D14),
-		OMAP343X_CONTROL_MEM_WKUP + 0x2a0);
+	if (saved)
+		cost->saved++;
+	else
+		cost->skipped++;
 
-	/*
-	 * override the value saved in scratchpad memory, errata i583
-	 */
-	if (omap_rev() <= OMAP3630_REV_ES1_1)
-		omap_ctrl_writew(0x1f, OMAP343X_CONTROL_MEM_WKUP +
-			OMAP3_CONTROL_PADCONF_SDRC_CKE1_OFFSET);
+	if (timekeeping_suspended)
+		return now;
+
+	ns = ktime_to_ns(ktime_sub(now, start));
+	cost->total_ns += ns;
+	cost->max_ns = max(cost->max_ns, ns);
+
+	return now;
+}
+
+/*
+ * Only the parts written since the previous CORE off are saved again,
+ * the copies of the others (scratchpad, intc_context, control_context)
+ * are still valid: nothing else writes them.
+ */
+static void omap3_core_save_context(void)
+{
+	u32 control_padconf_off, dirty;
+	ktime_t t = omap3_ctx_time();
+	int full;
+
+	dirty = omap3_control_ctx_test_and_clear(OMAP3_CTX_PADCONF |
+						 OMAP3_CTX_CONTROL);
+
+	if (dirty & OMAP3_CTX_PADCONF) {
+		/* Save the padconf registers */
+		control_padconf_off =
+			omap_ctrl_readl(OMAP343X_CONTROL_PADCONF_OFF);
+		control_padconf_off |= START_PADCONF_SAVE;
+		omap_ctrl_writel(control_padconf_off,
+				 OMAP343X_CONTROL_PADCONF_OFF);
+		/* wait for the save to complete */
+		while (!(omap_ctrl_readl(OMAP343X_CONTROL_GENERAL_PURPOSE_STATUS)
+				& PADCONF_SAVE_DONE))
+			udelay(1);
+
+		/*
+		 * Force write last pad into memory, as this can fail in some
+		 * cases according to erratas 1.157, 1.185
+		 */
+		omap_ctrl_writel(omap_ctrl_readl(OMAP343X_PADCONF_ETK_D14),
+			OMAP343X_CONTROL_MEM_WKUP + 0x2a0);
+
+		/*
+		 * override the value saved in scratchpad memory, errata i583
+		 */
+		if (omap_rev() <= OMAP3630_REV_ES1_1)
+			omap_ctrl_writew(0x1f, OMAP343X_CONTROL_MEM_WKUP +
+				OMAP3_CONTROL_PADCONF_SDRC_CKE1_OFFSET);
+	}
+	t = omap3_ctx_account(OMAP3_CTX_COST_PADCONF, t,
+			      dirty & OMAP3_CTX_PADCONF);
 
 	/* Save the Interrupt controller context */
-	omap_intc_save_context();
+	full = omap_intc_save_context();
+	t = omap3_ctx_account(OMAP3_CTX_COST_INTC, t, full);
+
 	/* Save the GPMC context */
 	omap3_gpmc_save_context();
+	t = omap3_ctx_account(OMAP3_CTX_COST_GPMC, t, true);
+
 	/* Save the system control module context, padconf already save above*/
-	omap3_control_save_context();
+	if (dirty & OMAP3_CTX_CONTROL)
+		omap3_control_save_context();
+	omap3_ctx_account(OMAP3_CTX_COST_CONTROL, t,
+			  dirty & OMAP3_CTX_CONTROL);
 }
 
 static void omap3_core_restore_context(void)
 {
+	ktime_t t = omap3_ctx_time();
+
 	if (omap_rev() <= OMAP3630_REV_ES1_1) {
+		/* The sequence ends with CKE1 as it was saved */
+		u32 dirty = omap3_control_ctx_test_and_clear(OMAP3_CTX_PADCONF);
+
 		/*
 		 * errata i583 workaround, safe transition sequence for CKE1:
 		 */
@@ -164,6 +260,9 @@ static void omap3_core_restore_context(void)
 			OMAP3_CONTROL_PADCONF_SDRC_CKE1_OFFSET);
 		omap_ctrl_writew(0x18, OMAP2_CONTROL_PADCONFS +
 			OMAP3_CONTROL_PADCONF_SDRC_CKE1_OFFSET);
+
+		omap3_control_ctx_test_and_clear(OMAP3_CTX_PADCONF);
+		omap3_control_mark_dirty(dirty);
 	}
 	/* Restore the control module context, padconf restored by h/w */
 	omap3_control_restore_context();
@@ -171,8 +270,50 @@ static void omap3_core_restore_context(void)
 	omap3_gpmc_restore_context();
 	/* Restore the interrupt controller context */
 	omap_intc_restore_context();
+
+	omap3_ctx_account(OMAP3_CTX_COST_RESTORE, t, true);
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int omap3_ctx_cost_show(struct seq_file *s, void *unused)
+{
+	int i;
+
+	seq_printf(s, "part        saved  skipped   avg(us)   max(us)\n");
+	for (i = 0; i < OMAP3_CTX_COST_MAX; i++) {
+		struct omap3_ctx_cost cost = omap3_ctx_cost[i];
+		u32 n = cost.saved + cost.skipped;
+		u64 avg = n ? div_u64(cost.total_ns, n) : 0;
+
+		seq_printf(s, "%-10s %6u %8u %9llu %9u\n", cost.name,
+			   cost.saved, cost.skipped, div_u64(avg, NSEC_PER_USEC),
+			   cost.max_ns / NSEC_PER_USEC);
+	}
+
+	return 0;
+}
+
+static int omap3_ctx_cost_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, omap3_ctx_cost_show, NULL);
+}
+
+static const struct file_operations omap3_ctx_cost_fops = {
+	.open		= omap3_ctx_cost_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void __init omap3_ctx_cost_debugfs_init(void)
+{
+	debugfs_create_file("core_off_context", S_IRUGO, NULL, NULL,
+			    &omap3_ctx_cost_fops);
+}
+#else
+static inline void omap3_ctx_cost_debugfs_init(void) {}
+#endif
+
 /**
  * omap3_secure_copy_data_set() - set up the secure ram copy size
  * @data - platform specific customization
@@ -194,15 +335,16 @@ int __init omap3_secure_copy_data_set(struct omap3_secure_copy_data *data)
 }
 
 /*
- * FIXME: This function should be called before entering off-mode after
- * OMAP3 secure services have been accessed. Currently it is only called
- * once during boot sequence, but this works as we are not using secure
- * services.
+ * Saved before every CORE off. Skipping the unchanged saves would need
+ * each secure service call to flag the secure RAM dirty, and the ROM and
+ * PPA services are entered from the sleep code and the bootloader, not
+ * through a common kernel entry point.
  */
 static void omap3_save_secure_ram_context(u32 target_mpu_state)
 {
 	u32 ret;
 	struct clockdomain *clkd = mpu_pwrdm->pwrdm_clkdms[0];
+	ktime_t t = omap3_ctx_time();
 
 	if (omap_type() != OMAP2_DEVICE_TYPE_GP) {
 		/*
@@ -223,6 +365,7 @@ static void omap3_save_secure_ram_context(u32 target_mpu_state)
 			while (1)
 				;
 		}
+		omap3_ctx_account(OMAP3_CTX_COST_SECURE, t, true);
 	}
 }
 
@@ -387,6 +530,8 @@ void restore_table_entry(void)
 	restore_control_register(control_reg_value);
 }
 
+struct omap_sram_idle_stamp omap_sram_idle_stamp;
+
 void omap_sram_idle(void)
 {
 	/* Variable to tell what needs to be saved and restored
@@ -561,8 +706,13 @@ void omap_sram_idle(void)
 	 * get saved. The restore path then reads from this
 	 * location and restores them back.
 	 */
+	/* for cpuidle, not from suspend where the timekeeping is stopped */
+	if (!timekeeping_suspended)
+		omap_sram_idle_stamp.wfi_enter = ktime_get();
 	_omap_sram_idle(omap3_arm_context, save_state);
 	cpu_init();
+	if (!timekeeping_suspended)
+		omap_sram_idle_stamp.wfi_exit = ktime_get();
 
 	/* Restore normal SDRC POWER settings */
 	if (omap_rev() >= OMAP3430_REV_ES3_0 &&
@@ -582,7 +732,7 @@ void omap_sram_idle(void)
 			omap3_cm_restore_context();
 			omap3_sram_restore_context();
 			omap2_sms_restore_context();
-
+			omap_vrfb_restore_context();
 		}
 		omap_uart_resume_idle(0);
 		omap_uart_resume_idle(1);
@@ -1272,6 +1422,7 @@ static int __init omap3_pm_init(void)
 
 	pm_idle = omap3_pm_idle;
 	omap3_idle_init();
+	omap3_ctx_cost_debugfs_init();
 
 	clkdm_add_wkdep(neon_clkdm, mpu_clkdm);
 
@@ -206,6 +206,7 @@ void omap_sram_idle_hib(void)
 			omap3_cm_restore_context();
 			omap3_sram_restore_context();
 			omap2_sms_restore_context();
+			omap_vrfb_restore_context();
 
 			if (omap_rev() < OMAP3630_REV_ES1_2)
 				/* Restore MUSB context */
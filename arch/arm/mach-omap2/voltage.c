@@ -31,6 +31,7 @@
 #include <linux/spinlock.h>
 #include <linux/plist.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
 
 #include <plat/omap-pm.h>
 #include <plat/omap34xx.h>
@@ -475,6 +476,13 @@ static struct omap_vdd_dep_info omap44xx_vddiva_dep_info[] = {
 /* By default VPFORCEUPDATE is the chosen method of voltage scaling */
 static bool voltscale_vpforceupdate = true;
 
+/*
+ * End of the last ramp started through pmic->set_vsel. The wait is left
+ * to omap_voltage_wait_ramp(), so that it overlaps the DPLL relock.
+ */
+static DEFINE_SPINLOCK(pmic_ramp_lock);
+static ktime_t pmic_ramp_done;
+
 static inline u32 voltage_read_reg(u8 offset)
 {
 	return prm_read_mod_reg(volt_mod, offset);
@@ -2235,6 +2243,77 @@ bool omap_vp_clear_transdone(struct voltagedomain *voltdm)
 	return true;
 }
 
+/*
+ * pmic_scale_voltage - direct PMIC method of voltage scaling
+ *
+ * Only the I2C command is sent here. When the voltage goes up, the end of
+ * the ramp is recorded and omap_voltage_wait_ramp() must be called before
+ * the new rate is used.
+ */
+static int pmic_scale_voltage(struct omap_vdd_info *vdd,
+		struct omap_volt_data *target_volt)
+{
+	u32 smps_steps = 0, smps_delay = 0;
+	u8 target_vsel = 0, current_vsel = 0;
+	unsigned long flags;
+	ktime_t done;
+	int ret;
+
+	if (IS_ERR_OR_NULL(target_volt)) {
+		pr_warning("%s: bad target data\n", __func__);
+		return -EINVAL;
+	}
+
+	target_vsel = vdd->pmic->uv_to_vsel(
+			omap_get_operation_voltage(target_volt));
+	/* Unknown current voltage: assume a full ramp */
+	if (vdd->curr_volt)
+		current_vsel = vdd->pmic->uv_to_vsel(
+				omap_get_operation_voltage(vdd->curr_volt));
+
+	ret = vdd->pmic->set_vsel(target_vsel);
+	if (ret)
+		return ret;
+
+	vdd->curr_volt = target_volt;
+
+	if (target_vsel <= current_vsel)
+		return 0;
+
+	smps_steps = target_vsel - current_vsel;
+	/* SMPS slew rate / step size. 2us added as buffer. */
+	smps_delay = ((smps_steps * vdd->pmic->step_size) /
+			vdd->pmic->slew_rate) + 2;
+	done = ktime_add_us(ktime_get(), smps_delay);
+
+	spin_lock_irqsave(&pmic_ramp_lock, flags);
+	if (ktime_to_ns(ktime_sub(done, pmic_ramp_done)) > 0)
+		pmic_ramp_done = done;
+	spin_unlock_irqrestore(&pmic_ramp_lock, flags);
+
+	return 0;
+}
+
+/**
+ * omap_voltage_wait_ramp - wait for the PMIC output to settle
+ *
+ * Busy-waits for whatever remains of the last voltage increase issued
+ * through pmic->set_vsel. Called by the DPLL code right before it relocks,
+ * so that the ramp runs while the DPLL is being reprogrammed.
+ */
+void omap_voltage_wait_ramp(void)
+{
+	unsigned long flags;
+	s64 left;
+
+	spin_lock_irqsave(&pmic_ramp_lock, flags);
+	left = ktime_us_delta(pmic_ramp_done, ktime_get());
+	spin_unlock_irqrestore(&pmic_ramp_lock, flags);
+
+	if (left > 0)
+		udelay(left);
+}
+
 /**
  * omap_voltage_scale_vdd : API to scale voltage of a particular voltage domain.
  * @voltdm: pointer to the VDD which is to be scaled.
@@ -2264,10 +2343,16 @@ int omap_voltage_scale_vdd(struct voltagedomain *voltdm,
 	srcu_notifier_call_chain(&vdd->volt_change_notify_list,
 		VOLTAGE_PRECHANGE, (void *)&v_info);
 
-	if (voltscale_vpforceupdate)
-		ret = vp_forceupdate_scale_voltage(vdd, target_volt);
-	else
-		ret =  vc_bypass_scale_voltage(vdd, target_volt);
+	ret = -ENODEV;
+	if (vdd->pmic->set_vsel)
+		ret = pmic_scale_voltage(vdd, target_volt);
+	/* the PMIC driver may not be probed yet */
+	if (ret == -ENODEV) {
+		if (voltscale_vpforceupdate)
+			ret = vp_forceupdate_scale_voltage(vdd, target_volt);
+		else
+			ret =  vc_bypass_scale_voltage(vdd, target_volt);
+	}
 
 	if (!ret)
 		srcu_notifier_call_chain(&vdd->volt_change_notify_list,
@@ -2587,6 +2672,9 @@ int omap_voltage_scale(struct voltagedomain *voltdm)
 		opp_set_rate(vdd->dev_list[i], freq);
 	}
 
+	/* In case no DPLL relock absorbed the ramp */
+	omap_voltage_wait_ramp();
+
 	if (!is_volt_scaled)
 		omap_voltage_scale_vdd(voltdm,
 				omap_voltage_get_voltdata(voltdm, volt));
@@ -26,6 +26,8 @@
 #include <linux/clk.h>
 #include <linux/io.h>
 #include <linux/cpu.h>
+#include <linux/ktime.h>
+#include <trace/events/power.h>
 
 #include <mach/hardware.h>
 #include <plat/clock.h>
@@ -102,6 +104,8 @@ static int omap_target(struct cpufreq_policy *policy,
 #endif
 	unsigned long freq;
 	struct device *mpu_dev = omap2_get_mpuss_device();
+	unsigned int old_freq;
+	ktime_t start;
 	int ret = 0;
 
 	if (omap_get_vdd1_lock())
@@ -151,9 +155,17 @@ static int omap_target(struct cpufreq_policy *policy,
 	}
 #endif
 
+	old_freq = omap_getspeed(policy->cpu);
+	start = ktime_get();
+
 	freq = target_freq * 1000;
 	if (opp_find_freq_ceil(mpu_dev, &freq))
 		omap_device_set_rate(mpu_dev, mpu_dev, freq);
+
+	/* voltage scaling and DPLL relock included */
+	trace_cpufreq_transition_latency(policy->cpu, old_freq,
+			omap_getspeed(policy->cpu),
+			ktime_us_delta(ktime_get(), start));
 #ifdef CONFIG_SMP
 	/*
 	 * Note that loops_per_jiffy is not updated on SMP systems in
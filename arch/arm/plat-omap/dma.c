@@ -445,6 +445,7 @@ int omap_request_dma(int dev_id, const char *dev_name,
 
 	pm_runtime_get_sync(&pd->dev);
 
+retry:
 	spin_lock_irqsave(&dma_chan_lock, flags);
 	for (ch = 0; ch < dma_chan_count; ch++) {
 		if (free_ch == -1 && dma_chan[ch].dev_id == -1) {
@@ -455,6 +456,9 @@ int omap_request_dma(int dev_id, const char *dev_name,
 	}
 	if (free_ch == -1) {
 		spin_unlock_irqrestore(&dma_chan_lock, flags);
+		/* channels kept for reuse by idle descriptor lists */
+		if (p->release_parked_lch && p->release_parked_lch() > 0)
+			goto retry;
 		pm_runtime_put(&pd->dev);
 		return -EBUSY;
 	}
@@ -23,6 +23,10 @@
 #include <linux/io.h>
 #include <linux/slab.h>
 #include <linux/pm_runtime.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <plat/omap_device.h>
 #include <plat/powerdomain.h>
@@ -280,8 +284,29 @@ struct gpio_bank {
 	bool dbck_flag;
 	bool off_mode_support;
 	u8 id;
+	/* threaded demux, see gpio_irq_hardirq() */
+	bool threaded;
+	u32 thread_isr;		/* lines to dispatch */
+	u32 thread_masked;	/* lines to enable again once dispatched */
+	ktime_t thread_stamp;	/* first bank interrupt not dispatched yet */
+#ifdef CONFIG_DEBUG_FS
+	struct gpio_irq_stat {
+		unsigned long count;
+		u32 max_latency_us;	/* bank interrupt to line handler */
+		u32 max_time_us;	/* line handler */
+		u64 total_time_ns;
+	} irq_stats[32];
+#endif
 };
 
+/*
+ * Bank ids whose interrupts are demultiplexed from a thread instead of a
+ * chained handler (OMAP2+ banks only), e.g. gpio.threaded_banks=0x3c
+ */
+static unsigned int threaded_banks;
+module_param(threaded_banks, uint, 0444);
+MODULE_PARM_DESC(threaded_banks, "Mask of GPIO banks demultiplexed in a thread");
+
 /*
  * TODO: Cleanup gpio_bank usage as it is having information
  * related to all instances of the device
@@ -1239,6 +1264,68 @@ static void omap_gpio_free(struct gpio_chip *chip, unsigned offset)
 		pm_runtime_put_sync(bank->dev);
 }
 
+static void __iomem *_get_gpio_irqbank_status(struct gpio_bank *bank)
+{
+#ifdef CONFIG_ARCH_OMAP1
+	if (bank->method == METHOD_MPUIO)
+		return bank->base + OMAP_MPUIO_GPIO_INT;
+#endif
+#ifdef CONFIG_ARCH_OMAP15XX
+	if (bank->method == METHOD_GPIO_1510)
+		return bank->base + OMAP1510_GPIO_INT_STATUS;
+#endif
+#if defined(CONFIG_ARCH_OMAP16XX)
+	if (bank->method == METHOD_GPIO_1610)
+		return bank->base + OMAP1610_GPIO_IRQSTATUS1;
+#endif
+#if defined(CONFIG_ARCH_OMAP730) || defined(CONFIG_ARCH_OMAP850)
+	if (bank->method == METHOD_GPIO_7XX)
+		return bank->base + OMAP7XX_GPIO_INT_STATUS;
+#endif
+#if defined(CONFIG_ARCH_OMAP2) || defined(CONFIG_ARCH_OMAP3)
+	if (bank->method == METHOD_GPIO_24XX)
+		return bank->base + OMAP24XX_GPIO_IRQSTATUS1;
+#endif
+#if defined(CONFIG_ARCH_OMAP4)
+	if (bank->method == METHOD_GPIO_44XX)
+		return bank->base + OMAP4_GPIO_IRQSTATUS0;
+#endif
+	return NULL;
+}
+
+/* Run the handler of one GPIO line, @stamp being the bank interrupt time */
+static inline void gpio_handle_irq(struct gpio_bank *bank,
+				   unsigned int gpio_irq, ktime_t stamp)
+{
+#ifdef CONFIG_DEBUG_FS
+	struct gpio_irq_stat *st;
+	ktime_t start, end;
+	u32 us;
+
+	st = &bank->irq_stats[gpio_irq - bank->virtual_irq_start];
+	start = ktime_get();
+	generic_handle_irq(gpio_irq);
+	end = ktime_get();
+
+	st->count++;
+	us = ktime_us_delta(start, stamp);
+	if (us > st->max_latency_us)
+		st->max_latency_us = us;
+	us = ktime_us_delta(end, start);
+	if (us > st->max_time_us)
+		st->max_time_us = us;
+	st->total_time_ns += ktime_to_ns(ktime_sub(end, start));
+#else
+	generic_handle_irq(gpio_irq);
+#endif
+}
+
+#ifdef CONFIG_DEBUG_FS
+#define gpio_irq_stamp()	ktime_get()
+#else
+#define gpio_irq_stamp()	ktime_set(0, 0)
+#endif
+
 /*
  * We need to unmask the GPIO bank interrupt as soon as possible to
  * avoid missing GPIO interrupts for other lines in the bank.
@@ -1256,36 +1343,14 @@ static void gpio_irq_handler(unsigned int irq, struct irq_desc *desc)
 	struct gpio_bank *bank;
 	u32 retrigger = 0;
 	int unmasked = 0;
+	ktime_t stamp = gpio_irq_stamp();
 
 	desc->chip->ack(irq);
 
 	bank = get_irq_data(irq);
-#ifdef CONFIG_ARCH_OMAP1
-	if (bank->method == METHOD_MPUIO)
-		isr_reg = bank->base + OMAP_MPUIO_GPIO_INT;
-#endif
-#ifdef CONFIG_ARCH_OMAP15XX
-	if (bank->method == METHOD_GPIO_1510)
-		isr_reg = bank->base + OMAP1510_GPIO_INT_STATUS;
-#endif
-#if defined(CONFIG_ARCH_OMAP16XX)
-	if (bank->method == METHOD_GPIO_1610)
-		isr_reg = bank->base + OMAP1610_GPIO_IRQSTATUS1;
-#endif
-#if defined(CONFIG_ARCH_OMAP730) || defined(CONFIG_ARCH_OMAP850)
-	if (bank->method == METHOD_GPIO_7XX)
-		isr_reg = bank->base + OMAP7XX_GPIO_INT_STATUS;
-#endif
-#if defined(CONFIG_ARCH_OMAP2) || defined(CONFIG_ARCH_OMAP3)
-	if (bank->method == METHOD_GPIO_24XX)
-		isr_reg = bank->base + OMAP24XX_GPIO_IRQSTATUS1;
-#endif
-#if defined(CONFIG_ARCH_OMAP4)
-	if (bank->method == METHOD_GPIO_44XX)
-		isr_reg = bank->base + OMAP4_GPIO_IRQSTATUS0;
-#endif
+	isr_reg = _get_gpio_irqbank_status(bank);
 	while(1) {
-		u32 isr_saved, level_mask = 0;
+		u32 isr_saved, edge_mask, level_mask = 0;
 		u32 enabled;
 
 		enabled = _get_gpio_irqbank_mask(bank);
@@ -1301,9 +1366,12 @@ static void gpio_irq_handler(unsigned int irq, struct irq_desc *desc)
 		/* clear edge sensitive interrupts before handler(s) are
 		called so that we don't miss any interrupt occurred while
 		executing them */
-		_enable_gpio_irqbank(bank, isr_saved & ~level_mask, 0);
-		_clear_gpio_irqbank(bank, isr_saved & ~level_mask);
-		_enable_gpio_irqbank(bank, isr_saved & ~level_mask, 1);
+		edge_mask = isr_saved & ~level_mask;
+		if (edge_mask) {
+			_enable_gpio_irqbank(bank, edge_mask, 0);
+			_clear_gpio_irqbank(bank, edge_mask);
+			_enable_gpio_irqbank(bank, edge_mask, 1);
+		}
 
 		/* if there is only edge sensitive GPIO pin interrupts
 		configured, we could unmask GPIO bank interrupt immediately */
@@ -1336,7 +1404,7 @@ static void gpio_irq_handler(unsigned int irq, struct irq_desc *desc)
 				_toggle_gpio_edge_triggering(bank, gpio_index);
 #endif
 
-			generic_handle_irq(gpio_irq);
+			gpio_handle_irq(bank, gpio_irq, stamp);
 		}
 	}
 	/* if bank has any level sensitive GPIO pin interrupt
@@ -1348,6 +1416,77 @@ static void gpio_irq_handler(unsigned int irq, struct irq_desc *desc)
 
 }
 
+/*
+ * Threaded demux: the bank interrupt only masks and acks the pending
+ * lines, one register write each, and leaves the line handlers to
+ * gpio_irq_thread(). Level sensitive lines are acked once their handler
+ * has cleared the source.
+ */
+static irqreturn_t gpio_irq_hardirq(int irq, void *dev_id)
+{
+	struct gpio_bank *bank = dev_id;
+	u32 isr;
+
+	spin_lock(&bank->lock);
+	isr = __raw_readl(_get_gpio_irqbank_status(bank)) &
+		_get_gpio_irqbank_mask(bank);
+	if (!isr) {
+		spin_unlock(&bank->lock);
+		return IRQ_NONE;
+	}
+
+	_enable_gpio_irqbank(bank, isr, 0);
+	if (isr & ~bank->level_mask)
+		_clear_gpio_irqbank(bank, isr & ~bank->level_mask);
+
+	if (!bank->thread_isr)
+		bank->thread_stamp = gpio_irq_stamp();
+	bank->thread_isr |= isr;
+	bank->thread_masked |= isr;
+	spin_unlock(&bank->lock);
+
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t gpio_irq_thread(int irq, void *dev_id)
+{
+	struct gpio_bank *bank = dev_id;
+	ktime_t stamp;
+	u32 isr, pending, level;
+
+	spin_lock_irq(&bank->lock);
+	isr = bank->thread_isr;
+	bank->thread_isr = 0;
+	stamp = bank->thread_stamp;
+	spin_unlock_irq(&bank->lock);
+
+	pending = isr;
+	while (pending) {
+		unsigned int index = __ffs(pending);
+
+		pending &= ~(1 << index);
+
+		/* line handlers expect to run with interrupts disabled */
+		local_irq_disable();
+		gpio_handle_irq(bank, bank->virtual_irq_start + index, stamp);
+		local_irq_enable();
+	}
+
+	/* lines masked by their handler in the meantime stay masked */
+	spin_lock_irq(&bank->lock);
+	level = isr & bank->level_mask;
+	if (level)
+		_clear_gpio_irqbank(bank, level);
+	if (bank->thread_masked & ~bank->thread_isr) {
+		_enable_gpio_irqbank(bank,
+				     bank->thread_masked & ~bank->thread_isr, 1);
+		bank->thread_masked &= bank->thread_isr;
+	}
+	spin_unlock_irq(&bank->lock);
+
+	return IRQ_HANDLED;
+}
+
 static void gpio_irq_shutdown(unsigned int irq)
 {
 	unsigned int gpio = irq - IH_GPIO_BASE;
@@ -1369,6 +1508,13 @@ static void gpio_mask_irq(unsigned int irq)
 	unsigned int gpio = irq - IH_GPIO_BASE;
 	struct gpio_bank *bank = get_irq_chip_data(irq);
 
+	if (bank->threaded) {
+		unsigned long flags;
+
+		spin_lock_irqsave(&bank->lock, flags);
+		bank->thread_masked &= ~(1 << get_gpio_index(gpio));
+		spin_unlock_irqrestore(&bank->lock, flags);
+	}
 	_set_gpio_irqenable(bank, gpio, 0);
 	_set_gpio_triggering(bank, get_gpio_index(gpio), IRQ_TYPE_NONE);
 }
@@ -1781,6 +1927,17 @@ static void __init omap_gpio_chip_init(struct gpio_bank *bank)
 		set_irq_handler(j, handle_simple_irq);
 		set_irq_flags(j, IRQF_VALID);
 	}
+
+	if (cpu_class_is_omap2() && (threaded_banks & (1 << bank->id))) {
+		bank->threaded = true;
+		if (!request_threaded_irq(bank->irq, gpio_irq_hardirq,
+					  gpio_irq_thread, 0,
+					  dev_name(bank->dev), bank))
+			return;
+		dev_warn(bank->dev, "no threaded interrupt, using chained\n");
+		bank->threaded = false;
+	}
+
 	set_irq_chained_handler(bank->irq, gpio_irq_handler);
 	set_irq_data(bank->irq, bank);
 }
@@ -2356,6 +2513,61 @@ static int __init omap_gpio_sysinit(void)
 
 arch_initcall(omap_gpio_sysinit);
 
+#ifdef CONFIG_DEBUG_FS
+
+static int gpio_irq_stats_show(struct seq_file *s, void *unused)
+{
+	int i, j;
+
+	seq_printf(s, "%-5s %-5s %-4s %10s %8s %8s %8s\n", "irq", "gpio",
+		   "mode", "count", "avg_us", "max_us", "lat_us");
+
+	for (i = 0; i < gpio_bank_count; i++) {
+		struct gpio_bank *bank = &gpio_bank[i];
+
+		if (bank_is_mpuio(bank))
+			continue;
+
+		for (j = 0; j < bank_width; j++) {
+			struct gpio_irq_stat *st = &bank->irq_stats[j];
+
+			if (!st->count)
+				continue;
+
+			seq_printf(s, "%-5d %-5d %-4s %10lu %8llu %8u %8u\n",
+				   bank->virtual_irq_start + j,
+				   bank->chip.base + j,
+				   bank->threaded ? "thr" : "irq", st->count,
+				   div_u64(st->total_time_ns, st->count) / 1000,
+				   st->max_time_us, st->max_latency_us);
+		}
+	}
+
+	return 0;
+}
+
+static int gpio_irq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, gpio_irq_stats_show, NULL);
+}
+
+static const struct file_operations gpio_irq_stats_fops = {
+	.open		= gpio_irq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init omap_gpio_debugfs_init(void)
+{
+	debugfs_create_file("omap_gpio_irq", S_IRUGO, NULL, NULL,
+			    &gpio_irq_stats_fops);
+	return 0;
+}
+late_initcall(omap_gpio_debugfs_init);
+
+#endif	/* CONFIG_DEBUG_FS */
+
 #ifdef CONFIG_ARCH_OMAP3
 /*
  * Following pad init code in addition to the context / restore hooks are
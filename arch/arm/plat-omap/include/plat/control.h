@@ -422,6 +422,12 @@ extern u32 omap3_arm_context[128];
 extern void omap3_control_save_context(void);
 extern void omap3_control_restore_context(void);
 
+/* Parts of the OMAP3 CORE off-mode context tracked for changes */
+#define OMAP3_CTX_PADCONF		(1 << 0)
+#define OMAP3_CTX_CONTROL		(1 << 1)
+extern void omap3_control_mark_dirty(u32 ctx);
+extern u32 omap3_control_ctx_test_and_clear(u32 ctx);
+
 #else
 #define omap_ctrl_base_get()		0
 #define omap_ctrl_readb(x)		0
@@ -369,6 +369,7 @@ struct omap_system_dma_plat_info {
 	void (*set_dma_chain_ch)(int free_ch);
 	void (*dma_context_save)(void);
 	void (*dma_context_restore)(void);
+	int (*release_parked_lch)(void);
 };
 
 extern void omap_set_dma_priority(int lch, int dst_port, int priority);
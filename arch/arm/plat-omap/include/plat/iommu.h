@@ -14,6 +14,7 @@
 #define __MACH_IOMMU_H
 
 #include <linux/list.h>
+#include <linux/rbtree.h>
 
 struct iotlb_entry {
 	u32 da;
@@ -27,6 +28,17 @@ struct iotlb_entry {
 	};
 };
 
+/* iovmm counters, shown in debugfs */
+struct iovmm_stats {
+	unsigned long	nr_pgsz[4];	/* 16MB, 1MB, 64KB and 4KB entries */
+	unsigned long	nr_map;
+	unsigned long	nr_unmap;
+	u64		map_ns;		/* total and worst map latency */
+	u64		map_ns_max;
+	u64		unmap_ns;	/* total and worst unmap latency */
+	u64		unmap_ns_max;
+};
+
 struct iommu {
 	const char	*name;
 	struct module	*owner;
@@ -44,6 +56,9 @@ struct iommu {
 	int		nr_tlb_entries;
 
 	struct list_head	mmap;
+	struct rb_root		mmap_rb; /* iovmas sorted by da_start */
+	unsigned long		*da_map; /* allocated da pages */
+	struct iovmm_stats	iovmm_stats;
 	struct mutex		mmap_lock; /* protect mmap */
 
 	struct raw_notifier_head	notifier;
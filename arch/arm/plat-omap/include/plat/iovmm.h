@@ -19,6 +19,7 @@ struct iovm_struct {
 	u32			da_end;
 	u32			flags; /* IOVMF_: see below */
 	struct list_head	list; /* linked in ascending order */
+	struct rb_node		node; /* in iommu->mmap_rb */
 	const struct sg_table	*sgt; /* keep 'page' <-> 'da' mapping */
 	void			*va; /* mpu side mapped address */
 };
@@ -42,6 +42,13 @@ struct omap2_mcspi_device_config {
 
 	/* Do we want one channel enabled at the same time? */
 	unsigned single_channel:1;
+
+	/* Run short messages in the caller's context when the bus is idle.
+	 * Only for devices whose driver submits messages from a context that
+	 * may sleep, and copes with ->complete() running before spi_async()
+	 * returns (e.g. only uses spi_sync()).
+	 */
+	unsigned inline_sync:1;
 };
 
 enum {
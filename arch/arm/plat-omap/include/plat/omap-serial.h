@@ -77,8 +77,15 @@
 
 #define OMAP_UART_DMA_CH_FREE	-1
 
-#define DEFAULT_RXDMA_TIMEOUT	(3 * HZ)	/* RX DMA timeout (jiffies) */
-#define DEFAULT_RXDMA_POLLRATE	1		/* RX DMA polling rate (us) */
+/* IIR interrupt type, and the RX timeout type missing from serial_reg.h */
+#define UART_OMAP_IIR_ID	0x3e
+#define UART_OMAP_IIR_RX_TIMEOUT 0x0c
+
+/* Bytes moved per RX DMA request, the RX trigger is one more */
+#define OMAP_UART_RX_DMA_BURST	32
+
+#define DEFAULT_RXDMA_TIMEOUT	(3 * HZ)	/* RX DMA idle release (jiffies) */
+#define DEFAULT_RXDMA_POLLRATE	1		/* Unused, RX DMA is not polled */
 #define DEFAULT_RXDMA_BUFSIZE	4096		/* RX DMA buffer size */
 #define DEFAULT_IDLE_TIMEOUT	5000		/* UART idle timeout (ms) */
 
@@ -110,8 +117,8 @@ struct omap_uart_port_info {
 	/* beyond this is the platform specific fields */
 	int                     use_dma;        /* DMA Enable / Disable */
 	int                     dma_rx_buf_size;/* DMA Rx Buffer Size */
-	int                     dma_rx_poll_rate;/* DMA RX poll rate */
-	int                     dma_rx_timeout; /* DMA RX timeout */
+	int                     dma_rx_poll_rate;/* Unused */
+	int                     dma_rx_timeout; /* DMA RX idle release */
 	unsigned int            idle_timeout;   /* Omap Uart Idle Time out */
 	u8			omap4_tx_threshold;
 	int			uart_wakeup_event;
@@ -128,6 +135,14 @@ struct omap_uart_port_info {
 	bool                    (*plat_omap_bt_active)(void);
 };
 
+struct uart_omap_dma_stats {
+	unsigned long		rx_dma_bytes;	/* received through the ring */
+	unsigned long		rx_pio_bytes;	/* read from the FIFO */
+	unsigned long		rx_pushes;	/* ring drains to the tty */
+	unsigned long		rx_timeouts;	/* RX timeout interrupts */
+	unsigned long		rx_wraps;	/* ring wraps */
+};
+
 struct uart_omap_dma {
 	u8			uart_dma_tx;
 	u8			uart_dma_rx;
@@ -147,12 +162,10 @@ struct uart_omap_dma {
 	int			rx_dma_used;
 	spinlock_t		tx_lock;
 	spinlock_t		rx_lock;
-	/* timer to poll activity on rx dma */
-	struct timer_list	rx_timer;
 	int			rx_buf_size;
-	int			rx_poll_rate;
 	int			rx_timeout;
 	u8			tx_threshold;
+	struct uart_omap_dma_stats stats;
 };
 
 struct uart_omap_port {
@@ -44,6 +44,11 @@ struct omap_volt_pmic_info {
 	unsigned char (*on_cmd)(unsigned char vsel);
 	unsigned char (*sleepforce_cmd)(unsigned char vsel);
 	unsigned char (*sleep_cmd)(unsigned char vsel);
+	/*
+	 * Optional: program the PMIC directly instead of through the VC/VP,
+	 * for PMICs not wired to the SR I2C. Must not wait for the ramp.
+	 */
+	int (*set_vsel)(unsigned char vsel);
 	unsigned char vp_config_erroroffset;
 	unsigned char vp_vstepmin_vstepmin;
 	unsigned char vp_vstepmax_vstepmax;
@@ -149,8 +154,10 @@ int omap_voltage_register_notifier(struct voltagedomain *voltdm,
 int omap_voltage_unregister_notifier(struct voltagedomain *voltdm,
 		struct notifier_block *nb);
 void set_dpll3_volt_freq(bool dpll3_restore);
+void omap_voltage_wait_ramp(void);
 #else
 static inline void omap_voltage_init_vc(struct omap_volt_vc_data *setup_vc) {}
+static inline void omap_voltage_wait_ramp(void) {}
 static inline  void omap_change_voltscale_method(int voltscale_method) {}
 static inline int omap_voltage_register_notifier(
 		struct voltagedomain *voltdm, struct notifier_block *nb)
@@ -17,6 +17,7 @@
 #include <linux/uaccess.h>
 #include <linux/platform_device.h>
 #include <linux/debugfs.h>
+#include <linux/math64.h>
 
 #include <plat/iommu.h>
 #include <plat/iovmm.h>
@@ -251,6 +252,29 @@ static ssize_t debug_read_mmap(struct file *file, char __user *userbuf,
 	return bytes;
 }
 
+static ssize_t debug_read_iovmm(struct file *file, char __user *userbuf,
+				size_t count, loff_t *ppos)
+{
+	struct iommu *obj = file->private_data;
+	struct iovmm_stats st;
+	char buf[MAXCOLUMN * 4], *p = buf;
+
+	mutex_lock(&obj->mmap_lock);
+	st = obj->iovmm_stats;
+	mutex_unlock(&obj->mmap_lock);
+
+	p += sprintf(p, "entries: 16M %lu 1M %lu 64K %lu 4K %lu\n",
+		     st.nr_pgsz[0], st.nr_pgsz[1], st.nr_pgsz[2], st.nr_pgsz[3]);
+	p += sprintf(p, "map:   %lu, avg %llu ns, max %llu ns\n", st.nr_map,
+		     st.nr_map ? div_u64(st.map_ns, st.nr_map) : 0,
+		     st.map_ns_max);
+	p += sprintf(p, "unmap: %lu, avg %llu ns, max %llu ns\n", st.nr_unmap,
+		     st.nr_unmap ? div_u64(st.unmap_ns, st.nr_unmap) : 0,
+		     st.unmap_ns_max);
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+}
+
 static ssize_t debug_read_mem(struct file *file, char __user *userbuf,
 			      size_t count, loff_t *ppos)
 {
@@ -342,6 +366,7 @@ DEBUG_FOPS_RO(regs);
 DEBUG_FOPS_RO(tlb);
 DEBUG_FOPS(pagetable);
 DEBUG_FOPS_RO(mmap);
+DEBUG_FOPS_RO(iovmm);
 DEBUG_FOPS(mem);
 
 #define __DEBUG_ADD_FILE(attr, mode)					\
@@ -380,6 +405,7 @@ static int iommu_debug_register(struct device *dev, void *data)
 	DEBUG_ADD_FILE_RO(tlb);
 	DEBUG_ADD_FILE(pagetable);
 	DEBUG_ADD_FILE_RO(mmap);
+	DEBUG_ADD_FILE_RO(iovmm);
 	DEBUG_ADD_FILE(mem);
 
 	return 0;
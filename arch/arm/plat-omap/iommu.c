@@ -14,6 +14,7 @@
 #include <linux/err.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/interrupt.h>
 #include <linux/ioport.h>
 #include <linux/platform_device.h>
@@ -993,6 +994,7 @@ static int __devinit omap_iommu_probe(struct platform_device *pdev)
 	mutex_init(&obj->mmap_lock);
 	spin_lock_init(&obj->page_table_lock);
 	INIT_LIST_HEAD(&obj->mmap);
+	obj->mmap_rb = RB_ROOT;
 
 	spin_lock_init(&obj->event_lock);
 	INIT_LIST_HEAD(&obj->event_list);
@@ -1038,6 +1040,7 @@ static int __devexit omap_iommu_remove(struct platform_device *pdev)
 
 	iopgtable_clear_entry_all(obj);
 	free_pages((unsigned long)obj->iopgd, get_order(IOPGD_TABLE_SIZE));
+	vfree(obj->da_map);
 
 	dev_info(&pdev->dev, "%s removed\n", obj->name);
 	kfree(obj);
@@ -15,6 +15,8 @@
 #include <linux/vmalloc.h>
 #include <linux/device.h>
 #include <linux/scatterlist.h>
+#include <linux/bitmap.h>
+#include <linux/ktime.h>
 
 #include <asm/cacheflush.h>
 #include <asm/mach/map.h>
@@ -56,7 +58,17 @@
  *	's':	multiple iommu superpage(16MB, 1MB, 64KB, 4KB) size is used.
  *
  *	'*':	not yet, but feasible.
+ *
+ * Whatever the pattern, map_iovm_area() uses superpages for the parts of
+ * an area which are physically contiguous and suitably aligned.
+ */
+
+/*
+ * Device address space is tracked in a bitmap of PAGE_SIZE pages,
+ * allocated on first use.
  */
+#define IOVMM_DA_PAGES		(1UL << (32 - PAGE_SHIFT))
+
 static struct kmem_cache *iovm_area_cachep;
 /* return total bytes of sg buffers */
 static size_t sgtable_len(const struct sg_table *sgt)
@@ -217,10 +229,16 @@ static inline void vunmap_sg(const void *va)
 
 static struct iovm_struct *__find_iovm_area(struct iommu *obj, const u32 da)
 {
-	struct iovm_struct *tmp;
+	struct rb_node *n = obj->mmap_rb.rb_node;
+
+	while (n) {
+		struct iovm_struct *tmp = rb_entry(n, struct iovm_struct, node);
 
-	list_for_each_entry(tmp, &obj->mmap, list) {
-		if ((da >= tmp->da_start) && (da < tmp->da_end)) {
+		if (da < tmp->da_start) {
+			n = n->rb_left;
+		} else if (da >= tmp->da_end) {
+			n = n->rb_right;
+		} else {
 			size_t len;
 
 			len = tmp->da_end - tmp->da_start;
@@ -256,72 +274,96 @@ EXPORT_SYMBOL_GPL(find_iovm_area);
 
 /*
  * This finds the hole(area) which fits the requested address and len
- * in iovmas mmap, and returns the new allocated iovma.
+ * in the da bitmap, and returns the new allocated iovma.
  */
 static struct iovm_struct *alloc_iovm_area(struct iommu *obj, u32 da,
 					   size_t bytes, u32 flags)
 {
 	struct iovm_struct *new, *tmp;
-	u32 start, prev_end, alignement;
+	struct rb_node **p, *parent;
+	unsigned long start, nr, alignement;
 
 	if (!obj || !bytes)
 		return ERR_PTR(-EINVAL);
-	start = da;
-	alignement = PAGE_SIZE;
-	if (flags & IOVMF_DA_ANON) {
+
+	if (!obj->da_map) {
+		obj->da_map = vmalloc(BITS_TO_LONGS(IOVMM_DA_PAGES) *
+				      sizeof(unsigned long));
+		if (!obj->da_map)
+			return ERR_PTR(-ENOMEM);
+		bitmap_zero(obj->da_map, IOVMM_DA_PAGES);
 		/*
 		 * Reserve the first page for NULL
 		 */
-		start = PAGE_SIZE;
-		if (flags & IOVMF_LINEAR)
-			alignement = iopgsz_max(bytes);
-		start = roundup(start, alignement);
+		set_bit(0, obj->da_map);
 	}
-	tmp = NULL;
-	if (list_empty(&obj->mmap))
-		goto found;
-	prev_end = 0;
-	list_for_each_entry(tmp, &obj->mmap, list) {
-
-		if ((prev_end < start) && (start + bytes < tmp->da_start))
-			goto found;
 
-		if (flags & IOVMF_DA_ANON)
-			start = roundup(tmp->da_end + 1, alignement);
-
-		prev_end = tmp->da_end;
+	nr = PAGE_ALIGN(bytes) >> PAGE_SHIFT;
+	if (flags & IOVMF_DA_ANON) {
+		/*
+		 * Align the area so that superpages can be used for it:
+		 * fully for linear memory, up to 1MB for scattered pages.
+		 */
+		alignement = iopgsz_max(bytes);
+		if (!(flags & IOVMF_LINEAR))
+			alignement = min_t(unsigned long, alignement, SZ_1M);
+		start = bitmap_find_next_zero_area(obj->da_map, IOVMM_DA_PAGES,
+				0, nr, (alignement >> PAGE_SHIFT) - 1);
+		if (start + nr > IOVMM_DA_PAGES)
+			goto no_space;
+	} else {
+		if (!IS_ALIGNED(da, PAGE_SIZE))
+			return ERR_PTR(-EINVAL);
+		start = da >> PAGE_SHIFT;
+		if (start + nr > IOVMM_DA_PAGES ||
+		    find_next_bit(obj->da_map, start + nr, start) < start + nr)
+			goto no_space;
 	}
 
-	if ((start > prev_end) && (ULONG_MAX - start >= bytes))
-		goto found;
-
-	dev_dbg(obj->dev, "%s: no space to fit %08x(%x) flags: %08x\n",
-		__func__, da, bytes, flags);
-
-	return ERR_PTR(-EINVAL);
-
-found:
 	new = kmem_cache_zalloc(iovm_area_cachep, GFP_KERNEL);
 	if (!new)
 		return ERR_PTR(-ENOMEM);
 
 	new->iommu = obj;
-	new->da_start = start;
-	new->da_end = start + bytes;
+	new->da_start = start << PAGE_SHIFT;
+	new->da_end = new->da_start + bytes;
 	new->flags = flags;
 
+	bitmap_set(obj->da_map, start, nr);
+
 	/*
 	 * keep ascending order of iovmas
 	 */
-	if (tmp)
-		list_add_tail(&new->list, &tmp->list);
-	else
+	p = &obj->mmap_rb.rb_node;
+	parent = NULL;
+	while (*p) {
+		parent = *p;
+		tmp = rb_entry(parent, struct iovm_struct, node);
+		if (new->da_start < tmp->da_start)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&new->node, parent, p);
+	rb_insert_color(&new->node, &obj->mmap_rb);
+
+	parent = rb_prev(&new->node);
+	if (parent) {
+		tmp = rb_entry(parent, struct iovm_struct, node);
+		list_add(&new->list, &tmp->list);
+	} else
 		list_add(&new->list, &obj->mmap);
 
 	dev_dbg(obj->dev, "%s: found %08x-%08x-%08x(%x) %08x\n",
-		__func__, new->da_start, start, new->da_end, bytes, flags);
+		__func__, new->da_start, da, new->da_end, bytes, flags);
 
 	return new;
+
+no_space:
+	dev_dbg(obj->dev, "%s: no space to fit %08x(%x) flags: %08x\n",
+		__func__, da, bytes, flags);
+
+	return ERR_PTR(-EINVAL);
 }
 
 static void free_iovm_area(struct iommu *obj, struct iovm_struct *area)
@@ -335,6 +377,10 @@ static void free_iovm_area(struct iommu *obj, struct iovm_struct *area)
 	dev_dbg(obj->dev, "%s: %08x-%08x(%x) %08x\n",
 		__func__, area->da_start, area->da_end, bytes, area->flags);
 
+	bitmap_clear(obj->da_map, area->da_start >> PAGE_SHIFT,
+		     PAGE_ALIGN(bytes) >> PAGE_SHIFT);
+
+	rb_erase(&area->node, &obj->mmap_rb);
 	list_del(&area->list);
 	kmem_cache_free(iovm_area_cachep, area);
 }
@@ -434,87 +480,135 @@ static inline void sgtable_drain_kmalloc(struct sg_table *sgt)
 	BUG_ON(!sgt);
 }
 
+/* release the mappings of [start, start + total) */
+static void iovmm_clear_range(struct iommu *obj, u32 start, size_t total,
+			      u32 flags)
+{
+	while (total > 0) {
+		size_t bytes;
+
+		bytes = iopgtable_clear_entry(obj, start);
+		if (bytes == 0)
+			bytes = PAGE_SIZE;
+		else
+			dev_dbg(obj->dev, "%s: unmap %08x(%x) %08x\n",
+				__func__, start, bytes, flags);
+
+		BUG_ON(!IS_ALIGNED(bytes, PAGE_SIZE));
+
+		total -= bytes;
+		start += bytes;
+	}
+	BUG_ON(total);
+}
+
+/*
+ * map the physically contiguous [pa, pa + len) at *da, using the largest
+ * iommu pages both addresses are aligned on.
+ */
+static int map_iovm_run(struct iommu *obj, u32 *da, u32 pa, size_t len,
+			u32 flags)
+{
+	static const size_t pagesize[] = { SZ_16M, SZ_1M, SZ_64K, SZ_4K, };
+
+	while (len) {
+		struct iotlb_entry e;
+		size_t bytes = 0;
+		int i, err;
+
+		for (i = 0; i < ARRAY_SIZE(pagesize); i++) {
+			bytes = pagesize[i];
+			if (len >= bytes && IS_ALIGNED(*da | pa, bytes))
+				break;
+		}
+		if (i == ARRAY_SIZE(pagesize))
+			return -EINVAL;
+
+		flags &= ~IOVMF_PGSZ_MASK;
+		flags |= bytes_to_iopgsz(bytes);
+
+		pr_debug("%s: %08x %08x(%x)\n", __func__, *da, pa, bytes);
+
+		iotlb_init_entry(&e, *da, pa, flags);
+		err = iopgtable_store_entry(obj, &e);
+		if (err)
+			return err;
+
+		obj->iovmm_stats.nr_pgsz[i]++;
+
+		*da += bytes;
+		pa += bytes;
+		len -= bytes;
+	}
+	return 0;
+}
+
 /* create 'da' <-> 'pa' mapping from 'sgt' */
 static int map_iovm_area(struct iommu *obj, struct iovm_struct *new,
 			 const struct sg_table *sgt, u32 flags)
 {
 	int err = 0;
-	unsigned int i, j;
+	unsigned int i;
 	struct scatterlist *sg;
 	u32 da = new->da_start;
+	u32 run_pa = 0;
+	size_t run_len = 0;
 
 	if (!obj || !sgt)
 		return -EINVAL;
 
 	BUG_ON(!sgtable_ok(sgt));
 
+	/* merge physically contiguous sg entries into runs */
 	for_each_sg(sgt->sgl, sg, sgt->nents, i) {
 		u32 pa;
-		int pgsz;
 		size_t bytes;
-		struct iotlb_entry e;
 
 		pa = sg_phys(sg);
 		bytes = sg_dma_len(sg);
 
-		flags &= ~IOVMF_PGSZ_MASK;
-		pgsz = bytes_to_iopgsz(bytes);
-		if (pgsz < 0)
-			goto err_out;
-		flags |= pgsz;
+		if (run_len && pa == run_pa + run_len) {
+			run_len += bytes;
+			continue;
+		}
 
-		pr_debug("%s: [%d] %08x %08x(%x)\n", __func__,
-			 i, da, pa, bytes);
+		if (run_len) {
+			err = map_iovm_run(obj, &da, run_pa, run_len, flags);
+			if (err)
+				goto err_out;
+		}
+		run_pa = pa;
+		run_len = bytes;
+	}
 
-		iotlb_init_entry(&e, da, pa, flags);
-		err = iopgtable_store_entry(obj, &e);
-		if (err)
-			goto err_out;
+	err = map_iovm_run(obj, &da, run_pa, run_len, flags);
+	if (err)
+		goto err_out;
 
-		da += bytes;
-	}
 	return 0;
 
 err_out:
-	da = new->da_start;
-
-	for_each_sg(sgt->sgl, sg, i, j) {
-		size_t bytes;
-
-		bytes = iopgtable_clear_entry(obj, da);
-
-		BUG_ON(!iopgsz_ok(bytes));
-
-		da += bytes;
-	}
+	iovmm_clear_range(obj, new->da_start, da - new->da_start, flags);
 	return err;
 }
 
 /* release 'da' <-> 'pa' mapping */
 static void unmap_iovm_area(struct iommu *obj, struct iovm_struct *area)
 {
-	u32 start;
 	size_t total = area->da_end - area->da_start;
 
 	BUG_ON((!total) || !IS_ALIGNED(total, PAGE_SIZE));
 
-	start = area->da_start;
-	while (total > 0) {
-		size_t bytes;
-
-		bytes = iopgtable_clear_entry(obj, start);
-		if (bytes == 0)
-			bytes = PAGE_SIZE;
-		else
-			dev_dbg(obj->dev, "%s: unmap %08x(%x) %08x\n",
-				__func__, start, bytes, area->flags);
+	iovmm_clear_range(obj, area->da_start, total, area->flags);
+}
 
-		BUG_ON(!IS_ALIGNED(bytes, PAGE_SIZE));
+static void iovmm_account(u64 *total, u64 *max, ktime_t start)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 
-		total -= bytes;
-		start += bytes;
-	}
-	BUG_ON(total);
+	*total += ns;
+	if (ns > *max)
+		*max = ns;
 }
 
 /* template function for all unmapping */
@@ -523,6 +617,7 @@ static struct sg_table *unmap_vm_area(struct iommu *obj, const u32 da,
 {
 	struct sg_table *sgt = NULL;
 	struct iovm_struct *area;
+	ktime_t start;
 
 	if (!IS_ALIGNED(da, PAGE_SIZE)) {
 		dev_err(obj->dev, "%s: alignment err(%08x)\n", __func__, da);
@@ -544,6 +639,7 @@ static struct sg_table *unmap_vm_area(struct iommu *obj, const u32 da,
 	}
 	sgt = (struct sg_table *)area->sgt;
 
+	start = ktime_get();
 	unmap_iovm_area(obj, area);
 
 	fn(area->va);
@@ -553,6 +649,10 @@ static struct sg_table *unmap_vm_area(struct iommu *obj, const u32 da,
 		area->da_end - area->da_start, area->flags);
 
 	free_iovm_area(obj, area);
+
+	obj->iovmm_stats.nr_unmap++;
+	iovmm_account(&obj->iovmm_stats.unmap_ns,
+		      &obj->iovmm_stats.unmap_ns_max, start);
 out:
 	mutex_unlock(&obj->mmap_lock);
 
@@ -564,9 +664,11 @@ static u32 map_iommu_region(struct iommu *obj, u32 da,
 {
 	int err = -ENOMEM;
 	struct iovm_struct *new;
+	ktime_t start;
 
 	mutex_lock(&obj->mmap_lock);
 
+	start = ktime_get();
 	new = alloc_iovm_area(obj, da, bytes, flags);
 	if (IS_ERR(new)) {
 		err = PTR_ERR(new);
@@ -578,6 +680,10 @@ static u32 map_iommu_region(struct iommu *obj, u32 da,
 	if (map_iovm_area(obj, new, sgt, new->flags))
 		goto err_map;
 
+	obj->iovmm_stats.nr_map++;
+	iovmm_account(&obj->iovmm_stats.map_ns,
+		      &obj->iovmm_stats.map_ns_max, start);
+
 	mutex_unlock(&obj->mmap_lock);
 
 	dev_dbg(obj->dev, "%s: da:%08x(%x) flags:%08x va:%p\n",
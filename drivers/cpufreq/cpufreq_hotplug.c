@@ -29,6 +29,9 @@
 #include <linux/sched.h>
 #include <linux/err.h>
 #include <linux/slab.h>
+#include <linux/input.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 
 /* greater than 80% avg load across online CPUs increases frequency */
 #define DEFAULT_UP_FREQ_MIN_LOAD			(80)
@@ -48,6 +51,31 @@
 /* default number of sampling periods to average before hotplug-out decision */
 #define DEFAULT_HOTPLUG_OUT_SAMPLING_PERIODS		(20)
 
+/* shortest sampling period (uSec), used while the load is moving */
+#define DEFAULT_SAMPLING_PERIOD_MIN			(20000)
+
+/* a load change of more than 15% between samples is "moving" */
+#define DEFAULT_SAMPLING_LOAD_DELTA			(15)
+
+/* input events hold the boost frequency for 1 sec (uSec) */
+#define DEFAULT_INPUT_BOOST_DURATION			(1000000)
+
+/* frequencies accounted in the stats attribute */
+#define HOTPLUG_STATS_MAX_FREQS				(16)
+
+/* what asked for a frequency change, for the stats attribute */
+enum hotplug_cause {
+	HOTPLUG_CAUSE_LOAD,
+	HOTPLUG_CAUSE_INPUT,
+	HOTPLUG_CAUSE_BINDER,
+	HOTPLUG_CAUSE_LIMITS,
+	HOTPLUG_CAUSE_NR,
+};
+
+static const char *hotplug_cause_names[HOTPLUG_CAUSE_NR] = {
+	"load", "input", "binder", "limits",
+};
+
 static void do_dbs_timer(struct work_struct *work);
 static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		unsigned int event);
@@ -72,6 +100,9 @@ struct cpu_dbs_info_s {
 	struct cpufreq_frequency_table *freq_table;
 	int cpu;
 	unsigned int boost_applied:1;
+	/* current (adaptive) sampling period and last max load */
+	unsigned int rate;
+	unsigned int prev_load;
 	/*
 	 * percpu mutex that serializes governor limit change with
 	 * do_dbs_timer invocation. We do not want do_dbs_timer to run
@@ -103,6 +134,11 @@ static struct dbs_tuners {
 	unsigned int ignore_nice;
 	unsigned int io_is_busy;
 	unsigned int boost_timeout;
+	unsigned int sampling_rate_min;
+	unsigned int sampling_load_delta;
+	unsigned int input_boost_freq;
+	unsigned int input_boost_duration;
+	unsigned int binder_boost;
 } dbs_tuners_ins = {
 	.sampling_rate =		DEFAULT_SAMPLING_PERIOD,
 	.up_threshold =			DEFAULT_UP_FREQ_MIN_LOAD,
@@ -114,8 +150,107 @@ static struct dbs_tuners {
 	.ignore_nice =			0,
 	.io_is_busy =			0,
 	.boost_timeout = 0,
+	.sampling_rate_min =		DEFAULT_SAMPLING_PERIOD_MIN,
+	.sampling_load_delta =		DEFAULT_SAMPLING_LOAD_DELTA,
+	.input_boost_freq =		0,
+	.input_boost_duration =		DEFAULT_INPUT_BOOST_DURATION,
+	.binder_boost =			0,
 };
 
+/*
+ * Event boost: input events and, if binder_boost is set, synchronous binder
+ * transactions raise the frequency to input_boost_freq (policy max if 0)
+ * right away, from hotplug_boost_work, and keep it there for
+ * input_boost_duration.
+ */
+static struct cpu_dbs_info_s *hotplug_boost_info;
+static unsigned long hotplug_boost_until;
+static enum hotplug_cause hotplug_boost_cause;
+static void hotplug_boost_work_fn(struct work_struct *work);
+static DECLARE_WORK(hotplug_boost_work, hotplug_boost_work_fn);
+
+/* frequency residency and transitions, by cause */
+static struct hotplug_stats {
+	unsigned int nr;
+	unsigned int cur;
+	u64 last;
+	unsigned int freq[HOTPLUG_STATS_MAX_FREQS];
+	u64 time[HOTPLUG_STATS_MAX_FREQS];
+	unsigned int trans[HOTPLUG_CAUSE_NR][HOTPLUG_STATS_MAX_FREQS];
+	unsigned int boosts[HOTPLUG_CAUSE_NR];
+	unsigned int fast_samples;
+	unsigned int samples;
+} hotplug_stats;
+static DEFINE_SPINLOCK(hotplug_stats_lock);
+
+static void hotplug_stats_init(struct cpufreq_policy *policy,
+		struct cpufreq_frequency_table *table)
+{
+	unsigned int i;
+
+	spin_lock(&hotplug_stats_lock);
+	memset(&hotplug_stats, 0, sizeof(hotplug_stats));
+	for (i = 0; table && table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		if (table[i].frequency == CPUFREQ_ENTRY_INVALID)
+			continue;
+		if (hotplug_stats.nr == HOTPLUG_STATS_MAX_FREQS)
+			break;
+		if (table[i].frequency == policy->cur)
+			hotplug_stats.cur = hotplug_stats.nr;
+		hotplug_stats.freq[hotplug_stats.nr++] = table[i].frequency;
+	}
+	hotplug_stats.last = get_jiffies_64();
+	spin_unlock(&hotplug_stats_lock);
+}
+
+/* Called with hotplug_stats_lock held */
+static void hotplug_stats_account(void)
+{
+	u64 now = get_jiffies_64();
+
+	if (hotplug_stats.nr)
+		hotplug_stats.time[hotplug_stats.cur] +=
+			now - hotplug_stats.last;
+	hotplug_stats.last = now;
+}
+
+static void hotplug_stats_update(unsigned int freq, enum hotplug_cause cause)
+{
+	unsigned int i;
+
+	spin_lock(&hotplug_stats_lock);
+	for (i = 0; i < hotplug_stats.nr; i++)
+		if (hotplug_stats.freq[i] == freq)
+			break;
+	if (i < hotplug_stats.nr && i != hotplug_stats.cur) {
+		hotplug_stats_account();
+		hotplug_stats.cur = i;
+		hotplug_stats.trans[cause][i]++;
+	}
+	spin_unlock(&hotplug_stats_lock);
+}
+
+/* All governor frequency changes go through here for the stats */
+static void hotplug_set_freq(struct cpufreq_policy *policy,
+		unsigned int freq, unsigned int relation,
+		enum hotplug_cause cause)
+{
+	__cpufreq_driver_target(policy, freq, relation);
+	hotplug_stats_update(policy->cur, cause);
+}
+
+static unsigned int hotplug_boost_freq(struct cpufreq_policy *policy)
+{
+	unsigned int freq = dbs_tuners_ins.input_boost_freq;
+
+	if (!freq || freq > policy->max)
+		freq = policy->max;
+	if (freq < policy->min)
+		freq = policy->min;
+
+	return freq;
+}
+
 /*
  * A corner case exists when switching io_is_busy at run-time: comparing idle
  * times from a non-io_is_busy period to an io_is_busy period (or vice-versa)
@@ -162,6 +297,72 @@ show_one(hotplug_out_sampling_periods, hotplug_out_sampling_periods);
 show_one(ignore_nice_load, ignore_nice);
 show_one(io_is_busy, io_is_busy);
 show_one(boost_timeout, boost_timeout);
+show_one(sampling_rate_min, sampling_rate_min);
+show_one(sampling_load_delta, sampling_load_delta);
+show_one(input_boost_freq, input_boost_freq);
+show_one(input_boost_duration, input_boost_duration);
+show_one(binder_boost, binder_boost);
+
+#define store_one(file_name, object)					\
+static ssize_t store_##file_name					\
+(struct kobject *a, struct attribute *b, const char *buf, size_t count)	\
+{									\
+	unsigned int input;						\
+	int ret;							\
+	ret = sscanf(buf, "%u", &input);				\
+	if (ret != 1)							\
+		return -EINVAL;						\
+									\
+	mutex_lock(&dbs_mutex);						\
+	dbs_tuners_ins.object = input;					\
+	mutex_unlock(&dbs_mutex);					\
+									\
+	return count;							\
+}
+store_one(sampling_rate_min, sampling_rate_min);
+store_one(sampling_load_delta, sampling_load_delta);
+store_one(input_boost_freq, input_boost_freq);
+store_one(input_boost_duration, input_boost_duration);
+store_one(binder_boost, binder_boost);
+
+static ssize_t show_stats(struct kobject *kobj, struct attribute *attr,
+			  char *buf)
+{
+	struct hotplug_stats *st;
+	ssize_t len = 0;
+	unsigned int i, c;
+
+	st = kmalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return -ENOMEM;
+
+	spin_lock(&hotplug_stats_lock);
+	hotplug_stats_account();
+	*st = hotplug_stats;
+	spin_unlock(&hotplug_stats_lock);
+
+	len += sprintf(buf + len, "%10s %12s", "freq", "time_ms");
+	for (c = 0; c < HOTPLUG_CAUSE_NR; c++)
+		len += sprintf(buf + len, " %8s", hotplug_cause_names[c]);
+	len += sprintf(buf + len, "\n");
+
+	for (i = 0; i < st->nr; i++) {
+		len += sprintf(buf + len, "%10u %12u", st->freq[i],
+			       jiffies_to_msecs((unsigned long)st->time[i]));
+		for (c = 0; c < HOTPLUG_CAUSE_NR; c++)
+			len += sprintf(buf + len, " %8u", st->trans[c][i]);
+		len += sprintf(buf + len, "\n");
+	}
+
+	len += sprintf(buf + len, "boosts: input %u binder %u\n",
+		       st->boosts[HOTPLUG_CAUSE_INPUT],
+		       st->boosts[HOTPLUG_CAUSE_BINDER]);
+	len += sprintf(buf + len, "samples: %u fast %u\n",
+		       st->samples, st->fast_samples);
+
+	kfree(st);
+	return len;
+}
 
 static ssize_t store_boost_timeout(struct kobject *a, struct attribute *b,
 				   const char *buf, size_t count)
@@ -409,6 +610,12 @@ define_one_global_rw(hotplug_out_sampling_periods);
 define_one_global_rw(ignore_nice_load);
 define_one_global_rw(io_is_busy);
 define_one_global_rw(boost_timeout);
+define_one_global_rw(sampling_rate_min);
+define_one_global_rw(sampling_load_delta);
+define_one_global_rw(input_boost_freq);
+define_one_global_rw(input_boost_duration);
+define_one_global_rw(binder_boost);
+define_one_global_ro(stats);
 
 static struct attribute *dbs_attributes[] = {
 	&sampling_rate.attr,
@@ -420,6 +627,12 @@ static struct attribute *dbs_attributes[] = {
 	&ignore_nice_load.attr,
 	&io_is_busy.attr,
 	&boost_timeout.attr,
+	&sampling_rate_min.attr,
+	&sampling_load_delta.attr,
+	&input_boost_freq.attr,
+	&input_boost_duration.attr,
+	&binder_boost.attr,
+	&stats.attr,
 	NULL
 };
 
@@ -445,6 +658,9 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	unsigned int hotplug_out_avg_load = 0;
 	/* number of sampling periods averaged for hotplug decisions */
 	unsigned int periods;
+	/* lowest frequency allowed, higher while boosted */
+	unsigned int floor;
+	unsigned int rate_min;
 
 	struct cpufreq_policy *policy;
 	unsigned int i, j;
@@ -493,6 +709,30 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	/* use the max load in the OPP freq change policy */
 	max_load_freq = max_load * policy->cur;
 
+	/*
+	 * adaptive sampling: sample at sampling_rate_min while the load is
+	 * moving, then back off towards sampling_rate once it settles
+	 */
+	rate_min = min(dbs_tuners_ins.sampling_rate_min,
+			dbs_tuners_ins.sampling_rate);
+	if (abs((int)max_load - (int)this_dbs_info->prev_load) >
+			dbs_tuners_ins.sampling_load_delta)
+		this_dbs_info->rate = rate_min;
+	else
+		this_dbs_info->rate = clamp(this_dbs_info->rate * 2, rate_min,
+				dbs_tuners_ins.sampling_rate);
+	this_dbs_info->prev_load = max_load;
+
+	spin_lock(&hotplug_stats_lock);
+	hotplug_stats.samples++;
+	if (this_dbs_info->rate < dbs_tuners_ins.sampling_rate)
+		hotplug_stats.fast_samples++;
+	spin_unlock(&hotplug_stats_lock);
+
+	floor = policy->min;
+	if (time_before(jiffies, hotplug_boost_until))
+		floor = hotplug_boost_freq(policy);
+
 	/* calculate the average load across all related CPUs */
 	avg_load = total_load / num_online_cpus();
 
@@ -549,8 +789,8 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	if (max_load > dbs_tuners_ins.up_threshold) {
 		/* increase to highest frequency supported */
 		if (policy->cur < policy->max)
-			__cpufreq_driver_target(policy, policy->max,
-					CPUFREQ_RELATION_H);
+			hotplug_set_freq(policy, policy->max,
+					CPUFREQ_RELATION_H, HOTPLUG_CAUSE_LOAD);
 
 		goto out;
 	}
@@ -574,17 +814,17 @@ static void dbs_check_cpu(struct cpu_dbs_info_s *this_dbs_info)
 	 */
 	if ((max_load_freq <
 	    (dbs_tuners_ins.up_threshold - dbs_tuners_ins.down_differential) *
-	     policy->cur) && (policy->cur > policy->min)) {
+	     policy->cur) && (policy->cur > floor)) {
 		unsigned int freq_next;
 		freq_next = max_load_freq /
 				(dbs_tuners_ins.up_threshold -
 				 dbs_tuners_ins.down_differential);
 
-		if (freq_next < policy->min)
-			freq_next = policy->min;
+		if (freq_next < floor)
+			freq_next = floor;
 
-		 __cpufreq_driver_target(policy, freq_next,
-					 CPUFREQ_RELATION_L);
+		hotplug_set_freq(policy, freq_next, CPUFREQ_RELATION_L,
+				HOTPLUG_CAUSE_LOAD);
 	}
 out:
 	mutex_unlock(&dbs_mutex);
@@ -602,7 +842,7 @@ static void do_dbs_timer(struct work_struct *work)
 	if (!dbs_info->boost_applied) {
 		dbs_check_cpu(dbs_info);
 		/* We want all related CPUs to do sampling nearly on same jiffy */
-		delay = usecs_to_jiffies(dbs_tuners_ins.sampling_rate);
+		delay = usecs_to_jiffies(dbs_info->rate);
 	} else {
 		delay = usecs_to_jiffies(dbs_tuners_ins.boost_timeout);
 		dbs_info->boost_applied = 0;
@@ -613,6 +853,150 @@ static void do_dbs_timer(struct work_struct *work)
 	mutex_unlock(&dbs_info->timer_mutex);
 }
 
+static void hotplug_boost_work_fn(struct work_struct *work)
+{
+	struct cpu_dbs_info_s *dbs_info = hotplug_boost_info;
+	struct cpufreq_policy *policy;
+	unsigned int freq;
+
+	if (!dbs_info)
+		return;
+
+	spin_lock(&hotplug_stats_lock);
+	hotplug_stats.boosts[hotplug_boost_cause]++;
+	spin_unlock(&hotplug_stats_lock);
+
+	mutex_lock(&dbs_info->timer_mutex);
+	policy = dbs_info->cur_policy;
+	freq = hotplug_boost_freq(policy);
+	if (policy->cur < freq)
+		hotplug_set_freq(policy, freq, CPUFREQ_RELATION_L,
+				hotplug_boost_cause);
+	/* the load is about to move, sample it closely */
+	dbs_info->rate = min(dbs_tuners_ins.sampling_rate_min,
+			dbs_tuners_ins.sampling_rate);
+	/* if do_dbs_timer is waiting on timer_mutex it requeues itself */
+	if (cancel_delayed_work(&dbs_info->work))
+		queue_delayed_work_on(dbs_info->cpu, khotplug_wq,
+				&dbs_info->work,
+				usecs_to_jiffies(dbs_info->rate));
+	mutex_unlock(&dbs_info->timer_mutex);
+}
+
+/* May be called from atomic context */
+static void hotplug_boost_trigger(enum hotplug_cause cause)
+{
+	unsigned long until;
+	bool boosted;
+
+	if (!hotplug_boost_info || !dbs_tuners_ins.input_boost_duration)
+		return;
+
+	until = jiffies + usecs_to_jiffies(dbs_tuners_ins.input_boost_duration);
+	boosted = time_before(jiffies, hotplug_boost_until);
+	hotplug_boost_until = until;
+
+	/* an ongoing boost is just extended */
+	if (boosted)
+		return;
+
+	hotplug_boost_cause = cause;
+	queue_work(khotplug_wq, &hotplug_boost_work);
+}
+
+/**
+ * cpufreq_hotplug_boost_hint - boost for a binder transaction
+ *
+ * Called by binder for synchronous transactions of tasks at nice <= 0.
+ * That includes the system daemons, not only the foreground application,
+ * so the hint is ignored unless binder_boost is set.
+ */
+void cpufreq_hotplug_boost_hint(void)
+{
+	if (dbs_tuners_ins.binder_boost)
+		hotplug_boost_trigger(HOTPLUG_CAUSE_BINDER);
+}
+EXPORT_SYMBOL_GPL(cpufreq_hotplug_boost_hint);
+
+static void hotplug_input_event(struct input_handle *handle,
+		unsigned int type, unsigned int code, int value)
+{
+	/* touch, keys and rotary knobs; ignore key releases */
+	if ((type == EV_KEY && value) || type == EV_ABS || type == EV_REL)
+		hotplug_boost_trigger(HOTPLUG_CAUSE_INPUT);
+}
+
+static int hotplug_input_connect(struct input_handler *handler,
+		struct input_dev *dev, const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(*handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_hotplug";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister;
+
+	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return error;
+}
+
+static void hotplug_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id hotplug_input_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) },
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_X)] = BIT_MASK(ABS_X) },
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_REL) },
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+	},
+	{ },
+};
+
+static struct input_handler hotplug_input_handler = {
+	.event		= hotplug_input_event,
+	.connect	= hotplug_input_connect,
+	.disconnect	= hotplug_input_disconnect,
+	.name		= "cpufreq_hotplug",
+	.id_table	= hotplug_input_ids,
+};
+
 static inline void dbs_timer_init(struct cpu_dbs_info_s *dbs_info)
 {
 	/* We want all related CPUs to do sampling nearly on same jiffy */
@@ -674,6 +1058,8 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 		}
 		this_dbs_info->cpu = cpu;
 		this_dbs_info->freq_table = cpufreq_frequency_get_table(cpu);
+		this_dbs_info->rate = dbs_tuners_ins.sampling_rate;
+		this_dbs_info->prev_load = 0;
 		/*
 		 * Start the timerschedule work, when this governor
 		 * is used for first time
@@ -685,6 +1071,7 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 				mutex_unlock(&dbs_mutex);
 				return rc;
 			}
+			hotplug_stats_init(policy, this_dbs_info->freq_table);
 		}
 		if (!dbs_tuners_ins.boost_timeout)
 			dbs_tuners_ins.boost_timeout =  dbs_tuners_ins.sampling_rate * 30;
@@ -692,9 +1079,20 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 
 		mutex_init(&this_dbs_info->timer_mutex);
 		dbs_timer_init(this_dbs_info);
+
+		if (!hotplug_boost_info) {
+			hotplug_boost_info = this_dbs_info;
+			if (input_register_handler(&hotplug_input_handler))
+				pr_warning("cpufreq-hotplug: no input boost\n");
+		}
 		break;
 
 	case CPUFREQ_GOV_STOP:
+		if (hotplug_boost_info == this_dbs_info) {
+			input_unregister_handler(&hotplug_input_handler);
+			hotplug_boost_info = NULL;
+			cancel_work_sync(&hotplug_boost_work);
+		}
 		dbs_timer_exit(this_dbs_info);
 
 		mutex_lock(&dbs_mutex);
@@ -715,11 +1113,13 @@ static int cpufreq_governor_dbs(struct cpufreq_policy *policy,
 	case CPUFREQ_GOV_LIMITS:
 		mutex_lock(&this_dbs_info->timer_mutex);
 		if (policy->max < this_dbs_info->cur_policy->cur)
-			__cpufreq_driver_target(this_dbs_info->cur_policy,
-				policy->max, CPUFREQ_RELATION_H);
+			hotplug_set_freq(this_dbs_info->cur_policy,
+				policy->max, CPUFREQ_RELATION_H,
+				HOTPLUG_CAUSE_LIMITS);
 		else if (policy->min > this_dbs_info->cur_policy->cur)
-			__cpufreq_driver_target(this_dbs_info->cur_policy,
-				policy->min, CPUFREQ_RELATION_L);
+			hotplug_set_freq(this_dbs_info->cur_policy,
+				policy->min, CPUFREQ_RELATION_L,
+				HOTPLUG_CAUSE_LIMITS);
 		mutex_unlock(&this_dbs_info->timer_mutex);
 		break;
 	}
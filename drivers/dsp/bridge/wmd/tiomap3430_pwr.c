@@ -42,6 +42,7 @@
 #include "_tiomap_util.h"
 #include <mach-omap2/prm-regbits-34xx.h>
 #include <mach-omap2/cm-regbits-34xx.h>
+#include <plat/control.h>
 
 #ifdef CONFIG_PM
 extern s32 dsp_test_sleepstate;
@@ -381,6 +382,7 @@ int dsp_peripheral_clk_ctrl(struct wmd_dev_context *dev_context,
 			value &= ~(1 << 2);
 			__raw_writel(value,
 				resources->dw_sys_ctrl_base + 0x274);
+			omap3_control_mark_dirty(OMAP3_CTX_CONTROL);
 		} else if (bpwr_clkid[clk_id_index] == BPWR_MCBSP2) {
 			/* clear MCBSP2_CLKS, on McBSP2 OFF */
 			value = __raw_readl(
@@ -388,6 +390,7 @@ int dsp_peripheral_clk_ctrl(struct wmd_dev_context *dev_context,
 			value &= ~(1 << 6);
 			__raw_writel(value,
 				resources->dw_sys_ctrl_base + 0x274);
+			omap3_control_mark_dirty(OMAP3_CTX_CONTROL);
 		}
 		dsp_clk_wakeup_event_ctrl(bpwr_clks[clk_id_index].clk_id,
 					  false);
@@ -406,6 +409,7 @@ int dsp_peripheral_clk_ctrl(struct wmd_dev_context *dev_context,
 			value |= 1 << 2;
 			__raw_writel(value,
 				resources->dw_sys_ctrl_base + 0x274);
+			omap3_control_mark_dirty(OMAP3_CTX_CONTROL);
 		} else if (bpwr_clkid[clk_id_index] == BPWR_MCBSP2) {
 			/* set MCBSP2_CLKS, on McBSP2 ON */
 			value = __raw_readl(
@@ -413,6 +417,7 @@ int dsp_peripheral_clk_ctrl(struct wmd_dev_context *dev_context,
 			value |= 1 << 6;
 			__raw_writel(value,
 				resources->dw_sys_ctrl_base + 0x274);
+			omap3_control_mark_dirty(OMAP3_CTX_CONTROL);
 		}
 		dsp_clk_wakeup_event_ctrl(bpwr_clks[clk_id_index].clk_id, true);
 		if ((DSP_SUCCEEDED(status)) && (DSP_SUCCEEDED(status1)))
@@ -531,6 +536,7 @@ int dsp_peripheral_clocks_disable(struct wmd_dev_context *dev_context,
 				value &= ~(1 << 2);
 				__raw_writel(value, resources->dw_sys_ctrl_base
 					     + 0x274);
+				omap3_control_mark_dirty(OMAP3_CTX_CONTROL);
 			} else if (bpwr_clkid[clk_idx] == BPWR_MCBSP2) {
 				/* clear MCBSP2_CLKS, on McBSP2 OFF */
 				value = __raw_readl(resources->dw_sys_ctrl_base
@@ -538,6 +544,7 @@ int dsp_peripheral_clocks_disable(struct wmd_dev_context *dev_context,
 				value &= ~(1 << 6);
 				__raw_writel(value, resources->dw_sys_ctrl_base
 					     + 0x274);
+				omap3_control_mark_dirty(OMAP3_CTX_CONTROL);
 			}
 
 			/* Disables the functional clock of the periphearl */
@@ -575,6 +582,7 @@ int dsp_peripheral_clocks_enable(struct wmd_dev_context *dev_context,
 				value |= 1 << 2;
 				__raw_writel(value, resources->dw_sys_ctrl_base
 					     + 0x274);
+				omap3_control_mark_dirty(OMAP3_CTX_CONTROL);
 			} else if (bpwr_clkid[clk_idx] == BPWR_MCBSP2) {
 				/* set MCBSP2_CLKS, on McBSP2 ON */
 				value = __raw_readl(resources->dw_sys_ctrl_base
@@ -582,6 +590,7 @@ int dsp_peripheral_clocks_enable(struct wmd_dev_context *dev_context,
 				value |= 1 << 6;
 				__raw_writel(value, resources->dw_sys_ctrl_base
 					     + 0x274);
+				omap3_control_mark_dirty(OMAP3_CTX_CONTROL);
 			}
 			/* Enable the functional clock of the periphearl */
 			fun_clk_status =
@@ -41,7 +41,11 @@
 #include <linux/i2c-omap.h>
 #include <linux/pm_runtime.h>
 #include <linux/notifier.h>
+#include <linux/dma-mapping.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
 #include <plat/clock.h>
+#include <plat/dma.h>
 
 /* I2C controller revisions */
 #define OMAP_I2C_REV_2			0x20
@@ -54,6 +58,9 @@
 /* timeout waiting for the controller to respond */
 #define OMAP_I2C_TIMEOUT (msecs_to_jiffies(1000))
 
+/* messages at least this long move their FIFO-sized chunks by DMA */
+#define OMAP_I2C_DMA_MIN_BYTES		32
+
 /* For OMAP3 I2C_IV has changed to I2C_WE (wakeup enable) */
 enum {
 	OMAP_I2C_REV_REG = 0,
@@ -104,6 +111,9 @@ enum {
 #define OMAP_I2C_STAT_NACK	(1 << 1)	/* No ack interrupt enable */
 #define OMAP_I2C_STAT_AL	(1 << 0)	/* Arbitration lost int ena */
 
+/* Driver-only cmd_err bit: the next message of a transfer couldn't start */
+#define OMAP_I2C_ERR_START	(1 << 15)
+
 /* I2C WE wakeup enable register */
 #define OMAP_I2C_WE_XDR_WE	(1 << 14)	/* TX drain wakup */
 #define OMAP_I2C_WE_RDR_WE	(1 << 13)	/* RX drain wakeup */
@@ -176,6 +186,16 @@ enum {
 #define OMAP_I2C_MASTER_CLOCK		96000000
 #define OMAP_I2C_DPLL_CLOCK		49152000
 
+struct omap_i2c_stats {
+	unsigned long		xfers;
+	unsigned long		msgs;
+	unsigned long		errors;
+	unsigned long		timeouts;
+	u64			bytes;
+	u64			dma_bytes;
+	u64			busy_us;
+};
+
 struct omap_i2c_dev {
 	struct device		*dev;
 	void __iomem		*base;		/* virtual */
@@ -191,6 +211,19 @@ struct omap_i2c_dev {
 	u8			*buf;
 	u8			*regs;
 	size_t			buf_len;
+	struct i2c_msg		*msgs;		/* current transfer */
+	int			msgs_num;
+	int			msg_idx;
+	unsigned		stop:1;		/* STP after the last message */
+	u32			phys_base;
+	int			dma_rx_req;
+	int			dma_tx_req;
+	int			dma_rx_ch;
+	int			dma_tx_ch;
+	int			dma_ch;		/* in use, -1 if none */
+	dma_addr_t		dma_addr;
+	size_t			dma_len;
+	struct omap_i2c_stats	stats;
 	struct i2c_adapter	adapter;
 	u8			fifo_size;	/* use as flag and value
 						 * fifo_size==0 implies no fifo
@@ -584,38 +617,146 @@ static int omap_i2c_wait_for_bb(struct omap_i2c_dev *dev)
 }
 
 /*
- * Low level master read/write transaction.
+ * Hand the FIFO threshold sized part of a long message to the system DMA,
+ * the FIFO threshold events becoming DMA requests. The remainder is left
+ * to the XDR/RDR interrupts. Returns the OMAP_I2C_BUF_REG DMA enable bit,
+ * or 0 if the message goes through the interrupt handler only.
  */
-static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
-			     struct i2c_msg *msg, int stop)
+static u16 omap_i2c_dma_start(struct omap_i2c_dev *dev, struct i2c_msg *msg)
 {
-	struct omap_i2c_dev *dev = i2c_get_adapdata(adap);
-	int r;
+	int rx = msg->flags & I2C_M_RD;
+	u32 data = dev->phys_base +
+		(dev->regs[OMAP_I2C_DATA_REG] << dev->reg_shift);
+	size_t len;
+	int ch;
+
+	ch = rx ? dev->dma_rx_ch : dev->dma_tx_ch;
+	if (ch < 0 || msg->len < OMAP_I2C_DMA_MIN_BYTES)
+		return 0;
+	/* Each write must wait for XUDF, the XRDY requests would not */
+	if (!rx && (dev->errata & I2C_OMAP3_1P153))
+		return 0;
+
+	if (!virt_addr_valid(msg->buf) || object_is_on_stack(msg->buf))
+		return 0;
+	len = msg->len - msg->len % dev->fifo_size;
+
+	/*
+	 * Don't let the invalidation hit anything sharing the cache lines:
+	 * the DMA area is whole lines, the tail bytes the CPU copies from
+	 * the FIFO are outside of it.
+	 */
+	if (rx) {
+		if (!IS_ALIGNED((unsigned long)msg->buf,
+				dma_get_cache_alignment()))
+			return 0;
+		len -= len % dma_get_cache_alignment();
+		len -= len % dev->fifo_size;
+		if (len < OMAP_I2C_DMA_MIN_BYTES)
+			return 0;
+	}
+	dev->dma_addr = dma_map_single(dev->dev, msg->buf, len,
+			rx ? DMA_FROM_DEVICE : DMA_TO_DEVICE);
+
+	if (rx) {
+		omap_set_dma_src_params(ch, 0, OMAP_DMA_AMODE_CONSTANT,
+				data, 0, 0);
+		omap_set_dma_dest_params(ch, 0, OMAP_DMA_AMODE_POST_INC,
+				dev->dma_addr, 0, 0);
+	} else {
+		omap_set_dma_src_params(ch, 0, OMAP_DMA_AMODE_POST_INC,
+				dev->dma_addr, 0, 0);
+		omap_set_dma_dest_params(ch, 0, OMAP_DMA_AMODE_CONSTANT,
+				data, 0, 0);
+	}
+	omap_set_dma_transfer_params(ch, OMAP_DMA_DATA_TYPE_S8,
+			dev->fifo_size, len / dev->fifo_size,
+			OMAP_DMA_SYNC_FRAME,
+			rx ? dev->dma_rx_req : dev->dma_tx_req,
+			rx ? OMAP_DMA_SRC_SYNC : OMAP_DMA_DST_SYNC);
+	omap_start_dma(ch);
+
+	dev->dma_ch = ch;
+	dev->dma_len = len;
+	dev->buf += len;
+	dev->buf_len -= len;
+
+	/* Only the draining events are left to the CPU */
+	omap_i2c_write_reg(dev, OMAP_I2C_IE_REG, dev->iestate &
+			~(OMAP_I2C_IE_XRDY | OMAP_I2C_IE_RRDY));
+
+	return rx ? OMAP_I2C_BUF_RDMA_EN : OMAP_I2C_BUF_XDMA_EN;
+}
+
+/*
+ * Called once the controller is done with the current message. The last
+ * DMA frame of a read may still be on its way to memory, which takes far
+ * less than the bound: this runs in interrupt context.
+ */
+static int omap_i2c_dma_finish(struct omap_i2c_dev *dev, int abort)
+{
+	struct i2c_msg *msg = &dev->msgs[dev->msg_idx];
+	int loops = 20;
+	int r = 0;
+	u16 w;
+
+	if (dev->dma_ch < 0)
+		return 0;
+
+	while (omap_get_dma_active_status(dev->dma_ch)) {
+		if (abort || !--loops) {
+			omap_stop_dma(dev->dma_ch);
+			r = -EIO;
+			break;
+		}
+		udelay(1);
+	}
+
+	w = omap_i2c_read_reg(dev, OMAP_I2C_BUF_REG);
+	w &= ~(OMAP_I2C_BUF_RDMA_EN | OMAP_I2C_BUF_XDMA_EN);
+	omap_i2c_write_reg(dev, OMAP_I2C_BUF_REG, w);
+	omap_i2c_write_reg(dev, OMAP_I2C_IE_REG, dev->iestate);
+
+	dma_unmap_single(dev->dev, dev->dma_addr, dev->dma_len,
+			(msg->flags & I2C_M_RD) ? DMA_FROM_DEVICE :
+						  DMA_TO_DEVICE);
+	if (!r)
+		dev->stats.dma_bytes += dev->dma_len;
+	dev->dma_ch = -1;
+	dev->dma_len = 0;
+
+	return r;
+}
+
+/*
+ * Program the controller for dev->msgs[dev->msg_idx]. Called by
+ * omap_i2c_xfer_msgs() for the first message of a transfer, and by the
+ * interrupt handler for the following ones so that they run back-to-back.
+ */
+static int omap_i2c_start_msg(struct omap_i2c_dev *dev)
+{
+	struct i2c_msg *msg = &dev->msgs[dev->msg_idx];
+	int stop = dev->stop && dev->msg_idx == dev->msgs_num - 1;
 	u16 w;
-	struct pm_qos_request_list *qos_handle = NULL;
 
 	dev_dbg(dev->dev, "addr: 0x%04x, len: %d, flags: 0x%x, stop: %d\n",
 		msg->addr, msg->len, msg->flags, stop);
 
-	if (msg->len == 0)
-		return -EINVAL;
-
 	omap_i2c_write_reg(dev, OMAP_I2C_SA_REG, msg->addr);
 
 	/* REVISIT: Could the STB bit of I2C_CON be used with probing? */
 	dev->buf = msg->buf;
 	dev->buf_len = msg->len;
+	dev->stats.msgs++;
 
 	omap_i2c_write_reg(dev, OMAP_I2C_CNT_REG, dev->buf_len);
 
 	/* Clear the FIFO Buffers */
 	w = omap_i2c_read_reg(dev, OMAP_I2C_BUF_REG);
 	w |= OMAP_I2C_BUF_RXFIF_CLR | OMAP_I2C_BUF_TXFIF_CLR;
+	w |= omap_i2c_dma_start(dev, msg);
 	omap_i2c_write_reg(dev, OMAP_I2C_BUF_REG, w);
 
-	init_completion(&dev->cmd_complete);
-	dev->cmd_err = 0;
-
 	w = OMAP_I2C_CON_EN | OMAP_I2C_CON_MST | OMAP_I2C_CON_STT;
 
 	/* High speed configuration */
@@ -633,21 +774,24 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 	omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, w);
 
 	/*
-	 * Don't write stt and stp together on some hardware.
+	 * Don't write stt and stp together on some hardware. The wait for
+	 * the start condition is left to process context, see
+	 * omap_i2c_next_msg().
 	 */
 	if (dev->b_hw && stop) {
-		unsigned long delay = jiffies + OMAP_I2C_TIMEOUT;
+		int loops = 10000;
 		u16 con = omap_i2c_read_reg(dev, OMAP_I2C_CON_REG);
 		while (con & OMAP_I2C_CON_STT) {
 			con = omap_i2c_read_reg(dev, OMAP_I2C_CON_REG);
 
 			/* Let the user know if i2c is in a bad state */
-			if (time_after(jiffies, delay)) {
+			if (!--loops) {
 				dev_err(dev->dev, "controller timed out "
 				"waiting for start condition to finish\n");
+				omap_i2c_dma_finish(dev, 1);
 				return -ETIMEDOUT;
 			}
-			cpu_relax();
+			udelay(1);
 		}
 
 		w |= OMAP_I2C_CON_STP;
@@ -655,6 +799,73 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 		omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, w);
 	}
 
+	return 0;
+}
+
+/*
+ * The current message is over: start the next one of the transfer, if
+ * any and if all went well. Returns true when it was started, false when
+ * the transfer is to be completed with @err.
+ */
+static bool omap_i2c_next_msg(struct omap_i2c_dev *dev, u16 *err)
+{
+	struct i2c_msg *msg = &dev->msgs[dev->msg_idx];
+
+	if (omap_i2c_dma_finish(dev, *err) < 0 && !*err)
+		*err |= (msg->flags & I2C_M_RD) ? OMAP_I2C_STAT_ROVR :
+						  OMAP_I2C_STAT_XUDF;
+
+	if (*err == OMAP_I2C_STAT_NACK && (msg->flags & I2C_M_IGNORE_NAK))
+		*err = 0;
+	if (*err)
+		return false;
+
+	dev->stats.bytes += msg->len;
+	if (dev->msg_idx + 1 >= dev->msgs_num)
+		return false;
+	/* The last message waits for STT, omap_i2c_xfer_msgs() starts it */
+	if (dev->b_hw && dev->stop && dev->msg_idx + 2 == dev->msgs_num)
+		return false;
+
+	dev->msg_idx++;
+	if (omap_i2c_start_msg(dev) < 0) {
+		*err |= OMAP_I2C_ERR_START;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Low level master read/write transaction: run @num messages, ending with
+ * a stop condition if @stop. Only the end of the whole sequence is
+ * waited for, except on b_hw controllers where the last message is
+ * started from here.
+ */
+static int omap_i2c_xfer_msgs(struct i2c_adapter *adap,
+			      struct i2c_msg *msgs, int num, int stop)
+{
+	struct omap_i2c_dev *dev = i2c_get_adapdata(adap);
+	int i, r;
+	u16 w;
+	struct pm_qos_request_list *qos_handle = NULL;
+
+	for (i = 0; i < num; i++)
+		if (msgs[i].len == 0)
+			return -EINVAL;
+
+	dev->msgs = msgs;
+	dev->msgs_num = num;
+	dev->msg_idx = 0;
+	dev->stop = stop;
+
+	init_completion(&dev->cmd_complete);
+	dev->cmd_err = 0;
+
+	r = omap_i2c_start_msg(dev);
+	if (r < 0)
+		return r;
+
 	/*
 	 * REVISIT: We should abort the transfer on signals, but the bus goes
 	 * into arbitration and we're currently unable to recover from it.
@@ -662,14 +873,26 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 	if (dev->set_mpu_wkup_lat != NULL)
 		dev->set_mpu_wkup_lat(&qos_handle, dev->latency);
 	r = wait_for_completion_timeout(&dev->cmd_complete,
-					OMAP_I2C_TIMEOUT);
+					OMAP_I2C_TIMEOUT * num);
+	if (r > 0 && !dev->cmd_err && dev->msg_idx + 1 < num) {
+		dev->msg_idx++;
+		INIT_COMPLETION(dev->cmd_complete);
+		if (omap_i2c_start_msg(dev) < 0)
+			dev->cmd_err |= OMAP_I2C_ERR_START;
+		else
+			r = wait_for_completion_timeout(&dev->cmd_complete,
+							OMAP_I2C_TIMEOUT);
+	}
 	if (dev->set_mpu_wkup_lat != NULL)
 		dev->set_mpu_wkup_lat(&qos_handle, -1);
 	dev->buf_len = 0;
+	stop = stop && dev->msg_idx == num - 1;
 	if (r < 0)
 		return r;
 	if (r == 0) {
 		dev_err(dev->dev, "controller timed out\n");
+		dev->stats.timeouts++;
+		omap_i2c_dma_finish(dev, 1);
 		omap_i2c_init(dev);
 		return -ETIMEDOUT;
 	}
@@ -678,6 +901,12 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 		return 0;
 
 	/* We have an error */
+	dev->stats.errors++;
+	if (dev->cmd_err & OMAP_I2C_ERR_START) {
+		omap_i2c_init(dev);
+		return -ETIMEDOUT;
+	}
+
 	if (dev->cmd_err & (OMAP_I2C_STAT_AL | OMAP_I2C_STAT_ROVR |
 			    OMAP_I2C_STAT_XUDF)) {
 		omap_i2c_init(dev);
@@ -685,7 +914,8 @@ static int omap_i2c_xfer_msg(struct i2c_adapter *adap,
 	}
 
 	if (dev->cmd_err & OMAP_I2C_STAT_NACK) {
-		if (msg->flags & I2C_M_IGNORE_NAK)
+		/* omap_i2c_next_msg() handles it for rev2, not the rev1 ISR */
+		if (msgs[dev->msg_idx].flags & I2C_M_IGNORE_NAK)
 			return 0;
 		if (stop) {
 			w = omap_i2c_read_reg(dev, OMAP_I2C_CON_REG);
@@ -805,7 +1035,7 @@ omap_i2c_speed_configure(struct omap_i2c_dev *dev,
 }
 
 /*
- * Prepare controller for a transaction and call omap_i2c_xfer_msg
+ * Prepare controller for a transaction and call omap_i2c_xfer_msgs
  * to do the work during IRQ processing.
  */
 static int
@@ -814,6 +1044,7 @@ omap_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 	struct omap_i2c_dev *dev = i2c_get_adapdata(adap);
 	int i;
 	int r;
+	ktime_t start;
 	struct platform_device *pdev;
 	struct omap_i2c_bus_platform_data *pdata;
 
@@ -857,11 +1088,20 @@ omap_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 	if (r < 0)
 		goto out;
 
-	for (i = 0; i < num; i++) {
-		r = omap_i2c_xfer_msg(adap, &msgs[i], (i == (num - 1)));
-		if (r != 0)
-			break;
+	start = ktime_get();
+	if (dev->rev < OMAP_I2C_REV_2) {
+		/* The rev1 interrupt handler completes every message */
+		for (i = 0; i < num; i++) {
+			r = omap_i2c_xfer_msgs(adap, &msgs[i], 1,
+					       (i == (num - 1)));
+			if (r != 0)
+				break;
+		}
+	} else {
+		r = omap_i2c_xfer_msgs(adap, msgs, num, 1);
 	}
+	dev->stats.xfers++;
+	dev->stats.busy_us += ktime_to_us(ktime_sub(ktime_get(), start));
 
 	if (r == 0)
 		r = num;
@@ -1056,7 +1296,9 @@ complete:
 			omap_i2c_ack_stat(dev, stat &
 				(OMAP_I2C_STAT_RRDY | OMAP_I2C_STAT_RDR |
 				OMAP_I2C_STAT_XRDY | OMAP_I2C_STAT_XDR));
-			omap_i2c_complete_cmd(dev, err);
+			err |= dev->cmd_err;
+			if (!omap_i2c_next_msg(dev, &err))
+				omap_i2c_complete_cmd(dev, err);
 			return IRQ_HANDLED;
 		}
 		if (stat & (OMAP_I2C_STAT_RRDY | OMAP_I2C_STAT_RDR)) {
@@ -1173,6 +1415,76 @@ static const struct i2c_algorithm omap_i2c_algo = {
 	.functionality	= omap_i2c_func,
 };
 
+static ssize_t omap_i2c_show_stats(struct device *d,
+		struct device_attribute *attr, char *buf)
+{
+	struct omap_i2c_dev *dev = dev_get_drvdata(d);
+	struct omap_i2c_stats st;
+
+	/* The counters only move while a transfer holds the bus */
+	i2c_lock_adapter(&dev->adapter);
+	st = dev->stats;
+	i2c_unlock_adapter(&dev->adapter);
+
+	return snprintf(buf, PAGE_SIZE,
+			"transfers: %lu\n"
+			"messages: %lu\n"
+			"errors: %lu\n"
+			"timeouts: %lu\n"
+			"bytes: %llu\n"
+			"dma bytes: %llu\n"
+			"busy: %llu us\n",
+			st.xfers, st.msgs, st.errors, st.timeouts,
+			st.bytes, st.dma_bytes, st.busy_us);
+}
+
+static DEVICE_ATTR(stats, S_IRUGO, omap_i2c_show_stats, NULL);
+
+static void omap_i2c_request_dma(struct omap_i2c_dev *dev,
+				 struct platform_device *pdev)
+{
+	struct resource *res;
+
+	dev->dma_rx_ch = -1;
+	dev->dma_tx_ch = -1;
+	dev->dma_ch = -1;
+
+	if (!dev->fifo_size)
+		return;
+
+	res = platform_get_resource_byname(pdev, IORESOURCE_DMA, "rx");
+	if (!res)
+		return;
+	dev->dma_rx_req = res->start;
+	res = platform_get_resource_byname(pdev, IORESOURCE_DMA, "tx");
+	if (!res)
+		return;
+	dev->dma_tx_req = res->start;
+
+	if (omap_request_dma(dev->dma_rx_req, dev_name(dev->dev), NULL, NULL,
+			     &dev->dma_rx_ch))
+		goto err;
+	if (omap_request_dma(dev->dma_tx_req, dev_name(dev->dev), NULL, NULL,
+			     &dev->dma_tx_ch))
+		goto err;
+	return;
+
+err:
+	dev_warn(dev->dev, "no DMA channel, using interrupts only\n");
+	if (dev->dma_rx_ch >= 0)
+		omap_free_dma(dev->dma_rx_ch);
+	dev->dma_rx_ch = -1;
+	dev->dma_tx_ch = -1;
+}
+
+static void omap_i2c_free_dma(struct omap_i2c_dev *dev)
+{
+	if (dev->dma_rx_ch >= 0)
+		omap_free_dma(dev->dma_rx_ch);
+	if (dev->dma_tx_ch >= 0)
+		omap_free_dma(dev->dma_tx_ch);
+}
+
 static int __devinit
 omap_i2c_probe(struct platform_device *pdev)
 {
@@ -1222,6 +1534,7 @@ omap_i2c_probe(struct platform_device *pdev)
 	dev->idle = 1;
 	dev->dev = &pdev->dev;
 	dev->irq = irq->start;
+	dev->phys_base = mem->start;
 	dev->base = ioremap(mem->start, resource_size(mem));
 	if (!dev->base) {
 		r = -ENOMEM;
@@ -1285,6 +1598,8 @@ omap_i2c_probe(struct platform_device *pdev)
 	}
 	spin_lock_init(&dev->dpll_lock);
 
+	omap_i2c_request_dma(dev, pdev);
+
 	/* reset ASAP, clearing any IRQs */
 	omap_i2c_init(dev);
 
@@ -1322,6 +1637,9 @@ omap_i2c_probe(struct platform_device *pdev)
 		goto err_free_irq;
 	}
 
+	if (device_create_file(&pdev->dev, &dev_attr_stats))
+		dev_warn(&pdev->dev, "cannot create stats attribute\n");
+
 	return 0;
 
 err_free_irq:
@@ -1329,6 +1647,7 @@ err_free_irq:
 err_unuse_clocks:
 	omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, 0);
 	omap_i2c_idle(dev);
+	omap_i2c_free_dma(dev);
 	iounmap(dev->base);
 err_free_mem:
 	platform_set_drvdata(pdev, NULL);
@@ -1345,11 +1664,13 @@ omap_i2c_remove(struct platform_device *pdev)
 	struct omap_i2c_dev	*dev = platform_get_drvdata(pdev);
 	struct resource		*mem;
 
+	device_remove_file(&pdev->dev, &dev_attr_stats);
 	platform_set_drvdata(pdev, NULL);
 
 	free_irq(dev->irq, dev);
 	i2c_del_adapter(&dev->adapter);
 	omap_i2c_write_reg(dev, OMAP_I2C_CON_REG, 0);
+	omap_i2c_free_dma(dev);
 	iounmap(dev->base);
 	kfree(dev);
 	mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
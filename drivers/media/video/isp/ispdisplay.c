@@ -0,0 +1,500 @@
+/*
+ * ispdisplay.c
+ *
+ * TI OMAP3 ISP - Capture to display overlay link
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <linux/gpio.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/omap3isp.h>
+#include <plat/display.h>
+
+#include "isp.h"
+#include "ispdisplay.h"
+#include "ispvideo.h"
+
+/*
+ * The display link routes completed capture buffers straight to a DSS video
+ * overlay, without going through userspace. Userspace configures the capture
+ * pipeline, queues physically contiguous USERPTR buffers (VM_PFNMAP memory
+ * such as DSS or framebuffer reserved memory) and starts streaming as usual,
+ * then enables the link. From that point on buffers cycle between the ISP and
+ * the overlay in the kernel:
+ *
+ * - The ISP interrupt handler hands completed buffers to the link, which
+ *   keeps the most recent one as pending and recycles the older one.
+ * - At every VSYNC the pending buffer is programmed in the overlay and the
+ *   shadow registers are committed. The hardware latches the new address at
+ *   the next VSYNC, where the buffer that was scanned out so far is returned
+ *   to the ISP DMA queue.
+ *
+ * When the board provides a reverse gear GPIO the overlay is only enabled
+ * while the gear is engaged. The capture keeps running in the background so
+ * that the first frame after engagement is displayed within one frame period.
+ * The time from gear engagement to the first displayed frame is logged and
+ * reported with the link statistics.
+ */
+
+struct isp_display {
+	struct isp_video *video;
+	struct omap_overlay *ovl;
+	struct omap_overlay_info info;
+	u32 irqmask;
+
+	spinlock_t lock;
+	bool active;
+	bool engaged;
+	bool visible;
+	bool hiding;
+
+	struct isp_video_buffer *pending;
+	struct isp_video_buffer *queued;
+	struct isp_video_buffer *shown;
+	struct list_head recycle;
+
+	int gear_gpio;
+	int gear_irq;
+	bool gear_active_low;
+	bool timing;
+	ktime_t gear_time;
+
+	u32 frames;
+	u32 dropped;
+	u32 latency_us;
+	u32 latency_max_us;
+};
+
+/*
+ * isp_display_recycle - Give buffers back to the ISP DMA queue
+ *
+ * Must be called with interrupts disabled and the display lock released.
+ */
+static void isp_display_recycle(struct isp_display *disp,
+				struct list_head *list)
+{
+	struct isp_video_queue *queue = disp->video->queue;
+	struct isp_video_buffer *buf;
+	struct isp_video_buffer *next;
+
+	if (list_empty(list))
+		return;
+
+	spin_lock(&queue->irqlock);
+	list_for_each_entry_safe(buf, next, list, irqlist) {
+		list_del(&buf->irqlist);
+		buf->state = ISP_BUF_STATE_QUEUED;
+		queue->ops->buffer_queue(buf);
+	}
+	spin_unlock(&queue->irqlock);
+}
+
+static int isp_display_apply(struct isp_display *disp, u32 paddr,
+			     bool enable)
+{
+	struct omap_overlay *ovl = disp->ovl;
+	struct omap_overlay_info info = disp->info;
+	int ret;
+
+	if (enable)
+		info.paddr = paddr;
+	info.enabled = enable;
+
+	ret = ovl->set_overlay_info(ovl, &info);
+	if (ret < 0)
+		return ret;
+
+	return ovl->manager->apply(ovl->manager);
+}
+
+static void isp_display_vsync_isr(void *arg, unsigned int irqstatus)
+{
+	struct isp_display *disp = arg;
+	struct device *dev = disp->video->isp->dev;
+	LIST_HEAD(recycle);
+	s64 latency;
+
+	spin_lock(&disp->lock);
+
+	if (!disp->active)
+		goto done;
+
+	list_splice_init(&disp->recycle, &recycle);
+
+	/* The buffer committed at the previous VSYNC is now being scanned out,
+	 * release the one it replaces.
+	 */
+	if (disp->queued) {
+		if (disp->shown)
+			list_add_tail(&disp->shown->irqlist, &recycle);
+		disp->shown = disp->queued;
+		disp->queued = NULL;
+		disp->frames++;
+
+		if (disp->timing) {
+			latency = ktime_us_delta(ktime_get(), disp->gear_time);
+			disp->latency_us = latency;
+			if (disp->latency_us > disp->latency_max_us)
+				disp->latency_max_us = disp->latency_us;
+			disp->timing = false;
+			dev_info(dev, "display: first frame %u us after "
+				 "reverse gear\n", disp->latency_us);
+		}
+	} else if (disp->hiding) {
+		if (disp->shown)
+			list_add_tail(&disp->shown->irqlist, &recycle);
+		disp->shown = NULL;
+		disp->hiding = false;
+	}
+
+	if (!disp->engaged) {
+		if (disp->pending)
+			list_add_tail(&disp->pending->irqlist, &recycle);
+		disp->pending = NULL;
+
+		if (disp->visible && isp_display_apply(disp, 0, false) == 0) {
+			disp->visible = false;
+			disp->hiding = true;
+		}
+		goto done;
+	}
+
+	if (disp->pending == NULL)
+		goto done;
+
+	if (isp_display_apply(disp, disp->pending->paddr, true) == 0) {
+		disp->queued = disp->pending;
+		disp->visible = true;
+	} else {
+		list_add_tail(&disp->pending->irqlist, &recycle);
+		disp->dropped++;
+	}
+	disp->pending = NULL;
+
+done:
+	spin_unlock(&disp->lock);
+	isp_display_recycle(disp, &recycle);
+}
+
+static irqreturn_t isp_display_gear_isr(int irq, void *arg)
+{
+	struct isp_display *disp = arg;
+	unsigned long flags;
+	bool engaged;
+
+	engaged = !!gpio_get_value(disp->gear_gpio) != disp->gear_active_low;
+
+	spin_lock_irqsave(&disp->lock, flags);
+	if (engaged && !disp->engaged) {
+		disp->gear_time = ktime_get();
+		disp->timing = true;
+	}
+	disp->engaged = engaged;
+	spin_unlock_irqrestore(&disp->lock, flags);
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * omap3isp_display_frame_done - Hand a completed buffer to the display link
+ * @video: ISP video object
+ * @buf: Completed video buffer, already removed from the DMA queue
+ * @error: Whether an error occurred during capture
+ *
+ * Called from interrupt context when a capture buffer is complete. Return
+ * true if the link has taken ownership of the buffer, or false if the buffer
+ * must be completed to userspace as usual.
+ */
+bool omap3isp_display_frame_done(struct isp_video *video,
+				 struct isp_video_buffer *buf,
+				 unsigned int error)
+{
+	struct isp_display *disp = video->display;
+	unsigned long flags;
+
+	if (disp == NULL)
+		return false;
+
+	spin_lock_irqsave(&disp->lock, flags);
+
+	if (!disp->active) {
+		spin_unlock_irqrestore(&disp->lock, flags);
+		return false;
+	}
+
+	/* The DSS has no MMU, only physically contiguous buffers can be
+	 * scanned out.
+	 */
+	if (error || !(buf->vm_flags & VM_PFNMAP)) {
+		list_add_tail(&buf->irqlist, &disp->recycle);
+		disp->dropped++;
+	} else {
+		if (disp->pending) {
+			list_add_tail(&disp->pending->irqlist, &disp->recycle);
+			disp->dropped++;
+		}
+		disp->pending = buf;
+	}
+
+	spin_unlock_irqrestore(&disp->lock, flags);
+	return true;
+}
+
+static void isp_display_complete(struct isp_video_buffer *buf)
+{
+	buf->state = ISP_BUF_STATE_DONE;
+	wake_up(&buf->wait);
+}
+
+/**
+ * omap3isp_display_stop - Disable the display link
+ * @video: ISP video object
+ *
+ * Disable the overlay and complete all buffers owned by the link to
+ * userspace. Must be called with the video stream lock held.
+ */
+void omap3isp_display_stop(struct isp_video *video)
+{
+	struct isp_display *disp = video->display;
+	struct isp_video_buffer *buf;
+	struct isp_video_buffer *next;
+	unsigned long flags;
+
+	if (disp == NULL)
+		return;
+
+	omap_dispc_unregister_isr(isp_display_vsync_isr, disp, disp->irqmask);
+
+	if (disp->gear_irq >= 0) {
+		free_irq(disp->gear_irq, disp);
+		gpio_free(disp->gear_gpio);
+	}
+
+	spin_lock_irqsave(&disp->lock, flags);
+	disp->active = false;
+	spin_unlock_irqrestore(&disp->lock, flags);
+
+	video->display = NULL;
+	synchronize_irq(video->isp->irq_num);
+
+	/* Wait for the overlay to be disabled before releasing the buffer it
+	 * scans out.
+	 */
+	if (isp_display_apply(disp, 0, false) == 0)
+		disp->ovl->wait_for_go(disp->ovl);
+	disp->ovl->in_use = false;
+
+	if (disp->shown)
+		isp_display_complete(disp->shown);
+	if (disp->queued)
+		isp_display_complete(disp->queued);
+	if (disp->pending)
+		isp_display_complete(disp->pending);
+	list_for_each_entry_safe(buf, next, &disp->recycle, irqlist) {
+		list_del(&buf->irqlist);
+		isp_display_complete(buf);
+	}
+
+	dev_dbg(video->isp->dev, "display: %u frames displayed, %u dropped\n",
+		disp->frames, disp->dropped);
+
+	kfree(disp);
+}
+
+static int isp_display_gear_init(struct isp_display *disp,
+				 const struct isp_display_platform_data *pdata)
+{
+	int ret;
+
+	disp->gear_irq = -1;
+	disp->engaged = true;
+	disp->timing = true;
+	disp->gear_time = ktime_get();
+
+	if (pdata == NULL || !gpio_is_valid(pdata->gear_gpio))
+		return 0;
+
+	disp->gear_gpio = pdata->gear_gpio;
+	disp->gear_active_low = pdata->gear_active_low;
+
+	ret = gpio_request(disp->gear_gpio, "reverse gear");
+	if (ret < 0)
+		return ret;
+
+	gpio_direction_input(disp->gear_gpio);
+	disp->engaged = !!gpio_get_value(disp->gear_gpio) !=
+			disp->gear_active_low;
+	disp->timing = disp->engaged;
+
+	ret = request_irq(gpio_to_irq(disp->gear_gpio), isp_display_gear_isr,
+			  IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING,
+			  "isp-display-gear", disp);
+	if (ret < 0) {
+		gpio_free(disp->gear_gpio);
+		return ret;
+	}
+
+	disp->gear_irq = gpio_to_irq(disp->gear_gpio);
+	return 0;
+}
+
+static int isp_display_start(struct isp_video *video, struct isp_video_fh *vfh,
+			     const struct omap3isp_display_config *config)
+{
+	const struct v4l2_pix_format *pix = &vfh->format.fmt.pix;
+	enum omap_color_mode mode;
+	struct omap_overlay *ovl;
+	struct isp_display *disp;
+	int ret;
+
+	if (video->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		return -EINVAL;
+
+	switch (pix->pixelformat) {
+	case V4L2_PIX_FMT_UYVY:
+		mode = OMAP_DSS_COLOR_UYVY;
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		mode = OMAP_DSS_COLOR_YUV2;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	ovl = omap_dss_get_overlay(config->overlay);
+	if (ovl == NULL || !(ovl->supported_modes & mode))
+		return -EINVAL;
+
+	if (ovl->manager == NULL || ovl->manager->device == NULL)
+		return -ENODEV;
+
+	if (ovl->in_use)
+		return -EBUSY;
+
+	disp = kzalloc(sizeof(*disp), GFP_KERNEL);
+	if (disp == NULL)
+		return -ENOMEM;
+
+	disp->video = video;
+	disp->ovl = ovl;
+	spin_lock_init(&disp->lock);
+	INIT_LIST_HEAD(&disp->recycle);
+
+	ovl->get_overlay_info(ovl, &disp->info);
+	disp->info.enabled = false;
+	disp->info.paddr = 0;
+	disp->info.vaddr = NULL;
+	disp->info.p_uv_addr = 0;
+	disp->info.color_mode = mode;
+	disp->info.width = pix->width;
+	disp->info.height = pix->height;
+	disp->info.screen_width = pix->bytesperline / 2;
+	disp->info.rotation = 0;
+	disp->info.mirror = false;
+	disp->info.pos_x = config->pos_x;
+	disp->info.pos_y = config->pos_y;
+	disp->info.out_width = config->out_width;
+	disp->info.out_height = config->out_height;
+
+	switch (ovl->manager->device->channel) {
+	case OMAP_DSS_CHANNEL_DIGIT:
+		disp->irqmask = DISPC_IRQ_EVSYNC_EVEN | DISPC_IRQ_EVSYNC_ODD;
+		break;
+	case OMAP_DSS_CHANNEL_LCD2:
+		disp->irqmask = DISPC_IRQ_VSYNC2;
+		break;
+	case OMAP_DSS_CHANNEL_LCD:
+	default:
+		disp->irqmask = DISPC_IRQ_VSYNC;
+		break;
+	}
+
+	ret = isp_display_gear_init(disp, video->isp->pdata->display);
+	if (ret < 0)
+		goto error;
+
+	disp->active = true;
+	ovl->in_use = true;
+	video->display = disp;
+
+	ret = omap_dispc_register_isr(isp_display_vsync_isr, disp,
+				      disp->irqmask);
+	if (ret < 0) {
+		video->display = NULL;
+		synchronize_irq(video->isp->irq_num);
+		ovl->in_use = false;
+		if (disp->gear_irq >= 0) {
+			free_irq(disp->gear_irq, disp);
+			gpio_free(disp->gear_gpio);
+		}
+		goto error;
+	}
+
+	return 0;
+
+error:
+	kfree(disp);
+	return ret;
+}
+
+/**
+ * omap3isp_display_config - Configure the display link
+ * @video: ISP video object
+ * @vfh: Video file handle, used to retrieve the capture format
+ * @config: Link configuration
+ *
+ * Enable or disable the link and report its statistics. Must be called with
+ * the video stream lock held.
+ */
+int omap3isp_display_config(struct isp_video *video, struct isp_video_fh *vfh,
+			    struct omap3isp_display_config *config)
+{
+	struct isp_display *disp;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!config->enable) {
+		omap3isp_display_stop(video);
+	} else if (video->display == NULL) {
+		ret = isp_display_start(video, vfh, config);
+		if (ret < 0)
+			return ret;
+	}
+
+	disp = video->display;
+	if (disp == NULL) {
+		config->frames = 0;
+		config->dropped = 0;
+		config->gear_latency_us = 0;
+		config->gear_latency_max_us = 0;
+		return 0;
+	}
+
+	spin_lock_irqsave(&disp->lock, flags);
+	config->overlay = disp->ovl->id;
+	config->frames = disp->frames;
+	config->dropped = disp->dropped;
+	config->gear_latency_us = disp->latency_us;
+	config->gear_latency_max_us = disp->latency_max_us;
+	spin_unlock_irqrestore(&disp->lock, flags);
+
+	return ret;
+}
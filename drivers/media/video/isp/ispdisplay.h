@@ -0,0 +1,63 @@
+/*
+ * ispdisplay.h
+ *
+ * TI OMAP3 ISP - Capture to display overlay link
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef OMAP3_ISP_DISPLAY_H
+#define OMAP3_ISP_DISPLAY_H
+
+#include <linux/errno.h>
+#include <linux/types.h>
+
+struct isp_video;
+struct isp_video_buffer;
+struct isp_video_fh;
+struct omap3isp_display_config;
+
+#ifdef CONFIG_VIDEO_OMAP3_ISP_DISPLAY
+
+int omap3isp_display_config(struct isp_video *video, struct isp_video_fh *vfh,
+			    struct omap3isp_display_config *config);
+void omap3isp_display_stop(struct isp_video *video);
+bool omap3isp_display_frame_done(struct isp_video *video,
+				 struct isp_video_buffer *buf,
+				 unsigned int error);
+
+#else
+
+static inline int omap3isp_display_config(struct isp_video *video,
+					  struct isp_video_fh *vfh,
+					  struct omap3isp_display_config *config)
+{
+	return -EINVAL;
+}
+
+static inline void omap3isp_display_stop(struct isp_video *video)
+{
+}
+
+static inline bool omap3isp_display_frame_done(struct isp_video *video,
+					       struct isp_video_buffer *buf,
+					       unsigned int error)
+{
+	return false;
+}
+
+#endif /* CONFIG_VIDEO_OMAP3_ISP_DISPLAY */
+
+#endif /* OMAP3_ISP_DISPLAY_H */
@@ -25,6 +25,8 @@
 
 #include <asm/cacheflush.h>
 #include <linux/dma-mapping.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
 #include <linux/pagemap.h>
 #include <linux/poll.h>
@@ -46,44 +48,38 @@
  * the (user space) buffer address range. And this _must_ be done
  * at QBUF stage (and *only* at QBUF).
  *
- * We try to use optimal cache invalidation function:
- * - dmac_map_area:
- *    - used when the number of pages are _low_.
- *    - it becomes quite slow as the number of pages increase.
- *       - for 648x492 viewfinder (150 pages) it takes 1.3 ms.
- *       - for 5 Mpix buffer (2491 pages) it takes between 25-50 ms.
- *
- * - flush_cache_all:
- *    - used when the number of pages are _high_.
- *    - time taken in the range of 500-900 us.
- *    - has a higher penalty but, as whole dcache + icache is invalidated
- */
-/*
- * FIXME: dmac_inv_range crashes randomly on the user space buffer
- *        address. Fall back to flush_cache_all for now.
+ * Cache maintenance is performed through the buffer scatter list, on the
+ * kernel linear mapping of the pinned pages. This restricts the operation to
+ * the buffer memory without walking the userspace page tables, which used to
+ * crash randomly with dmac_inv_range on userspace addresses. The OMAP3 L1 data
+ * cache doesn't alias, so maintenance through the kernel mapping covers the
+ * userspace mapping as well.
+ *
+ * VM_PFNMAP buffers have no struct page backing and no kernel mapping, fall
+ * back to flush_cache_all for them.
  */
-#define ISP_CACHE_FLUSH_PAGES_MAX       0
-
 static void isp_video_buffer_cache_sync(struct isp_video_buffer *buf)
 {
+	enum dma_data_direction direction;
+
 	if (buf->skip_cache)
 		return;
 
-	if (buf->vbuf.m.userptr == 0 || buf->npages == 0 ||
-	    buf->npages > ISP_CACHE_FLUSH_PAGES_MAX)
+	if ((buf->vm_flags & VM_PFNMAP) || buf->sglist == NULL) {
 		flush_cache_all();
-	else {
-		dmac_map_area((void *)buf->vbuf.m.userptr, buf->vbuf.length,
-			      DMA_FROM_DEVICE);
-		outer_inv_range(buf->vbuf.m.userptr,
-				buf->vbuf.m.userptr + buf->vbuf.length);
+		return;
 	}
+
+	direction = buf->vbuf.type == V4L2_BUF_TYPE_VIDEO_CAPTURE
+		  ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+	dma_sync_sg_for_device(buf->queue->dev, buf->sglist, buf->sglen,
+			       direction);
 }
 
 /*
- * isp_video_buffer_lock_vma - Prevent VMAs from being unmapped
+ * isp_video_lock_vma - Prevent VMAs from being unmapped
  *
- * Lock the VMAs underlying the given buffer into memory. This avoids the
+ * Lock the VMAs underlying the given memory area into memory. This avoids the
  * userspace buffer mapping from being swapped out, making VIPT cache handling
  * easier.
  *
@@ -94,16 +90,13 @@ static void isp_video_buffer_cache_sync(struct isp_video_buffer *buf)
  * userspace mapping manager not finding out that the pages are locked under
  * some conditions.
  */
-static int isp_video_buffer_lock_vma(struct isp_video_buffer *buf, int lock)
+static int isp_video_lock_vma(unsigned long start, unsigned long length,
+			      int lock)
 {
 	struct vm_area_struct *vma;
-	unsigned long start;
 	unsigned long end;
 	int ret = 0;
 
-	if (buf->vbuf.memory == V4L2_MEMORY_MMAP)
-		return 0;
-
 	/* We can be called from workqueue context if the current task dies to
 	 * unlock the VMAs. In that case there's no current memory management
 	 * context so unlocking can't be performed, but the VMAs have been or
@@ -112,8 +105,7 @@ static int isp_video_buffer_lock_vma(struct isp_video_buffer *buf, int lock)
 	if (!current || !current->mm)
 		return lock ? -EINVAL : 0;
 
-	start = buf->vbuf.m.userptr;
-	end = buf->vbuf.m.userptr + buf->vbuf.length - 1;
+	end = start + length - 1;
 
 	down_write(&current->mm->mmap_sem);
 	spin_lock(&current->mm->page_table_lock);
@@ -133,15 +125,68 @@ static int isp_video_buffer_lock_vma(struct isp_video_buffer *buf, int lock)
 		start = vma->vm_end + 1;
 	} while (vma->vm_end < end);
 
+out:
+	spin_unlock(&current->mm->page_table_lock);
+	up_write(&current->mm->mmap_sem);
+	return ret;
+}
+
+static int isp_video_buffer_lock_vma(struct isp_video_buffer *buf, int lock)
+{
+	int ret;
+
+	if (buf->vbuf.memory == V4L2_MEMORY_MMAP)
+		return 0;
+
+	ret = isp_video_lock_vma(buf->vbuf.m.userptr, buf->vbuf.length, lock);
+	if (ret < 0)
+		return ret;
+
 	if (lock)
 		buf->vm_flags |= VM_LOCKED;
 	else
 		buf->vm_flags &= ~VM_LOCKED;
 
-out:
-	spin_unlock(&current->mm->page_table_lock);
-	up_write(&current->mm->mmap_sem);
-	return ret;
+	return 0;
+}
+
+/*
+ * isp_video_vma_valid - Check whether a buffer VMA is still in place
+ *
+ * Return true if the VMA recorded when the memory area was pinned still maps
+ * the given userspace address with the same layout and the same first page,
+ * or false if the VMA has been unmapped, remapped or replaced in the meantime.
+ *
+ * A VMA freed and allocated again for a new mapping of the same area carries
+ * the same identity, only the page it maps tells it apart.
+ */
+static bool isp_video_vma_valid(const struct isp_video_vma *id,
+				unsigned long start)
+{
+	struct vm_area_struct *vma;
+	struct page *page;
+	unsigned long pfn;
+	bool valid;
+
+	if (id->vma == NULL || !current || current->mm != id->mm)
+		return false;
+
+	down_read(&current->mm->mmap_sem);
+	vma = find_vma(current->mm, start);
+	valid = vma == id->vma && vma->vm_start == id->vm_start &&
+		vma->vm_end == id->vm_end && vma->vm_pgoff == id->vm_pgoff &&
+		vma->vm_file == id->vm_file;
+
+	if (valid && (vma->vm_flags & VM_PFNMAP)) {
+		valid = !follow_pfn(vma, start & PAGE_MASK, &pfn) &&
+			pfn == id->pfn;
+	} else if (valid) {
+		page = follow_page(vma, start & PAGE_MASK, 0);
+		valid = page != NULL && page_to_pfn(page) == id->pfn;
+	}
+	up_read(&current->mm->mmap_sem);
+
+	return valid;
 }
 
 /*
@@ -289,8 +334,175 @@ static void isp_video_buffer_cleanup(struct isp_video_buffer *buf)
 
 	buf->npages = 0;
 	buf->skip_cache = false;
+	memset(&buf->vma, 0, sizeof(buf->vma));
+}
+
+/* -----------------------------------------------------------------------------
+ * USERPTR pin cache
+ *
+ * Pinning userspace pages and mapping them for DMA is expensive. Applications
+ * commonly cycle through a fixed set of USERPTR memory areas without keeping a
+ * stable area-to-index association, which would otherwise result in the
+ * buffers being unpinned and pinned again for every frame.
+ *
+ * When a buffer is queued with a new userspace address, the memory area it
+ * used so far is parked in a per-queue cache keyed by address and length
+ * instead of being released. Preparing a buffer for a cached memory area then
+ * only requires the driver-specific preparation. Cache entries are released
+ * in LRU order when the cache is full, when the VMA backing them changes and
+ * when the queue is freed.
+ */
+
+static void isp_video_pin_release(struct isp_video_queue *queue,
+				  struct isp_video_pin *pin)
+{
+	enum dma_data_direction direction;
+	unsigned int i;
+
+	if (!(pin->vm_flags & VM_PFNMAP)) {
+		direction = queue->type == V4L2_BUF_TYPE_VIDEO_CAPTURE
+			  ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+		dma_unmap_sg(queue->dev, pin->sglist, pin->sglen, direction);
+	}
+
+	vfree(pin->sglist);
+
+	if (pin->pages != NULL) {
+		/* Don't touch the VM_LOCKED flag of a VMA that replaced the
+		 * one we have locked.
+		 */
+		if (isp_video_vma_valid(&pin->vma, pin->userptr))
+			isp_video_lock_vma(pin->userptr, pin->length, 0);
+
+		for (i = 0; i < pin->npages; ++i)
+			page_cache_release(pin->pages[i]);
+
+		vfree(pin->pages);
+	}
+
+	list_del(&pin->list);
+	queue->npins--;
+	kfree(pin);
+}
+
+static void isp_video_pin_cache_flush(struct isp_video_queue *queue)
+{
+	struct isp_video_pin *pin;
+	struct isp_video_pin *next;
+
+	list_for_each_entry_safe(pin, next, &queue->pins, list)
+		isp_video_pin_release(queue, pin);
+}
+
+/*
+ * isp_video_pin_lookup - Find a cached memory area
+ *
+ * Look up the pin cache for a memory area matching the given userspace address
+ * and length. Stale entries whose VMA has changed are released.
+ *
+ * Return the cache entry, removed from the cache, or NULL if no valid entry
+ * matches.
+ */
+static struct isp_video_pin *
+isp_video_pin_lookup(struct isp_video_queue *queue, unsigned long userptr,
+		     unsigned long length)
+{
+	struct isp_video_pin *pin;
+
+	list_for_each_entry(pin, &queue->pins, list) {
+		if (pin->userptr != userptr || pin->length != length)
+			continue;
+
+		if (!isp_video_vma_valid(&pin->vma, userptr)) {
+			isp_video_pin_release(queue, pin);
+			return NULL;
+		}
+
+		list_del(&pin->list);
+		queue->npins--;
+		return pin;
+	}
+
+	return NULL;
 }
 
+/*
+ * isp_video_buffer_park - Release a buffer memory area into the pin cache
+ *
+ * Undo the driver-specific buffer preparation and move the pinned and mapped
+ * memory area to the pin cache. Buffers that can't be cached are cleaned up
+ * completely.
+ */
+static void isp_video_buffer_park(struct isp_video_buffer *buf)
+{
+	struct isp_video_queue *queue = buf->queue;
+	struct isp_video_pin *pin;
+
+	if (buf->vbuf.memory != V4L2_MEMORY_USERPTR || !buf->prepared ||
+	    buf->vma.vma == NULL) {
+		isp_video_buffer_cleanup(buf);
+		return;
+	}
+
+	pin = kmalloc(sizeof(*pin), GFP_KERNEL);
+	if (pin == NULL) {
+		isp_video_buffer_cleanup(buf);
+		return;
+	}
+
+	if (queue->ops->buffer_cleanup)
+		queue->ops->buffer_cleanup(buf);
+
+	if (queue->npins == ISP_VIDEO_PIN_CACHE_SIZE)
+		isp_video_pin_release(queue, list_entry(queue->pins.prev,
+					struct isp_video_pin, list));
+
+	pin->userptr = buf->vbuf.m.userptr;
+	pin->length = buf->vbuf.length;
+	pin->vma = buf->vma;
+	pin->vm_flags = buf->vm_flags;
+	pin->offset = buf->offset;
+	pin->npages = buf->npages;
+	pin->pages = buf->pages;
+	pin->paddr = buf->paddr;
+	pin->sglen = buf->sglen;
+	pin->sglist = buf->sglist;
+	pin->skip_cache = buf->skip_cache;
+
+	list_add(&pin->list, &queue->pins);
+	queue->npins++;
+
+	buf->pages = NULL;
+	buf->npages = 0;
+	buf->sglist = NULL;
+	buf->sglen = 0;
+	buf->skip_cache = false;
+	memset(&buf->vma, 0, sizeof(buf->vma));
+}
+
+/*
+ * isp_video_buffer_adopt - Take over a cached memory area
+ */
+static void isp_video_buffer_adopt(struct isp_video_buffer *buf,
+				   struct isp_video_pin *pin)
+{
+	buf->vma = pin->vma;
+	buf->vm_flags = pin->vm_flags;
+	buf->offset = pin->offset;
+	buf->npages = pin->npages;
+	buf->pages = pin->pages;
+	buf->paddr = pin->paddr;
+	buf->sglen = pin->sglen;
+	buf->sglist = pin->sglist;
+	buf->skip_cache = pin->skip_cache;
+
+	kfree(pin);
+}
+
+/* -----------------------------------------------------------------------------
+ * Video buffers preparation
+ */
+
 /*
  * isp_video_buffer_prepare_user - Pin userspace VMA pages to memory.
  *
@@ -437,6 +649,16 @@ static int isp_video_buffer_prepare_vm_flags(struct isp_video_buffer *buf)
 		if (start == buf->vbuf.m.userptr) {
 			buf->vm_flags = vma->vm_flags;
 			vm_page_prot = vma->vm_page_prot;
+
+			buf->vma.mm = current->mm;
+			buf->vma.vma = vma;
+			buf->vma.vm_start = vma->vm_start;
+			buf->vma.vm_end = vma->vm_end;
+			buf->vma.vm_pgoff = vma->vm_pgoff;
+			buf->vma.vm_file = vma->vm_file;
+		} else {
+			/* Buffers spanning several VMAs can't be cached. */
+			buf->vma.vma = NULL;
 		}
 
 		if ((buf->vm_flags ^ vma->vm_flags) & VM_PFNMAP)
@@ -473,13 +695,18 @@ done:
  * - mapping buffers for DMA operation
  * - performing driver-specific preparation
  *
+ * USERPTR buffers whose memory area is found in the pin cache skip all steps
+ * but the driver-specific preparation.
+ *
  * The function must be called in userspace context with a valid mm context
  * (this excludes cleanup paths such as sys_close when the userspace process
  * segfaults).
  */
 static int isp_video_buffer_prepare(struct isp_video_buffer *buf)
 {
+	struct isp_video_queue *queue = buf->queue;
 	enum dma_data_direction direction;
+	struct isp_video_pin *pin;
 	int ret;
 
 	switch (buf->vbuf.memory) {
@@ -488,6 +715,17 @@ static int isp_video_buffer_prepare(struct isp_video_buffer *buf)
 		break;
 
 	case V4L2_MEMORY_USERPTR:
+		pin = isp_video_pin_lookup(queue, buf->vbuf.m.userptr,
+					   buf->vbuf.length);
+		if (pin != NULL) {
+			queue->stats.pin_hits++;
+			isp_video_buffer_adopt(buf, pin);
+			ret = 0;
+			goto prepare;
+		}
+
+		queue->stats.pin_misses++;
+
 		ret = isp_video_buffer_prepare_vm_flags(buf);
 		if (ret < 0)
 			return ret;
@@ -497,12 +735,14 @@ static int isp_video_buffer_prepare(struct isp_video_buffer *buf)
 			if (ret < 0)
 				return ret;
 
+			buf->vma.pfn = buf->paddr >> PAGE_SHIFT;
 			ret = isp_video_buffer_sglist_pfnmap(buf);
 		} else {
 			ret = isp_video_buffer_prepare_user(buf);
 			if (ret < 0)
 				return ret;
 
+			buf->vma.pfn = page_to_pfn(buf->pages[0]);
 			ret = isp_video_buffer_sglist_user(buf);
 		}
 		break;
@@ -525,8 +765,9 @@ static int isp_video_buffer_prepare(struct isp_video_buffer *buf)
 		}
 	}
 
-	if (buf->queue->ops->buffer_prepare)
-		ret = buf->queue->ops->buffer_prepare(buf);
+prepare:
+	if (queue->ops->buffer_prepare)
+		ret = queue->ops->buffer_prepare(buf);
 
 done:
 	if (ret < 0) {
@@ -623,6 +864,8 @@ static int isp_video_queue_free(struct isp_video_queue *queue)
 		queue->buffers[i] = NULL;
 	}
 
+	isp_video_pin_cache_flush(queue);
+
 	INIT_LIST_HEAD(&queue->queue);
 	queue->count = 0;
 	return 0;
@@ -733,6 +976,7 @@ int omap3isp_video_queue_init(struct isp_video_queue *queue,
 			      struct device *dev, unsigned int bufsize)
 {
 	INIT_LIST_HEAD(&queue->queue);
+	INIT_LIST_HEAD(&queue->pins);
 	mutex_init(&queue->lock);
 	spin_lock_init(&queue->irqlock);
 
@@ -841,14 +1085,22 @@ done:
  * queue is streaming, to the IRQ queue.
  *
  * Before being enqueued, USERPTR buffers are checked for address changes. If
- * the buffer has a different userspace address, the old memory area is unlocked
- * and the new memory area is locked.
+ * the buffer has a different userspace address, the old memory area is moved
+ * to the pin cache and the new memory area is looked up in the cache or locked.
+ * Buffers whose VMA has been replaced since they were prepared are prepared
+ * again.
+ *
+ * The time spent preparing and queueing the buffer is recorded in the queue
+ * statistics.
  */
 int omap3isp_video_queue_qbuf(struct isp_video_queue *queue,
 			      struct v4l2_buffer *vbuf)
 {
 	struct isp_video_buffer *buf;
 	unsigned long flags;
+	ktime_t start;
+	s64 prepare = 0;
+	s64 elapsed;
 	int ret = -EINVAL;
 
 	if (vbuf->type != queue->type)
@@ -856,6 +1108,8 @@ int omap3isp_video_queue_qbuf(struct isp_video_queue *queue,
 
 	mutex_lock(&queue->lock);
 
+	start = ktime_get();
+
 	if (vbuf->index >= queue->count)
 		goto done;
 
@@ -873,9 +1127,17 @@ int omap3isp_video_queue_qbuf(struct isp_video_queue *queue,
 
 	if (vbuf->memory == V4L2_MEMORY_USERPTR &&
 	    vbuf->m.userptr != buf->vbuf.m.userptr) {
-		isp_video_buffer_cleanup(buf);
+		isp_video_buffer_park(buf);
 		buf->vbuf.m.userptr = vbuf->m.userptr;
 		buf->prepared = 0;
+	} else if (vbuf->memory == V4L2_MEMORY_USERPTR && buf->prepared &&
+		   buf->vma.vma != NULL &&
+		   !isp_video_vma_valid(&buf->vma, buf->vbuf.m.userptr)) {
+		/* The memory area has been unmapped and something else has
+		 * been mapped at the same address, pin the new pages.
+		 */
+		isp_video_buffer_cleanup(buf);
+		buf->prepared = 0;
 	}
 
 	if (!buf->prepared) {
@@ -883,6 +1145,13 @@ int omap3isp_video_queue_qbuf(struct isp_video_queue *queue,
 		if (ret < 0)
 			goto done;
 		buf->prepared = 1;
+
+		prepare = ktime_to_ns(ktime_sub(ktime_get(), start));
+		queue->stats.prepares++;
+		queue->stats.prepare_last = prepare;
+		queue->stats.prepare_total += prepare;
+		if (prepare > queue->stats.prepare_max)
+			queue->stats.prepare_max = prepare;
 	}
 
 	isp_video_buffer_cache_sync(buf);
@@ -896,6 +1165,16 @@ int omap3isp_video_queue_qbuf(struct isp_video_queue *queue,
 		spin_unlock_irqrestore(&queue->irqlock, flags);
 	}
 
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+	queue->stats.frames++;
+	queue->stats.queue_last = elapsed;
+	queue->stats.queue_total += elapsed;
+	if (elapsed > queue->stats.queue_max)
+		queue->stats.queue_max = elapsed;
+
+	dev_dbg(queue->dev, "buffer %u queued in %lld ns (prepare %lld ns)\n",
+		buf->vbuf.index, elapsed, prepare);
+
 	ret = 0;
 
 done:
@@ -968,6 +1247,7 @@ int omap3isp_video_queue_streamon(struct isp_video_queue *queue)
 		goto done;
 
 	queue->streaming = 1;
+	memset(&queue->stats, 0, sizeof(queue->stats));
 
 	spin_lock_irqsave(&queue->irqlock, flags);
 	list_for_each_entry(buf, &queue->queue, stream)
@@ -1002,6 +1282,18 @@ void omap3isp_video_queue_streamoff(struct isp_video_queue *queue)
 
 	queue->streaming = 0;
 
+	if (queue->stats.frames)
+		dev_dbg(queue->dev, "%u frames, qbuf avg %lld max %lld ns, "
+			"%u prepares avg %lld max %lld ns, pin cache %u/%u\n",
+			queue->stats.frames,
+			div_s64(queue->stats.queue_total, queue->stats.frames),
+			queue->stats.queue_max, queue->stats.prepares,
+			queue->stats.prepares ?
+			div_s64(queue->stats.prepare_total,
+				queue->stats.prepares) : 0,
+			queue->stats.prepare_max, queue->stats.pin_hits,
+			queue->stats.pin_hits + queue->stats.pin_misses);
+
 	spin_lock_irqsave(&queue->irqlock, flags);
 	for (i = 0; i < queue->count; ++i) {
 		buf = queue->buffers[i];
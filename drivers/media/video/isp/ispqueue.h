@@ -37,6 +37,7 @@ struct page;
 struct scatterlist;
 
 #define ISP_VIDEO_MAX_BUFFERS		16
+#define ISP_VIDEO_PIN_CACHE_SIZE	ISP_VIDEO_MAX_BUFFERS
 
 /**
  * enum isp_video_buffer_state - ISP video buffer state
@@ -59,6 +60,27 @@ enum isp_video_buffer_state {
 	ISP_BUF_STATE_DONE,
 };
 
+/**
+ * struct isp_video_vma - Identity of the VMA backing a userspace buffer
+ * @mm: Memory management context the VMA belongs to
+ * @vma: VMA covering the whole buffer, or NULL if the buffer spans several
+ *	VMAs (such buffers are never cached)
+ * @vm_start: VMA start address at pinning time
+ * @vm_end: VMA end address at pinning time
+ * @vm_pgoff: VMA page offset at pinning time
+ * @vm_file: VMA backing file at pinning time
+ * @pfn: Page frame mapped at the buffer start address at pinning time
+ */
+struct isp_video_vma {
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long vm_pgoff;
+	struct file *vm_file;
+	unsigned long pfn;
+};
+
 /**
  * struct isp_video_buffer - ISP video buffer
  * @vma_use_count: Number of times the buffer is mmap'ed to userspace
@@ -68,6 +90,7 @@ enum isp_video_buffer_state {
  * @skip_cache: Whether to skip cache management operations for this buffer
  * @vaddr: Memory virtual address (for kernel buffers)
  * @vm_flags: Buffer VMA flags (for userspace buffers)
+ * @vma: Identity of the buffer VMA (for userspace buffers)
  * @offset: Offset inside the first page (for userspace buffers)
  * @npages: Number of pages (for userspace buffers)
  * @pages: Pages table (for userspace non-VM_PFNMAP buffers)
@@ -91,6 +114,7 @@ struct isp_video_buffer {
 
 	/* For userspace buffers. */
 	unsigned long vm_flags;
+	struct isp_video_vma vma;
 	unsigned long offset;
 	unsigned int npages;
 	struct page **pages;
@@ -109,6 +133,59 @@ struct isp_video_buffer {
 
 #define to_isp_video_buffer(vb)	container_of(vb, struct isp_video_buffer, vb)
 
+/**
+ * struct isp_video_pin - Pinned and DMA-mapped userspace memory area
+ * @list: List head for insertion into the queue pin cache (LRU order)
+ * @userptr: Userspace address of the memory area
+ * @length: Length of the memory area in bytes
+ * @vma: Identity of the VMA backing the memory area
+ *
+ * The remaining fields hold the pinning state taken over from the
+ * isp_video_buffer that last used the memory area, see the isp_video_buffer
+ * structure for their description.
+ */
+struct isp_video_pin {
+	struct list_head list;
+	unsigned long userptr;
+	unsigned long length;
+	struct isp_video_vma vma;
+
+	unsigned long vm_flags;
+	unsigned long offset;
+	unsigned int npages;
+	struct page **pages;
+	dma_addr_t paddr;
+	unsigned int sglen;
+	struct scatterlist *sglist;
+	bool skip_cache;
+};
+
+/**
+ * struct isp_video_queue_stats - Video buffers queue timing statistics
+ * @frames: Number of buffers queued
+ * @prepares: Number of buffers prepared (pinned and mapped)
+ * @pin_hits: Number of USERPTR preparations served from the pin cache
+ * @pin_misses: Number of USERPTR preparations that had to pin memory
+ * @prepare_last: Duration of the last buffer preparation (ns)
+ * @prepare_max: Maximum buffer preparation duration (ns)
+ * @prepare_total: Cumulated buffer preparation duration (ns)
+ * @queue_last: Duration of the last VIDIOC_QBUF operation (ns)
+ * @queue_max: Maximum VIDIOC_QBUF duration (ns)
+ * @queue_total: Cumulated VIDIOC_QBUF duration (ns)
+ */
+struct isp_video_queue_stats {
+	unsigned int frames;
+	unsigned int prepares;
+	unsigned int pin_hits;
+	unsigned int pin_misses;
+	s64 prepare_last;
+	s64 prepare_max;
+	s64 prepare_total;
+	s64 queue_last;
+	s64 queue_max;
+	s64 queue_total;
+};
+
 /**
  * struct isp_video_queue_operations - Driver-specific operations
  * @queue_prepare: Called before allocating buffers. Drivers should clamp the
@@ -145,6 +222,9 @@ struct isp_video_queue_operations {
  * @irqlock: Spinlock to protect access to the IRQ queue
  * @streaming: Queue state, indicates whether the queue is streaming
  * @queue: List of all queued buffers
+ * @pins: Cache of pinned USERPTR memory areas not used by any buffer
+ * @npins: Number of entries in the pin cache
+ * @stats: Timing statistics
  */
 struct isp_video_queue {
 	enum v4l2_buf_type type;
@@ -160,6 +240,11 @@ struct isp_video_queue {
 	unsigned int streaming:1;
 
 	struct list_head queue;
+
+	struct list_head pins;
+	unsigned int npins;
+
+	struct isp_video_queue_stats stats;
 };
 
 int omap3isp_video_queue_cleanup(struct isp_video_queue *queue);
@@ -31,12 +31,14 @@
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/omap3isp.h>
 #include <media/v4l2-dev.h>
 #include <media/v4l2-ioctl.h>
 #include <plat/iommu.h>
 #include <plat/iovmm.h>
 #include <plat/omap-pm.h>
 
+#include "ispdisplay.h"
 #include "ispvideo.h"
 #include "isp.h"
 
@@ -643,9 +645,13 @@ struct isp_buffer *omap3isp_video_buffer_next(struct isp_video *video,
 	else
 		buf->vbuf.sequence = atomic_read(&pipe->frame_number);
 
-	buf->state = error ? ISP_BUF_STATE_ERROR : ISP_BUF_STATE_DONE;
-
-	wake_up(&buf->wait);
+	/* Completed buffers are recycled in the kernel when the capture is
+	 * linked to a display overlay.
+	 */
+	if (!omap3isp_display_frame_done(video, buf, error)) {
+		buf->state = error ? ISP_BUF_STATE_ERROR : ISP_BUF_STATE_DONE;
+		wake_up(&buf->wait);
+	}
 
 	if (list_empty(&video->dmaqueue)) {
 		if (queue->type == V4L2_BUF_TYPE_VIDEO_CAPTURE)
@@ -1125,6 +1131,7 @@ isp_video_streamoff(struct file *file, void *fh, enum v4l2_buf_type type)
 
 	/* Stop the stream. */
 	omap3isp_pipeline_set_stream(pipe, ISP_PIPELINE_STREAM_STOPPED);
+	omap3isp_display_stop(video);
 	omap3isp_video_queue_streamoff(&vfh->queue);
 	video->queue = NULL;
 	video->streaming = 0;
@@ -1164,6 +1171,29 @@ isp_video_s_input(struct file *file, void *fh, unsigned int input)
 	return input == 0 ? 0 : -EINVAL;
 }
 
+static long
+isp_video_ioctl_default(struct file *file, void *fh, bool valid_prio, int cmd,
+			void *arg)
+{
+	struct isp_video_fh *vfh = to_isp_video_fh(fh);
+	struct isp_video *video = video_drvdata(file);
+	int ret;
+
+	switch (cmd) {
+	case VIDIOC_OMAP3ISP_DISPLAY:
+		mutex_lock(&video->stream_lock);
+		if (video->streaming && video->queue != &vfh->queue)
+			ret = -EBUSY;
+		else
+			ret = omap3isp_display_config(video, vfh, arg);
+		mutex_unlock(&video->stream_lock);
+		return ret;
+
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct v4l2_ioctl_ops isp_video_ioctl_ops = {
 	.vidioc_querycap		= isp_video_querycap,
 	.vidioc_g_fmt_vid_cap		= isp_video_get_format,
@@ -1186,6 +1216,7 @@ static const struct v4l2_ioctl_ops isp_video_ioctl_ops = {
 	.vidioc_enum_input		= isp_video_enum_input,
 	.vidioc_g_input			= isp_video_g_input,
 	.vidioc_s_input			= isp_video_s_input,
+	.vidioc_default			= isp_video_ioctl_default,
 };
 
 /* -----------------------------------------------------------------------------
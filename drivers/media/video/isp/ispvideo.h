@@ -175,6 +175,9 @@ struct isp_video {
 	enum isp_video_dmaqueue_flags dmaqueue_flags;
 
 	const struct isp_video_operations *ops;
+
+	/* Capture to display overlay link */
+	struct isp_display *display;
 };
 
 #define to_isp_video(vdev)	container_of(vdev, struct isp_video, video)
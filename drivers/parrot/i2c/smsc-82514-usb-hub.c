@@ -25,6 +25,7 @@
 #include <plat/gpio.h>
 
 #include "smsc-82514-usb-hub.h"
+#include "../parrot_async.h"
 
 
 #define SMSC_USB82514_DRV_NAME		"smsc82514"
@@ -109,8 +110,13 @@ static u8 smsc82514_init_seq[][2] = {
 
 #define SMSC82514_INIT_SEQ_SIZE  ARRAY_SIZE(smsc82514_init_seq)
 
-static int smsc82514_init_client(struct i2c_client *client)
+/*
+ * PARROT_ASYNC_USB_HUB step: runs on an async thread, the reset delays
+ * sleep so that the other boot steps go on meanwhile.
+ */
+static int smsc82514_init_client(void *arg)
 {
+	struct i2c_client *client = arg;
 	int i;
 	struct i2c_msg xfer[2];
 	u8 dout[3];
@@ -120,12 +126,12 @@ static int smsc82514_init_client(struct i2c_client *client)
 	if( data->ds_data.reset_pin ){
 		gpio_set_value(data->ds_data.reset_pin, 0);
 
-		mdelay(20);
+		msleep(20);
 
 		gpio_set_value(data->ds_data.reset_pin, 1);
 	}
 
-	mdelay(10);
+	msleep(10);
 
 	xfer[0].addr	= client->addr;
 	xfer[0].flags	= 0;
@@ -211,8 +217,11 @@ static int smsc82514_probe(struct i2c_client *client, const struct i2c_device_id
 	data->client = client;
 	i2c_set_clientdata(client, data);
 
-	/* Initialize chip */
-	ret = smsc82514_init_client(client);
+	/* Initialize chip, EHCI is registered once it is done */
+	ret = parrot_async_run(PARROT_ASYNC_USB_HUB, 0,
+			       smsc82514_init_client, client);
+	if (ret)
+		kfree(data);
 
 exit:
 	return ret;
@@ -222,6 +231,7 @@ static int __devexit smsc82514_remove(struct i2c_client *client)
 {
 	struct smsc82514_data *data = i2c_get_clientdata(client);
 
+	parrot_async_wait(PARROT_ASYNC(PARROT_ASYNC_USB_HUB));
 	kfree(data);
 	return 0;
 }
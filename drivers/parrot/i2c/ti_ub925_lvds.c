@@ -4,42 +4,80 @@
 #include <linux/i2c.h>
 #include <linux/interrupt.h>
 #include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
 
+#include "../parrot_async.h"
 
+/* Serializer registers */
+#define TI_LVDS_REG_CONFIG1	0x03	/* bit 3: remote I2C pass-through */
+#define TI_LVDS_REG_DES_ID	0x06	/* remote deserializer address << 1 */
+#define TI_LVDS_REG_I2C_CTRL	0x17	/* bit 7: pass all remote I2C */
+#define TI_LVDS_REG_ICR		0xc6	/* interrupt control */
+#define TI_LVDS_REG_ISR		0xc7	/* interrupt status, clear on read */
+#define TI_LVDS_REG_TX_ID	0xf0	/* "_UB925", 6 bytes */
+
+#define TI_LVDS_ICR_INT_EN	0x01
+#define TI_LVDS_ICR_IE_RX_INT	0x20	/* interrupt from the deserializer */
+#define TI_LVDS_ISR_IS_INT	0x01
+
+/* Deserializer registers */
+#define TI_LVDS_DES_REG_SCL_HIGH	0x26
+#define TI_LVDS_DES_REG_SCL_LOW		0x27
+
+#define TI_LVDS_MAX_BATCH	8
 
 #define LVDS_MAXIRQ 2
 struct ti_lvds_data {
 	struct i2c_client *client;
+	bool irq_requested;
+	/* time of the last back-channel interrupt */
+	ktime_t irq_time;
+	u32 irq_count;
+	u32 irq_spurious;
 };
 
+/* one register write, to the serializer or to a remote device */
+struct ti_lvds_reg {
+	u16 addr;	/* 0 for the serializer */
+	u8 reg;
+	u8 val;
+};
+
+/* Latency from the back-channel interrupt to the client handler, in us */
+struct lvds_irq_stats {
+	u32 count;
+	u32 handled;
+	u32 lat_avg;
+	u32 lat_max;
+};
 
 /* data */
 static struct {
 	irq_handler_t handler;
 	void *dev_id;
+	struct lvds_irq_stats stats;
 } lvds_irq [LVDS_MAXIRQ];
 
-static DEFINE_SPINLOCK(ldvs_lock);
+/* held while dispatching, so lvds_free_irq() waits for the handler */
+static DEFINE_MUTEX(lvds_irq_lock);
 
 /* func */
-static int _ti_lvds_read_reg(struct i2c_client *client, int addr,
-			       u8 reg)
+static int _ti_lvds_read_regs(struct i2c_client *client, int addr,
+			       u8 reg, u8 *buf, int len)
 {
 	struct i2c_msg xfer[2];
-	u8 buf[1];
-
-	buf[0] = reg & 0xff;
 
 	/* Write register */
 	xfer[0].addr = addr;
 	xfer[0].flags = 0;
 	xfer[0].len = 1;
-	xfer[0].buf = buf;
+	xfer[0].buf = &reg;
 
 	/* Read data */
 	xfer[1].addr = addr;
 	xfer[1].flags = I2C_M_RD;
-	xfer[1].len = 1;
+	xfer[1].len = len;
 	xfer[1].buf = buf;
 
 	if (i2c_transfer(client->adapter, xfer, 2) != 2) {
@@ -47,80 +85,91 @@ static int _ti_lvds_read_reg(struct i2c_client *client, int addr,
 		return -EIO;
 	}
 
-	return buf[0];
+	return 0;
 }
+
 static int ti_lvds_read_reg(struct i2c_client *client,
 			       u8 reg)
 {
-	return _ti_lvds_read_reg(client, client->addr, reg);
-}
+	u8 val;
+	int ret;
 
-static int ti_lvds_read_write(struct i2c_client *client,
-			       u8 reg, u8 val)
-{
-	char buff[2] = {reg, val};
-	if (i2c_master_send(client, buff, 2) != 2) {
-		dev_err(&client->dev, "%s: i2c transfer failed\n", __func__);
-		return -EIO;
-	}
-	return 0;
+	ret = _ti_lvds_read_regs(client, client->addr, reg, &val, 1);
+	return ret ? ret : val;
 }
 
-static int _ti_lvds_read_write(struct i2c_client *client, int addr,
-			       u8 reg, u8 val)
+/* Write a register sequence as one combined I2C transfer. */
+static int ti_lvds_write_seq(struct i2c_client *client,
+			     const struct ti_lvds_reg *seq, int len)
 {
-	char buff[2] = {reg, val};
-	struct i2c_msg msg;
-	int ret;
+	struct i2c_msg msg[TI_LVDS_MAX_BATCH];
+	u8 buf[TI_LVDS_MAX_BATCH][2];
+	int i;
 
-	msg.addr = addr;
-	msg.flags = client->flags & I2C_M_TEN;
-	msg.len = 2;
-	msg.buf = (char *)buff;
+	if (WARN_ON(len > TI_LVDS_MAX_BATCH))
+		return -EINVAL;
 
-	ret = i2c_transfer(client->adapter, &msg, 1);
+	for (i = 0; i < len; i++) {
+		buf[i][0] = seq[i].reg;
+		buf[i][1] = seq[i].val;
+		msg[i].addr = seq[i].addr ? seq[i].addr : client->addr;
+		msg[i].flags = client->flags & I2C_M_TEN;
+		msg[i].len = 2;
+		msg[i].buf = buf[i];
+	}
 
-	if (ret == 1) {
-		dev_err(&client->dev, "%s: i2c transfer failed\n", __func__);
+	if (i2c_transfer(client->adapter, msg, len) != len)
 		return -EIO;
-	}
+
 	return 0;
 }
 
 static int ti_lvds_initialize(struct ti_lvds_data *data)
 {
 	struct i2c_client *client = data->client;
-	int remote;
-
-	if (ti_lvds_read_reg(client, 0xF0) != '_')
-		return -ENODEV;
-	if (ti_lvds_read_reg(client, 0xF1) != 'U')
-		return -ENODEV;
-	if (ti_lvds_read_reg(client, 0xF2) != 'B')
-		return -ENODEV;
-	if (ti_lvds_read_reg(client, 0xF3) != '9')
+	static const struct ti_lvds_reg seq[] = {
+		/* i2c pass thu */
+		{ 0, TI_LVDS_REG_CONFIG1, 0xda },
+		/* i2c pass all */
+		{ 0, TI_LVDS_REG_I2C_CTRL, 0xde },
+		/* irq ena */
+		{ 0, TI_LVDS_REG_ICR,
+		  TI_LVDS_ICR_INT_EN | TI_LVDS_ICR_IE_RX_INT },
+	};
+	struct ti_lvds_reg remote_seq[] = {
+		/* remote i2c speed */
+		{ 0, TI_LVDS_DES_REG_SCL_HIGH, 0x25 },
+		{ 0, TI_LVDS_DES_REG_SCL_LOW, 0x25 },
+	};
+	u8 id[6];
+	int remote, ret;
+
+	if (_ti_lvds_read_regs(client, client->addr, TI_LVDS_REG_TX_ID,
+			       id, sizeof(id)))
 		return -ENODEV;
-	if (ti_lvds_read_reg(client, 0xF4) != '2')
-		return -ENODEV;
-	if (ti_lvds_read_reg(client, 0xF5) != '5')
+	if (memcmp(id, "_UB925", sizeof(id)))
 		return -ENODEV;
 
-	remote = ti_lvds_read_reg(client, 0x6);
+	remote = ti_lvds_read_reg(client, TI_LVDS_REG_DES_ID);
+	if (remote < 0)
+		return -ENODEV;
 	remote >>= 1;
 	if (!remote)
 		return -ENODEV;
 
-	/* i2c pass thu */
-	ti_lvds_read_write(client, 0x3, 0xda);
-	/* i2c pass all */
-	ti_lvds_read_write(client, 0x17, 0xde);
-	/* irq ena */
-	ti_lvds_read_write(client, 0xc6, 0x21);
+	ret = ti_lvds_write_seq(client, seq, ARRAY_SIZE(seq));
+	if (ret) {
+		dev_err(&client->dev, "%s: i2c transfer failed\n", __func__);
+		return ret;
+	}
 
-	_ti_lvds_read_write(client, remote, 0x26, 0x25);
-	_ti_lvds_read_write(client, remote, 0x27, 0x25);
+	/* The deserializer may not be up yet, it keeps its default speed */
+	remote_seq[0].addr = remote;
+	remote_seq[1].addr = remote;
+	if (ti_lvds_write_seq(client, remote_seq, ARRAY_SIZE(remote_seq)))
+		dev_warn(&client->dev, "remote 0x%02x: no i2c speed setup\n",
+			 remote);
 
-	/* remote i2c speed */
 	return 0;
 }
 
@@ -146,77 +195,140 @@ static int ti_lvds_initialize(struct ti_lvds_data *data)
 }
 #endif
 
+static irqreturn_t lvds_hardirq(int irq, void *dev_id)
+{
+	struct ti_lvds_data *data = dev_id;
+
+	data->irq_time = ktime_get();
+	return IRQ_WAKE_THREAD;
+}
+
+/*
+ * The status is read once, which acks the serializer, and every client is
+ * called once. The INTB line goes up on the read: anything that comes
+ * in during the dispatch is a new edge and a new run of this thread.
+ */
 static irqreturn_t lvds_interrupt(int irq, void *dev_id)
 {
 	struct ti_lvds_data *data = dev_id;
 	struct i2c_client *client = data->client;
-	int status = ti_lvds_read_reg(client, 0xc7);
-	if (!status)
-		printk("%s spurious irq ???\n", __func__);
-
-	do {
-		int r = 0;
-		int i;
-
-		for (i = 0; i < LVDS_MAXIRQ; i++) {
-			if (!lvds_irq[i].handler)
-				continue;
-			r = lvds_irq[i].handler(irq, lvds_irq[i].dev_id);
-			if (r)
-				break;
-		}
-		/* no irq handle for all handler */
-		if (!r)
-			break;
+	int status = ti_lvds_read_reg(client, TI_LVDS_REG_ISR);
+	int i;
+
+	data->irq_count++;
+	if (status <= 0 || !(status & TI_LVDS_ISR_IS_INT))
+		data->irq_spurious++;
+
+	mutex_lock(&lvds_irq_lock);
+	for (i = 0; i < LVDS_MAXIRQ; i++) {
+		struct lvds_irq_stats *stats = &lvds_irq[i].stats;
+		u32 lat;
 
-		/* ack lvds */
-		ti_lvds_read_reg(client, 0xc7);
-	} while (1);
+		if (!lvds_irq[i].handler)
+			continue;
+
+		lat = ktime_us_delta(ktime_get(), data->irq_time);
+		if (stats->count++)
+			stats->lat_avg += ((s32)lat - (s32)stats->lat_avg) / 8;
+		else
+			stats->lat_avg = lat;
+		stats->lat_max = max(stats->lat_max, lat);
+
+		if (lvds_irq[i].handler(irq, lvds_irq[i].dev_id) == IRQ_HANDLED)
+			stats->handled++;
+	}
+	mutex_unlock(&lvds_irq_lock);
 
 	return IRQ_HANDLED;
 }
 
-static int __devinit ti_lvds_probe(struct i2c_client *client,
-		const struct i2c_device_id *id)
+static ssize_t ti_lvds_irq_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
 {
-	const struct ti_lvds_platform_data *pdata = client->dev.platform_data;
-	struct ti_lvds_data *data;
-	int error;
+	struct ti_lvds_data *data = i2c_get_clientdata(to_i2c_client(dev));
+	ssize_t len;
+	int i;
 
-	data = kzalloc(sizeof(*data), GFP_KERNEL);
+	len = sprintf(buf, "interrupts %u spurious %u\n",
+		      data->irq_count, data->irq_spurious);
 
-	data->client = client;
+	mutex_lock(&lvds_irq_lock);
+	for (i = 0; i < LVDS_MAXIRQ; i++) {
+		struct lvds_irq_stats *stats = &lvds_irq[i].stats;
+
+		if (!lvds_irq[i].handler)
+			continue;
+		len += sprintf(buf + len, "%pf: calls %u handled %u "
+			       "latency avg %u us max %u us\n",
+			       lvds_irq[i].handler, stats->count,
+			       stats->handled, stats->lat_avg, stats->lat_max);
+	}
+	mutex_unlock(&lvds_irq_lock);
 
+	return len;
+}
 
-	i2c_set_clientdata(client, data);
+static DEVICE_ATTR(irq_stats, S_IRUGO, ti_lvds_irq_stats_show, NULL);
+
+/* PARROT_ASYNC_LVDS step, the touchscreen behind the link waits for it */
+static int ti_lvds_start(void *arg)
+{
+	struct ti_lvds_data *data = arg;
+	struct i2c_client *client = data->client;
+	int error;
 
 	error = ti_lvds_initialize(data);
-	if (error)
-		goto err_free_object;
+	if (error) {
+		dev_err(&client->dev, "no serializer or remote (%d)\n", error);
+		return error;
+	}
 
-	error = request_threaded_irq(client->irq, NULL, lvds_interrupt,
+	error = request_threaded_irq(client->irq, lvds_hardirq, lvds_interrupt,
 			IRQF_TRIGGER_FALLING, client->dev.driver->name, data);
 	if (error) {
 		dev_err(&client->dev, "Failed to register interrupt\n");
-		goto err_free_object;
+		return error;
 	}
-	ti_lvds_read_reg(client, 0xc7);
-
+	data->irq_requested = true;
+	ti_lvds_read_reg(client, TI_LVDS_REG_ISR);
 
+	if (device_create_file(&client->dev, &dev_attr_irq_stats))
+		dev_warn(&client->dev, "no irq_stats attribute\n");
 
 	return 0;
+}
 
-err_free_object:
-	kfree(data);
+static int __devinit ti_lvds_probe(struct i2c_client *client,
+		const struct i2c_device_id *id)
+{
+	struct ti_lvds_data *data;
+	int error;
+
+	data = kzalloc(sizeof(*data), GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
+	data->client = client;
+	i2c_set_clientdata(client, data);
+
+	error = parrot_async_run(PARROT_ASYNC_LVDS, 0, ti_lvds_start, data);
+	if (error) {
+		kfree(data);
+		return error;
+	}
 
-	return error;
+	return 0;
 }
 
 static int __devexit ti_lvds_remove(struct i2c_client *client)
 {
 	struct ti_lvds_data *data = i2c_get_clientdata(client);
 
-	free_irq(client->irq, data);
+	parrot_async_wait(PARROT_ASYNC(PARROT_ASYNC_LVDS));
+	if (data->irq_requested) {
+		device_remove_file(&client->dev, &dev_attr_irq_stats);
+		free_irq(client->irq, data);
+	}
 	kfree(data);
 
 	return 0;
@@ -257,25 +369,27 @@ int
 lvds_request_irq(unsigned int irq, irq_handler_t handler, unsigned long flags1,
 	    const char *name, void *dev)
 {
-	unsigned long flags;
 	int i;
-	spin_lock_irqsave(&ldvs_lock, flags);
+
+	mutex_lock(&lvds_irq_lock);
 	for (i = 0; i < LVDS_MAXIRQ; i++) {
 		if (!lvds_irq[i].handler) {
 			lvds_irq[i].dev_id = dev;
 			lvds_irq[i].handler = handler;
+			memset(&lvds_irq[i].stats, 0,
+			       sizeof(lvds_irq[i].stats));
 			break;
 		}
 	}
-	spin_unlock_irqrestore(&ldvs_lock, flags);
+	mutex_unlock(&lvds_irq_lock);
 	return i == LVDS_MAXIRQ ? -EINVAL : 0;
 }
 
 void lvds_free_irq(unsigned int irq, void *dev_id)
 {
-	unsigned long flags;
 	int i;
-	spin_lock_irqsave(&ldvs_lock, flags);
+
+	mutex_lock(&lvds_irq_lock);
 	for (i = 0; i < LVDS_MAXIRQ; i++) {
 		if (lvds_irq[i].dev_id == dev_id ) {
 			lvds_irq[i].handler = NULL;
@@ -283,9 +397,8 @@ void lvds_free_irq(unsigned int irq, void *dev_id)
 			break;
 		}
 	}
-	spin_unlock_irqrestore(&ldvs_lock, flags);
+	mutex_unlock(&lvds_irq_lock);
 }
 
 EXPORT_SYMBOL(lvds_request_irq);
 EXPORT_SYMBOL(lvds_free_irq);
-
@@ -25,6 +25,7 @@
 #include <linux/earlysuspend.h>
 #endif
 #include "../../i2c/ti_ub925_lvds.h"
+#include "../../parrot_async.h"
 
 /* Family ID */
 #define MXT224_ID		0x80
@@ -2487,17 +2488,17 @@ static int mxt_initialize_input_device(struct mxt_data *data)
 	return 0;
 }
 
-static int __devinit mxt_probe(struct i2c_client *client,
-		const struct i2c_device_id *id)
+/*
+ * PARROT_ASYNC_TOUCH step. The controller may be reached through the
+ * LVDS serializer I2C pass-through, so it runs after PARROT_ASYNC_LVDS.
+ */
+static int mxt_start(void *arg)
 {
+	struct i2c_client *client = arg;
 	const struct mxt_platform_data *pdata = client->dev.platform_data;
 	struct mxt_data *data;
 	int error;
 
-
-	if (!pdata)
-		return -EINVAL;
-
 	data = kzalloc(sizeof(struct mxt_data), GFP_KERNEL);
 	if (!data) {
 		dev_err(&client->dev, "Failed to allocate memory\n");
@@ -2575,12 +2576,30 @@ err_free_object:
 	kfree(data->object_table);
 err_free_data:
 	kfree(data);
+	i2c_set_clientdata(client, NULL);
+	dev_err(&client->dev, "initialization failed (%d)\n", error);
 	return error;
 }
 
+static int __devinit mxt_probe(struct i2c_client *client,
+		const struct i2c_device_id *id)
+{
+	if (!client->dev.platform_data)
+		return -EINVAL;
+
+	return parrot_async_run(PARROT_ASYNC_TOUCH,
+				PARROT_ASYNC(PARROT_ASYNC_LVDS),
+				mxt_start, client);
+}
+
 static int __devexit mxt_remove(struct i2c_client *client)
 {
-	struct mxt_data *data = i2c_get_clientdata(client);
+	struct mxt_data *data;
+
+	parrot_async_wait(PARROT_ASYNC(PARROT_ASYNC_TOUCH));
+	data = i2c_get_clientdata(client);
+	if (!data)
+		return 0;
 
 	sysfs_remove_bin_file(&client->dev.kobj, &data->mem_access_attr);
 	sysfs_remove_group(&client->dev.kobj, &mxt_attr_group);
@@ -2604,7 +2623,12 @@ static int mxt_suspend(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 	struct mxt_data *data = i2c_get_clientdata(client);
-	struct input_dev *input_dev = data->input_dev;
+	struct input_dev *input_dev;
+
+	/* initialization failed */
+	if (!data)
+		return 0;
+	input_dev = data->input_dev;
 
 	mutex_lock(&input_dev->mutex);
 
@@ -2620,7 +2644,12 @@ static int mxt_resume(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 	struct mxt_data *data = i2c_get_clientdata(client);
-	struct input_dev *input_dev = data->input_dev;
+	struct input_dev *input_dev;
+
+	/* initialization failed */
+	if (!data)
+		return 0;
+	input_dev = data->input_dev;
 
 	/* Soft reset */
 	mxt_write_object(data, MXT_GEN_COMMAND_T6,
@@ -2666,6 +2695,10 @@ static void mxt_shutdown(struct i2c_client *client)
 {
 	struct mxt_data *data = i2c_get_clientdata(client);
 
+	/* initialization failed */
+	if (!data)
+		return;
+
 	disable_irq(data->irq);
 	data->state = SHUTDOWN;
 }
@@ -33,6 +33,7 @@ Change log:
 #include	"wlan_headers.h"
 
 #include	<linux/firmware.h>
+#include	<linux/ktime.h>
 
 /********************************************************
 		Local Variables
@@ -300,6 +301,7 @@ wlan_init_fw(wlan_private * priv)
 {
     int ret = WLAN_STATUS_SUCCESS;
     wlan_adapter *Adapter = priv->adapter;
+    ktime_t t0, t1, t2, t3;
 
     ENTER();
 
@@ -309,6 +311,7 @@ wlan_init_fw(wlan_private * priv)
     if (sbi_check_fw_status(priv, 1) == WLAN_STATUS_SUCCESS) {
         PRINTM(MSG, "WLAN FW already running! Skip FW download\n");
     } else {
+        t0 = ktime_get();
         if ((ret =
              request_firmware(&priv->fw_helper, helper_name,
                               priv->hotplug_device)) < 0) {
@@ -327,6 +330,7 @@ wlan_init_fw(wlan_private * priv)
             ret = WLAN_STATUS_FAILURE;
             goto done;
         }
+        t1 = ktime_get();
 
         if ((ret =
              request_firmware(&priv->firmware, fw_name,
@@ -341,6 +345,7 @@ wlan_init_fw(wlan_private * priv)
             ret = WLAN_STATUS_FAILURE;
             goto done;
         }
+        t2 = ktime_get();
 
         /* Check if the firmware is downloaded successfully or not */
         if (sbi_check_fw_status(priv, MAX_FIRMWARE_POLL_TRIES) ==
@@ -349,7 +354,10 @@ wlan_init_fw(wlan_private * priv)
             ret = WLAN_STATUS_FAILURE;
             goto done;
         }
-        PRINTM(MSG, "WLAN FW is active\n");
+        t3 = ktime_get();
+        PRINTM(MSG, "WLAN FW is active (helper %lld us, firmware %lld us, "
+               "ready %lld us)\n", ktime_to_us(ktime_sub(t1, t0)),
+               ktime_to_us(ktime_sub(t2, t1)), ktime_to_us(ktime_sub(t3, t2)));
     }
 
 #define RF_REG_OFFSET 0x07
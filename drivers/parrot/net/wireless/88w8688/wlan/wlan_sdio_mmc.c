@@ -26,6 +26,10 @@ Change log:
 #include	"wlan_sdio_mmc.h"
 
 #include <linux/firmware.h>
+#include <linux/mmc/core.h>
+#include <linux/mmc/host.h>
+#include <linux/scatterlist.h>
+#include <linux/vmalloc.h>
 
 /** define SDIO block size */
 /* We support up to 480-byte block size due to FW buffer limitation. */
@@ -39,6 +43,9 @@ Change log:
 /** Max retry number of CMD53 write */
 #define MAX_WRITE_IOMEM_RETRY	2
 
+/** Max pages a firmware block run spans */
+#define FW_WRITE_MAX_PAGES	(DIV_ROUND_UP(WLAN_UPLD_SIZE, PAGE_SIZE) + 1)
+
 /********************************************************
 		Local Variables
 ********************************************************/
@@ -71,6 +78,9 @@ extern u8 *fw_name;
 /**Interrupt status */
 static u8 sd_ireg = 0;
 
+/** Workqueue running the card initialization off the probe path */
+static struct workqueue_struct *wlan_add_wq;
+
 #ifdef SDIO_SUSPEND_RESUME
 /** PM keep power */
 extern int pm_keep_power;
@@ -409,9 +419,35 @@ sbi_interrupt(struct sdio_func *func)
     LEAVE();
 }
 
+/** 
+ *  @brief This function downloads the firmware and brings the card up.
+ *  
+ *  @param work	   A pointer to the add_work member of sdio_mmc_card.
+ *  @return 	   n/a
+ */
+static void
+wlan_add_card_work(struct work_struct *work)
+{
+    struct sdio_mmc_card *card =
+        container_of(work, struct sdio_mmc_card, add_work);
+
+    ENTER();
+
+    if (!wlan_add_card(card)) {
+        PRINTM(ERROR, "%s: wlan_add_callback failed\n", __FUNCTION__);
+        /* Let wlan_remove() free the card */
+        sdio_set_drvdata(card->func, card);
+    }
+
+    LEAVE();
+}
+
 /** 
  *  @brief This function handles client driver probe.
  *  
+ *  The firmware download and the rest of the card initialization run
+ *  from wlan_add_wq, the interface shows up once they complete.
+ *
  *  @param func	   A pointer to sdio_func structure.
  *  @param id	   A pointer to sdio_device_id structure.
  *  @return 	   WLAN_STATUS_SUCCESS or WLAN_STATUS_FAILURE
@@ -434,13 +470,10 @@ wlan_probe(struct sdio_func *func, const struct sdio_device_id *id)
     }
 
     card->func = func;
+    INIT_WORK(&card->add_work, wlan_add_card_work);
 
-    if (!wlan_add_card(card)) {
-        PRINTM(ERROR, "%s: wlan_add_callback failed\n", __FUNCTION__);
-        kfree(card);
-        ret = WLAN_STATUS_FAILURE;
-        goto done;
-    }
+    sdio_set_drvdata(func, card);
+    queue_work(wlan_add_wq, &card->add_work);
 
     ret = WLAN_STATUS_SUCCESS;
 
@@ -467,6 +500,8 @@ wlan_remove(struct sdio_func *func)
     if (func) {
         card = sdio_get_drvdata(func);
         if (card) {
+            /* Wait for, or cancel, the deferred initialization */
+            cancel_work_sync(&card->add_work);
             wlan_remove_card(card);
             kfree(card);
         }
@@ -623,9 +658,17 @@ sbi_register()
 
     ENTER();
 
+    wlan_add_wq = create_singlethread_workqueue("wlan_add");
+    if (!wlan_add_wq) {
+        PRINTM(FATAL, "Cannot create the card init workqueue\n");
+        LEAVE();
+        return WLAN_STATUS_FAILURE;
+    }
+
     /* SDIO Driver Registration */
     if (sdio_register_driver(&wlan_sdio) != 0) {
         PRINTM(FATAL, "SDIO Driver Registration Failed \n");
+        destroy_workqueue(wlan_add_wq);
         ret = WLAN_STATUS_FAILURE;
     }
 
@@ -645,6 +688,7 @@ sbi_unregister(void)
 
     /* SDIO Driver Unregistration */
     sdio_unregister_driver(&wlan_sdio);
+    destroy_workqueue(wlan_add_wq);
 
     LEAVE();
 }
@@ -1359,6 +1403,79 @@ sbi_prog_helper(wlan_private * priv)
     return ret;
 }
 
+/** 
+ *  @brief This function writes firmware blocks straight from the pages
+ *  of a vmalloc()ed image: one CMD53 to the I/O port, with a scatterlist
+ *  entry per page. Every page boundary must fall between two blocks.
+ *  
+ *  @param func    	A pointer to sdio_func structure
+ *  @param port    	The I/O port address
+ *  @param src     	Start of the blocks, in the vmalloc area
+ *  @param blocks  	Number of SD_BLOCK_SIZE blocks
+ *  @return 	   	0, -EAGAIN if the host can't take the run as is,
+ *  			or a negative error
+ */
+static int
+sbi_write_fw_pages(struct sdio_func *func, unsigned int port,
+                   const u8 * src, int blocks)
+{
+    struct mmc_host *host = func->card->host;
+    struct scatterlist sg[FW_WRITE_MAX_PAGES];
+    struct mmc_request mrq;
+    struct mmc_command cmd;
+    struct mmc_data data;
+    unsigned int left = blocks * SD_BLOCK_SIZE;
+    int nsg = 0;
+
+    if (((unsigned long) src & (SD_BLOCK_SIZE - 1))
+        || blocks > host->max_blk_count || left > host->max_req_size)
+        return -EAGAIN;
+
+    sg_init_table(sg, FW_WRITE_MAX_PAGES);
+    while (left) {
+        unsigned int off = offset_in_page(src);
+        unsigned int len = min_t(unsigned int, left, PAGE_SIZE - off);
+
+        if (nsg == FW_WRITE_MAX_PAGES || nsg == host->max_hw_segs
+            || len > host->max_seg_size)
+            return -EAGAIN;
+        sg_set_page(&sg[nsg++], vmalloc_to_page(src), len, off);
+        src += len;
+        left -= len;
+    }
+    sg_mark_end(&sg[nsg - 1]);
+
+    memset(&mrq, 0, sizeof(mrq));
+    memset(&cmd, 0, sizeof(cmd));
+    memset(&data, 0, sizeof(data));
+    mrq.cmd = &cmd;
+    mrq.data = &data;
+
+    /* Block mode write to a fixed address, as sdio_writesb() */
+    cmd.opcode = SD_IO_RW_EXTENDED;
+    cmd.arg = 0x80000000 | func->num << 28 | 0x08000000 | port << 9 | blocks;
+    cmd.flags = MMC_RSP_SPI_R5 | MMC_RSP_R5 | MMC_CMD_ADTC;
+
+    data.blksz = SD_BLOCK_SIZE;
+    data.blocks = blocks;
+    data.flags = MMC_DATA_WRITE;
+    data.sg = sg;
+    data.sg_len = nsg;
+    mmc_set_data_timeout(&data, func->card);
+
+    mmc_wait_for_req(host, &mrq);
+
+    if (cmd.error)
+        return cmd.error;
+    if (data.error)
+        return data.error;
+    if (!mmc_host_is_spi(host)
+        && (cmd.resp[0] & (R5_ERROR | R5_FUNCTION_NUMBER | R5_OUT_OF_RANGE)))
+        return -EIO;
+
+    return 0;
+}
+
 /** 
  *  @brief This function downloads firmware image to the card.
  *  
@@ -1378,6 +1495,9 @@ sbi_prog_fw_w_helper(wlan_private * priv)
     void *tmpfwbuf = NULL;
     int tmpfwbufsz;
     u8 *fwbuf;
+    u8 *txbuf;
+    bool direct;
+    bool paged;
     u16 len;
     int txlen = 0;
     int tx_blocks = 0;
@@ -1421,6 +1541,15 @@ sbi_prog_fw_w_helper(wlan_private * priv)
 #else /* PXA3XX_DMA_ALIGN */
     fwbuf = (u8 *) tmpfwbuf;
 #endif /* PXA3XX_DMA_ALIGN */
+    txbuf = fwbuf;
+
+    /* 
+     * Images built into the kernel are in the linear mapping and are sent
+     * as they are. request_firmware() hands out vmalloc()ed images, sent
+     * page by page from the vmalloc area, see sbi_write_fw_pages().
+     */
+    direct = !is_vmalloc_addr(firmware) && virt_addr_valid(firmware);
+    paged = is_vmalloc_addr(firmware);
 
     sdio_claim_host(card->func);
 
@@ -1501,13 +1630,34 @@ sbi_prog_fw_w_helper(wlan_private * priv)
 
             tx_blocks = (txlen + SD_BLOCK_SIZE - 1) / SD_BLOCK_SIZE;
 
-            /* Copy payload to buffer */
-            memcpy(fwbuf, &firmware[offset], txlen);
+            if ((direct || paged)
+                && offset + tx_blocks * SD_BLOCK_SIZE <= firmwarelen
+#ifdef PXA3XX_DMA_ALIGN
+                && !((u32) (firmware + offset) & (PXA3XX_DMA_ALIGNMENT - 1))
+#endif /* PXA3XX_DMA_ALIGN */
+                ) {
+                txbuf = &firmware[offset];
+            } else {
+                /* Copy payload to buffer */
+                memcpy(fwbuf, &firmware[offset], txlen);
+                txbuf = fwbuf;
+            }
         }
 
-        /* Send data */
-        ret = sdio_writesb(card->func, priv->wlan_dev.ioport,
-                           fwbuf, tx_blocks * SD_BLOCK_SIZE);
+        /* Send data, a CRC error resends the previous txbuf */
+        ret = -EAGAIN;
+        if (txbuf != fwbuf && paged)
+            ret = sbi_write_fw_pages(card->func, priv->wlan_dev.ioport,
+                                     txbuf, tx_blocks);
+        if (ret == -EAGAIN) {
+            if (txbuf != fwbuf && paged) {
+                /* Blocks straddle pages, bounce them */
+                memcpy(fwbuf, txbuf, txlen);
+                txbuf = fwbuf;
+            }
+            ret = sdio_writesb(card->func, priv->wlan_dev.ioport,
+                               txbuf, tx_blocks * SD_BLOCK_SIZE);
+        }
 
         if (ret < 0) {
             PRINTM(ERROR, "FW download, write iomem (%d) failed @ %d\n", i,
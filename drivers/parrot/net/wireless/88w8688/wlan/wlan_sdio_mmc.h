@@ -30,6 +30,7 @@ Change log:
 #include	<linux/mmc/sdio_ids.h>
 #include	<linux/mmc/sdio_func.h>
 #include	<linux/mmc/card.h>
+#include	<linux/workqueue.h>
 
 #include	"wlan_headers.h"
 
@@ -109,6 +110,8 @@ struct sdio_mmc_card
     struct sdio_func *func;
         /** wlan_private structure pointer */
     wlan_private *priv;
+        /** Deferred card initialization (firmware download) */
+    struct work_struct add_work;
 };
 
 #endif /* _WLAN_SDIO_MMC_H */
@@ -0,0 +1,242 @@
+/*
+ * parrot_async.c
+ *
+ * Asynchronous, dependency ordered device initialization at boot
+ *
+ * Copyright (C) 2012 Parrot SA
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Drivers hand the slow part of their probe to parrot_async_run(), which
+ * runs it on the kernel async threads after the steps it depends on.
+ * init_post() waits for all async work before starting userspace and
+ * freeing the init sections, so __init code can be used by the steps
+ * scheduled from the board init.
+ *
+ * A step is only waited for if it has been scheduled or the board said it
+ * would be with parrot_async_expect(): on a board without LVDS link the
+ * touchscreen does not wait for it.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/async.h>
+#include <linux/bitops.h>
+#include <linux/completion.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "parrot_async.h"
+
+/* How long a step waits for a dependency which never shows up */
+#define PARROT_ASYNC_DEP_TIMEOUT	(2 * HZ)
+
+struct parrot_async_entry {
+	int (*fn)(void *data);
+	void *data;
+	unsigned long deps;
+	struct completion done;
+	int ret;
+	bool queued;
+	ktime_t queue_time;
+	ktime_t start_time;
+	ktime_t end_time;
+};
+
+static const char * const parrot_async_names[PARROT_ASYNC_MAX] = {
+	[PARROT_ASYNC_LVDS]	= "lvds",
+	[PARROT_ASYNC_USB_HUB]	= "usb_hub",
+	[PARROT_ASYNC_TOUCH]	= "touch",
+	[PARROT_ASYNC_USB_PHY]	= "usb_phy",
+	[PARROT_ASYNC_USB_HOST]	= "usb_host",
+};
+
+static struct parrot_async_entry parrot_async_steps[PARROT_ASYNC_MAX];
+static unsigned long parrot_async_expected;
+static DEFINE_SPINLOCK(parrot_async_lock);
+
+/**
+ * parrot_async_expect - declare steps that will be scheduled
+ * @steps: PARROT_ASYNC() mask
+ *
+ * Called by the board init, before the steps depending on them are
+ * scheduled.
+ */
+void parrot_async_expect(unsigned long steps)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&parrot_async_lock, flags);
+	parrot_async_expected |= steps;
+	spin_unlock_irqrestore(&parrot_async_lock, flags);
+}
+EXPORT_SYMBOL(parrot_async_expect);
+
+/**
+ * parrot_async_wait - wait for steps to complete
+ * @steps: PARROT_ASYNC() mask
+ *
+ * Steps neither scheduled nor expected are not waited for. Returns 0, or
+ * the error of the first failed step, or -ETIMEDOUT.
+ */
+int parrot_async_wait(unsigned long steps)
+{
+	unsigned long flags;
+	int i, ret = 0;
+
+	for_each_set_bit(i, &steps, PARROT_ASYNC_MAX) {
+		struct parrot_async_entry *e = &parrot_async_steps[i];
+		bool wait;
+
+		spin_lock_irqsave(&parrot_async_lock, flags);
+		wait = e->queued || (parrot_async_expected & PARROT_ASYNC(i));
+		spin_unlock_irqrestore(&parrot_async_lock, flags);
+		if (!wait)
+			continue;
+
+		if (!wait_for_completion_timeout(&e->done,
+						 PARROT_ASYNC_DEP_TIMEOUT)) {
+			pr_warning("parrot_async: %s never completed\n",
+				   parrot_async_names[i]);
+			/* don't make the next ones wait too */
+			spin_lock_irqsave(&parrot_async_lock, flags);
+			parrot_async_expected &= ~PARROT_ASYNC(i);
+			spin_unlock_irqrestore(&parrot_async_lock, flags);
+			if (!ret)
+				ret = -ETIMEDOUT;
+			continue;
+		}
+		if (e->ret && !ret)
+			ret = e->ret;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL(parrot_async_wait);
+
+static void parrot_async_func(void *data, async_cookie_t cookie)
+{
+	struct parrot_async_entry *e = data;
+	int step = e - parrot_async_steps;
+	int ret;
+
+	ret = parrot_async_wait(e->deps);
+	if (ret)
+		pr_warning("parrot_async: %s: dependency failed (%d)\n",
+			   parrot_async_names[step], ret);
+
+	e->start_time = ktime_get();
+	e->ret = e->fn(e->data);
+	e->end_time = ktime_get();
+
+	pr_info("parrot_async: %s %s, waited %lld us, ran %lld us\n",
+		parrot_async_names[step], e->ret ? "failed" : "done",
+		ktime_us_delta(e->start_time, e->queue_time),
+		ktime_us_delta(e->end_time, e->start_time));
+
+	complete_all(&e->done);
+}
+
+/**
+ * parrot_async_run - run one boot step asynchronously
+ * @step: the step @fn implements
+ * @deps: PARROT_ASYNC() mask of the steps to wait for first
+ * @fn: the step, its result is returned by parrot_async_wait()
+ * @data: argument of @fn
+ *
+ * Returns 0 once @fn is scheduled. If @step is already pending, @fn is
+ * run synchronously and its result returned.
+ */
+int parrot_async_run(enum parrot_async_step step, unsigned long deps,
+		     int (*fn)(void *data), void *data)
+{
+	struct parrot_async_entry *e = &parrot_async_steps[step];
+	unsigned long flags;
+
+	spin_lock_irqsave(&parrot_async_lock, flags);
+	if (e->queued && !completion_done(&e->done)) {
+		spin_unlock_irqrestore(&parrot_async_lock, flags);
+		WARN(1, "parrot_async: %s already pending\n",
+		     parrot_async_names[step]);
+		parrot_async_wait(deps);
+		return fn(data);
+	}
+	INIT_COMPLETION(e->done);
+	e->fn = fn;
+	e->data = data;
+	e->deps = deps & ~PARROT_ASYNC(step);
+	e->ret = 0;
+	e->queued = true;
+	e->queue_time = ktime_get();
+	e->start_time = e->end_time = ktime_set(0, 0);
+	spin_unlock_irqrestore(&parrot_async_lock, flags);
+
+	async_schedule(parrot_async_func, e);
+
+	return 0;
+}
+EXPORT_SYMBOL(parrot_async_run);
+
+#ifdef CONFIG_DEBUG_FS
+static int parrot_async_show(struct seq_file *s, void *unused)
+{
+	int i;
+
+	seq_printf(s, "step        queued(ms)  start(ms)    end(ms)  ret\n");
+	for (i = 0; i < PARROT_ASYNC_MAX; i++) {
+		struct parrot_async_entry *e = &parrot_async_steps[i];
+
+		if (!e->queued) {
+			seq_printf(s, "%-10s %s\n", parrot_async_names[i],
+				   parrot_async_expected & PARROT_ASYNC(i) ?
+				   "expected" : "-");
+			continue;
+		}
+		seq_printf(s, "%-10s %10lld %10lld %10lld  %d\n",
+			   parrot_async_names[i],
+			   ktime_to_us(e->queue_time) / USEC_PER_MSEC,
+			   ktime_to_us(e->start_time) / USEC_PER_MSEC,
+			   ktime_to_us(e->end_time) / USEC_PER_MSEC,
+			   e->ret);
+	}
+
+	return 0;
+}
+
+static int parrot_async_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, parrot_async_show, NULL);
+}
+
+static const struct file_operations parrot_async_fops = {
+	.open		= parrot_async_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init parrot_async_debugfs_init(void)
+{
+	debugfs_create_file("parrot_async", S_IRUGO, NULL, NULL,
+			    &parrot_async_fops);
+	return 0;
+}
+late_initcall(parrot_async_debugfs_init);
+#endif
+
+/* before the board init (arch_initcall) schedules anything */
+static int __init parrot_async_init(void)
+{
+	int i;
+
+	for (i = 0; i < PARROT_ASYNC_MAX; i++)
+		init_completion(&parrot_async_steps[i].done);
+
+	return 0;
+}
+pure_initcall(parrot_async_init);
@@ -0,0 +1,55 @@
+/*
+ * parrot_async.h
+ *
+ * Asynchronous, dependency ordered device initialization at boot
+ *
+ * Copyright (C) 2012 Parrot SA
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __PARROT_ASYNC_H
+#define __PARROT_ASYNC_H
+
+/*
+ * Boot steps. Each one is the slow part (resets, configuration over I2C)
+ * of one device, run from an async thread once the steps it depends on
+ * are done. Steps that do not depend on each other run concurrently.
+ */
+enum parrot_async_step {
+	PARROT_ASYNC_LVDS,	/* ti_ub925 serializer, remote I2C pass-through */
+	PARROT_ASYNC_USB_HUB,	/* smsc82514 configured and started */
+	PARROT_ASYNC_TOUCH,	/* atmel mXT, may sit behind the LVDS link */
+	PARROT_ASYNC_USB_PHY,	/* board: USB0 PHY out of reset, MUSB added */
+	PARROT_ASYNC_USB_HOST,	/* board: EHCI added */
+	PARROT_ASYNC_MAX,
+};
+
+#define PARROT_ASYNC(step)	(1UL << (step))
+
+#ifdef CONFIG_PARROT_ASYNC_PROBE
+extern void parrot_async_expect(unsigned long steps);
+extern int parrot_async_run(enum parrot_async_step step, unsigned long deps,
+			    int (*fn)(void *data), void *data);
+extern int parrot_async_wait(unsigned long steps);
+#else
+static inline void parrot_async_expect(unsigned long steps)
+{
+}
+
+static inline int parrot_async_run(enum parrot_async_step step,
+				   unsigned long deps,
+				   int (*fn)(void *data), void *data)
+{
+	return fn(data);
+}
+
+static inline int parrot_async_wait(unsigned long steps)
+{
+	return 0;
+}
+#endif
+
+#endif /* __PARROT_ASYNC_H */
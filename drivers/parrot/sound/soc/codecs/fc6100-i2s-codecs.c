@@ -22,6 +22,7 @@
 #include <linux/i2c.h>
 #include <linux/platform_device.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 
 #include <sound/core.h>
 #include <sound/pcm.h>
@@ -40,6 +41,14 @@
 
 #define wau8822_reset(c) wau8822_write(c, WAU8822_RESET, 0)
 
+/*
+ * Deferred register writes are sent in batches of at most
+ * WAU8822_BATCH_MAX registers, and never stay pending for more than
+ * WAU8822_FLUSH_DELAY_MS when no DAPM sync point comes first.
+ */
+#define WAU8822_BATCH_MAX	16
+#define WAU8822_FLUSH_DELAY_MS	20
+
  enum{
         MASTER_I2S_CODEC,
         SND_I2S_CODEC,
@@ -77,6 +86,18 @@ struct wau8822_priv {
         atomic_t hw_params_set;		// dai hardware params (set/unset)
         atomic_t bias_level_set;	// dai bias level (set/unset)
         atomic_t mute_set;		// dai mute (set/unset)
+
+        /* Register I/O: the reg cache holds the wanted values, hw_reg what
+         * the codec actually holds. A register is dirty when they differ.
+         * While defer is set, writes only update the cache and are flushed
+         * at the next DAPM sync point (bias level change, digital mute) or
+         * from flush_work.
+         */
+        struct mutex io_lock;
+        unsigned int defer;
+        u16 hw_reg[WAU8822_CACHEREGNUM];
+        struct delayed_work flush_work;
+        struct snd_soc_codec *io_codec;
 };
 
 static const u16 wau8822_reg[WAU8822_CACHEREGNUM] = {
@@ -151,6 +172,156 @@ static inline void wau8822_write_reg_cache(struct snd_soc_codec  *codec,
         cache[reg] = value;
 }
 
+/*
+ * send a batch of registers to the codec. The control port does not
+ * auto-increment, so the batch is one I2C transfer of 2-byte messages
+ * separated by repeated starts.
+ */
+static int wau8822_hw_write_batch(struct snd_soc_codec *codec,
+  const u8 *regs, unsigned int count)
+{
+        struct wau8822_priv *wau8822 = snd_soc_codec_get_drvdata(codec);
+        struct i2c_client *client = codec->control_data;
+        struct i2c_msg msgs[WAU8822_BATCH_MAX];
+        u8 data[WAU8822_BATCH_MAX][2];
+        u16 *cache = codec->reg_cache;
+        unsigned int i;
+        int ret;
+
+        for (i = 0; i < count; i++) {
+                data[i][0] = (regs[i] << 1) | ((cache[regs[i]] >> 8) & 0x0001);
+                data[i][1] = cache[regs[i]] & 0x00ff;
+                msgs[i].addr = client->addr;
+                msgs[i].flags = 0;
+                msgs[i].len = 2;
+                msgs[i].buf = data[i];
+        }
+
+        ret = i2c_transfer(client->adapter, msgs, count);
+        if (ret != (int)count) {
+                dev_err(codec->dev, "%s=> %u registers from 0x%02x error %d\n",
+                        __FUNCTION__, count, regs[0], ret);
+                return ret < 0 ? ret : -EIO;
+        }
+
+        for (i = 0; i < count; i++)
+                wau8822->hw_reg[regs[i]] = cache[regs[i]];
+
+        return 0;
+}
+
+/*
+ * write all dirty registers to the codec, in register order. Must be
+ * called with io_lock held.
+ */
+static int wau8822_sync(struct snd_soc_codec *codec)
+{
+        struct wau8822_priv *wau8822 = snd_soc_codec_get_drvdata(codec);
+        u16 *cache = codec->reg_cache;
+        u8 regs[WAU8822_BATCH_MAX];
+        unsigned int count = 0;
+        unsigned int reg;
+        int ret = 0;
+
+        for (reg = WAU8822_RESET + 1; reg < WAU8822_CACHEREGNUM; reg++) {
+                if (cache[reg] == wau8822->hw_reg[reg])
+                        continue;
+
+                regs[count++] = reg;
+                if (count == WAU8822_BATCH_MAX) {
+                        ret = wau8822_hw_write_batch(codec, regs, count);
+                        if (ret < 0)
+                                return ret;
+                        count = 0;
+                }
+        }
+
+        if (count)
+                ret = wau8822_hw_write_batch(codec, regs, count);
+
+        return ret;
+}
+
+/*
+ * start deferring register writes until the next wau8822_flush()
+ */
+static void wau8822_defer(struct snd_soc_codec *codec)
+{
+        struct wau8822_priv *wau8822 = snd_soc_codec_get_drvdata(codec);
+
+        mutex_lock(&wau8822->io_lock);
+        wau8822->defer = 1;
+        mutex_unlock(&wau8822->io_lock);
+}
+
+/*
+ * write the deferred registers and go back to immediate writes
+ */
+static int wau8822_flush(struct snd_soc_codec *codec)
+{
+        struct wau8822_priv *wau8822 = snd_soc_codec_get_drvdata(codec);
+        int ret;
+
+        mutex_lock(&wau8822->io_lock);
+        wau8822->defer = 0;
+        ret = wau8822_sync(codec);
+        mutex_unlock(&wau8822->io_lock);
+
+        return ret;
+}
+
+static void wau8822_flush_work(struct work_struct *work)
+{
+        struct wau8822_priv *wau8822 =
+                container_of(work, struct wau8822_priv, flush_work.work);
+
+        wau8822_flush(wau8822->io_codec);
+}
+
+/*
+ * codec write operation, all writes (controls included) go through here
+ */
+static int wau8822_reg_write(struct snd_soc_codec *codec, unsigned int reg,
+  unsigned int value)
+{
+        struct wau8822_priv *wau8822 = snd_soc_codec_get_drvdata(codec);
+        u16 *cache = codec->reg_cache;
+        u8 data[2];
+        int ret;
+
+        if (reg >= WAU8822_CACHEREGNUM)
+                return -EINVAL;
+
+        mutex_lock(&wau8822->io_lock);
+        cache[reg] = value;
+
+        if (wau8822->defer && reg != WAU8822_RESET) {
+                mutex_unlock(&wau8822->io_lock);
+                schedule_delayed_work(&wau8822->flush_work,
+                                      msecs_to_jiffies(WAU8822_FLUSH_DELAY_MS));
+                return 0;
+        }
+
+        data[0] = (reg << 1) | ((value >> 8) & 0x0001);
+        data[1] = value & 0x00ff;
+
+        ret = codec->hw_write(codec->control_data, data, 2);
+        if (ret == 2) {
+                ret = 0;
+                /* Reset brings every register back to its default. */
+                if (reg == WAU8822_RESET)
+                        memcpy(wau8822->hw_reg, wau8822_reg,
+                               sizeof(wau8822->hw_reg));
+                else
+                        wau8822->hw_reg[reg] = value;
+        } else if (ret >= 0) {
+                ret = -EIO;
+        }
+        mutex_unlock(&wau8822->io_lock);
+
+        return ret;
+}
+
 /*
  * write to the WAU8822 register space
  */
@@ -565,6 +736,9 @@ static int wau8822_set_dai_pll(struct snd_soc_dai *codec_dai,
 
         dev_dbg(codec->dev, "%s, pll_id %d, freq_in %d, frq_out %d\n", __FUNCTION__, pll_id,freq_in,freq_out);
 
+        /* The PLL sequence is order sensitive, write it immediately. */
+        wau8822_flush(codec);
+
         if(freq_in == 0 || freq_out == 0) {
 
                 if( (atomic_read(&wau8822->substream) > 1)
@@ -640,6 +814,9 @@ static int wau8822_set_dai_clkdiv(struct snd_soc_dai *codec_dai,
         if( atomic_read(&wau8822->dai_clkdiv_set) )
                 return 0; /* One DAI has allready been initialized */
 
+        /* Interface setup is flushed when the stream powers up */
+        wau8822_defer(codec);
+
 	/* Initialization */
         atomic_inc(&wau8822->dai_clkdiv_set);
 
@@ -682,6 +859,9 @@ static int wau8822_set_dai_fmt(struct snd_soc_dai *codec_dai,
 
         dev_dbg(codec->dev, "%s\n", __FUNCTION__);
 
+        /* Interface setup is flushed when the stream powers up */
+        wau8822_defer(codec);
+
         /* set master/slave audio interface */
         switch (fmt & SND_SOC_DAIFMT_MASTER_MASK) {
                 case SND_SOC_DAIFMT_CBM_CFM:
@@ -770,6 +950,9 @@ static int wau8822_pcm_hw_params(struct snd_pcm_substream *substream,
 
         dev_dbg(codec->dev, "%s: rate=>%d format=>%d\n", __FUNCTION__, params_rate(params), params_format(params));
 
+        /* Interface setup is flushed when the stream powers up */
+        wau8822_defer(codec);
+
         /* bit size */
         switch (params_format(params)) {
                 case SNDRV_PCM_FORMAT_S16_LE:
@@ -838,6 +1021,9 @@ static int wau8822_mute(struct snd_soc_dai *codec_dai, int mute)
 
         dev_dbg(codec->dev, "%s : muting/unmuting %d \n",__FUNCTION__,  mute);
 
+        /* DAPM sync point: the interface must be set up before unmuting */
+        wau8822_flush(codec);
+
         /* Only on DAI in use */
         if(mute) {
         	if( (atomic_read(&wau8822->substream) == 1) 
@@ -982,6 +1168,9 @@ static int wau8822_set_bias_level(struct snd_soc_codec *codec,
 
         dev_dbg(codec->dev, "%s level %d \n", __FUNCTION__, level);
 
+        /* DAPM sync point */
+        wau8822_flush(codec);
+
         if( atomic_read(&wau8822->substream)
 		&& atomic_read(&wau8822->bias_level_set) ){
                 codec->dapm->bias_level = level;
@@ -1027,9 +1216,11 @@ static int wau8822_set_bias_level(struct snd_soc_codec *codec,
         	if( (atomic_read(&wau8822->substream) == 1)
 			&& atomic_read(&wau8822->bias_level_set) ){
 
+                	wau8822_defer(codec);
                 	wau8822_write(codec, WAU8822_POWER1, 0);
                 	wau8822_write(codec, WAU8822_POWER2, 0);
                 	wau8822_write(codec, WAU8822_POWER3, 0);
+                	wau8822_flush(codec);
 		}
                 break;
         }
@@ -1040,32 +1231,33 @@ static int wau8822_set_bias_level(struct snd_soc_codec *codec,
 
 static int wau8822_suspend(struct snd_soc_codec *codec, pm_message_t state)
 {
+        struct wau8822_priv *wau8822 = snd_soc_codec_get_drvdata(codec);
+
         /* we only need to suspend if we are a valid card */
         if(!codec->card)
                 return 0;
 
+        cancel_delayed_work_sync(&wau8822->flush_work);
         wau8822_set_bias_level(codec, SND_SOC_BIAS_OFF);
         return 0;
 }
 
 static int wau8822_resume(struct snd_soc_codec *codec )
 {
-        int i;
-        u8 data[2];
-        u16 *cache = codec->reg_cache;
+        struct wau8822_priv *wau8822 = snd_soc_codec_get_drvdata(codec);
 
         /* we only need to resume if we are a valid card */
         if(!codec->card)
                 return 0;
-        /* Sync reg_cache with the hardware */
 
-        for (i = 0; i < ARRAY_SIZE(wau8822_reg); i++) {
-                if (i == WAU8822_RESET)
-                        continue;
-                data[0] = (i << 1) | ((cache[i] >> 8) & 0x0001);
-                data[1] = cache[i] & 0x00ff;
-                wau8822_write(codec->control_data, data, 2);
-        }
+        /* The codec lost power: only the registers differing from the
+         * defaults need to be restored.
+         */
+        mutex_lock(&wau8822->io_lock);
+        memcpy(wau8822->hw_reg, wau8822_reg, sizeof(wau8822->hw_reg));
+        mutex_unlock(&wau8822->io_lock);
+        wau8822_flush(codec);
+
         wau8822_set_bias_level(codec, SND_SOC_BIAS_STANDBY);
             wau8822_set_bias_level(codec, codec->dapm->suspend_bias_level);
         return 0;
@@ -1089,6 +1281,8 @@ static int wau8822_probe(struct snd_soc_codec *codec)
                 dev_err(codec->dev, "Failed to set cache I/O: %d\n", ret);
                 return ret;
         }
+        codec->driver->write = wau8822_reg_write;
+        wau8822->io_codec = codec;
 
         /* Reset  */
         ret = wau8822_reset(codec);
@@ -1103,10 +1297,12 @@ static int wau8822_probe(struct snd_soc_codec *codec)
 
         /* initialize codec register and update cache */
         dev_dbg(codec->dev, "initialize codec\n");
+        wau8822_defer(codec);
         for(i=0;i<SET_CODEC_REG_INIT_NUM;i++)
         {
                 wau8822_write(codec, Set_Codec_Reg_Init[i][0],Set_Codec_Reg_Init[i][1]);
         }
+        wau8822_flush(codec);
         /* update cache */
         for(i=0;i<WAU8822_CACHEREGNUM;i++)
         {
@@ -1135,6 +1331,7 @@ static int wau8822_remove(struct snd_soc_codec * codec)
 
         dev_dbg(codec->dev, "%s\n", __FUNCTION__);
 
+        cancel_delayed_work_sync(&wau8822->flush_work);
         wau8822_set_bias_level(codec, SND_SOC_BIAS_OFF);
 
         kfree(wau8822);
@@ -1179,6 +1376,9 @@ static int wau8822_i2c_probe(struct i2c_client *i2c, const struct i2c_device_id
         atomic_set(&wau8822->bias_level_set, 0);
         atomic_set(&wau8822->mute_set, 1);
 
+        mutex_init(&wau8822->io_lock);
+        INIT_DELAYED_WORK(&wau8822->flush_work, wau8822_flush_work);
+
 
         ret =  snd_soc_register_codec(&i2c->dev,
                         &soc_codec_dev_wau8822, wau8822_dai, ARRAY_SIZE(wau8822_dai));
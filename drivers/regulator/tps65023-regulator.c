@@ -22,6 +22,7 @@
 #include <linux/platform_device.h>
 #include <linux/regulator/driver.h>
 #include <linux/regulator/machine.h>
+#include <linux/regulator/tps65023.h>
 #include <linux/i2c.h>
 #include <linux/delay.h>
 #include <linux/slab.h>
@@ -36,6 +37,7 @@
 #define	TPS65023_REG_DEF_CORE		6
 #define	TPS65023_REG_DEFSLEW		7
 #define	TPS65023_REG_LDO_CTRL		8
+#define	TPS65023_NUM_REGS		9
 
 /* PGOODZ bitfields */
 #define	TPS65023_PGOODZ_PWRFAILZ	BIT(7)
@@ -72,6 +74,10 @@
 #define	TPS65023_CON_CTRL_FPWM_DCDC1		BIT(1)
 #define	TPS65023_CON_CTRL_FPWM_DCDC3		BIT(0)
 
+/* CON_CTRL2 bitfields */
+#define	TPS65023_CON_CTRL2_GO			BIT(7)
+#define	TPS65023_CON_CTRL2_CORE_ADJ		BIT(6)
+
 /* LDO_CTRL bitfields */
 #define TPS65023_LDO_CTRL_LDOx_SHIFT(ldo_id)	((ldo_id)*4)
 #define TPS65023_LDO_CTRL_LDOx_MASK(ldo_id)	(0xF0 >> ((ldo_id)*4))
@@ -136,16 +142,38 @@ struct tps_pmic {
 	struct regulator_dev *rdev[TPS65023_NUM_REGULATOR];
 	const struct tps_info *info[TPS65023_NUM_REGULATOR];
 	struct mutex io_lock;
+	/* shadow of the control registers, read once at probe */
+	u8 regs[TPS65023_NUM_REGS];
+	/* pre-built DEF_CORE write + GO command for VDCDC1 scaling */
+	struct i2c_msg vsel_msgs[2];
+	u8 vsel_buf[2];
+	u8 go_buf[2];
 };
 
+/* for tps65023_dcdc1_set_vsel(), there is only one per board */
+static struct tps_pmic *tps_65023_dvfs;
+
+/* PGOODZ reflects the outputs state, it is never cached */
+static inline bool tps_65023_volatile(u8 reg)
+{
+	return reg <= TPS65023_REG_PGOODZ || reg >= TPS65023_NUM_REGS;
+}
+
 static inline int tps_65023_read(struct tps_pmic *tps, u8 reg)
 {
+	if (!tps_65023_volatile(reg))
+		return tps->regs[reg];
 	return i2c_smbus_read_byte_data(tps->client, reg);
 }
 
 static inline int tps_65023_write(struct tps_pmic *tps, u8 reg, u8 val)
 {
-	return i2c_smbus_write_byte_data(tps->client, reg, val);
+	int err;
+
+	err = i2c_smbus_write_byte_data(tps->client, reg, val);
+	if (!err && !tps_65023_volatile(reg))
+		tps->regs[reg] = val;
+	return err;
 }
 
 static int tps_65023_set_bits(struct tps_pmic *tps, u8 reg, u8 mask)
@@ -224,6 +252,60 @@ static int tps_65023_reg_write(struct tps_pmic *tps, u8 reg, u8 val)
 	return err;
 }
 
+/*
+ * VDCDC1 only moves to DEF_CORE once GO is set in CON_CTRL2. Both writes
+ * are issued as one combined transfer, built at probe time.
+ */
+static int tps_65023_dcdc1_vsel(struct tps_pmic *tps, u8 vsel)
+{
+	int err;
+
+	mutex_lock(&tps->io_lock);
+
+	if (vsel == tps->regs[TPS65023_REG_DEF_CORE]) {
+		mutex_unlock(&tps->io_lock);
+		return 0;
+	}
+
+	tps->vsel_buf[1] = vsel;
+	tps->go_buf[1] = tps->regs[TPS65023_REG_CON_CTRL2] |
+				TPS65023_CON_CTRL2_GO;
+
+	err = i2c_transfer(tps->client->adapter, tps->vsel_msgs,
+			   ARRAY_SIZE(tps->vsel_msgs));
+	if (err == ARRAY_SIZE(tps->vsel_msgs)) {
+		tps->regs[TPS65023_REG_DEF_CORE] = vsel;
+		err = 0;
+	} else {
+		dev_err(&tps->client->dev, "VDCDC1 vsel 0x%x failed\n", vsel);
+		if (err >= 0)
+			err = -EIO;
+	}
+
+	mutex_unlock(&tps->io_lock);
+	return err;
+}
+
+/**
+ * tps65023_dcdc1_set_vsel - program VDCDC1 from the DVFS code
+ * @vsel: index in the VDCDC1 voltage table
+ *
+ * Bypasses the regulator framework, for the OMAP voltage layer which does
+ * its own bookkeeping. Does not wait for the output to ramp.
+ */
+int tps65023_dcdc1_set_vsel(u8 vsel)
+{
+	struct tps_pmic *tps = tps_65023_dvfs;
+
+	if (!tps)
+		return -ENODEV;
+	if (vsel >= tps->info[TPS65023_DCDC_1]->table_len)
+		return -EINVAL;
+
+	return tps_65023_dcdc1_vsel(tps, vsel);
+}
+EXPORT_SYMBOL_GPL(tps65023_dcdc1_set_vsel);
+
 static int tps65023_dcdc_is_enabled(struct regulator_dev *dev)
 {
 	struct tps_pmic *tps = rdev_get_drvdata(dev);
@@ -360,7 +442,7 @@ static int tps65023_dcdc_set_voltage(struct regulator_dev *dev,
 	if (vsel == tps->info[dcdc]->table_len)
 		return -EINVAL;
 	else
-		return tps_65023_reg_write(tps, TPS65023_REG_DEF_CORE, vsel);
+		return tps_65023_dcdc1_vsel(tps, vsel);
 }
 
 static int tps65023_ldo_get_voltage(struct regulator_dev *dev)
@@ -499,6 +581,27 @@ static int __devinit tps_65023_probe(struct i2c_client *client,
 	/* common for all regulators */
 	tps->client = client;
 
+	for (i = TPS65023_REG_PGOODZ + 1; i < TPS65023_NUM_REGS; i++) {
+		error = i2c_smbus_read_byte_data(client, i);
+		if (error < 0) {
+			dev_err(&client->dev, "Read from reg 0x%x failed\n", i);
+			kfree(tps);
+			return error;
+		}
+		tps->regs[i] = error;
+	}
+	/* GO self-clears, never write it back */
+	tps->regs[TPS65023_REG_CON_CTRL2] &= ~TPS65023_CON_CTRL2_GO;
+
+	tps->vsel_buf[0] = TPS65023_REG_DEF_CORE;
+	tps->go_buf[0] = TPS65023_REG_CON_CTRL2;
+	tps->vsel_msgs[0].addr = client->addr;
+	tps->vsel_msgs[0].len = sizeof(tps->vsel_buf);
+	tps->vsel_msgs[0].buf = tps->vsel_buf;
+	tps->vsel_msgs[1].addr = client->addr;
+	tps->vsel_msgs[1].len = sizeof(tps->go_buf);
+	tps->vsel_msgs[1].buf = tps->go_buf;
+
 	for (i = 0; i < TPS65023_NUM_REGULATOR; i++, info++, init_data++) {
 		/* Store regulator specific information */
 		tps->info[i] = info;
@@ -532,6 +635,8 @@ static int __devinit tps_65023_probe(struct i2c_client *client,
 	    TPS65023_CON_CTRL_DCDC2_PHASE1 | TPS65023_CON_CTRL_DCDC3_PHASE1 | TPS65023_CON_CTRL_DCDC3_PHASE0 |
 	    TPS65023_CON_CTRL_FPWM_DCDC1 | TPS65023_CON_CTRL_FPWM_DCDC2 | TPS65023_CON_CTRL_FPWM_DCDC3);
 
+	tps_65023_dvfs = tps;
+
 	return 0;
 
  fail:
@@ -553,6 +658,9 @@ static int __devexit tps_65023_remove(struct i2c_client *client)
 	struct tps_pmic *tps = i2c_get_clientdata(client);
 	int i;
 
+	if (tps_65023_dvfs == tps)
+		tps_65023_dvfs = NULL;
+
 	for (i = 0; i < TPS65023_NUM_REGULATOR; i++)
 		regulator_unregister(tps->rdev[i]);
 
@@ -49,8 +49,9 @@ static struct uart_omap_port *ui[OMAP_MAX_HSUART_PORTS];
 
 /* Forward declaration of functions */
 static void uart_tx_dma_callback(int lch, u16 ch_status, void *data);
-static void serial_omap_rxdma_poll(unsigned long uart_no);
 static int serial_omap_start_rxdma(struct uart_omap_port *up);
+static unsigned int serial_omap_rxdma_pos(struct uart_omap_port *up);
+static void serial_omap_rxdma_drain(struct uart_omap_port *up);
 static int omap_uart_cts_wakeup(int uart_no, int state);
 
 static inline unsigned int serial_in(struct uart_omap_port *up, int offset)
@@ -101,8 +102,9 @@ serial_omap_get_divisor(struct uart_port *port, unsigned int baud)
 static void serial_omap_stop_rxdma(struct uart_omap_port *up)
 {
 	if (up->uart_dma.rx_dma_used) {
-		del_timer(&up->uart_dma.rx_timer);
 		omap_stop_dma(up->uart_dma.rx_dma_channel);
+		omap_dma_unlink_lch(up->uart_dma.rx_dma_channel,
+				up->uart_dma.rx_dma_channel);
 		omap_free_dma(up->uart_dma.rx_dma_channel);
 		up->uart_dma.rx_dma_channel = OMAP_UART_DMA_CH_FREE;
 		up->uart_dma.rx_dma_used = false;
@@ -384,6 +386,53 @@ inline bool omap_is_console_port(struct uart_port *port)
 }
 EXPORT_SYMBOL(omap_is_console_port);
 
+/*
+ * RX in DMA mode: the RX DMA channel runs over rx_buf as a ring, moving
+ * OMAP_UART_RX_DMA_BURST bytes whenever the FIFO holds one more than that.
+ * The FIFO is therefore never emptied by the DMA, so once the line goes
+ * quiet the UART raises its RX timeout interrupt, which hands everything
+ * received so far to the tty: the ring up to the DMA position, then the
+ * bytes left in the FIFO. While data keeps flowing the ring is also
+ * drained once a quarter of it is pending, and on every wrap.
+ */
+static void serial_omap_rxdma_irq(struct uart_omap_port *up,
+		unsigned int iir, unsigned int *lsr)
+{
+	struct uart_omap_dma *dma = &up->uart_dma;
+	unsigned int id = iir & UART_OMAP_IIR_ID;
+	unsigned int head, tail;
+
+	if (id != UART_IIR_RDI && id != UART_OMAP_IIR_RX_TIMEOUT &&
+			id != UART_IIR_RLSI)
+		return;
+
+	if (!dma->rx_dma_used && serial_omap_start_rxdma(up) != 0) {
+		if (*lsr & (UART_LSR_DR | UART_LSR_BI))
+			receive_chars(up, lsr);
+		return;
+	}
+
+	if (id == UART_IIR_RDI) {
+		/* Threshold reached, the DMA takes care of the data */
+		head = serial_omap_rxdma_pos(up);
+		tail = dma->prev_rx_dma_pos - dma->rx_buf_dma_phys;
+		if ((head + dma->rx_buf_size - tail) % dma->rx_buf_size >=
+				dma->rx_buf_size / 4)
+			serial_omap_rxdma_drain(up);
+		return;
+	}
+
+	if (id == UART_OMAP_IIR_RX_TIMEOUT)
+		dma->stats.rx_timeouts++;
+	serial_omap_rxdma_drain(up);
+	if (*lsr & (UART_LSR_DR | UART_LSR_BI)) {
+		unsigned int rx = up->port.icount.rx;
+
+		receive_chars(up, lsr);
+		dma->stats.rx_pio_bytes += up->port.icount.rx - rx;
+	}
+}
+
 /**
  * serial_omap_irq() - This handles the interrupt from one port
  * @irq: uart port irq number
@@ -420,11 +469,7 @@ static inline irqreturn_t serial_omap_irq(int irq, void *dev_id)
 					up->plat_hold_wakelock(up, WAKELK_IRQ);
 			}
 		} else {
-			up->ier &= ~UART_IER_RDI;
-			serial_out(up, UART_IER, up->ier);
-			if (serial_omap_start_rxdma(up) != 0)
-				if (lsr & UART_LSR_DR)
-					receive_chars(up, &lsr);
+			serial_omap_rxdma_irq(up, iir, &lsr);
 		}
 	}
 
@@ -575,9 +620,6 @@ static int serial_omap_startup(struct uart_port *port)
 			UART_XMIT_SIZE,
 			(dma_addr_t *)&(up->uart_dma.tx_buf_dma_phys),
 			0);
-		init_timer(&(up->uart_dma.rx_timer));
-		up->uart_dma.rx_timer.function = serial_omap_rxdma_poll;
-		up->uart_dma.rx_timer.data = up->pdev->id;
 		/* Currently the buffer size is 4KB. Can increase it */
 		up->uart_dma.rx_buf = dma_alloc_coherent(NULL,
 			up->uart_dma.rx_buf_size,
@@ -836,7 +878,13 @@ serial_omap_set_termios(struct uart_port *port, struct ktermios *termios,
 					TX_FIFO_THR_LVL);
 		}
 
-		serial_out(up, UART_TI752_TLR, 0);
+		/*
+		 * With 1-byte granularity the RX trigger level is TLR[7:4]
+		 * times 4 plus FCR[7:6] (UART_FCR_R_TRIG_01 above): one byte
+		 * more than the DMA burst, see serial_omap_rxdma_irq().
+		 */
+		serial_out(up, UART_TI752_TLR,
+			((OMAP_UART_RX_DMA_BURST + 1) >> 2) << 4);
 		serial_out(up, UART_OMAP_SCR,
 			(UART_FCR_TRIGGER_4 | UART_FCR_TRIGGER_8));
 	}
@@ -1231,50 +1279,68 @@ static int serial_omap_resume(struct platform_device *dev)
 	return 0;
 }
 
-static void serial_omap_rxdma_poll(unsigned long uart_no)
+/* Offset in the ring of the next byte the DMA will write */
+static unsigned int serial_omap_rxdma_pos(struct uart_omap_port *up)
 {
-	struct uart_omap_port *up = ui[uart_no];
-	unsigned int curr_dma_pos, curr_transmitted_size;
-
-	curr_dma_pos = omap_get_dma_dst_pos(up->uart_dma.rx_dma_channel);
-	if ((curr_dma_pos == up->uart_dma.prev_rx_dma_pos) ||
-			     (curr_dma_pos == 0)) {
-		if (jiffies_to_msecs(jiffies - up->port_activity) <
-						up->uart_dma.rx_timeout) {
-			mod_timer(&up->uart_dma.rx_timer, jiffies +
-				usecs_to_jiffies(up->uart_dma.rx_poll_rate));
-		} else {
-			serial_omap_stop_rxdma(up);
-			up->ier |= UART_IER_RDI;
-			serial_out(up, UART_IER, up->ier);
-		}
-		return;
+	unsigned int pos;
+
+	pos = omap_get_dma_dst_pos(up->uart_dma.rx_dma_channel) -
+			up->uart_dma.rx_buf_dma_phys;
+	/*
+	 * At the end of the block the position reads either way; before the
+	 * first transfer it may read 0.
+	 */
+	if (pos >= up->uart_dma.rx_buf_size)
+		pos = 0;
+
+	return pos;
+}
+
+/* Hand the ring contents up to the current DMA position to the tty */
+static void serial_omap_rxdma_drain(struct uart_omap_port *up)
+{
+	struct uart_omap_dma *dma = &up->uart_dma;
+	struct tty_struct *tty = up->port.state->port.tty;
+	unsigned int head, tail, count = 0;
+
+	head = serial_omap_rxdma_pos(up);
+	tail = dma->prev_rx_dma_pos - dma->rx_buf_dma_phys;
+
+	if (head < tail) {
+		count = dma->rx_buf_size - tail;
+		tty_insert_flip_string(tty, dma->rx_buf + tail, count);
+		tail = 0;
 	}
+	if (head > tail) {
+		tty_insert_flip_string(tty, dma->rx_buf + tail, head - tail);
+		count += head - tail;
+	}
+	dma->prev_rx_dma_pos = dma->rx_buf_dma_phys + head;
+	if (!count)
+		return;
 
-	curr_transmitted_size = curr_dma_pos -
-					up->uart_dma.prev_rx_dma_pos;
-	up->port.icount.rx += curr_transmitted_size;
-	tty_insert_flip_string(up->port.state->port.tty,
-			up->uart_dma.rx_buf +
-			(up->uart_dma.prev_rx_dma_pos -
-			up->uart_dma.rx_buf_dma_phys),
-			curr_transmitted_size);
-	tty_flip_buffer_push(up->port.state->port.tty);
-	if (up->uart_dma.rx_buf_size +
-			up->uart_dma.rx_buf_dma_phys == curr_dma_pos) {
-		omap_start_dma(up->uart_dma.rx_dma_channel);
-		up->uart_dma.prev_rx_dma_pos = up->uart_dma.rx_buf_dma_phys;
-	} else
-		up->uart_dma.prev_rx_dma_pos = curr_dma_pos;
-
-	mod_timer(&up->uart_dma.rx_timer, jiffies +
-		usecs_to_jiffies(up->uart_dma.rx_poll_rate));
+	up->port.icount.rx += count;
+	dma->stats.rx_dma_bytes += count;
+	dma->stats.rx_pushes++;
 	up->port_activity = jiffies;
+
+	spin_unlock(&up->port.lock);
+	tty_flip_buffer_push(tty);
+	spin_lock(&up->port.lock);
 }
 
 static void uart_rx_dma_callback(int lch, u16 ch_status, void *data)
 {
-	return;
+	struct uart_omap_port *up = data;
+	unsigned long flags;
+
+	/* The ring wrapped around, flush its tail before it is overwritten */
+	spin_lock_irqsave(&up->port.lock, flags);
+	if (up->uart_dma.rx_dma_used) {
+		up->uart_dma.stats.rx_wraps++;
+		serial_omap_rxdma_drain(up);
+	}
+	spin_unlock_irqrestore(&up->port.lock, flags);
 }
 
 static int serial_omap_start_rxdma(struct uart_omap_port *up)
@@ -1295,17 +1361,23 @@ static int serial_omap_start_rxdma(struct uart_omap_port *up)
 		omap_set_dma_dest_params(up->uart_dma.rx_dma_channel, 0,
 				OMAP_DMA_AMODE_POST_INC,
 				up->uart_dma.rx_buf_dma_phys, 0, 0);
+		/* One frame per DMA request, one block per ring */
 		omap_set_dma_transfer_params(up->uart_dma.rx_dma_channel,
 				OMAP_DMA_DATA_TYPE_S8,
-				up->uart_dma.rx_buf_size, 1,
-				OMAP_DMA_SYNC_ELEMENT,
-				up->uart_dma.uart_dma_rx, 0);
+				OMAP_UART_RX_DMA_BURST,
+				up->uart_dma.rx_buf_size /
+					OMAP_UART_RX_DMA_BURST,
+				OMAP_DMA_SYNC_FRAME,
+				up->uart_dma.uart_dma_rx, OMAP_DMA_SRC_SYNC);
+		/* Loop the channel onto itself */
+		omap_dma_link_lch(up->uart_dma.rx_dma_channel,
+				up->uart_dma.rx_dma_channel);
+		omap_enable_dma_irq(up->uart_dma.rx_dma_channel,
+				OMAP_DMA_BLOCK_IRQ);
 	}
 	up->uart_dma.prev_rx_dma_pos = up->uart_dma.rx_buf_dma_phys;
-	/* FIXME: Cache maintenance needed here? */
+	/* rx_buf is coherent memory, no cache maintenance needed */
 	omap_start_dma(up->uart_dma.rx_dma_channel);
-	mod_timer(&up->uart_dma.rx_timer, jiffies +
-				usecs_to_jiffies(up->uart_dma.rx_poll_rate));
 	up->uart_dma.rx_dma_used = true;
 
 	if (up->plat_hold_wakelock)
@@ -1385,6 +1457,30 @@ static void uart_tx_dma_callback(int lch, u16 ch_status, void *data)
 	return;
 }
 
+static ssize_t serial_omap_show_rx_dma_stats(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct uart_omap_port *up = dev_get_drvdata(dev);
+	struct uart_omap_dma_stats st;
+	unsigned long flags;
+
+	spin_lock_irqsave(&up->port.lock, flags);
+	st = up->uart_dma.stats;
+	spin_unlock_irqrestore(&up->port.lock, flags);
+
+	return snprintf(buf, PAGE_SIZE,
+			"dma bytes: %lu\n"
+			"pio bytes: %lu\n"
+			"pushes: %lu\n"
+			"timeouts: %lu\n"
+			"wraps: %lu\n",
+			st.rx_dma_bytes, st.rx_pio_bytes, st.rx_pushes,
+			st.rx_timeouts, st.rx_wraps);
+}
+
+static DEVICE_ATTR(rx_dma_stats, S_IRUGO, serial_omap_show_rx_dma_stats,
+		NULL);
+
 static int serial_omap_probe(struct platform_device *pdev)
 {
 	struct uart_omap_port	*up;
@@ -1455,8 +1551,10 @@ static int serial_omap_probe(struct platform_device *pdev)
 		up->uart_dma.uart_dma_rx = dma_rx->start;
 		up->use_dma = omap_up_info->use_dma;
 		up->uart_dma.tx_threshold = omap_up_info->omap4_tx_threshold;
-		up->uart_dma.rx_buf_size = omap_up_info->dma_rx_buf_size;
-		up->uart_dma.rx_poll_rate = omap_up_info->dma_rx_poll_rate;
+		/* The ring is made of whole DMA frames */
+		up->uart_dma.rx_buf_size = omap_up_info->dma_rx_buf_size &
+					~(OMAP_UART_RX_DMA_BURST - 1);
+		up->uart_dma.rx_timeout = omap_up_info->dma_rx_timeout;
 		spin_lock_init(&(up->uart_dma.tx_lock));
 		spin_lock_init(&(up->uart_dma.rx_lock));
 		up->uart_dma.tx_dma_channel = OMAP_UART_DMA_CH_FREE;
@@ -1471,6 +1569,11 @@ static int serial_omap_probe(struct platform_device *pdev)
 		goto do_release_region;
 
 	platform_set_drvdata(pdev, up);
+
+	if (up->use_dma && device_create_file(&pdev->dev,
+				&dev_attr_rx_dma_stats))
+		dev_warn(&pdev->dev, "cannot create rx_dma_stats attribute\n");
+
 	return 0;
 err:
 	dev_err(&pdev->dev, "[UART%d]: failure [%s]: %d\n",
@@ -1486,6 +1589,8 @@ static int serial_omap_remove(struct platform_device *dev)
 
 	platform_set_drvdata(dev, NULL);
 	if (up) {
+		if (up->use_dma)
+			device_remove_file(&dev->dev, &dev_attr_rx_dma_stats);
 		uart_remove_one_port(&serial_omap_reg, &up->port);
 		kfree(up);
 	}
@@ -1668,9 +1773,27 @@ int omap_uart_active(int num, u32 timeout)
 		return 1;
 
 	/* Check if DMA channels are active */
-	if (up->use_dma && (up->uart_dma.rx_dma_channel != OMAP_UART_DMA_CH_FREE ||
-		up->uart_dma.tx_dma_channel != OMAP_UART_DMA_CH_FREE))
-		return 1;
+	if (up->use_dma) {
+		unsigned long flags;
+
+		if (up->uart_dma.tx_dma_channel != OMAP_UART_DMA_CH_FREE)
+			return 1;
+
+		/*
+		 * The RX ring would run forever: once the port has been quiet
+		 * for rx_timeout, release it. The next character restarts it
+		 * from the RX interrupt.
+		 */
+		if (up->uart_dma.rx_dma_channel != OMAP_UART_DMA_CH_FREE) {
+			if (jiffies - up->port_activity <
+						up->uart_dma.rx_timeout)
+				return 1;
+
+			spin_lock_irqsave(&up->port.lock, flags);
+			serial_omap_stop_rxdma(up);
+			spin_unlock_irqrestore(&up->port.lock, flags);
+		}
+	}
 
 	return 0;
 }
@@ -34,6 +34,11 @@
 #include <linux/io.h>
 #include <linux/slab.h>
 #include <linux/pm_runtime.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include <linux/spi/spi.h>
 
@@ -98,11 +103,29 @@ struct omap2_mcspi_dma {
  */
 #define DMA_MIN_BYTES			160
 
+/* keep the module clocks this long after the last message */
+#define OMAP2_MCSPI_CLOCKS_IDLE		msecs_to_jiffies(20)
+
+struct omap2_mcspi_stats {
+	unsigned long		msgs;
+	unsigned long		inline_msgs;
+	u64			bytes;
+	u64			busy_us;
+	u64			lat_total_us;
+	u32			lat_max_us;
+};
+
 struct omap2_mcspi {
-	struct work_struct	work;
+	struct task_struct	*pump;
 	/* lock protects queue and registers */
 	spinlock_t		lock;
 	struct list_head	msg_queue;
+	/* bus_lock is held while a message runs, by the pump or inline */
+	struct mutex		bus_lock;
+	bool			clocks_held;
+	unsigned long		last_xfer;
+	struct delayed_work	clocks_work;
+	struct omap2_mcspi_stats stats;
 	struct spi_master	*master;
 	/* Virtual base address of the controller */
 	void __iomem		*base;
@@ -170,8 +193,6 @@ static struct reg_type ch_reg_type[] = {
 };
 #endif
 
-static struct workqueue_struct *omap2_mcspi_wq;
-
 #define MOD_REG_BIT(val, mask, set) do { \
 	if (set) \
 		val |= mask; \
@@ -1109,16 +1130,66 @@ static void omap2_mcspi_cleanup(struct spi_device *spi)
 	}
 }
 
-static void omap2_mcspi_work(struct work_struct *work)
+/* Called with bus_lock held */
+static int omap2_mcspi_hold_clocks(struct omap2_mcspi *mcspi)
+{
+	if (!mcspi->clocks_held) {
+		if (omap2_mcspi_enable_clocks(mcspi) < 0)
+			return -ENODEV;
+		mcspi->clocks_held = true;
+	}
+	mcspi->last_xfer = jiffies;
+	schedule_delayed_work(&mcspi->clocks_work, OMAP2_MCSPI_CLOCKS_IDLE);
+
+	return 0;
+}
+
+static void omap2_mcspi_clocks_idle(struct work_struct *work)
 {
 	struct omap2_mcspi	*mcspi;
+	unsigned long		idle;
 
-	mcspi = container_of(work, struct omap2_mcspi, work);
+	mcspi = container_of(work, struct omap2_mcspi, clocks_work.work);
 
-	if (omap2_mcspi_enable_clocks(mcspi) < 0)
-		return;
+	mutex_lock(&mcspi->bus_lock);
+	if (mcspi->clocks_held) {
+		idle = mcspi->last_xfer + OMAP2_MCSPI_CLOCKS_IDLE;
+		if (time_before(jiffies, idle)) {
+			schedule_delayed_work(&mcspi->clocks_work,
+					idle - jiffies);
+		} else {
+			omap2_mcspi_disable_clocks(mcspi);
+			mcspi->clocks_held = false;
+		}
+	}
+	mutex_unlock(&mcspi->bus_lock);
+}
 
-	spin_lock_irq(&mcspi->lock);
+/* The submission time is kept in m->state, in (wrapping) microseconds */
+static inline u32 omap2_mcspi_now_us(void)
+{
+	return (u32)ktime_to_us(ktime_get());
+}
+
+/* Called with bus_lock held */
+static void omap2_mcspi_run_message(struct omap2_mcspi *mcspi,
+		struct spi_message *m, bool inline_msg)
+{
+	struct spi_device		*spi;
+	struct spi_transfer		*t = NULL;
+	int				cs_active = 0;
+	struct omap2_mcspi_cs		*cs;
+	struct omap2_mcspi_device_config *cd;
+	int				par_override = 0;
+	int				status = 0;
+	u32				chconf, start, end;
+
+	start = omap2_mcspi_now_us();
+
+	if (omap2_mcspi_hold_clocks(mcspi) < 0) {
+		status = -ENODEV;
+		goto out;
+	}
 
 	/* We only enable one channel at a time -- the one whose message is
 	 * at the head of the queue -- although this controller would gladly
@@ -1126,125 +1197,182 @@ static void omap2_mcspi_work(struct work_struct *work)
 	 * channel" master mode.  As a side effect, we need to manage the
 	 * chipselect with the FORCE bit ... CS != channel enable.
 	 */
-	while (!list_empty(&mcspi->msg_queue)) {
-		struct spi_message		*m;
-		struct spi_device		*spi;
-		struct spi_transfer		*t = NULL;
-		int				cs_active = 0;
-		struct omap2_mcspi_cs		*cs;
-		struct omap2_mcspi_device_config *cd;
-		int				par_override = 0;
-		int				status = 0;
-		u32				chconf;
-
-		m = container_of(mcspi->msg_queue.next, struct spi_message,
-				 queue);
-
-		list_del_init(&m->queue);
-		spin_unlock_irq(&mcspi->lock);
+	spi = m->spi;
+	cs = spi->controller_state;
+	cd = spi->controller_data;
 
-		spi = m->spi;
-		cs = spi->controller_state;
-		cd = spi->controller_data;
-
-		omap2_mcspi_set_enable(spi, 1);
-		list_for_each_entry(t, &m->transfers, transfer_list) {
-			if (t->tx_buf == NULL && t->rx_buf == NULL && t->len) {
-				status = -EINVAL;
+	omap2_mcspi_set_enable(spi, 1);
+	list_for_each_entry(t, &m->transfers, transfer_list) {
+		if (t->tx_buf == NULL && t->rx_buf == NULL && t->len) {
+			status = -EINVAL;
+			break;
+		}
+		if (par_override || t->speed_hz || t->bits_per_word) {
+			par_override = 1;
+			status = omap2_mcspi_setup_transfer(spi, t);
+			if (status < 0)
 				break;
-			}
-			if (par_override || t->speed_hz || t->bits_per_word) {
-				par_override = 1;
-				status = omap2_mcspi_setup_transfer(spi, t);
-				if (status < 0)
-					break;
-				if (!t->speed_hz && !t->bits_per_word)
-					par_override = 0;
-			}
+			if (!t->speed_hz && !t->bits_per_word)
+				par_override = 0;
+		}
 
-			if ((!cs_active) && (mcspi->force_cs_mode) &&
-				(mcspi->mcspi_mode ==
-				OMAP2_MCSPI_MASTER)) {
+		if ((!cs_active) && (mcspi->force_cs_mode) &&
+			(mcspi->mcspi_mode ==
+			OMAP2_MCSPI_MASTER)) {
 
-				omap2_mcspi_force_cs(spi, 1);
-				cs_active = 1;
-			}
+			omap2_mcspi_force_cs(spi, 1);
+			cs_active = 1;
+		}
 
-			chconf = mcspi_cached_chconf0(spi);
-			chconf &= ~OMAP2_MCSPI_CHCONF_TRM_MASK;
-			chconf &= ~OMAP2_MCSPI_CHCONF_TURBO;
+		chconf = mcspi_cached_chconf0(spi);
+		chconf &= ~OMAP2_MCSPI_CHCONF_TRM_MASK;
+		chconf &= ~OMAP2_MCSPI_CHCONF_TURBO;
 
-			if (t->tx_buf == NULL)
-				chconf |= OMAP2_MCSPI_CHCONF_TRM_RX_ONLY;
-			else if (t->rx_buf == NULL)
-				chconf |= OMAP2_MCSPI_CHCONF_TRM_TX_ONLY;
-
-			if (cd && cd->turbo_mode && t->tx_buf == NULL) {
-				/* Turbo mode is for more than one word */
-				if (t->len > ((cs->word_len + 7) >> 3))
-					chconf |= OMAP2_MCSPI_CHCONF_TURBO;
-			}
+		if (t->tx_buf == NULL)
+			chconf |= OMAP2_MCSPI_CHCONF_TRM_RX_ONLY;
+		else if (t->rx_buf == NULL)
+			chconf |= OMAP2_MCSPI_CHCONF_TRM_TX_ONLY;
 
-			mcspi_write_chconf0(spi, chconf);
+		if (cd && cd->turbo_mode && t->tx_buf == NULL) {
+			/* Turbo mode is for more than one word */
+			if (t->len > ((cs->word_len + 7) >> 3))
+				chconf |= OMAP2_MCSPI_CHCONF_TURBO;
+		}
 
-			if (t->len) {
-				unsigned	count;
+		mcspi_write_chconf0(spi, chconf);
 
-				/* RX_ONLY mode needs dummy data in TX reg */
-				if (t->tx_buf == NULL)
-					__raw_writel(0, cs->base
-						+ mcspi->regs[OMAP2_MCSPI_TX0]);
+		if (t->len) {
+			unsigned	count;
 
-				if (m->is_dma_mapped ||
-					t->len >= DMA_MIN_BYTES ||
-					mcspi->dma_mode)
+			/* RX_ONLY mode needs dummy data in TX reg */
+			if (t->tx_buf == NULL)
+				__raw_writel(0, cs->base
+					+ mcspi->regs[OMAP2_MCSPI_TX0]);
 
-					count = omap2_mcspi_txrx_dma(spi, t);
-				else
-					count = omap2_mcspi_txrx_pio(spi, t);
+			if (m->is_dma_mapped ||
+				t->len >= DMA_MIN_BYTES ||
+				mcspi->dma_mode)
 
-				m->actual_length += count;
+				count = omap2_mcspi_txrx_dma(spi, t);
+			else
+				count = omap2_mcspi_txrx_pio(spi, t);
 
-				if (count != t->len) {
-					status = -EIO;
-					break;
-				}
+			m->actual_length += count;
+
+			if (count != t->len) {
+				status = -EIO;
+				break;
 			}
+		}
 
-			if (t->delay_usecs)
-				udelay(t->delay_usecs);
+		if (t->delay_usecs)
+			udelay(t->delay_usecs);
 
-			/* ignore the "leave it on after last xfer" hint */
-			if ((t->cs_change) && (mcspi->force_cs_mode) &&
-				(mcspi->mcspi_mode ==
-				OMAP2_MCSPI_MASTER)) {
+		/* ignore the "leave it on after last xfer" hint */
+		if ((t->cs_change) && (mcspi->force_cs_mode) &&
+			(mcspi->mcspi_mode ==
+			OMAP2_MCSPI_MASTER)) {
 
-				omap2_mcspi_force_cs(spi, 0);
-				cs_active = 0;
-			}
+			omap2_mcspi_force_cs(spi, 0);
+			cs_active = 0;
 		}
+	}
 
-		/* Restore defaults if they were overriden */
-		if (par_override) {
-			par_override = 0;
-			status = omap2_mcspi_setup_transfer(spi, NULL);
-		}
+	/* Restore defaults if they were overriden */
+	if (par_override) {
+		par_override = 0;
+		status = omap2_mcspi_setup_transfer(spi, NULL);
+	}
 
-		if ((cs_active) && (mcspi->force_cs_mode) &&
-			(mcspi->mcspi_mode == OMAP2_MCSPI_MASTER))
-				omap2_mcspi_force_cs(spi, 0);
+	if ((cs_active) && (mcspi->force_cs_mode) &&
+		(mcspi->mcspi_mode == OMAP2_MCSPI_MASTER))
+			omap2_mcspi_force_cs(spi, 0);
 
-		omap2_mcspi_set_enable(spi, 0);
+	omap2_mcspi_set_enable(spi, 0);
+
+out:
+	end = omap2_mcspi_now_us();
+	mcspi->stats.msgs++;
+	if (inline_msg)
+		mcspi->stats.inline_msgs++;
+	mcspi->stats.bytes += m->actual_length;
+	mcspi->stats.busy_us += end - start;
+	start = (u32)(unsigned long)m->state;
+	mcspi->stats.lat_total_us += end - start;
+	if (end - start > mcspi->stats.lat_max_us)
+		mcspi->stats.lat_max_us = end - start;
+
+	m->status = status;
+	m->complete(m->context);
+}
 
-		m->status = status;
-		m->complete(m->context);
+static int omap2_mcspi_pump_thread(void *data)
+{
+	struct omap2_mcspi	*mcspi = data;
+	struct sched_param	param = { .sched_priority = MAX_RT_PRIO - 1 };
+	struct spi_message	*m;
+
+	sched_setscheduler(current, SCHED_FIFO, &param);
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (list_empty(&mcspi->msg_queue)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
 
+		/* Messages are dequeued with bus_lock held, which keeps the
+		 * inline path from overtaking them.
+		 */
+		mutex_lock(&mcspi->bus_lock);
 		spin_lock_irq(&mcspi->lock);
+		while (!list_empty(&mcspi->msg_queue)) {
+			m = container_of(mcspi->msg_queue.next,
+					struct spi_message, queue);
+			list_del_init(&m->queue);
+			spin_unlock_irq(&mcspi->lock);
+
+			omap2_mcspi_run_message(mcspi, m, false);
+
+			spin_lock_irq(&mcspi->lock);
+		}
+		spin_unlock_irq(&mcspi->lock);
+		mutex_unlock(&mcspi->bus_lock);
 	}
+	__set_current_state(TASK_RUNNING);
 
-	spin_unlock_irq(&mcspi->lock);
+	return 0;
+}
 
-	omap2_mcspi_disable_clocks(mcspi);
+/*
+ * Short PIO messages of devices flagged inline_sync are run right away in
+ * the caller's context when the bus is idle, saving the pump wakeup.
+ * Returns false if the message must be queued instead.
+ */
+static bool omap2_mcspi_run_inline(struct omap2_mcspi *mcspi,
+		struct spi_device *spi, struct spi_message *m, bool pio)
+{
+	struct omap2_mcspi_device_config *cd = spi->controller_data;
+	unsigned long	flags;
+	bool		idle;
+
+	if (!pio || !cd || !cd->inline_sync || in_interrupt() ||
+			irqs_disabled())
+		return false;
+
+	if (!mutex_trylock(&mcspi->bus_lock))
+		return false;
+
+	spin_lock_irqsave(&mcspi->lock, flags);
+	idle = list_empty(&mcspi->msg_queue);
+	spin_unlock_irqrestore(&mcspi->lock, flags);
+
+	if (idle)
+		omap2_mcspi_run_message(mcspi, m, true);
+	mutex_unlock(&mcspi->bus_lock);
+
+	return idle;
 }
 
 static int omap2_mcspi_transfer(struct spi_device *spi, struct spi_message *m)
@@ -1252,9 +1380,11 @@ static int omap2_mcspi_transfer(struct spi_device *spi, struct spi_message *m)
 	struct omap2_mcspi	*mcspi;
 	unsigned long		flags;
 	struct spi_transfer	*t;
+	bool			pio = true;
 
 	m->actual_length = 0;
 	m->status = 0;
+	m->state = (void *)(unsigned long)omap2_mcspi_now_us();
 
 	mcspi = spi_master_get_devdata(spi->master);
 
@@ -1293,8 +1423,12 @@ static int omap2_mcspi_transfer(struct spi_device *spi, struct spi_message *m)
 
 		/* Ignore DMA_MIN_BYTES check if dma only mode is set */
 		if (m->is_dma_mapped || ((len < DMA_MIN_BYTES) &&
-						(!mcspi->dma_mode)))
+						(!mcspi->dma_mode))) {
+			if (m->is_dma_mapped)
+				pio = false;
 			continue;
+		}
+		pio = false;
 
 		/* Do DMA mapping "early" for better error reporting and
 		 * dcache use.  Note that if dma_unmap_single() ever starts
@@ -1324,14 +1458,44 @@ static int omap2_mcspi_transfer(struct spi_device *spi, struct spi_message *m)
 		}
 	}
 
+	if (omap2_mcspi_run_inline(mcspi, spi, m, pio))
+		return 0;
+
 	spin_lock_irqsave(&mcspi->lock, flags);
 	list_add_tail(&m->queue, &mcspi->msg_queue);
-	queue_work(omap2_mcspi_wq, &mcspi->work);
 	spin_unlock_irqrestore(&mcspi->lock, flags);
+	wake_up_process(mcspi->pump);
 
 	return 0;
 }
 
+static ssize_t omap2_mcspi_show_stats(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct spi_master	*master = dev_get_drvdata(dev);
+	struct omap2_mcspi	*mcspi = spi_master_get_devdata(master);
+	struct omap2_mcspi_stats st;
+
+	mutex_lock(&mcspi->bus_lock);
+	st = mcspi->stats;
+	mutex_unlock(&mcspi->bus_lock);
+
+	return snprintf(buf, PAGE_SIZE,
+			"messages: %lu\n"
+			"inline: %lu\n"
+			"bytes: %llu\n"
+			"throughput: %llu KiB/s\n"
+			"latency avg: %llu us\n"
+			"latency max: %u us\n",
+			st.msgs, st.inline_msgs, st.bytes,
+			st.busy_us ? div64_u64(st.bytes * 1000000 >> 10,
+					st.busy_us) : 0,
+			st.msgs ? div64_u64(st.lat_total_us, st.msgs) : 0,
+			st.lat_max_us);
+}
+
+static DEVICE_ATTR(stats, S_IRUGO, omap2_mcspi_show_stats, NULL);
+
 static int __init omap2_mcspi_reset(struct omap2_mcspi *mcspi)
 {
 	struct spi_master	*master = mcspi->master;
@@ -1432,9 +1596,10 @@ static int __init omap2_mcspi_probe(struct platform_device *pdev)
 	}
 
 	mcspi->dev = &pdev->dev;
-	INIT_WORK(&mcspi->work, omap2_mcspi_work);
+	INIT_DELAYED_WORK(&mcspi->clocks_work, omap2_mcspi_clocks_idle);
 
 	spin_lock_init(&mcspi->lock);
+	mutex_init(&mcspi->bus_lock);
 	INIT_LIST_HEAD(&mcspi->msg_queue);
 	INIT_LIST_HEAD(&omap2_mcspi_ctx[master->bus_num - 1].cs);
 
@@ -1476,6 +1641,13 @@ static int __init omap2_mcspi_probe(struct platform_device *pdev)
 	if (status || omap2_mcspi_reset(mcspi) < 0)
 		goto err3;
 
+	mcspi->pump = kthread_run(omap2_mcspi_pump_thread, mcspi, "%s",
+			dev_name(&pdev->dev));
+	if (IS_ERR(mcspi->pump)) {
+		status = PTR_ERR(mcspi->pump);
+		goto err3;
+	}
+
 	status = spi_register_master(master);
 	if (status < 0)
 		goto err4;
@@ -1486,10 +1658,15 @@ static int __init omap2_mcspi_probe(struct platform_device *pdev)
 		printk(KERN_ERR "McSPI irq interrupt request failed");
 		goto err5;
 	}
+
+	if (device_create_file(&pdev->dev, &dev_attr_stats))
+		dev_warn(&pdev->dev, "cannot create stats attribute\n");
+
 	return status;
 err5:
 	spi_unregister_master(master);
 err4:
+	kthread_stop(mcspi->pump);
 	spi_master_put(master);
 err3:
 	kfree(mcspi->dma_channels);
@@ -1512,7 +1689,11 @@ static int __exit omap2_mcspi_remove(struct platform_device *pdev)
 	mcspi = spi_master_get_devdata(master);
 	dma_channels = mcspi->dma_channels;
 
-	omap2_mcspi_disable_clocks(mcspi);
+	device_remove_file(&pdev->dev, &dev_attr_stats);
+	kthread_stop(mcspi->pump);
+	cancel_delayed_work_sync(&mcspi->clocks_work);
+	if (mcspi->clocks_held)
+		omap2_mcspi_disable_clocks(mcspi);
 	r = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	release_mem_region(r->start, (r->end - r->start) + 1);
 
@@ -1543,10 +1724,6 @@ static struct platform_driver omap2_mcspi_driver = {
 
 static int __init omap2_mcspi_init(void)
 {
-	omap2_mcspi_wq = create_singlethread_workqueue(
-				omap2_mcspi_driver.driver.name);
-	if (omap2_mcspi_wq == NULL)
-		return -1;
 	return platform_driver_probe(&omap2_mcspi_driver, omap2_mcspi_probe);
 }
 subsys_initcall(omap2_mcspi_init);
@@ -1554,8 +1731,6 @@ subsys_initcall(omap2_mcspi_init);
 static void __exit omap2_mcspi_exit(void)
 {
 	platform_driver_unregister(&omap2_mcspi_driver);
-
-	destroy_workqueue(omap2_mcspi_wq);
 }
 module_exit(omap2_mcspi_exit);
 
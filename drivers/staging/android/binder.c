@@ -16,6 +16,7 @@
  */
 
 #include <asm/cacheflush.h>
+#include <linux/cpufreq.h>
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
@@ -1537,6 +1538,10 @@ static void binder_transaction(struct binder_proc *proc,
 		t->from = thread;
 	else
 		t->from = NULL;
+
+	/* a task at nice <= 0 waits for the reply: make it quick */
+	if (!reply && !(tr->flags & TF_ONE_WAY) && task_nice(current) <= 0)
+		cpufreq_hotplug_boost_hint();
 	t->sender_euid = proc->tsk->cred->euid;
 	t->to_proc = target_proc;
 	t->to_thread = target_thread;
@@ -27,6 +27,8 @@
 #include <linux/platform_device.h>
 #include <linux/kernel.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
 #include <linux/omapfb.h>
 
 #include <plat/display.h>
@@ -511,6 +513,91 @@ static ssize_t show_virt(struct device *dev,
 	return snprintf(buf, PAGE_SIZE, "%p\n", ofbi->region->vaddr);
 }
 
+/* Copy a frame out of a VRFB view and back, returns the time taken in us */
+static s64 vrfb_bench_view(void __iomem *vaddr, void *tmp, unsigned lines,
+		size_t line_len, unsigned long stride)
+{
+	ktime_t start = ktime_get();
+	unsigned i;
+
+	for (i = 0; i < lines; i++) {
+		memcpy_fromio(tmp, vaddr + i * stride, line_len);
+		memcpy_toio(vaddr + i * stride, tmp, line_len);
+	}
+
+	return ktime_to_us(ktime_sub(ktime_get(), start));
+}
+
+/*
+ * Measure the CPU blit throughput through the unrotated and the 90 degree
+ * VRFB views of the framebuffer. The frame contents are left untouched.
+ */
+static ssize_t show_vrfb_bench(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fbi = dev_get_drvdata(dev);
+	struct omapfb_info *ofbi = FB2OFB(fbi);
+	struct omapfb2_mem_region *rg;
+	struct vrfb *vrfb;
+	unsigned long stride, bytes;
+	bool unmap = false;
+	s64 t0, t90;
+	void *tmp;
+	int r;
+
+	if (ofbi->rotation_type != OMAP_DSS_ROT_VRFB)
+		return -ENODEV;
+
+	if (!lock_fb_info(fbi))
+		return -ENODEV;
+
+	rg = omapfb_get_mem_region(ofbi->region);
+	vrfb = &rg->vrfb;
+
+	if (!vrfb->vaddr[0]) {
+		r = -ENODEV;
+		goto out;
+	}
+
+	tmp = kmalloc(max(vrfb->xres, vrfb->yres) * vrfb->bytespp, GFP_KERNEL);
+	if (!tmp) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	if (!vrfb->vaddr[1]) {
+		r = omap_vrfb_map_angle(vrfb, vrfb->xres, 1);
+		if (r)
+			goto free;
+		unmap = true;
+	}
+
+	stride = OMAP_VRFB_LINE_LEN * vrfb->bytespp;
+	bytes = 2 * vrfb->xres * vrfb->yres * vrfb->bytespp;
+
+	t0 = vrfb_bench_view(vrfb->vaddr[0], tmp, vrfb->yres,
+			vrfb->xres * vrfb->bytespp, stride);
+	t90 = vrfb_bench_view(vrfb->vaddr[1], tmp, vrfb->xres,
+			vrfb->yres * vrfb->bytespp, stride);
+
+	if (unmap) {
+		iounmap(vrfb->vaddr[1]);
+		vrfb->vaddr[1] = NULL;
+	}
+
+	/* bytes per us is MB/s */
+	r = snprintf(buf, PAGE_SIZE, "0: %lu MB/s\n90: %lu MB/s\n",
+			bytes / max_t(unsigned long, t0, 1),
+			bytes / max_t(unsigned long, t90, 1));
+free:
+	kfree(tmp);
+out:
+	omapfb_put_mem_region(rg);
+	unlock_fb_info(fbi);
+
+	return r;
+}
+
 static ssize_t show_fit_to_screen(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -582,6 +669,7 @@ static struct device_attribute omapfb_attrs[] = {
 			store_overlays_rotate),
 	__ATTR(phys_addr, S_IRUGO, show_phys, NULL),
 	__ATTR(virt_addr, S_IRUGO, show_virt, NULL),
+	__ATTR(vrfb_bench, S_IRUSR, show_vrfb_bench, NULL),
 };
 
 int omapfb_create_sysfs(struct omapfb2_device *fbdev)
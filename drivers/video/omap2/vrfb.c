@@ -25,7 +25,6 @@
 #include <linux/ioport.h>
 #include <linux/io.h>
 #include <linux/bitops.h>
-#include <linux/mutex.h>
 
 #include <mach/io.h>
 #include <plat/vrfb.h>
@@ -59,7 +58,19 @@
 /* bitmap of reserved contexts */
 static unsigned long ctx_map;
 
-static DEFINE_MUTEX(ctx_lock);
+/*
+ * Bitmap of contexts whose virtual areas are still reserved. A released
+ * context keeps its areas, so that handing it out again is only a bit
+ * operation and no longer needs a lock.
+ */
+static unsigned long ctx_areas;
+
+/*
+ * Bitmap of contexts whose registers hold vrfb_hw_context. Only these need
+ * to be written back after off-mode, and omap_vrfb_setup() only writes the
+ * registers that changed for them.
+ */
+static unsigned long ctx_valid;
 
 /*
  * Access to this happens from client drivers or the PM core after wake-up.
@@ -80,6 +91,26 @@ static inline void restore_hw_context(int ctx)
 	omap2_sms_write_rot_physical_ba(vrfb_hw_context[ctx].physical_ba, ctx);
 }
 
+static int reserve_areas(u8 ctx)
+{
+	int rot;
+
+	for (rot = 0; rot < 4; ++rot) {
+		if (!request_mem_region(SMS_ROT_VIRT_BASE(ctx, rot),
+					OMAP_VRFB_SIZE, "vrfb")) {
+			pr_err("vrfb: failed to reserve VRFB "
+					"area for ctx %d, rotation %d\n",
+					ctx, rot * 90);
+			while (rot--)
+				release_mem_region(SMS_ROT_VIRT_BASE(ctx, rot),
+						OMAP_VRFB_SIZE);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
 static u32 get_image_width_roundup(u16 width, u8 bytespp)
 {
 	unsigned long stride = width * bytespp;
@@ -103,7 +134,7 @@ static inline u32 get_extra_physical_size(u16 image_width_roundup, u8 bytespp)
 void omap_vrfb_restore_context(void)
 {
 	int i;
-	unsigned long map = ctx_map;
+	unsigned long map = ctx_valid;
 
 	for (i = ffs(map); i; i = ffs(map)) {
 		/* i=1..32 */
@@ -202,13 +233,29 @@ void omap_vrfb_setup(struct vrfb *vrfb, unsigned long paddr,
 	control |= VRFB_PAGE_WIDTH_EXP  << SMS_PW_OFFSET;
 	control |= VRFB_PAGE_HEIGHT_EXP << SMS_PH_OFFSET;
 
-	vrfb_hw_context[ctx].physical_ba = paddr;
-	vrfb_hw_context[ctx].size = size;
-	vrfb_hw_context[ctx].control = control;
+	/*
+	 * Flipping between buffers of the same geometry only moves the
+	 * physical base, so leave the other registers alone.
+	 */
+	if (!test_bit(ctx, &ctx_valid) ||
+			vrfb_hw_context[ctx].physical_ba != paddr) {
+		vrfb_hw_context[ctx].physical_ba = paddr;
+		omap2_sms_write_rot_physical_ba(paddr, ctx);
+	}
 
-	omap2_sms_write_rot_physical_ba(paddr, ctx);
-	omap2_sms_write_rot_size(size, ctx);
-	omap2_sms_write_rot_control(control, ctx);
+	if (!test_bit(ctx, &ctx_valid) ||
+			vrfb_hw_context[ctx].size != size) {
+		vrfb_hw_context[ctx].size = size;
+		omap2_sms_write_rot_size(size, ctx);
+	}
+
+	if (!test_bit(ctx, &ctx_valid) ||
+			vrfb_hw_context[ctx].control != control) {
+		vrfb_hw_context[ctx].control = control;
+		omap2_sms_write_rot_control(control, ctx);
+	}
+
+	set_bit(ctx, &ctx_valid);
 
 	DBG("vrfb offset pixels %d, %d\n",
 			vrfb_width - width, vrfb_height - height);
@@ -250,73 +297,69 @@ void omap_vrfb_release_ctx(struct vrfb *vrfb)
 
 	DBG("release ctx %d\n", ctx);
 
-	mutex_lock(&ctx_lock);
+	BUG_ON(!test_bit(ctx, &ctx_map));
 
-	BUG_ON(!(ctx_map & (1 << ctx)));
-
-	clear_bit(ctx, &ctx_map);
+	/* The registers are lost in off-mode once nobody restores them */
+	clear_bit(ctx, &ctx_valid);
 
-	for (rot = 0; rot < 4; ++rot) {
-		if (vrfb->paddr[rot]) {
-			release_mem_region(vrfb->paddr[rot], OMAP_VRFB_SIZE);
-			vrfb->paddr[rot] = 0;
-		}
-	}
+	for (rot = 0; rot < 4; ++rot)
+		vrfb->paddr[rot] = 0;
 
 	vrfb->context = 0xff;
 
-	mutex_unlock(&ctx_lock);
+	/* Keep the areas reserved for the next user of the context */
+	smp_mb__before_clear_bit();
+	clear_bit(ctx, &ctx_map);
 }
 EXPORT_SYMBOL(omap_vrfb_release_ctx);
 
 int omap_vrfb_request_ctx(struct vrfb *vrfb)
 {
 	int rot;
-	u32 paddr;
 	u8 ctx;
 	int r;
 
 	DBG("request ctx\n");
 
-	mutex_lock(&ctx_lock);
+	do {
+		/* Prefer a context whose areas are still reserved */
+		for (ctx = 0; ctx < VRFB_NUM_CTXS; ++ctx)
+			if (test_bit(ctx, &ctx_areas) &&
+					!test_bit(ctx, &ctx_map))
+				break;
 
-	for (ctx = 0; ctx < VRFB_NUM_CTXS; ++ctx)
-		if ((ctx_map & (1 << ctx)) == 0)
-			break;
+		if (ctx == VRFB_NUM_CTXS)
+			ctx = find_first_zero_bit(&ctx_map, VRFB_NUM_CTXS);
 
-	if (ctx == VRFB_NUM_CTXS) {
-		pr_err("vrfb: no free contexts\n");
-		r = -EBUSY;
-		goto out;
-	}
+		if (ctx >= VRFB_NUM_CTXS) {
+			pr_err("vrfb: no free contexts\n");
+			return -EBUSY;
+		}
+	} while (test_and_set_bit(ctx, &ctx_map));
 
 	DBG("found free ctx %d\n", ctx);
 
-	set_bit(ctx, &ctx_map);
+	/* The context is ours now, nobody else touches its areas */
+	if (!test_bit(ctx, &ctx_areas)) {
+		r = reserve_areas(ctx);
+		if (r) {
+			smp_mb__before_clear_bit();
+			clear_bit(ctx, &ctx_map);
+			return r;
+		}
+		set_bit(ctx, &ctx_areas);
+	}
 
 	memset(vrfb, 0, sizeof(*vrfb));
 
 	vrfb->context = ctx;
 
 	for (rot = 0; rot < 4; ++rot) {
-		paddr = SMS_ROT_VIRT_BASE(ctx, rot);
-		if (!request_mem_region(paddr, OMAP_VRFB_SIZE, "vrfb")) {
-			pr_err("vrfb: failed to reserve VRFB "
-					"area for ctx %d, rotation %d\n",
-					ctx, rot * 90);
-			omap_vrfb_release_ctx(vrfb);
-			r = -ENOMEM;
-			goto out;
-		}
-
-		vrfb->paddr[rot] = paddr;
+		vrfb->paddr[rot] = SMS_ROT_VIRT_BASE(ctx, rot);
 
 		DBG("VRFB %d/%d: %lx\n", ctx, rot*90, vrfb->paddr[rot]);
 	}
 
-	r = 0;
-out:
-	mutex_unlock(&ctx_lock);
-	return r;
+	return 0;
 }
 EXPORT_SYMBOL(omap_vrfb_request_ctx);
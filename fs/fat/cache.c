@@ -13,8 +13,11 @@
 #include <linux/buffer_head.h>
 #include "fat.h"
 
-/* this must be > 0. */
-#define FAT_MAX_CACHE	8
+/*
+ * this must be > 0. Each extent is a run of contiguous clusters, so this
+ * covers large fragmented files (e.g. written in parallel) as well.
+ */
+#define FAT_MAX_CACHE	32
 
 struct fat_cache {
 	struct list_head cache_list;
@@ -215,6 +218,31 @@ static inline void cache_init(struct fat_cache_id *cid, int fclus, int dclus)
 	cid->nr_contig = 0;
 }
 
+/*
+ * Record the cluster fat_chain_add() just linked at the end of the chain,
+ * so that the next append doesn't have to walk the chain to find it.
+ */
+void fat_cache_extend(struct inode *inode, int fclus, int dclus)
+{
+	struct fat_cache_id cid;
+	struct fat_cache *p;
+
+	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
+	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
+		if (p->fcluster + p->nr_contig + 1 == fclus &&
+		    p->dcluster + p->nr_contig + 1 == dclus) {
+			p->nr_contig++;
+			fat_cache_update_lru(inode, p);
+			spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
+			return;
+		}
+	}
+	spin_unlock(&MSDOS_I(inode)->cache_lru_lock);
+
+	cache_init(&cid, fclus, dclus);
+	fat_cache_add(inode, &cid);
+}
+
 int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 {
 	struct super_block *sb = inode->i_sb;
@@ -332,12 +332,20 @@ parse_long:
 	return 0;
 }
 
-/*
- * Return values: negative -> error, 0 -> not found, positive -> found,
- * value is the total amount of slots, including the shortname entry.
+/**
+ * fat_walk_names - Call @actor on the names of directory records.
+ *
+ * Records starting in [@start, @end) are parsed, and @actor is called with
+ * their short name, then their long name if any, and the offset of their
+ * first slot. The walk stops when @actor returns non zero: the record is
+ * then returned in @sinfo and the caller must release sinfo->bh.
+ *
+ * Returns zero when @actor stopped the walk, -ENOENT at the end of the range,
+ * or a negative error.
  */
-int fat_search_long(struct inode *inode, const unsigned char *name,
-		    int name_len, struct fat_slot_info *sinfo)
+int fat_walk_names(struct inode *inode, loff_t start, loff_t end,
+		   fat_name_actor_t actor, void *priv,
+		   struct fat_slot_info *sinfo)
 {
 	struct super_block *sb = inode->i_sb;
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
@@ -350,11 +358,14 @@ int fat_search_long(struct inode *inode, const unsigned char *name,
 	unsigned char work[MSDOS_NAME];
 	unsigned char bufname[FAT_MAX_SHORT_SIZE];
 	unsigned short opt_shortname = sbi->options.shortname;
-	loff_t cpos = 0;
+	loff_t cpos = start;
+	loff_t slot_off;
 	int chl, i, j, last_u, err, len;
 
 	err = -ENOENT;
 	while (1) {
+		if (cpos >= end)
+			goto end_of_dir;
 		if (fat_get_entry(inode, &cpos, &bh, &de) == -1)
 			goto end_of_dir;
 parse_record:
@@ -417,19 +428,21 @@ parse_record:
 		if (!last_u)
 			continue;
 
-		/* Compare shortname */
+		slot_off = cpos - (nr_slots + 1) * sizeof(*de);
+
+		/* Shortname */
 		bufuname[last_u] = 0x0000;
 		len = fat_uni_to_x8(sbi, bufuname, bufname, sizeof(bufname));
-		if (fat_name_match(sbi, name, name_len, bufname, len))
+		if (actor(priv, bufname, len, slot_off))
 			goto found;
 
 		if (nr_slots) {
 			void *longname = unicode + FAT_MAX_UNI_CHARS;
 			int size = PATH_MAX - FAT_MAX_UNI_SIZE;
 
-			/* Compare longname */
+			/* Longname */
 			len = fat_uni_to_x8(sbi, unicode, longname, size);
-			if (fat_name_match(sbi, name, name_len, longname, len))
+			if (actor(priv, longname, len, slot_off))
 				goto found;
 		}
 	}
@@ -449,6 +462,54 @@ end_of_dir:
 	return err;
 }
 
+struct fat_match_name {
+	struct msdos_sb_info *sbi;
+	const unsigned char *name;
+	int name_len;
+};
+
+static int fat_match_name_actor(void *priv, const unsigned char *name,
+				int len, loff_t slot_off)
+{
+	struct fat_match_name *match = priv;
+
+	return fat_name_match(match->sbi, match->name, match->name_len,
+			      name, len);
+}
+
+/*
+ * Search @name in the records starting in [@start, @end).
+ */
+int fat_search_long_range(struct inode *inode, const unsigned char *name,
+			  int name_len, struct fat_slot_info *sinfo,
+			  loff_t start, loff_t end)
+{
+	struct fat_match_name match = {
+		.sbi = MSDOS_SB(inode->i_sb),
+		.name = name,
+		.name_len = name_len,
+	};
+
+	return fat_walk_names(inode, start, end, fat_match_name_actor,
+			      &match, sinfo);
+}
+
+/*
+ * Return values: negative -> error, 0 -> found, -ENOENT -> not found.
+ */
+int fat_search_long(struct inode *inode, const unsigned char *name,
+		    int name_len, struct fat_slot_info *sinfo)
+{
+	int err;
+
+	err = fat_dir_index_search(inode, name, name_len, sinfo);
+	if (err != -EAGAIN)
+		return err;
+
+	return fat_search_long_range(inode, name, name_len, sinfo,
+				     0, LLONG_MAX);
+}
+
 EXPORT_SYMBOL_GPL(fat_search_long);
 
 struct fat_ioctl_filldir_callback {
@@ -996,6 +1057,8 @@ int fat_remove_entries(struct inode *dir, struct fat_slot_info *sinfo)
 	 * First stage: Remove the shortname. By this, the directory
 	 * entry is removed.
 	 */
+	fat_dir_index_inval(dir);
+
 	nr_slots = sinfo->nr_slots;
 	de = sinfo->de;
 	sinfo->de = NULL;
@@ -1242,6 +1305,8 @@ int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 	int err, free_slots, i, nr_bhs;
 	loff_t pos, i_pos;
 
+	fat_dir_index_inval(dir);
+
 	sinfo->nr_slots = nr_slots;
 
 	/* First stage: search free direcotry entries */
@@ -0,0 +1,538 @@
+/*
+ *  linux/fs/fat/dirindex.c
+ *
+ *  In-memory name index of large directories
+ *
+ *  fat_search_long() has to parse every record of a directory, long name
+ *  slots included, until it finds the name. On directories holding
+ *  thousands of files, every lookup (and every negative lookup) costs a scan
+ *  of the whole directory.
+ *
+ *  The first lookup in a directory of at least FAT_DIR_INDEX_MIN_SIZE bytes
+ *  builds a sorted array of (name hash, position of the first slot) pairs,
+ *  one for the short name and one for the long name of each record. Lookups
+ *  then only parse the records whose hash matches. The index is dropped
+ *  whenever entries are added to or removed from the directory, and rebuilt
+ *  by the next lookup.
+ *
+ *  Indexes are accounted per filesystem against the dirindex= mount option
+ *  (KiB, 0 disables indexing). The least recently used indexes are dropped
+ *  to make room for a new one.
+ *
+ *  With debugfs, writing the path of a VFAT directory to fat_dirindex_bench
+ *  times the index build and the lookup of every name of the directory,
+ *  through the index and with the linear scan. Reading the file shows the
+ *  results of the last run.
+ */
+
+#include <linux/fs.h>
+#include <linux/dcache.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/namei.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include "fat.h"
+
+#define FAT_DIR_INDEX_MIN_SIZE	(16 * 1024)	/* 512 records */
+#define FAT_DIR_INDEX_MAX_CAND	8		/* else fall back to a scan */
+
+struct fat_dir_index_ent {
+	u32 hash;
+	u32 pos;		/* first slot, in directory entries */
+};
+
+struct fat_dir_index {
+	struct list_head lru;
+	struct inode *dir;
+	unsigned long size;	/* accounted bytes */
+	unsigned int nr;
+	struct fat_dir_index_ent *ents;
+};
+
+struct fat_dir_index_builder {
+	struct msdos_sb_info *sbi;
+	struct fat_dir_index_ent *ents;
+	unsigned int nr;
+	unsigned int max;
+	unsigned int limit;
+	int err;
+};
+
+void fat_dir_index_init(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	spin_lock_init(&sbi->dir_index_lock);
+	INIT_LIST_HEAD(&sbi->dir_index_lru);
+	sbi->dir_index_bytes = 0;
+}
+
+/* Must fold the name exactly as fat_name_match() compares it. */
+static u32 fat_dir_index_hash(struct msdos_sb_info *sbi,
+			      const unsigned char *name, int len)
+{
+	unsigned long hash = init_name_hash();
+
+	if (sbi->options.name_check != 's') {
+		while (len--)
+			hash = partial_name_hash(nls_tolower(sbi->nls_io,
+							     *name++), hash);
+	} else {
+		while (len--)
+			hash = partial_name_hash(*name++, hash);
+	}
+
+	return end_name_hash(hash);
+}
+
+static void fat_dir_index_free(struct fat_dir_index *idx)
+{
+	vfree(idx->ents);
+	kfree(idx);
+}
+
+/* Called with dir_index_lock held. */
+static void __fat_dir_index_detach(struct msdos_sb_info *sbi,
+				   struct fat_dir_index *idx,
+				   struct list_head *dispose)
+{
+	MSDOS_I(idx->dir)->i_dir_index = NULL;
+	sbi->dir_index_bytes -= idx->size;
+	list_move(&idx->lru, dispose);
+}
+
+static void fat_dir_index_dispose(struct list_head *dispose)
+{
+	struct fat_dir_index *idx, *n;
+
+	list_for_each_entry_safe(idx, n, dispose, lru)
+		fat_dir_index_free(idx);
+}
+
+void fat_dir_index_inval(struct inode *dir)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(dir->i_sb);
+	LIST_HEAD(dispose);
+
+	if (!MSDOS_I(dir)->i_dir_index)
+		return;
+
+	spin_lock(&sbi->dir_index_lock);
+	if (MSDOS_I(dir)->i_dir_index)
+		__fat_dir_index_detach(sbi, MSDOS_I(dir)->i_dir_index,
+				       &dispose);
+	spin_unlock(&sbi->dir_index_lock);
+
+	fat_dir_index_dispose(&dispose);
+}
+
+static int fat_dir_index_add(void *priv, const unsigned char *name, int len,
+			     loff_t slot_off)
+{
+	struct fat_dir_index_builder *b = priv;
+
+	if (b->nr == b->max) {
+		struct fat_dir_index_ent *ents;
+		unsigned int max = b->max ? b->max * 2 : 256;
+
+		if (max > b->limit)
+			max = b->limit;
+		if (b->nr == max) {
+			b->err = -ENOSPC;
+			return 1;
+		}
+
+		ents = vmalloc(max * sizeof(*ents));
+		if (!ents) {
+			b->err = -ENOMEM;
+			return 1;
+		}
+		if (b->ents) {
+			memcpy(ents, b->ents, b->nr * sizeof(*ents));
+			vfree(b->ents);
+		}
+		b->ents = ents;
+		b->max = max;
+	}
+
+	b->ents[b->nr].hash = fat_dir_index_hash(b->sbi, name, len);
+	b->ents[b->nr].pos = slot_off >> MSDOS_DIR_BITS;
+	b->nr++;
+
+	return 0;
+}
+
+static int fat_dir_index_cmp(const void *a, const void *b)
+{
+	const struct fat_dir_index_ent *ea = a, *eb = b;
+
+	if (ea->hash != eb->hash)
+		return ea->hash < eb->hash ? -1 : 1;
+	if (ea->pos != eb->pos)
+		return ea->pos < eb->pos ? -1 : 1;
+	return 0;
+}
+
+static int fat_dir_index_build(struct inode *dir)
+{
+	struct super_block *sb = dir->i_sb;
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	unsigned long max_bytes = (unsigned long)sbi->options.dir_index_kb << 10;
+	struct fat_dir_index_builder b;
+	struct fat_dir_index *idx;
+	struct fat_slot_info sinfo;
+	unsigned int i, nr;
+	LIST_HEAD(dispose);
+	int err;
+
+	if (max_bytes <= sizeof(*idx))
+		return -ENOSPC;
+
+	memset(&b, 0, sizeof(b));
+	b.sbi = sbi;
+	b.limit = (max_bytes - sizeof(*idx)) / sizeof(*b.ents);
+
+	err = fat_walk_names(dir, 0, LLONG_MAX, fat_dir_index_add, &b, &sinfo);
+	if (err == 0) {
+		/* The builder stopped the walk */
+		brelse(sinfo.bh);
+		err = b.err;
+	} else if (err == -ENOENT) {
+		err = 0;
+	}
+	if (err)
+		goto out;
+
+	idx = kmalloc(sizeof(*idx), GFP_NOFS);
+	if (!idx) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	/* Short and long names often fold to the same hash. */
+	sort(b.ents, b.nr, sizeof(*b.ents), fat_dir_index_cmp, NULL);
+	for (i = 0, nr = 0; i < b.nr; i++) {
+		if (nr && !fat_dir_index_cmp(&b.ents[nr - 1], &b.ents[i]))
+			continue;
+		b.ents[nr++] = b.ents[i];
+	}
+
+	idx->dir = dir;
+	idx->nr = nr;
+	idx->ents = b.ents;
+	idx->size = sizeof(*idx) + b.max * sizeof(*b.ents);
+	b.ents = NULL;
+
+	spin_lock(&sbi->dir_index_lock);
+	while (sbi->dir_index_bytes + idx->size > max_bytes &&
+	       !list_empty(&sbi->dir_index_lru)) {
+		__fat_dir_index_detach(sbi,
+			list_first_entry(&sbi->dir_index_lru,
+					 struct fat_dir_index, lru),
+			&dispose);
+	}
+	MSDOS_I(dir)->i_dir_index = idx;
+	list_add_tail(&idx->lru, &sbi->dir_index_lru);
+	sbi->dir_index_bytes += idx->size;
+	spin_unlock(&sbi->dir_index_lock);
+
+	fat_dir_index_dispose(&dispose);
+
+out:
+	vfree(b.ents);
+	return err;
+}
+
+/*
+ * Copy the positions of the records matching @hash to @pos. Returns the
+ * number of candidates (FAT_DIR_INDEX_MAX_CAND + 1 meaning too many), or
+ * -ENOENT if the directory has no index.
+ */
+static int fat_dir_index_lookup(struct inode *dir, u32 hash, u32 *pos)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(dir->i_sb);
+	struct fat_dir_index *idx;
+	unsigned int lo, hi, mid;
+	int nr = 0;
+
+	spin_lock(&sbi->dir_index_lock);
+	idx = MSDOS_I(dir)->i_dir_index;
+	if (!idx) {
+		spin_unlock(&sbi->dir_index_lock);
+		return -ENOENT;
+	}
+
+	list_move_tail(&idx->lru, &sbi->dir_index_lru);
+
+	lo = 0;
+	hi = idx->nr;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (idx->ents[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < idx->nr && idx->ents[lo].hash == hash; lo++) {
+		if (nr == FAT_DIR_INDEX_MAX_CAND) {
+			nr++;
+			break;
+		}
+		pos[nr++] = idx->ents[lo].pos;
+	}
+	spin_unlock(&sbi->dir_index_lock);
+
+	return nr;
+}
+
+/*
+ * Look @name up through the directory index, building it if needed.
+ * Returns -EAGAIN when the directory isn't indexed and must be scanned,
+ * else the fat_search_long() return value. Called with dir->i_mutex held.
+ */
+int fat_dir_index_search(struct inode *dir, const unsigned char *name,
+			 int name_len, struct fat_slot_info *sinfo)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(dir->i_sb);
+	u32 pos[FAT_DIR_INDEX_MAX_CAND];
+	u32 hash;
+	int i, nr, err;
+
+	if (!sbi->options.dir_index_kb || dir->i_size < FAT_DIR_INDEX_MIN_SIZE)
+		return -EAGAIN;
+
+	hash = fat_dir_index_hash(sbi, name, name_len);
+	nr = fat_dir_index_lookup(dir, hash, pos);
+	if (nr == -ENOENT) {
+		if (fat_dir_index_build(dir))
+			return -EAGAIN;
+		nr = fat_dir_index_lookup(dir, hash, pos);
+	}
+	if (nr < 0 || nr > FAT_DIR_INDEX_MAX_CAND)
+		return -EAGAIN;
+
+	for (i = 0; i < nr; i++) {
+		loff_t start = (loff_t)pos[i] << MSDOS_DIR_BITS;
+
+		err = fat_search_long_range(dir, name, name_len, sinfo,
+					    start, start + 1);
+		if (err != -ENOENT)
+			return err;
+	}
+
+	return -ENOENT;
+}
+
+#ifdef CONFIG_DEBUG_FS
+#define FAT_DIR_INDEX_BENCH_NAMES	16384
+#define FAT_DIR_INDEX_BENCH_BYTES	(1024 * 1024)
+
+struct fat_dir_index_bench_name {
+	loff_t slot_off;
+	unsigned int off;
+	unsigned int len;
+};
+
+struct fat_dir_index_bench {
+	struct fat_dir_index_bench_name *names;
+	unsigned char *buf;
+	unsigned int nr;
+	unsigned int used;
+};
+
+static struct dentry *fat_dir_index_bench_dentry;
+static DEFINE_MUTEX(fat_dir_index_bench_mutex);
+static char fat_dir_index_bench_result[256] = "no run\n";
+
+static int fat_dir_index_bench_add(void *priv, const unsigned char *name,
+				   int len, loff_t slot_off)
+{
+	struct fat_dir_index_bench *b = priv;
+	struct fat_dir_index_bench_name *n;
+
+	/* The long name is looked up rather than the short one */
+	if (b->nr && b->names[b->nr - 1].slot_off == slot_off)
+		b->nr--;
+	if (b->nr == FAT_DIR_INDEX_BENCH_NAMES ||
+	    b->used + len > FAT_DIR_INDEX_BENCH_BYTES)
+		return 1;
+
+	n = &b->names[b->nr++];
+	n->slot_off = slot_off;
+	n->off = b->used;
+	n->len = len;
+	memcpy(b->buf + b->used, name, len);
+	b->used += len;
+
+	return 0;
+}
+
+/* Looks every name up, returns the number found */
+static unsigned int fat_dir_index_bench_lookups(struct inode *dir,
+						struct fat_dir_index_bench *b,
+						bool indexed)
+{
+	struct fat_slot_info sinfo;
+	unsigned int i, found = 0;
+	int err;
+
+	for (i = 0; i < b->nr; i++) {
+		const unsigned char *name = b->buf + b->names[i].off;
+		int len = b->names[i].len;
+
+		if (indexed)
+			err = fat_dir_index_search(dir, name, len, &sinfo);
+		else
+			err = fat_search_long_range(dir, name, len, &sinfo,
+						    0, LLONG_MAX);
+		if (!err) {
+			brelse(sinfo.bh);
+			found++;
+		}
+	}
+
+	return found;
+}
+
+static int fat_dir_index_bench_run(struct inode *dir)
+{
+	struct super_block *sb = dir->i_sb;
+	struct fat_dir_index_bench b;
+	struct fat_slot_info sinfo;
+	unsigned int index_found, scan_found;
+	s64 build_us, index_us, scan_us;
+	ktime_t start;
+	int build_err, err;
+
+	memset(&b, 0, sizeof(b));
+	b.names = vmalloc(FAT_DIR_INDEX_BENCH_NAMES * sizeof(*b.names));
+	b.buf = vmalloc(FAT_DIR_INDEX_BENCH_BYTES);
+	if (!b.names || !b.buf) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	mutex_lock(&dir->i_mutex);
+	lock_super(sb);
+
+	err = fat_walk_names(dir, 0, LLONG_MAX, fat_dir_index_bench_add, &b,
+			     &sinfo);
+	if (err == 0) {
+		/* Out of room, the first names only are looked up */
+		brelse(sinfo.bh);
+	} else if (err != -ENOENT) {
+		goto out_unlock;
+	}
+	err = 0;
+
+	fat_dir_index_inval(dir);
+	start = ktime_get();
+	build_err = fat_dir_index_build(dir);
+	build_us = ktime_us_delta(ktime_get(), start);
+
+	start = ktime_get();
+	index_found = fat_dir_index_bench_lookups(dir, &b, true);
+	index_us = ktime_us_delta(ktime_get(), start);
+
+	start = ktime_get();
+	scan_found = fat_dir_index_bench_lookups(dir, &b, false);
+	scan_us = ktime_us_delta(ktime_get(), start);
+
+	snprintf(fat_dir_index_bench_result,
+		 sizeof(fat_dir_index_bench_result),
+		 "directory:       %lu, %lld bytes, %u names\n"
+		 "index build:     %lld us (%d)\n"
+		 "indexed lookups: %lld us, %u found\n"
+		 "scanned lookups: %lld us, %u found\n",
+		 dir->i_ino, dir->i_size, b.nr, build_us, build_err,
+		 index_us, index_found, scan_us, scan_found);
+
+out_unlock:
+	unlock_super(sb);
+	mutex_unlock(&dir->i_mutex);
+out:
+	vfree(b.buf);
+	vfree(b.names);
+	return err;
+}
+
+static ssize_t fat_dir_index_bench_write(struct file *file,
+					 const char __user *ubuf,
+					 size_t count, loff_t *ppos)
+{
+	struct path path;
+	char *name;
+	int err;
+
+	if (count >= PATH_MAX)
+		return -ENAMETOOLONG;
+
+	name = kmalloc(count + 1, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+	if (copy_from_user(name, ubuf, count)) {
+		err = -EFAULT;
+		goto out;
+	}
+	name[count] = '\0';
+
+	err = kern_path(strim(name), LOOKUP_FOLLOW | LOOKUP_DIRECTORY, &path);
+	if (err)
+		goto out;
+
+	if (path.dentry->d_sb->s_magic != MSDOS_SUPER_MAGIC ||
+	    !MSDOS_SB(path.dentry->d_sb)->options.isvfat) {
+		err = -EINVAL;
+	} else {
+		mutex_lock(&fat_dir_index_bench_mutex);
+		err = fat_dir_index_bench_run(path.dentry->d_inode);
+		mutex_unlock(&fat_dir_index_bench_mutex);
+	}
+	path_put(&path);
+
+out:
+	kfree(name);
+	return err ? err : count;
+}
+
+static int fat_dir_index_bench_show(struct seq_file *s, void *unused)
+{
+	mutex_lock(&fat_dir_index_bench_mutex);
+	seq_puts(s, fat_dir_index_bench_result);
+	mutex_unlock(&fat_dir_index_bench_mutex);
+
+	return 0;
+}
+
+static int fat_dir_index_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fat_dir_index_bench_show, NULL);
+}
+
+static const struct file_operations fat_dir_index_bench_fops = {
+	.owner		= THIS_MODULE,
+	.open		= fat_dir_index_bench_open,
+	.read		= seq_read,
+	.write		= fat_dir_index_bench_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void fat_dir_index_bench_init(void)
+{
+	fat_dir_index_bench_dentry =
+		debugfs_create_file("fat_dirindex_bench", S_IRUSR | S_IWUSR,
+				    NULL, NULL, &fat_dir_index_bench_fops);
+}
+
+void fat_dir_index_bench_exit(void)
+{
+	debugfs_remove(fat_dir_index_bench_dentry);
+}
+#endif /* CONFIG_DEBUG_FS */
@@ -7,6 +7,7 @@
 #include <linux/fs.h>
 #include <linux/mutex.h>
 #include <linux/ratelimit.h>
+#include <linux/workqueue.h>
 #include <linux/msdos_fs.h>
 
 /*
@@ -47,6 +48,7 @@ struct fat_mount_options {
 		 tz_utc:1,	  /* Filesystem timestamps are in UTC */
 		 rodir:1,	  /* allow ATTR_RO for directory */
 		 discard:1;	  /* Issue discard requests on deletions */
+	unsigned int dir_index_kb; /* Directory name index memory, 0 = off */
 };
 
 #define FAT_HASH_BITS	8
@@ -88,6 +90,16 @@ struct msdos_sb_info {
 
 	spinlock_t inode_hash_lock;
 	struct hlist_head inode_hashtable[FAT_HASH_SIZE];
+
+	spinlock_t dir_index_lock;
+	struct list_head dir_index_lru; /* directory name indexes, LRU first */
+	unsigned long dir_index_bytes;  /* memory used by the indexes */
+
+	unsigned long *free_map;	/* bit per cluster, set if in use */
+	unsigned int free_map_next;	/* clusters below are in free_map */
+	unsigned int free_map_free;	/* free clusters below free_map_next */
+	int free_map_stop;
+	struct work_struct free_map_work;
 };
 
 #define FAT_CACHE_VALID	0	/* special case for valid cache */
@@ -106,10 +118,12 @@ struct msdos_inode_info {
 	loff_t mmu_private;	/* physically allocated size */
 
 	int i_start;		/* first cluster or 0 */
+	int i_alloc_hint;	/* where to look for the next cluster, or 0 */
 	int i_logstart;		/* logical first cluster */
 	int i_attrs;		/* unused attribute bits */
 	loff_t i_pos;		/* on-disk position of directory entry or 0 */
 	struct hlist_node i_fat_hash;	/* hash by i_location */
+	struct fat_dir_index *i_dir_index; /* name index, directories only */
 	struct inode vfs_inode;
 };
 
@@ -232,13 +246,24 @@ static inline void fatwchar_to16(__u8 *dst, const wchar_t *src, size_t len)
 
 /* fat/cache.c */
 extern void fat_cache_inval_inode(struct inode *inode);
+extern void fat_cache_extend(struct inode *inode, int fclus, int dclus);
 extern int fat_get_cluster(struct inode *inode, int cluster,
 			   int *fclus, int *dclus);
 extern int fat_bmap(struct inode *inode, sector_t sector, sector_t *phys,
 		    unsigned long *mapped_blocks, int create);
 
 /* fat/dir.c */
+typedef int (*fat_name_actor_t)(void *priv, const unsigned char *name,
+				int len, loff_t slot_off);
+
 extern const struct file_operations fat_dir_operations;
+extern int fat_walk_names(struct inode *inode, loff_t start, loff_t end,
+			  fat_name_actor_t actor, void *priv,
+			  struct fat_slot_info *sinfo);
+extern int fat_search_long_range(struct inode *inode,
+				 const unsigned char *name, int name_len,
+				 struct fat_slot_info *sinfo,
+				 loff_t start, loff_t end);
 extern int fat_search_long(struct inode *inode, const unsigned char *name,
 			   int name_len, struct fat_slot_info *sinfo);
 extern int fat_dir_empty(struct inode *dir);
@@ -252,6 +277,21 @@ extern int fat_add_entries(struct inode *dir, void *slots, int nr_slots,
 			   struct fat_slot_info *sinfo);
 extern int fat_remove_entries(struct inode *dir, struct fat_slot_info *sinfo);
 
+/* fat/dirindex.c */
+#define FAT_DIR_INDEX_DEFAULT_KB	2048
+
+extern void fat_dir_index_init(struct super_block *sb);
+extern int fat_dir_index_search(struct inode *dir, const unsigned char *name,
+				int name_len, struct fat_slot_info *sinfo);
+extern void fat_dir_index_inval(struct inode *dir);
+#ifdef CONFIG_DEBUG_FS
+extern void fat_dir_index_bench_init(void);
+extern void fat_dir_index_bench_exit(void);
+#else
+static inline void fat_dir_index_bench_init(void) { }
+static inline void fat_dir_index_bench_exit(void) { }
+#endif
+
 /* fat/fatent.c */
 struct fat_entry {
 	int entry;
@@ -300,6 +340,8 @@ extern int fat_alloc_clusters(struct inode *inode, int *cluster,
 			      int nr_cluster);
 extern int fat_free_clusters(struct inode *inode, int cluster);
 extern int fat_count_free_clusters(struct super_block *sb);
+extern void fat_free_map_start(struct super_block *sb);
+extern void fat_free_map_stop(struct super_block *sb);
 
 /* fat/file.c */
 extern long fat_generic_ioctl(struct file *filp, unsigned int cmd,
@@ -343,6 +385,8 @@ extern int fat_sync_bhs(struct buffer_head **bhs, int nr_bhs);
 
 int fat_cache_init(void);
 void fat_cache_destroy(void);
+int fat_free_map_init(void);
+void fat_free_map_destroy(void);
 
 /* helper for printk */
 typedef unsigned long long	llu;
@@ -7,6 +7,8 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/blkdev.h>
+#include <linux/bitmap.h>
+#include <linux/vmalloc.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -452,6 +454,91 @@ static void fat_collect_bhs(struct buffer_head **bhs, int *nr_bhs,
 	}
 }
 
+/*
+ * Free cluster map.
+ *
+ * After mount, fat_free_map_work() reads the whole FAT once, in the
+ * background, and records the state of every cluster in sbi->free_map (bit
+ * set: in use). Clusters below sbi->free_map_next are tracked by the map,
+ * which is kept up to date by the allocator from there on. Once the map
+ * covers the whole FAT, the free cluster count is known and
+ * fat_alloc_clusters() searches the map for runs of free clusters instead of
+ * reading the FAT entry by entry. The map is protected by lock_fat().
+ */
+static struct workqueue_struct *fat_free_map_wq;
+
+static inline int fat_free_map_ready(struct msdos_sb_info *sbi)
+{
+	return sbi->free_map && sbi->free_map_next >= sbi->max_cluster;
+}
+
+static inline void fat_free_map_use(struct msdos_sb_info *sbi, int entry)
+{
+	if (sbi->free_map && entry < sbi->free_map_next &&
+	    !__test_and_set_bit(entry, sbi->free_map))
+		sbi->free_map_free--;
+}
+
+static inline void fat_free_map_release(struct msdos_sb_info *sbi, int entry)
+{
+	if (sbi->free_map && entry < sbi->free_map_next &&
+	    __test_and_clear_bit(entry, sbi->free_map))
+		sbi->free_map_free++;
+}
+
+/*
+ * Find a run of @nr free clusters, from @start then from the beginning of
+ * the FAT. If there is none, fall back to the first free cluster.
+ */
+static int fat_free_map_find(struct msdos_sb_info *sbi, int start, int nr)
+{
+	unsigned long *map = sbi->free_map;
+	unsigned long size = sbi->max_cluster;
+	unsigned long entry;
+
+	if (start < FAT_START_ENT || start >= size)
+		start = FAT_START_ENT;
+
+	entry = bitmap_find_next_zero_area(map, size, start, nr, 0);
+	if (entry + nr <= size)
+		return entry;
+	entry = bitmap_find_next_zero_area(map, size, FAT_START_ENT, nr, 0);
+	if (entry + nr <= size)
+		return entry;
+
+	entry = find_next_zero_bit(map, size, start);
+	if (entry < size)
+		return entry;
+	entry = find_next_zero_bit(map, size, FAT_START_ENT);
+	if (entry < size)
+		return entry;
+
+	return -ENOSPC;
+}
+
+/* Make the free entry @fatent the new end of the chain ending at @prev_ent */
+static void fat_alloc_entry(struct super_block *sb, struct fat_entry *fatent,
+			    struct fat_entry *prev_ent,
+			    struct buffer_head **bhs, int *nr_bhs)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	struct fatent_operations *ops = sbi->fatent_ops;
+	int entry = fatent->entry;
+
+	/* make the cluster chain */
+	ops->ent_put(fatent, FAT_ENT_EOF);
+	if (prev_ent->nr_bhs)
+		ops->ent_put(prev_ent, entry);
+
+	fat_collect_bhs(bhs, nr_bhs, fatent);
+
+	sbi->prev_free = entry;
+	if (sbi->free_clusters != -1)
+		sbi->free_clusters--;
+	fat_free_map_use(sbi, entry);
+	sb->s_dirt = 1;
+}
+
 int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 {
 	struct super_block *sb = inode->i_sb;
@@ -459,7 +546,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	struct fatent_operations *ops = sbi->fatent_ops;
 	struct fat_entry fatent, prev_ent;
 	struct buffer_head *bhs[MAX_BUF_PER_PAGE];
-	int i, count, err, nr_bhs, idx_clus;
+	int i, count, err, nr_bhs, idx_clus, hint;
 
 	BUG_ON(nr_cluster > (MAX_BUF_PER_PAGE / 2));	/* fixed limit */
 
@@ -471,9 +558,43 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	}
 
 	err = nr_bhs = idx_clus = 0;
-	count = FAT_START_ENT;
 	fatent_init(&prev_ent);
 	fatent_init(&fatent);
+
+	/*
+	 * Prefer the clusters following the last ones given to this inode,
+	 * so that files written in parallel don't interleave.
+	 */
+	hint = MSDOS_I(inode)->i_alloc_hint;
+	if (!hint)
+		hint = sbi->prev_free + 1;
+	while (fat_free_map_ready(sbi)) {
+		int entry = fat_free_map_find(sbi, hint, nr_cluster - idx_clus);
+		if (entry < 0)
+			goto nospc;
+
+		fatent_set_entry(&fatent, entry);
+		err = fat_ent_read_block(sb, &fatent);
+		if (err)
+			goto out;
+
+		hint = entry + 1;
+		if (ops->ent_get(&fatent) != FAT_ENT_FREE) {
+			/* The map is stale, mark the cluster and go on */
+			fat_free_map_use(sbi, entry);
+			continue;
+		}
+
+		fat_alloc_entry(sb, &fatent, &prev_ent, bhs, &nr_bhs);
+		cluster[idx_clus] = entry;
+		idx_clus++;
+		if (idx_clus == nr_cluster)
+			goto out;
+
+		prev_ent = fatent;
+	}
+
+	count = FAT_START_ENT;
 	fatent_set_entry(&fatent, sbi->prev_free + 1);
 	while (count < sbi->max_cluster) {
 		if (fatent.entry >= sbi->max_cluster)
@@ -486,21 +607,9 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 		/* Find the free entries in a block */
 		do {
 			if (ops->ent_get(&fatent) == FAT_ENT_FREE) {
-				int entry = fatent.entry;
-
-				/* make the cluster chain */
-				ops->ent_put(&fatent, FAT_ENT_EOF);
-				if (prev_ent.nr_bhs)
-					ops->ent_put(&prev_ent, entry);
-
-				fat_collect_bhs(bhs, &nr_bhs, &fatent);
-
-				sbi->prev_free = entry;
-				if (sbi->free_clusters != -1)
-					sbi->free_clusters--;
-				sb->s_dirt = 1;
-
-				cluster[idx_clus] = entry;
+				fat_alloc_entry(sb, &fatent, &prev_ent,
+						bhs, &nr_bhs);
+				cluster[idx_clus] = fatent.entry;
 				idx_clus++;
 				if (idx_clus == nr_cluster)
 					goto out;
@@ -517,6 +626,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 		} while (fat_ent_next(sbi, &fatent));
 	}
 
+nospc:
 	/* Couldn't allocate the free entries */
 	sbi->free_clusters = 0;
 	sbi->free_clus_valid = 1;
@@ -527,6 +637,7 @@ out:
 	unlock_fat(sbi);
 	fatent_brelse(&fatent);
 	if (!err) {
+		MSDOS_I(inode)->i_alloc_hint = cluster[idx_clus - 1] + 1;
 		if (inode_needs_sync(inode))
 			err = fat_sync_bhs(bhs, nr_bhs);
 		if (!err)
@@ -584,6 +695,7 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		fat_free_map_release(sbi, fatent.entry);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			sb->s_dirt = 1;
@@ -646,6 +758,10 @@ int fat_count_free_clusters(struct super_block *sb)
 	unsigned long reada_blocks, reada_mask, cur_block;
 	int err = 0, free;
 
+	/* The free cluster map counts them while it's built */
+	if (sbi->free_map)
+		flush_work(&sbi->free_map_work);
+
 	lock_fat(sbi);
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
 		goto out;
@@ -682,3 +798,106 @@ out:
 	unlock_fat(sbi);
 	return err;
 }
+
+static void fat_free_map_work(struct work_struct *work)
+{
+	struct msdos_sb_info *sbi =
+		container_of(work, struct msdos_sb_info, free_map_work);
+	struct super_block *sb = sbi->fat_inode->i_sb;
+	struct fatent_operations *ops = sbi->fatent_ops;
+	struct fat_entry fatent;
+	unsigned long reada_blocks, reada_mask, cur_block;
+	int err = 0;
+
+	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
+	reada_mask = reada_blocks - 1;
+	cur_block = 0;
+
+	fatent_init(&fatent);
+	fatent_set_entry(&fatent, FAT_START_ENT);
+	while (fatent.entry < sbi->max_cluster && !sbi->free_map_stop) {
+		/* readahead of fat blocks */
+		if ((cur_block & reada_mask) == 0) {
+			unsigned long rest = sbi->fat_length - cur_block;
+			fat_ent_reada(sb, &fatent, min(reada_blocks, rest));
+		}
+		cur_block++;
+
+		/* One block at a time, not to hold up the allocator */
+		lock_fat(sbi);
+		err = fat_ent_read_block(sb, &fatent);
+		if (err) {
+			unlock_fat(sbi);
+			break;
+		}
+
+		do {
+			if (ops->ent_get(&fatent) == FAT_ENT_FREE) {
+				__clear_bit(fatent.entry, sbi->free_map);
+				sbi->free_map_free++;
+			}
+		} while (fat_ent_next(sbi, &fatent));
+		sbi->free_map_next = fatent.entry;
+
+		if (fat_free_map_ready(sbi)) {
+			sbi->free_clusters = sbi->free_map_free;
+			sbi->free_clus_valid = 1;
+			sb->s_dirt = 1;
+		}
+		unlock_fat(sbi);
+
+		cond_resched();
+	}
+	fatent_brelse(&fatent);
+
+	if (err) {
+		lock_fat(sbi);
+		vfree(sbi->free_map);
+		sbi->free_map = NULL;
+		unlock_fat(sbi);
+	}
+}
+
+void fat_free_map_start(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	INIT_WORK(&sbi->free_map_work, fat_free_map_work);
+	sbi->free_map_next = 0;
+	sbi->free_map_free = 0;
+	sbi->free_map_stop = 0;
+
+	/* Without the map, allocation just reads the FAT as before */
+	sbi->free_map = vmalloc(BITS_TO_LONGS(sbi->max_cluster) *
+				sizeof(unsigned long));
+	if (!sbi->free_map)
+		return;
+	/* Unknown clusters are in use until the FAT says otherwise */
+	bitmap_fill(sbi->free_map, sbi->max_cluster);
+
+	queue_work(fat_free_map_wq, &sbi->free_map_work);
+}
+
+void fat_free_map_stop(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	sbi->free_map_stop = 1;
+	cancel_work_sync(&sbi->free_map_work);
+
+	vfree(sbi->free_map);
+	sbi->free_map = NULL;
+}
+
+int __init fat_free_map_init(void)
+{
+	fat_free_map_wq = create_singlethread_workqueue("fat_free_map");
+	if (!fat_free_map_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void fat_free_map_destroy(void)
+{
+	destroy_workqueue(fat_free_map_wq);
+}
@@ -459,6 +459,7 @@ static void fat_delete_inode(struct inode *inode)
 static void fat_clear_inode(struct inode *inode)
 {
 	fat_cache_inval_inode(inode);
+	fat_dir_index_inval(inode);
 	fat_detach(inode);
 }
 
@@ -492,6 +493,8 @@ static void fat_put_super(struct super_block *sb)
 
 	lock_kernel();
 
+	fat_free_map_stop(sb);
+
 	if (sb->s_dirt)
 		fat_write_super(sb);
 
@@ -517,6 +520,7 @@ static struct inode *fat_alloc_inode(struct super_block *sb)
 	ei = kmem_cache_alloc(fat_inode_cachep, GFP_NOFS);
 	if (!ei)
 		return NULL;
+	ei->i_alloc_hint = 0;
 	return &ei->vfs_inode;
 }
 
@@ -534,6 +538,7 @@ static void init_once(void *foo)
 	ei->cache_valid_id = FAT_CACHE_VALID + 1;
 	INIT_LIST_HEAD(&ei->cache_lru);
 	INIT_HLIST_NODE(&ei->i_fat_hash);
+	ei->i_dir_index = NULL;
 	inode_init_once(&ei->vfs_inode);
 }
 
@@ -888,6 +893,8 @@ static int fat_show_options(struct seq_file *m, struct vfsmount *mnt)
 		seq_puts(m, ",errors=remount-ro");
 	if (opts->discard)
 		seq_puts(m, ",discard");
+	if (isvfat && opts->dir_index_kb != FAT_DIR_INDEX_DEFAULT_KB)
+		seq_printf(m, ",dirindex=%u", opts->dir_index_kb);
 
 	return 0;
 }
@@ -901,7 +908,7 @@ enum {
 	Opt_shortname_winnt, Opt_shortname_mixed, Opt_utf8_no, Opt_utf8_yes,
 	Opt_uni_xl_no, Opt_uni_xl_yes, Opt_nonumtail_no, Opt_nonumtail_yes,
 	Opt_obsolate, Opt_flush, Opt_tz_utc, Opt_rodir, Opt_err_cont,
-	Opt_err_panic, Opt_err_ro, Opt_discard, Opt_err,
+	Opt_err_panic, Opt_err_ro, Opt_discard, Opt_dir_index, Opt_err,
 };
 
 static const match_table_t fat_tokens = {
@@ -978,6 +985,7 @@ static const match_table_t vfat_tokens = {
 	{Opt_nonumtail_yes, "nonumtail=true"},
 	{Opt_nonumtail_yes, "nonumtail"},
 	{Opt_rodir, "rodir"},
+	{Opt_dir_index, "dirindex=%u"},
 	{Opt_err, NULL}
 };
 
@@ -1011,6 +1019,7 @@ static int parse_options(char *options, int is_vfat, int silent, int *debug,
 	opts->usefree = opts->nocase = 0;
 	opts->tz_utc = 0;
 	opts->errors = FAT_ERRORS_RO;
+	opts->dir_index_kb = FAT_DIR_INDEX_DEFAULT_KB;
 	*debug = 0;
 
 	if (!options)
@@ -1167,6 +1176,11 @@ static int parse_options(char *options, int is_vfat, int silent, int *debug,
 		case Opt_rodir:
 			opts->rodir = 1;
 			break;
+		case Opt_dir_index:
+			if (match_int(&args[0], &option) || option < 0)
+				return 0;
+			opts->dir_index_kb = option;
+			break;
 		case Opt_discard:
 			opts->discard = 1;
 			break;
@@ -1468,6 +1482,7 @@ int fat_fill_super(struct super_block *sb, void *data, int silent,
 
 	/* set up enough so that it can read an inode */
 	fat_hash_init(sb);
+	fat_dir_index_init(sb);
 	fat_ent_access_init(sb);
 
 	/*
@@ -1518,6 +1533,8 @@ int fat_fill_super(struct super_block *sb, void *data, int silent,
 		goto out_fail;
 	}
 
+	fat_free_map_start(sb);
+
 	return 0;
 
 out_invalid:
@@ -1600,12 +1617,20 @@ static int __init init_fat_fs(void)
 	if (err)
 		return err;
 
-	err = fat_init_inodecache();
+	err = fat_free_map_init();
 	if (err)
 		goto failed;
 
+	err = fat_init_inodecache();
+	if (err)
+		goto failed_free_map;
+
+	fat_dir_index_bench_init();
+
 	return 0;
 
+failed_free_map:
+	fat_free_map_destroy();
 failed:
 	fat_cache_destroy();
 	return err;
@@ -1613,6 +1638,8 @@ failed:
 
 static void __exit exit_fat_fs(void)
 {
+	fat_dir_index_bench_exit();
+	fat_free_map_destroy();
 	fat_cache_destroy();
 	fat_destroy_inodecache();
 }
@@ -24,6 +24,9 @@
 #include <linux/types.h>
 #include <linux/mutex.h>
 #include <linux/buffer_head.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/cpumask.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -34,15 +37,27 @@
 /*
  * This file (and decompressor.h) implements a decompressor framework for
  * Squashfs, allowing multiple decompressors to be easily supported
+ *
+ * Each filesystem keeps a pool of decompressor streams, so that readers of
+ * different blocks decompress in parallel.  One stream is allocated at mount
+ * time, more are allocated on demand up to one per possible CPU, after which
+ * readers wait for an idle stream.
  */
 
+struct squashfs_stream {
+	struct list_head	list;
+	void			*stream;
+};
+
 static const struct squashfs_decompressor squashfs_lzma_unsupported_comp_ops = {
 	NULL, NULL, NULL, LZMA_COMPRESSION, "lzma", 0
 };
 
+#ifndef CONFIG_SQUASHFS_LZO
 static const struct squashfs_decompressor squashfs_lzo_unsupported_comp_ops = {
 	NULL, NULL, NULL, LZO_COMPRESSION, "lzo", 0
 };
+#endif
 
 static const struct squashfs_decompressor squashfs_unknown_comp_ops = {
 	NULL, NULL, NULL, 0, "unknown", 0
@@ -51,7 +66,11 @@ static const struct squashfs_decompressor squashfs_unknown_comp_ops = {
 static const struct squashfs_decompressor *decompressor[] = {
 	&squashfs_zlib_comp_ops,
 	&squashfs_lzma_unsupported_comp_ops,
+#ifdef CONFIG_SQUASHFS_LZO
+	&squashfs_lzo_comp_ops,
+#else
 	&squashfs_lzo_unsupported_comp_ops,
+#endif
 	&squashfs_unknown_comp_ops
 };
 
@@ -66,3 +85,115 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 
 	return decompressor[i];
 }
+
+
+static struct squashfs_stream *stream_alloc(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream = kmalloc(sizeof(*stream), GFP_KERNEL);
+
+	if (stream == NULL)
+		return NULL;
+
+	stream->stream = msblk->decompressor->init(msblk);
+	if (stream->stream == NULL) {
+		kfree(stream);
+		return NULL;
+	}
+
+	return stream;
+}
+
+
+int squashfs_decompressor_init(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream;
+
+	spin_lock_init(&msblk->stream_lock);
+	INIT_LIST_HEAD(&msblk->stream_idle);
+	init_waitqueue_head(&msblk->stream_wait);
+	msblk->stream_max = num_possible_cpus();
+
+	stream = stream_alloc(msblk);
+	if (stream == NULL)
+		return -ENOMEM;
+
+	list_add(&stream->list, &msblk->stream_idle);
+	msblk->stream_count = 1;
+	return 0;
+}
+
+
+/* All the streams must be idle */
+void squashfs_decompressor_free(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream, *next;
+
+	if (msblk->decompressor == NULL || msblk->stream_count == 0)
+		return;
+
+	list_for_each_entry_safe(stream, next, &msblk->stream_idle, list) {
+		msblk->decompressor->free(stream->stream);
+		kfree(stream);
+	}
+	msblk->stream_count = 0;
+}
+
+
+static struct squashfs_stream *get_stream(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream;
+
+	while (1) {
+		spin_lock(&msblk->stream_lock);
+		if (!list_empty(&msblk->stream_idle)) {
+			stream = list_entry(msblk->stream_idle.next,
+					struct squashfs_stream, list);
+			list_del(&stream->list);
+			spin_unlock(&msblk->stream_lock);
+			return stream;
+		}
+
+		if (msblk->stream_count < msblk->stream_max) {
+			msblk->stream_count++;
+			spin_unlock(&msblk->stream_lock);
+
+			stream = stream_alloc(msblk);
+			if (stream)
+				return stream;
+
+			/* Make do with the streams we have */
+			spin_lock(&msblk->stream_lock);
+			msblk->stream_count--;
+			msblk->stream_max = msblk->stream_count;
+		}
+		spin_unlock(&msblk->stream_lock);
+
+		wait_event(msblk->stream_wait,
+				!list_empty(&msblk->stream_idle));
+	}
+}
+
+
+static void put_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *stream)
+{
+	spin_lock(&msblk->stream_lock);
+	list_add(&stream->list, &msblk->stream_idle);
+	spin_unlock(&msblk->stream_lock);
+	wake_up(&msblk->stream_wait);
+}
+
+
+int squashfs_decompress(struct squashfs_sb_info *msblk, void **buffer,
+	struct buffer_head **bh, int b, int offset, int length, int srclength,
+	int pages)
+{
+	struct squashfs_stream *stream = get_stream(msblk);
+	int res;
+
+	res = msblk->decompressor->decompress(msblk, stream->stream, buffer,
+		bh, b, offset, length, srclength, pages);
+	put_stream(msblk, stream);
+
+	return res;
+}
@@ -38,6 +38,11 @@
  * Larger files use multiple slots, with 1.75 TiB files using all 8 slots.
  * The index cache is designed to be memory efficient, and by default uses
  * 16 KiB.
+ *
+ * Reading the first page of a datablock also queues the decompression of the
+ * following readahead_blocks datablocks of the file, so that sequential
+ * readers find them in the page cache.  The read-ahead is done by the
+ * squashfs_read workqueue, on behalf of a locked page of each block.
  */
 
 #include <linux/fs.h>
@@ -47,6 +52,8 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/module.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -371,6 +378,80 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+struct workqueue_struct *squashfs_read_wq;
+
+static unsigned int readahead_blocks;
+module_param(readahead_blocks, uint, 0644);
+MODULE_PARM_DESC(readahead_blocks,
+	"Datablocks decompressed ahead of sequential readers (default 0)");
+
+struct squashfs_readahead {
+	struct work_struct	work;
+	struct page		*page;
+};
+
+static int squashfs_readpage(struct file *, struct page *);
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_readahead *ra =
+		container_of(work, struct squashfs_readahead, work);
+
+	/* No file: don't chain further read-ahead */
+	squashfs_readpage(NULL, ra->page);
+	page_cache_release(ra->page);
+	kfree(ra);
+}
+
+
+/*
+ * Queue the decompression of the datablocks following datablock index,
+ * unless their first page is already cached.  The first page is added to the
+ * page cache locked, which keeps the inode around until it is read.
+ */
+static void squashfs_readahead(struct inode *inode, int index, int file_end)
+{
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	struct address_space *mapping = inode->i_mapping;
+	struct squashfs_readahead *ra;
+	struct page *page;
+	pgoff_t first;
+	int i;
+
+	for (i = index + 1; i <= index + (int) readahead_blocks &&
+			i < file_end; i++) {
+		first = (pgoff_t) i << shift;
+
+		page = find_get_page(mapping, first);
+		if (page) {
+			page_cache_release(page);
+			continue;
+		}
+
+		ra = kmalloc(sizeof(*ra), GFP_KERNEL);
+		if (ra == NULL)
+			return;
+
+		page = page_cache_alloc_cold(mapping);
+		if (page == NULL) {
+			kfree(ra);
+			return;
+		}
+
+		if (add_to_page_cache_lru(page, mapping, first, GFP_KERNEL)) {
+			page_cache_release(page);
+			kfree(ra);
+			continue;
+		}
+
+		ra->page = page;
+		INIT_WORK(&ra->work, squashfs_readahead_work);
+		queue_work(squashfs_read_wq, &ra->work);
+	}
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -399,7 +480,12 @@ static int squashfs_readpage(struct file *file, struct page *page)
 		 * to get location and block size.
 		 */
 		u64 block = 0;
-		int bsize = read_blocklist(inode, index, &block);
+		int bsize;
+
+		if (file && readahead_blocks)
+			squashfs_readahead(inode, index, file_end);
+
+		bsize = read_blocklist(inode, index, &block);
 		if (bsize < 0)
 			goto error_out;
 
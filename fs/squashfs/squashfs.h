@@ -88,6 +88,7 @@ extern const struct export_operations squashfs_export_ops;
 
 /* file.c */
 extern const struct address_space_operations squashfs_aops;
+extern struct workqueue_struct *squashfs_read_wq;
 
 /* inode.c */
 extern const struct inode_operations squashfs_inode_ops;
@@ -102,5 +103,8 @@ extern const struct inode_operations squashfs_symlink_inode_ops;
 /* xattr.c */
 extern const struct xattr_handler *squashfs_xattr_handlers[];
 
+/* lzo_wrapper.c */
+extern const struct squashfs_decompressor squashfs_lzo_comp_ops;
+
 /* zlib_wrapper.c */
 extern const struct squashfs_decompressor squashfs_zlib_comp_ops;
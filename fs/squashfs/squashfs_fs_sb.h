@@ -62,10 +62,13 @@ struct squashfs_sb_info {
 	__le64					*id_table;
 	__le64					*fragment_index;
 	__le64					*xattr_id_table;
-	struct mutex				read_data_mutex;
 	struct mutex				meta_index_mutex;
 	struct meta_index			*meta_index;
-	void					*stream;
+	spinlock_t				stream_lock;
+	struct list_head			stream_idle;
+	int					stream_count;
+	int					stream_max;
+	wait_queue_head_t			stream_wait;
 	__le64					*inode_lookup_table;
 	u64					inode_table;
 	u64					directory_table;
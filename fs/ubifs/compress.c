@@ -28,6 +28,7 @@
  */
 
 #include <linux/crypto.h>
+#include <linux/percpu.h>
 #include "ubifs.h"
 
 /* Fake description object for the "none" compressor */
@@ -169,12 +170,21 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 		return 0;
 	}
 
-	if (compr->decomp_mutex)
-		mutex_lock(compr->decomp_mutex);
-	err = crypto_comp_decompress(compr->cc, in_buf, in_len, out_buf,
-				     (unsigned int *)out_len);
-	if (compr->decomp_mutex)
-		mutex_unlock(compr->decomp_mutex);
+	if (compr->dcc) {
+		/* The handle (and its work-space) belongs to this CPU */
+		struct crypto_comp *cc = *per_cpu_ptr(compr->dcc, get_cpu());
+
+		err = crypto_comp_decompress(cc, in_buf, in_len, out_buf,
+					     (unsigned int *)out_len);
+		put_cpu();
+	} else {
+		if (compr->decomp_mutex)
+			mutex_lock(compr->decomp_mutex);
+		err = crypto_comp_decompress(compr->cc, in_buf, in_len,
+					     out_buf, (unsigned int *)out_len);
+		if (compr->decomp_mutex)
+			mutex_unlock(compr->decomp_mutex);
+	}
 	if (err)
 		ubifs_err("cannot decompress %d bytes, compressor %s, "
 			  "error %d", in_len, compr->name, err);
@@ -182,6 +192,63 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 	return err;
 }
 
+/**
+ * dcc_free - free per-CPU decompression handles.
+ * @compr: compressor description object
+ */
+static void dcc_free(struct ubifs_compressor *compr)
+{
+	int cpu;
+
+	if (!compr->dcc)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *cc = *per_cpu_ptr(compr->dcc, cpu);
+
+		if (cc && !IS_ERR(cc))
+			crypto_free_comp(cc);
+	}
+	free_percpu(compr->dcc);
+	compr->dcc = NULL;
+}
+
+/**
+ * dcc_init - allocate per-CPU decompression handles.
+ * @compr: compressor description object
+ *
+ * Compressors which serialize decompression with @compr->decomp_mutex get one
+ * cryptoapi handle per CPU, so that data nodes may be decompressed on all
+ * CPUs at once. This is an optimization: if the handles cannot be allocated,
+ * decompression keeps using the shared handle.
+ */
+static void __init dcc_init(struct ubifs_compressor *compr)
+{
+	int cpu;
+
+	if (!compr->decomp_mutex || num_possible_cpus() == 1)
+		return;
+
+	compr->dcc = alloc_percpu(struct crypto_comp *);
+	if (!compr->dcc)
+		goto out_warn;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *cc;
+
+		cc = crypto_alloc_comp(compr->capi_name, 0, 0);
+		*per_cpu_ptr(compr->dcc, cpu) = cc;
+		if (IS_ERR(cc))
+			goto out_free;
+	}
+	return;
+
+out_free:
+	dcc_free(compr);
+out_warn:
+	ubifs_warn("cannot allocate per-CPU %s decompressors", compr->name);
+}
+
 /**
  * compr_init - initialize a compressor.
  * @compr: compressor description object
@@ -198,6 +265,7 @@ static int __init compr_init(struct ubifs_compressor *compr)
 				  compr->name, PTR_ERR(compr->cc));
 			return PTR_ERR(compr->cc);
 		}
+		dcc_init(compr);
 	}
 
 	ubifs_compressors[compr->compr_type] = compr;
@@ -210,8 +278,10 @@ static int __init compr_init(struct ubifs_compressor *compr)
  */
 static void compr_exit(struct ubifs_compressor *compr)
 {
-	if (compr->capi_name)
+	if (compr->capi_name) {
+		dcc_free(compr);
 		crypto_free_comp(compr->cc);
+	}
 	return;
 }
 
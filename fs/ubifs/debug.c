@@ -2901,6 +2901,41 @@ static const struct file_operations dfs_fops = {
 	.llseek = no_llseek,
 };
 
+static ssize_t dfs_bu_stats_read(struct file *file, char __user *u,
+				 size_t count, loff_t *ppos)
+{
+	struct ubifs_info *c = file->private_data;
+	struct ubifs_bu_stats *st = &c->bu_stats;
+	unsigned long hits, misses;
+	char buf[256];
+	int len;
+
+	hits = atomic_long_read(&st->hits);
+	misses = atomic_long_read(&st->misses);
+	len = snprintf(buf, sizeof(buf),
+		       "bulk-reads:       %lu\n"
+		       "pages hit:        %lu\n"
+		       "pages missed:     %lu\n"
+		       "read-ahead pages: %lu\n"
+		       "hit rate:         %lu%%\n"
+		       "read time:        %lu us\n"
+		       "decompress time:  %lu us\n",
+		       atomic_long_read(&st->reads), hits, misses,
+		       atomic_long_read(&st->ra_pages),
+		       hits + misses ? hits * 100 / (hits + misses) : 0,
+		       atomic_long_read(&st->read_us),
+		       atomic_long_read(&st->decomp_us));
+
+	return simple_read_from_buffer(u, count, ppos, buf, len);
+}
+
+static const struct file_operations dfs_bu_stats_fops = {
+	.open = dfs_file_open,
+	.read = dfs_bu_stats_read,
+	.owner = THIS_MODULE,
+	.llseek = no_llseek,
+};
+
 /**
  * dbg_debugfs_init_fs - initialize debugfs for UBIFS instance.
  * @c: UBIFS file-system description object
@@ -2995,6 +3030,12 @@ int dbg_debugfs_init_fs(struct ubifs_info *c)
 		goto out_remove;
 	d->dfs_tst_rcvry = dent;
 
+	fname = "bulk_read_stats";
+	dent = debugfs_create_file(fname, S_IRUSR, d->dfs_dir, c,
+				   &dfs_bu_stats_fops);
+	if (IS_ERR_OR_NULL(dent))
+		goto out_remove;
+
 	return 0;
 
 out_remove:
@@ -53,6 +53,9 @@
 #include <linux/mount.h>
 #include <linux/namei.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/cpu.h>
+#include <linux/ktime.h>
 
 static int read_block(struct inode *inode, void *addr, unsigned int block,
 		      struct ubifs_data_node *dn)
@@ -689,6 +692,7 @@ out_hole:
 	flush_dcache_page(page);
 	kunmap(page);
 	*n = nn;
+	atomic_long_inc(&c->bu_stats.hits);
 	return 0;
 
 out_err:
@@ -760,6 +764,7 @@ static int ubifs_do_bulk_read(struct ubifs_info *c, struct bu_info *bu,
 		err = ubifs_tnc_bulk_read(c, bu);
 		if (err)
 			goto out_warn;
+		atomic_long_inc(&c->bu_stats.reads);
 	}
 
 	err = populate_page(c, page1, bu, &n);
@@ -885,10 +890,258 @@ out_unlock:
 
 static int ubifs_readpage(struct file *file, struct page *page)
 {
+	struct ubifs_info *c = page->mapping->host->i_sb->s_fs_info;
+
 	if (ubifs_bulk_read(page))
 		return 0;
 	do_readpage(page);
+	atomic_long_inc(&c->bu_stats.misses);
+	unlock_page(page);
+	return 0;
+}
+
+/*
+ * Read-ahead.
+ *
+ * When bulk-read is enabled, @c->bdi.ra_pages is set and the page cache
+ * read-ahead calls 'ubifs_readpages()' with windows which grow while a file
+ * is read sequentially, and shrink back when it is not. The pages are added
+ * to the page cache locked and are read by the 'ubifs_ra' work queue, as
+ * many bulk-reads as needed to cover the window, across LEBs. The reader only
+ * waits for the pages it needs, while the next ones are being read and
+ * decompressed.
+ *
+ * When a second bulk-read buffer could be allocated (@c->ra_bu), the read-ahead
+ * is pipelined: while the data nodes of one bulk-read are decompressed by the
+ * 'ubifs_decomp' work queue, the next bulk-read is issued into the other
+ * buffer. The decompression work is spread over the online CPUs.
+ */
+struct workqueue_struct *ubifs_ra_wq;
+struct workqueue_struct *ubifs_decomp_wq;
+
+/**
+ * struct ubifs_ra_chunk - pages to populate from one bulk-read.
+ * @work: decompression work
+ * @c: UBIFS file-system description object
+ * @bu: bulk-read information, holding the data nodes
+ * @pages: locked pages, in ascending index order
+ * @cnt: number of pages, %0 if @bu is free
+ * @done: completed when all the pages have been unlocked
+ */
+struct ubifs_ra_chunk {
+	struct work_struct work;
+	struct ubifs_info *c;
+	struct bu_info *bu;
+	struct page **pages;
+	int cnt;
+	struct completion done;
+};
+
+/**
+ * struct ubifs_ra_work - read-ahead work.
+ * @work: the work
+ * @c: UBIFS file-system description object
+ * @chunk: one chunk per bulk-read buffer
+ * @cnt: number of pages
+ * @pages: locked pages to read, in ascending index order
+ */
+struct ubifs_ra_work {
+	struct work_struct work;
+	struct ubifs_info *c;
+	struct ubifs_ra_chunk chunk[2];
+	int cnt;
+	struct page *pages[];
+};
+
+static void ra_page_done(struct page *page)
+{
 	unlock_page(page);
+	page_cache_release(page);
+}
+
+static void ra_populate(struct ubifs_ra_chunk *ch)
+{
+	struct ubifs_info *c = ch->c;
+	ktime_t start = ktime_get();
+	int i, n = 0;
+
+	for (i = 0; i < ch->cnt; i++) {
+		populate_page(c, ch->pages[i], ch->bu, &n);
+		ra_page_done(ch->pages[i]);
+	}
+	atomic_long_add(ktime_us_delta(ktime_get(), start),
+			&c->bu_stats.decomp_us);
+}
+
+static void ra_chunk_fn(struct work_struct *work)
+{
+	struct ubifs_ra_chunk *ch = container_of(work, struct ubifs_ra_chunk,
+						 work);
+
+	ra_populate(ch);
+	complete(&ch->done);
+}
+
+/**
+ * ra_bulk_read - bulk-read the data nodes of a run of pages.
+ * @c: UBIFS file-system description object
+ * @bu: bulk-read information to use
+ * @inode: inode the pages belong to
+ * @index: index of the first page
+ *
+ * This function returns the number of pages covered by the bulk-read, or %0 if
+ * the pages have to be read one by one.
+ */
+static int ra_bulk_read(struct ubifs_info *c, struct bu_info *bu,
+			struct inode *inode, pgoff_t index)
+{
+	ktime_t start;
+	int err, page_cnt;
+
+	if (!bu->buf)
+		return 0;
+
+	bu->buf_len = c->max_bu_buf_len;
+	data_key_init(c, &bu->key, inode->i_ino,
+		      index << UBIFS_BLOCKS_PER_PAGE_SHIFT);
+	err = ubifs_tnc_get_bu_keys(c, bu);
+	if (err)
+		return 0;
+
+	page_cnt = bu->blk_cnt >> UBIFS_BLOCKS_PER_PAGE_SHIFT;
+	if (!page_cnt || !bu->cnt)
+		return page_cnt;
+
+	start = ktime_get();
+	err = ubifs_tnc_bulk_read(c, bu);
+	if (err)
+		return 0;
+	atomic_long_add(ktime_us_delta(ktime_get(), start),
+			&c->bu_stats.read_us);
+	atomic_long_inc(&c->bu_stats.reads);
+	return page_cnt;
+}
+
+/**
+ * ubifs_ra_read - read pages for read-ahead.
+ * @w: read-ahead work
+ *
+ * Pages which are not part of a bulk-read are read one by one. Errors are not
+ * reported: the page is left not up-to-date and 'ubifs_readpage()' is called
+ * for it when it is actually needed.
+ */
+static void ubifs_ra_read(struct ubifs_ra_work *w)
+{
+	struct ubifs_info *c = w->c;
+	struct page **pages = w->pages;
+	struct inode *inode = pages[0]->mapping->host;
+	int i = 0, k = 0, j, cpu = -1, nbufs;
+
+	get_online_cpus();
+	mutex_lock(&c->bu_mutex);
+	nbufs = c->ra_bu ? 2 : 1;
+	for (j = 0; j < nbufs; j++) {
+		struct ubifs_ra_chunk *ch = &w->chunk[j];
+
+		INIT_WORK(&ch->work, ra_chunk_fn);
+		init_completion(&ch->done);
+		ch->c = c;
+		ch->bu = j ? c->ra_bu : &c->bu;
+		ch->cnt = 0;
+	}
+
+	while (i < w->cnt) {
+		struct ubifs_ra_chunk *ch = &w->chunk[k];
+		pgoff_t index = pages[i]->index;
+		int page_cnt;
+
+		/* Wait until the previous user of this buffer is done */
+		if (ch->cnt) {
+			wait_for_completion(&ch->done);
+			ch->cnt = 0;
+		}
+
+		page_cnt = ra_bulk_read(c, ch->bu, inode, index);
+		if (!page_cnt) {
+			do_readpage(pages[i]);
+			atomic_long_inc(&c->bu_stats.misses);
+			ra_page_done(pages[i++]);
+			continue;
+		}
+
+		/* @pages may skip the pages which were already cached */
+		for (j = i + 1; j < w->cnt; j++)
+			if (pages[j]->index >= index + page_cnt)
+				break;
+		ch->pages = &pages[i];
+		ch->cnt = j - i;
+		i = j;
+
+		if (nbufs == 1) {
+			ra_populate(ch);
+			ch->cnt = 0;
+			continue;
+		}
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		INIT_COMPLETION(ch->done);
+		queue_work_on(cpu, ubifs_decomp_wq, &ch->work);
+		k = !k;
+	}
+
+	for (j = 0; j < nbufs; j++)
+		if (w->chunk[j].cnt)
+			wait_for_completion(&w->chunk[j].done);
+	mutex_unlock(&c->bu_mutex);
+	put_online_cpus();
+}
+
+static void ubifs_ra_work_fn(struct work_struct *work)
+{
+	struct ubifs_ra_work *w = container_of(work, struct ubifs_ra_work,
+					       work);
+
+	ubifs_ra_read(w);
+	kfree(w);
+}
+
+static int ubifs_readpages(struct file *file, struct address_space *mapping,
+			   struct list_head *pages, unsigned nr_pages)
+{
+	struct ubifs_info *c = mapping->host->i_sb->s_fs_info;
+	struct ubifs_ra_work *w;
+	unsigned int i;
+
+	/* Without it, the pages are freed and read by 'ubifs_readpage()' */
+	w = kmalloc(sizeof(*w) + nr_pages * sizeof(struct page *),
+		    GFP_NOFS | __GFP_NOWARN);
+	if (!w)
+		return 0;
+
+	w->c = c;
+	w->cnt = 0;
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = list_entry(pages->prev, struct page, lru);
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+					  GFP_NOFS)) {
+			page_cache_release(page);
+			continue;
+		}
+		w->pages[w->cnt++] = page;
+	}
+
+	if (!w->cnt) {
+		kfree(w);
+		return 0;
+	}
+
+	atomic_long_add(w->cnt, &c->bu_stats.ra_pages);
+	INIT_WORK(&w->work, ubifs_ra_work_fn);
+	queue_work(ubifs_ra_wq, &w->work);
 	return 0;
 }
 
@@ -1556,6 +1809,7 @@ static int ubifs_file_mmap(struct file *file, struct vm_area_struct *vma)
 
 const struct address_space_operations ubifs_file_address_operations = {
 	.readpage       = ubifs_readpage,
+	.readpages      = ubifs_readpages,
 	.writepage      = ubifs_writepage,
 	.write_begin    = ubifs_write_begin,
 	.write_end      = ubifs_write_end,
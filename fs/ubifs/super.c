@@ -36,6 +36,7 @@
 #include <linux/mount.h>
 #include <linux/math64.h>
 #include <linux/writeback.h>
+#include <linux/workqueue.h>
 #include "ubifs.h"
 
 /*
@@ -1122,6 +1123,38 @@ again:
 		c->bulk_read = 0;
 		return;
 	}
+
+	/* Without it, read-ahead does not overlap reads and decompression */
+	c->ra_bu = kmalloc(sizeof(struct bu_info), GFP_KERNEL | __GFP_NOWARN);
+	if (c->ra_bu) {
+		c->ra_bu->buf = kmalloc(c->max_bu_buf_len,
+					GFP_KERNEL | __GFP_NOWARN);
+		if (!c->ra_bu->buf) {
+			kfree(c->ra_bu);
+			c->ra_bu = NULL;
+		}
+	}
+
+	/*
+	 * Let the page cache read-ahead drive bulk-reads, see
+	 * 'ubifs_readpages()'. Its window grows up to two LEBs.
+	 */
+	c->bdi.ra_pages = (2 * c->leb_size) >> PAGE_CACHE_SHIFT;
+}
+
+/**
+ * bu_free - free bulk-read buffers.
+ * @c: UBIFS file-system description object
+ */
+static void bu_free(struct ubifs_info *c)
+{
+	kfree(c->bu.buf);
+	c->bu.buf = NULL;
+	if (c->ra_bu) {
+		kfree(c->ra_bu->buf);
+		kfree(c->ra_bu);
+		c->ra_bu = NULL;
+	}
 }
 
 /**
@@ -1499,7 +1532,7 @@ out_cbuf:
 	kfree(c->cbuf);
 out_free:
 	kfree(c->write_reserve_buf);
-	kfree(c->bu.buf);
+	bu_free(c);
 	vfree(c->ileb_buf);
 	vfree(c->sbuf);
 	kfree(c->bottom_up_buf);
@@ -1538,7 +1571,7 @@ static void ubifs_umount(struct ubifs_info *c)
 	kfree(c->rcvrd_mst_node);
 	kfree(c->mst_node);
 	kfree(c->write_reserve_buf);
-	kfree(c->bu.buf);
+	bu_free(c);
 	vfree(c->ileb_buf);
 	vfree(c->sbuf);
 	kfree(c->bottom_up_buf);
@@ -1769,6 +1802,9 @@ static void ubifs_put_super(struct super_block *sb)
 	ubifs_msg("un-mount UBI device %d, volume %d", c->vi.ubi_num,
 		  c->vi.vol_id);
 
+	/* Read-ahead work may still refer to @c after unlocking its pages */
+	flush_workqueue(ubifs_ra_wq);
+
 	/*
 	 * The following asserts are only valid if there has not been a failure
 	 * of the media. For example, there will be dirty inodes if we failed
@@ -1876,8 +1912,11 @@ static int ubifs_remount_fs(struct super_block *sb, int *flags, char *data)
 		bu_init(c);
 	else {
 		dbg_gen("disable bulk-read");
-		kfree(c->bu.buf);
-		c->bu.buf = NULL;
+		c->bdi.ra_pages = 0;
+		flush_workqueue(ubifs_ra_wq);
+		mutex_lock(&c->bu_mutex);
+		bu_free(c);
+		mutex_unlock(&c->bu_mutex);
 	}
 
 	ubifs_assert(c->lst.taken_empty_lebs > 0);
@@ -2022,7 +2061,9 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 	 * which means the user would have to wait not just for their own I/O
 	 * but the read-ahead I/O as well i.e. completely pointless.
 	 *
-	 * Read-ahead will be disabled because @c->bdi.ra_pages is 0.
+	 * Read-ahead is disabled because @c->bdi.ra_pages is 0, unless
+	 * bulk-read is enabled: 'ubifs_readpages()' then defers the I/O to
+	 * the read-ahead work queue.
 	 */
 	c->bdi.name = "ubifs",
 	c->bdi.capabilities = BDI_CAP_MAP_COPY;
@@ -2258,12 +2299,25 @@ static int __init ubifs_init(void)
 	if (err)
 		goto out_shrinker;
 
+	err = -ENOMEM;
+	ubifs_ra_wq = create_singlethread_workqueue("ubifs_ra");
+	if (!ubifs_ra_wq)
+		goto out_compr;
+
+	ubifs_decomp_wq = create_workqueue("ubifs_decomp");
+	if (!ubifs_decomp_wq)
+		goto out_wq;
+
 	err = dbg_debugfs_init();
 	if (err)
-		goto out_compr;
+		goto out_decomp_wq;
 
 	return 0;
 
+out_decomp_wq:
+	destroy_workqueue(ubifs_decomp_wq);
+out_wq:
+	destroy_workqueue(ubifs_ra_wq);
 out_compr:
 	ubifs_compressors_exit();
 out_shrinker:
@@ -2282,6 +2336,8 @@ static void __exit ubifs_exit(void)
 	ubifs_assert(atomic_long_read(&ubifs_clean_zn_cnt) == 0);
 
 	dbg_debugfs_exit();
+	destroy_workqueue(ubifs_ra_wq);
+	destroy_workqueue(ubifs_decomp_wq);
 	ubifs_compressors_exit();
 	unregister_shrinker(&ubifs_shrinker_info);
 	kmem_cache_destroy(ubifs_inode_slab);
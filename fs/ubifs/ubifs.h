@@ -823,6 +823,8 @@ struct ubifs_node_range {
  * struct ubifs_compressor - UBIFS compressor description structure.
  * @compr_type: compressor type (%UBIFS_COMPR_LZO, etc)
  * @cc: cryptoapi compressor handle
+ * @dcc: per-CPU cryptoapi handles used for decompression, or %NULL if
+ *       decompression uses @cc
  * @comp_mutex: mutex used during compression
  * @decomp_mutex: mutex used during decompression
  * @name: compressor name
@@ -831,6 +833,7 @@ struct ubifs_node_range {
 struct ubifs_compressor {
 	int compr_type;
 	struct crypto_comp *cc;
+	struct crypto_comp * __percpu *dcc;
 	struct mutex *comp_mutex;
 	struct mutex *decomp_mutex;
 	const char *name;
@@ -939,6 +942,24 @@ struct ubifs_mount_opts {
 	unsigned int compr_type:2;
 };
 
+/**
+ * struct ubifs_bu_stats - bulk-read statistics.
+ * @reads: number of bulk-reads issued
+ * @hits: pages filled from bulk-reads
+ * @misses: pages read one data node at a time
+ * @ra_pages: pages submitted by the page cache read-ahead
+ * @read_us: time spent in read-ahead bulk-reads, in microseconds
+ * @decomp_us: time spent populating read-ahead pages, in microseconds
+ */
+struct ubifs_bu_stats {
+	atomic_long_t reads;
+	atomic_long_t hits;
+	atomic_long_t misses;
+	atomic_long_t ra_pages;
+	atomic_long_t read_us;
+	atomic_long_t decomp_us;
+};
+
 /**
  * struct ubifs_budg_info - UBIFS budgeting information.
  * @idx_growth: amount of bytes budgeted for index growth
@@ -1047,6 +1068,9 @@ struct ubifs_debug_info;
  * @max_bu_buf_len: maximum bulk-read buffer length
  * @bu_mutex: protects the pre-allocated bulk-read buffer and @c->bu
  * @bu: pre-allocated bulk-read information
+ * @bu_stats: bulk-read statistics
+ * @ra_bu: second bulk-read buffer, used by the read-ahead while @bu is being
+ *         decompressed (also protected by @bu_mutex)
  *
  * @write_reserve_mutex: protects @write_reserve_buf
  * @write_reserve_buf: on the write path we allocate memory, which might
@@ -1287,6 +1311,8 @@ struct ubifs_info {
 	int max_bu_buf_len;
 	struct mutex bu_mutex;
 	struct bu_info bu;
+	struct ubifs_bu_stats bu_stats;
+	struct bu_info *ra_bu;
 
 	struct mutex write_reserve_mutex;
 	void *write_reserve_buf;
@@ -1468,6 +1494,8 @@ extern const struct inode_operations ubifs_dir_inode_operations;
 extern const struct inode_operations ubifs_symlink_inode_operations;
 extern struct backing_dev_info ubifs_backing_dev_info;
 extern struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
+extern struct workqueue_struct *ubifs_ra_wq;
+extern struct workqueue_struct *ubifs_decomp_wq;
 
 /* io.c */
 void ubifs_ro_mode(struct ubifs_info *c, int err);
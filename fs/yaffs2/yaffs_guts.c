@@ -3176,10 +3176,42 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
  *   In Linux, the page cache provides read buffering aand the short op cache provides write
  *   buffering.
  *
- *   There are a limited number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   The number of cache chunks per device is set at mount. Caches in use are
+ *   hashed by object and chunk id, free caches are kept on a list, so lookups
+ *   and grabs do not depend on the cache size. Only pushing out the least
+ *   recently used chunk, and flushing, scan all the caches.
  */
 
+static struct ylist_head *yaffs_ChunkCacheBucket(yaffs_Device *dev,
+						const yaffs_Object *obj,
+						int chunkId)
+{
+	unsigned h = obj->objectId * 31 + chunkId;
+
+	return &dev->srCacheHash[h & dev->srCacheHashMask];
+}
+
+/* Assign a free cache to a chunk of an object */
+static void yaffs_SetChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache,
+				yaffs_Object *obj, int chunkId)
+{
+	cache->object = obj;
+	cache->chunkId = chunkId;
+	ylist_del(&cache->hashLink);
+	ylist_add(&cache->hashLink, yaffs_ChunkCacheBucket(dev, obj, chunkId));
+}
+
+/* Give a cache back to the free list */
+static void yaffs_ClearChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache)
+{
+	if (!cache->object)
+		return;
+
+	cache->object = NULL;
+	ylist_del(&cache->hashLink);
+	ylist_add_tail(&cache->hashLink, &dev->srCacheFree);
+}
+
 static int yaffs_ObjectHasCachedWriteData(yaffs_Object *obj)
 {
 	yaffs_Device *dev = obj->myDev;
@@ -3234,7 +3266,7 @@ static void yaffs_FlushFilesChunkCache(yaffs_Object *obj)
 								 cache->nBytes,
 								 1);
 				cache->dirty = 0;
-				cache->object = NULL;
+				yaffs_ClearChunkCache(dev, cache);
 			}
 
 		} while (cache && chunkWritten > 0);
@@ -3286,14 +3318,9 @@ void yaffs_FlushEntireDeviceCache(yaffs_Device *dev)
  */
 static yaffs_ChunkCache *yaffs_GrabChunkCacheWorker(yaffs_Device *dev)
 {
-	int i;
-
-	if (dev->param.nShortOpCaches > 0) {
-		for (i = 0; i < dev->param.nShortOpCaches; i++) {
-			if (!dev->srCache[i].object)
-				return &dev->srCache[i];
-		}
-	}
+	if (dev->param.nShortOpCaches > 0 && !ylist_empty(&dev->srCacheFree))
+		return ylist_entry(dev->srCacheFree.next, yaffs_ChunkCache,
+				   hashLink);
 
 	return NULL;
 }
@@ -3354,14 +3381,19 @@ static yaffs_ChunkCache *yaffs_FindChunkCache(const yaffs_Object *obj,
 					      int chunkId)
 {
 	yaffs_Device *dev = obj->myDev;
-	int i;
+	struct ylist_head *bucket;
+	struct ylist_head *i;
+	yaffs_ChunkCache *cache;
+
 	if (dev->param.nShortOpCaches > 0) {
-		for (i = 0; i < dev->param.nShortOpCaches; i++) {
-			if (dev->srCache[i].object == obj &&
-			    dev->srCache[i].chunkId == chunkId) {
+		bucket = yaffs_ChunkCacheBucket(dev, obj, chunkId);
+		ylist_for_each(i, bucket) {
+			cache = ylist_entry(i, yaffs_ChunkCache, hashLink);
+			if (cache->object == obj &&
+			    cache->chunkId == chunkId) {
 				dev->cacheHits++;
 
-				return &dev->srCache[i];
+				return cache;
 			}
 		}
 	}
@@ -3402,7 +3434,7 @@ static void yaffs_InvalidateChunkCache(yaffs_Object *object, int chunkId)
 		yaffs_ChunkCache *cache = yaffs_FindChunkCache(object, chunkId);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_ClearChunkCache(object->myDev, cache);
 	}
 }
 
@@ -3418,7 +3450,7 @@ static void yaffs_InvalidateWholeChunkCache(yaffs_Object *in)
 		/* Invalidate it. */
 		for (i = 0; i < dev->param.nShortOpCaches; i++) {
 			if (dev->srCache[i].object == in)
-				dev->srCache[i].object = NULL;
+				yaffs_ClearChunkCache(dev, &dev->srCache[i]);
 		}
 	}
 }
@@ -3476,8 +3508,8 @@ int yaffs_ReadDataFromFile(yaffs_Object *in, __u8 *buffer, loff_t offset,
 
 				if (!cache) {
 					cache = yaffs_GrabChunkCache(in->myDev);
-					cache->object = in;
-					cache->chunkId = chunk;
+					yaffs_SetChunkCache(dev, cache, in,
+							    chunk);
 					cache->dirty = 0;
 					cache->locked = 0;
 					yaffs_ReadChunkDataFromObject(in, chunk,
@@ -3603,8 +3635,8 @@ int yaffs_DoWriteDataToFile(yaffs_Object *in, const __u8 *buffer, loff_t offset,
 				if (!cache
 				    && yaffs_CheckSpaceForAllocation(dev, 1)) {
 					cache = yaffs_GrabChunkCache(dev);
-					cache->object = in;
-					cache->chunkId = chunk;
+					yaffs_SetChunkCache(dev, cache, in,
+							    chunk);
 					cache->dirty = 0;
 					cache->locked = 0;
 					yaffs_ReadChunkDataFromObject(in, chunk,
@@ -5296,26 +5328,44 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	dev->gcCleanupList = NULL;
 
 
+	dev->srCacheHash = NULL;
+	YINIT_LIST_HEAD(&dev->srCacheFree);
+
 	if (!init_failed &&
 	    dev->param.nShortOpCaches > 0) {
 		int i;
 		void *buf;
-		int srCacheBytes = dev->param.nShortOpCaches * sizeof(yaffs_ChunkCache);
+		int srCacheBytes;
+		unsigned nBuckets = 1;
 
 		if (dev->param.nShortOpCaches > YAFFS_MAX_SHORT_OP_CACHES)
 			dev->param.nShortOpCaches = YAFFS_MAX_SHORT_OP_CACHES;
 
+		srCacheBytes = dev->param.nShortOpCaches * sizeof(yaffs_ChunkCache);
 		dev->srCache =  YMALLOC(srCacheBytes);
 
+		/* About one cache per bucket */
+		while (nBuckets < dev->param.nShortOpCaches)
+			nBuckets <<= 1;
+		dev->srCacheHash = YMALLOC(nBuckets * sizeof(struct ylist_head));
+		dev->srCacheHashMask = nBuckets - 1;
+
 		buf = (__u8 *) dev->srCache;
+		if (!dev->srCacheHash)
+			buf = NULL;
 
 		if (dev->srCache)
 			memset(dev->srCache, 0, srCacheBytes);
 
+		for (i = 0; i < nBuckets && buf; i++)
+			YINIT_LIST_HEAD(&dev->srCacheHash[i]);
+
 		for (i = 0; i < dev->param.nShortOpCaches && buf; i++) {
 			dev->srCache[i].object = NULL;
 			dev->srCache[i].lastUse = 0;
 			dev->srCache[i].dirty = 0;
+			ylist_add_tail(&dev->srCache[i].hashLink,
+				       &dev->srCacheFree);
 			dev->srCache[i].data = buf = YMALLOC_DMA(dev->param.totalBytesPerChunk);
 		}
 		if (!buf)
@@ -5439,6 +5489,11 @@ void yaffs_Deinitialise(yaffs_Device *dev)
 			dev->srCache = NULL;
 		}
 
+		if (dev->srCacheHash) {
+			YFREE(dev->srCacheHash);
+			dev->srCacheHash = NULL;
+		}
+
 		YFREE(dev->gcCleanupList);
 
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
@@ -88,7 +88,7 @@
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_MAX_SHORT_OP_CACHES	256
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -113,6 +113,7 @@
 
 /* ChunkCache is used for short read/write operations.*/
 typedef struct {
+	struct ylist_head hashLink;	/* Hash bucket if in use, else free list */
 	struct yaffs_ObjectStruct *object;
 	int chunkId;
 	int lastUse;
@@ -534,8 +535,10 @@ struct yaffs_DeviceParamStruct {
 
 
 	int nShortOpCaches;	/* If <= 0, then short op caching is disabled, else
-				 * the number of short op caches (don't use too many).
-                                 * 10 to 20 is a good bet.
+				 * the number of short op caches, at most
+				 * YAFFS_MAX_SHORT_OP_CACHES. 10 to 20 is a good
+				 * bet, use more for many small writes to many
+				 * files. Lookups are hashed.
 				 */
 	int useNANDECC;		/* Flag to decide whether or not to use NANDECC on data (yaffs1) */
 	int noTagsECC;		/* Flag to decide whether or not to do ECC on packed tags (yaffs2) */ 
@@ -720,6 +723,9 @@ struct yaffs_DeviceStruct {
 
 	yaffs_ChunkCache *srCache;
 	int srLastUse;
+	struct ylist_head *srCacheHash;	/* Caches in use, by object and chunk */
+	unsigned srCacheHashMask;
+	struct ylist_head srCacheFree;	/* Caches not in use */
 
 	/* Stuff for background deletion and unlinked files.*/
 	yaffs_Object *unlinkedDir;	/* Directory where unlinked and deleted files live. */
@@ -175,6 +175,7 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_bg_checkpoint = 0;	/* Idle seconds before a background checkpoint, 0 = never */
 
 /* Module Parameters */
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
@@ -183,6 +184,7 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_bg_checkpoint, uint, 0644);
 #else
 MODULE_PARM(yaffs_traceMask, "i");
 MODULE_PARM(yaffs_wr_attempts, "i");
@@ -2312,6 +2314,28 @@ void yaffs_background_waker(unsigned long data)
 	wake_up_process((struct task_struct *)data);
 }
 
+/*
+ * Write a checkpoint from the background thread, so that a mount following
+ * an unclean shutdown finds a valid checkpoint instead of scanning the whole
+ * device. Called with the gross lock held.
+ */
+static void yaffs_BackgroundCheckpoint(yaffs_Device *dev)
+{
+	struct super_block *sb = yaffs_DeviceToLC(dev)->superBlock;
+
+	/* Don't race with unmount, which stops this thread */
+	if (!sb || !down_read_trylock(&sb->s_umount))
+		return;
+
+	yaffs_FlushSuperBlock(sb, 1);
+	sb->s_dirt = 0;
+	up_read(&sb->s_umount);
+
+	T(YAFFS_TRACE_BACKGROUND,
+		(TSTR("yaffs_background checkpoint: isCheckpointed %d\n"),
+		dev->isCheckpointed));
+}
+
 static int yaffs_BackgroundThread(void *data)
 {
 	yaffs_Device *dev = (yaffs_Device *)data;
@@ -2319,6 +2343,9 @@ static int yaffs_BackgroundThread(void *data)
 	unsigned long now = jiffies;
 	unsigned long next_dir_update = now;
 	unsigned long next_gc = now;
+	unsigned long next_checkpoint = now;
+	__u32 lastPageWrites = dev->nPageWrites;
+	int idle;
 	unsigned long expires;
 	unsigned int urgency;
 
@@ -2346,6 +2373,7 @@ static int yaffs_BackgroundThread(void *data)
 		yaffs_GrossLock(dev);
 
 		now = jiffies;
+		idle = (dev->nPageWrites == lastPageWrites);
 
 		if(time_after(now, next_dir_update) && yaffs_bg_enable){
 			yaffs_UpdateDirtyDirectories(dev);
@@ -2368,6 +2396,20 @@ static int yaffs_BackgroundThread(void *data)
 				*/
 				next_gc = next_dir_update;
 		}
+
+		/* Checkpoint once writes have stopped for a while */
+		if(yaffs_bg_checkpoint && yaffs_bg_enable &&
+		   !dev->isCheckpointed && !dev->param.skipCheckpointWrite){
+			if(!idle)
+				next_checkpoint = now + yaffs_bg_checkpoint * HZ;
+			else if(time_after(now, next_checkpoint) &&
+				!yaffs_bg_gc_urgency(dev)){
+				yaffs_BackgroundCheckpoint(dev);
+				next_checkpoint = now + yaffs_bg_checkpoint * HZ;
+			}
+		}
+		/* Don't count our own gc and checkpoint writes as activity */
+		lastPageWrites = dev->nPageWrites;
 		yaffs_GrossUnlock(dev);
 #if 1
 		expires = next_dir_update;
@@ -2606,6 +2648,7 @@ typedef struct {
 	int skip_checkpoint_read;
 	int skip_checkpoint_write;
 	int no_cache;
+	int cache_size;
 	int tags_ecc_on;
 	int tags_ecc_overridden;
 	int lazy_loading_enabled;
@@ -2660,6 +2703,9 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 			options->empty_lost_and_found_overridden=1;
 		} else if (!strcmp(cur_opt, "no-cache"))
 			options->no_cache = 1;
+		else if (!strncmp(cur_opt, "cache-size=", 11))
+			options->cache_size =
+				simple_strtoul(cur_opt + 11, NULL, 0);
 		else if (!strcmp(cur_opt, "no-checkpoint-read"))
 			options->skip_checkpoint_read = 1;
 		else if (!strcmp(cur_opt, "no-checkpoint-write"))
@@ -2916,7 +2962,13 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	param->nChunksPerBlock = YAFFS_CHUNKS_PER_BLOCK;
 	param->totalBytesPerChunk = YAFFS_BYTES_PER_CHUNK;
 	param->nReservedBlocks = 5;
-	param->nShortOpCaches = (options.no_cache) ? 0 : 10;
+	if (options.no_cache)
+		param->nShortOpCaches = 0;
+	else if (options.cache_size)
+		param->nShortOpCaches = min(options.cache_size,
+					    YAFFS_MAX_SHORT_OP_CACHES);
+	else
+		param->nShortOpCaches = 10;
 	param->inbandTags = options.inband_tags;
 
 #ifdef CONFIG_YAFFS_DISABLE_LAZY_LOAD
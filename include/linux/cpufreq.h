@@ -375,6 +375,13 @@ extern struct cpufreq_governor cpufreq_gov_hotplug;
 #define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_hotplug)
 #endif
 
+/* boost hint for the 'hotplug' governor, only when it is built in */
+#ifdef CONFIG_CPU_FREQ_GOV_HOTPLUG
+void cpufreq_hotplug_boost_hint(void);
+#else
+static inline void cpufreq_hotplug_boost_hint(void) {}
+#endif
+
 
 /*********************************************************************
  *                     FREQUENCY TABLE HELPERS                       *
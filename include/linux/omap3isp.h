@@ -39,6 +39,7 @@
  * VIDIOC_OMAP3ISP_AF_CFG: Set auto-focus module configuration
  * VIDIOC_OMAP3ISP_STAT_REQ: Read statistics (AEWB/AF/histogram) data
  * VIDIOC_OMAP3ISP_STAT_EN: Enable/disable a statistics module
+ * VIDIOC_OMAP3ISP_DISPLAY: Enable/disable the capture to display overlay link
  */
 
 #define VIDIOC_OMAP3ISP_CCDC_CFG \
@@ -55,6 +56,8 @@
 	_IOWR('V', BASE_VIDIOC_PRIVATE + 6, struct omap3isp_stat_data)
 #define VIDIOC_OMAP3ISP_STAT_EN \
 	_IOWR('V', BASE_VIDIOC_PRIVATE + 7, unsigned long)
+#define VIDIOC_OMAP3ISP_DISPLAY \
+	_IOWR('V', BASE_VIDIOC_PRIVATE + 8, struct omap3isp_display_config)
 
 /*
  * Events
@@ -641,4 +644,36 @@ struct omap3isp_prev_update_config {
 	struct omap3isp_prev_gtables __user *gamma;
 };
 
+/* Capture to display link */
+
+/**
+ * struct omap3isp_display_config - Capture to display overlay link
+ * @enable: 1 to route completed capture buffers to the overlay, 0 to return
+ *	them to userspace. Enabling an already enabled link only reports the
+ *	statistics.
+ * @overlay: DSS overlay index
+ * @pos_x: Overlay horizontal position on the display
+ * @pos_y: Overlay vertical position on the display
+ * @out_width: Overlay output width (0 to disable scaling)
+ * @out_height: Overlay output height (0 to disable scaling)
+ * @frames: Number of frames displayed (returned by the driver)
+ * @dropped: Number of frames dropped (returned by the driver)
+ * @gear_latency_us: Time from the last reverse gear engagement to the first
+ *	displayed frame in microseconds (returned by the driver)
+ * @gear_latency_max_us: Maximum reverse gear to first frame time in
+ *	microseconds (returned by the driver)
+ */
+struct omap3isp_display_config {
+	__u32 enable;
+	__u32 overlay;
+	__u16 pos_x;
+	__u16 pos_y;
+	__u16 out_width;
+	__u16 out_height;
+	__u32 frames;
+	__u32 dropped;
+	__u32 gear_latency_us;
+	__u32 gear_latency_max_us;
+};
+
 #endif	/* OMAP3_ISP_USER_H */
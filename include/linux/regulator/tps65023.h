@@ -0,0 +1,37 @@
+/*
+ * tps65023.h
+ *
+ * Interface of the TPS65023 regulator driver for the DVFS code
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#ifndef __LINUX_REGULATOR_TPS65023_H
+#define __LINUX_REGULATOR_TPS65023_H
+
+#include <linux/types.h>
+#include <linux/errno.h>
+
+/* VDCDC1: 0.8 V to 1.55 V by 25 mV (vsel 0-30), vsel 31 is 1.6 V */
+#define TPS65023_VDCDC1_MIN_UV		800000
+#define TPS65023_VDCDC1_STEP_UV		25000
+#define TPS65023_VDCDC1_MAX_VSEL	31
+#define TPS65023_VDCDC1_MAX_UV		1600000
+
+#ifdef CONFIG_REGULATOR_TPS65023
+int tps65023_dcdc1_set_vsel(u8 vsel);
+#else
+static inline int tps65023_dcdc1_set_vsel(u8 vsel)
+{
+	return -ENODEV;
+}
+#endif
+
+#endif
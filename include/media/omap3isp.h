@@ -130,9 +130,21 @@ struct isp_v4l2_subdevs_group {
 	} bus; /* gcc < 4.6.0 chokes on anonymous union initializers */
 };
 
+/**
+ * struct isp_display_platform_data - ISP to display link platform data
+ * @gear_gpio: GPIO reporting the reverse gear state, or -1 if the overlay
+ *	must be shown as soon as the link is enabled
+ * @gear_active_low: The reverse gear GPIO is active low
+ */
+struct isp_display_platform_data {
+	int gear_gpio;
+	unsigned int gear_active_low:1;
+};
+
 struct isp_platform_data {
 	struct isp_v4l2_subdevs_group *subdevs;
 	void (*set_constraints)(struct isp_device *isp, bool enable);
+	struct isp_display_platform_data *display;
 };
 
 #endif	/* __MEDIA_OMAP3ISP_H__ */
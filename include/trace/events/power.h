@@ -67,6 +67,32 @@ TRACE_EVENT(power_end,
 
 );
 
+TRACE_EVENT(cpufreq_transition_latency,
+
+	TP_PROTO(unsigned int cpu, unsigned int old_freq,
+		 unsigned int new_freq, s64 latency_us),
+
+	TP_ARGS(cpu, old_freq, new_freq, latency_us),
+
+	TP_STRUCT__entry(
+		__field(	u32,		cpu		)
+		__field(	u32,		old_freq	)
+		__field(	u32,		new_freq	)
+		__field(	s64,		latency_us	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->old_freq = old_freq;
+		__entry->new_freq = new_freq;
+		__entry->latency_us = latency_us;
+	),
+
+	TP_printk("cpu=%lu old=%lu new=%lu latency_us=%lld",
+		  (unsigned long)__entry->cpu, (unsigned long)__entry->old_freq,
+		  (unsigned long)__entry->new_freq, __entry->latency_us)
+);
+
 #endif /* _TRACE_POWER_H */
 
 /* This part must be outside protection */
@@ -14,4 +14,5 @@
 #include <trace/events/power.h>
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(power_frequency);
+EXPORT_TRACEPOINT_SYMBOL_GPL(cpufreq_transition_latency);
 
@@ -36,6 +36,7 @@
 
 #include "omap-mcbsp.h"
 #include "omap-pcm.h"
+#include "omap-pcm-mix.h"
 
 #include "../codecs/wau8822.h"
 
@@ -273,6 +274,18 @@ static struct snd_soc_ops fc6100_i2s_ops = {
         .startup = fc6100_i2s_startup,
 };
 
+/*
+ * Navigation prompts, media and phone audio are mixed in the kernel on the
+ * codec link. The mixer PCM takes the first device number after the links.
+ */
+#define FC6100_MIX_DEVICE	4
+#define FC6100_MIX_STREAMS	3
+
+static int fc6100_i2s_codec_init(struct snd_soc_pcm_runtime *rtd)
+{
+	return omap_pcm_mix_new(rtd, FC6100_MIX_DEVICE, FC6100_MIX_STREAMS);
+}
+
 /* Digital audio interface glue - connects codec <--> CPU */
 static struct snd_soc_dai_link fc6100_dai[4] = {
         {/* Nuvoton nau8820/wau8822 codec */
@@ -283,6 +296,7 @@ static struct snd_soc_dai_link fc6100_dai[4] = {
                 .platform_name = "omap-pcm-audio",
                 /* Configuration for Pal codec */
                 .no_codec = 1, /* TODO: have a dummy CODEC */
+                .init = fc6100_i2s_codec_init,
                 .ops = &fc6100_i2s_ops,
         },
         {/* Marvel Bluetooth chip */
@@ -0,0 +1,967 @@
+/*
+ * omap-pcm-mix.c  --  Software mixing stage on top of an OMAP PCM link
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/*
+ * The mixer exposes a PCM device with several playback substreams accepting
+ * S16_LE mono or stereo at any rate up to 48 kHz. While one of them is open,
+ * the playback substream of the underlying McBSP link is opened in-kernel and
+ * runs continuously at 48 kHz stereo. Each time the McBSP DMA completes a
+ * period, a tasklet resamples the running substreams with a fixed point
+ * polyphase filter, applies their gain and sums them directly into the DMA
+ * buffer, OMAP_PCM_MIX_LEAD periods ahead of the hardware.
+ *
+ * Substreams flagged as priority (navigation prompts, phone) duck the other
+ * ones to the "Mix Duck Playback Volume" level while they are running. Gain
+ * changes are ramped over one period to avoid clicks.
+ */
+
+#include <linux/fs.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <sound/core.h>
+#include <sound/control.h>
+#include <sound/info.h>
+#include <sound/pcm.h>
+#include <sound/pcm_params.h>
+#include <sound/soc.h>
+
+#include "omap-pcm-mix.h"
+
+#define OMAP_PCM_MIX_RATE		48000
+#define OMAP_PCM_MIX_CHANNELS		2
+#define OMAP_PCM_MIX_PERIOD		480	/* 10 ms */
+#define OMAP_PCM_MIX_PERIODS		4
+#define OMAP_PCM_MIX_LEAD		2
+#define OMAP_PCM_MIX_MAX_STREAMS	4
+
+#define OMAP_PCM_MIX_ONE		(1 << 16)
+#define OMAP_PCM_MIX_TAPS		8
+#define OMAP_PCM_MIX_PHASE_BITS		6
+#define OMAP_PCM_MIX_GAIN_MAX		32767
+
+static int mix_benchmark;
+module_param(mix_benchmark, bool, 0444);
+MODULE_PARM_DESC(mix_benchmark, "Measure the mixer CPU cost at registration");
+
+/*
+ * Interpolation filter: 64 phases of an 8 taps Kaiser windowed sinc (beta 6,
+ * cutoff at 0.92 of the input Nyquist frequency), Q15, each phase normalized
+ * to unity DC gain. Phase p interpolates the input at x[n] + p/64 using taps
+ * x[n-3] .. x[n+4].
+ */
+static const s16 omap_pcm_mix_fir[1 << OMAP_PCM_MIX_PHASE_BITS][OMAP_PCM_MIX_TAPS] = {
+	{    389,  -1211,   2177,  30091,   2177,  -1211,    389,    -33 },
+	{    359,  -1089,   1755,  30084,   2612,  -1336,    419,    -36 },
+	{    331,   -968,   1346,  30051,   3061,  -1462,    449,    -40 },
+	{    302,   -850,    950,  29997,   3522,  -1590,    480,    -43 },
+	{    275,   -735,    569,  29921,   3994,  -1719,    510,    -47 },
+	{    248,   -622,    201,  29820,   4479,  -1849,    542,    -51 },
+	{    222,   -512,   -152,  29697,   4975,  -1979,    573,    -56 },
+	{    197,   -405,   -491,  29552,   5481,  -2110,    604,    -60 },
+	{    172,   -302,   -815,  29384,   5998,  -2240,    635,    -64 },
+	{    149,   -201,  -1125,  29193,   6524,  -2370,    666,    -68 },
+	{    126,   -105,  -1420,  28984,   7060,  -2500,    696,    -73 },
+	{    105,    -12,  -1700,  28750,   7604,  -2628,    726,    -77 },
+	{     84,     77,  -1966,  28497,   8156,  -2754,    756,    -82 },
+	{     64,    163,  -2217,  28223,   8716,  -2879,    784,    -86 },
+	{     45,    244,  -2452,  27929,   9282,  -3001,    812,    -91 },
+	{     28,    322,  -2674,  27614,   9855,  -3121,    839,    -95 },
+	{     11,    395,  -2880,  27281,  10433,  -3238,    865,    -99 },
+	{     -5,    465,  -3072,  26929,  11015,  -3351,    890,   -103 },
+	{    -19,    530,  -3250,  26558,  11602,  -3460,    914,   -107 },
+	{    -33,    592,  -3413,  26169,  12193,  -3565,    936,   -111 },
+	{    -46,    649,  -3562,  25765,  12785,  -3666,    957,   -114 },
+	{    -58,    702,  -3698,  25346,  13380,  -3761,    975,   -118 },
+	{    -68,    751,  -3819,  24907,  13976,  -3850,    992,   -121 },
+	{    -78,    796,  -3927,  24454,  14572,  -3933,   1007,   -123 },
+	{    -87,    838,  -4022,  23987,  15168,  -4010,   1020,   -126 },
+	{    -95,    875,  -4104,  23507,  15762,  -4080,   1031,   -128 },
+	{   -102,    908,  -4173,  23013,  16355,  -4143,   1039,   -129 },
+	{   -108,    938,  -4230,  22507,  16944,  -4198,   1045,   -130 },
+	{   -114,    964,  -4275,  21991,  17530,  -4245,   1048,   -131 },
+	{   -118,    986,  -4309,  21462,  18112,  -4283,   1049,   -131 },
+	{   -122,   1005,  -4330,  20923,  18688,  -4312,   1046,   -130 },
+	{   -125,   1020,  -4341,  20376,  19258,  -4332,   1041,   -129 },
+	{   -128,   1032,  -4342,  19821,  19823,  -4342,   1032,   -128 },
+	{   -129,   1041,  -4332,  19258,  20376,  -4341,   1020,   -125 },
+	{   -130,   1046,  -4312,  18688,  20923,  -4330,   1005,   -122 },
+	{   -131,   1049,  -4283,  18112,  21462,  -4309,    986,   -118 },
+	{   -131,   1048,  -4245,  17530,  21991,  -4275,    964,   -114 },
+	{   -130,   1045,  -4198,  16944,  22507,  -4230,    938,   -108 },
+	{   -129,   1039,  -4143,  16355,  23013,  -4173,    908,   -102 },
+	{   -128,   1031,  -4080,  15762,  23507,  -4104,    875,    -95 },
+	{   -126,   1020,  -4010,  15168,  23987,  -4022,    838,    -87 },
+	{   -123,   1007,  -3933,  14572,  24454,  -3927,    796,    -78 },
+	{   -121,    992,  -3850,  13976,  24907,  -3819,    751,    -68 },
+	{   -118,    975,  -3761,  13380,  25346,  -3698,    702,    -58 },
+	{   -114,    957,  -3666,  12785,  25765,  -3562,    649,    -46 },
+	{   -111,    936,  -3565,  12193,  26169,  -3413,    592,    -33 },
+	{   -107,    914,  -3460,  11602,  26558,  -3250,    530,    -19 },
+	{   -103,    890,  -3351,  11015,  26929,  -3072,    465,     -5 },
+	{    -99,    865,  -3238,  10433,  27281,  -2880,    395,     11 },
+	{    -95,    839,  -3121,   9855,  27614,  -2674,    322,     28 },
+	{    -91,    812,  -3001,   9282,  27929,  -2452,    244,     45 },
+	{    -86,    784,  -2879,   8716,  28223,  -2217,    163,     64 },
+	{    -82,    756,  -2754,   8156,  28497,  -1966,     77,     84 },
+	{    -77,    726,  -2628,   7604,  28750,  -1700,    -12,    105 },
+	{    -73,    696,  -2500,   7060,  28984,  -1420,   -105,    126 },
+	{    -68,    666,  -2370,   6524,  29193,  -1125,   -201,    149 },
+	{    -64,    635,  -2240,   5998,  29384,   -815,   -302,    172 },
+	{    -60,    604,  -2110,   5481,  29552,   -491,   -405,    197 },
+	{    -56,    573,  -1979,   4975,  29697,   -152,   -512,    222 },
+	{    -51,    542,  -1849,   4479,  29820,    201,   -622,    248 },
+	{    -47,    510,  -1719,   3994,  29921,    569,   -735,    275 },
+	{    -43,    480,  -1590,   3522,  29997,    950,   -850,    302 },
+	{    -40,    449,  -1462,   3061,  30051,   1346,   -968,    331 },
+	{    -36,    419,  -1336,   2612,  30084,   1755,  -1089,    359 },
+};
+
+struct omap_pcm_mix;
+
+struct omap_pcm_mix_stream {
+	struct snd_pcm_substream	*substream;
+	unsigned int			running:1;
+	unsigned int			priority:1;
+
+	/* Input ring, cached at prepare time */
+	const s16			*area;
+	snd_pcm_uframes_t		buffer_size;
+	snd_pcm_uframes_t		period_size;
+	unsigned int			channels;
+	snd_pcm_uframes_t		pos;
+	snd_pcm_uframes_t		period_pos;
+
+	/* Resampler state, 16.16 fixed point input position */
+	u32				step;
+	u32				phase;
+	unsigned int			head;
+	s16				hist[2 * OMAP_PCM_MIX_TAPS][2];
+
+	/* Q15 gains */
+	int				volume;
+	int				gain;
+};
+
+struct omap_pcm_mix_stats {
+	unsigned long			periods;
+	unsigned long			late;
+	u64				total_ns;
+	unsigned int			last_ns;
+	unsigned int			max_ns;
+};
+
+struct omap_pcm_mix {
+	struct snd_soc_pcm_runtime	*rtd;
+	struct snd_pcm			*pcm;
+
+	/* Back-end McBSP substream, protected by the mutex */
+	struct mutex			mutex;
+	unsigned int			users;
+	struct file			be_file;
+	struct snd_pcm_substream	*be;
+	unsigned int			be_next;
+	struct tasklet_struct		tasklet;
+
+	/* Mixing state, protected by the spinlock */
+	spinlock_t			lock;
+	bool				be_running;
+	int				duck;
+	unsigned int			nstreams;
+	struct omap_pcm_mix_stream	streams[OMAP_PCM_MIX_MAX_STREAMS];
+	s32				acc[OMAP_PCM_MIX_PERIOD * OMAP_PCM_MIX_CHANNELS];
+	struct omap_pcm_mix_stats	stats;
+};
+
+/* The transfer_ack_end hook has no private data: one mixer per system. */
+static struct omap_pcm_mix *omap_pcm_mix_dev;
+
+/* -----------------------------------------------------------------------------
+ * Mixing
+ */
+
+/*
+ * Resample one stream and add it to the accumulator. Return true when at
+ * least one input period has been consumed.
+ */
+static bool omap_pcm_mix_resample(struct omap_pcm_mix_stream *s, s32 *acc,
+				  unsigned int frames, int target)
+{
+	int dgain = (target - s->gain) / (int)frames;
+	int gain = s->gain;
+	bool elapsed = false;
+	unsigned int i, k;
+
+	for (i = 0; i < frames; i++) {
+		s16 (*win)[2];
+		const s16 *coef;
+		s32 l, r;
+
+		while (s->phase >= OMAP_PCM_MIX_ONE) {
+			const s16 *src = s->area + s->pos * s->channels;
+			s16 sl = src[0];
+			s16 sr = s->channels == 2 ? src[1] : sl;
+
+			s->hist[s->head][0] = sl;
+			s->hist[s->head][1] = sr;
+			s->hist[s->head + OMAP_PCM_MIX_TAPS][0] = sl;
+			s->hist[s->head + OMAP_PCM_MIX_TAPS][1] = sr;
+			s->head = (s->head + 1) & (OMAP_PCM_MIX_TAPS - 1);
+
+			if (++s->pos == s->buffer_size)
+				s->pos = 0;
+			if (++s->period_pos == s->period_size) {
+				s->period_pos = 0;
+				elapsed = true;
+			}
+			s->phase -= OMAP_PCM_MIX_ONE;
+		}
+
+		win = &s->hist[s->head];
+		if (s->step == OMAP_PCM_MIX_ONE) {
+			/* No rate conversion, only the delay line. */
+			l = win[3][0];
+			r = win[3][1];
+		} else {
+			coef = omap_pcm_mix_fir[s->phase >>
+				(16 - OMAP_PCM_MIX_PHASE_BITS)];
+			l = r = 0;
+			for (k = 0; k < OMAP_PCM_MIX_TAPS; k++) {
+				l += coef[k] * win[k][0];
+				r += coef[k] * win[k][1];
+			}
+			l >>= 15;
+			r >>= 15;
+		}
+
+		gain += dgain;
+		acc[2 * i] += (l * gain) >> 15;
+		acc[2 * i + 1] += (r * gain) >> 15;
+
+		s->phase += s->step;
+	}
+
+	s->gain = target;
+	return elapsed;
+}
+
+/*
+ * Mix all running streams into one 48 kHz stereo period. Return a bitmask of
+ * the streams that completed a period. Must be called with the lock held.
+ */
+static unsigned long omap_pcm_mix_render(struct omap_pcm_mix *mix, s16 *dst,
+					 unsigned int frames)
+{
+	unsigned long elapsed = 0;
+	bool duck = false;
+	unsigned int i;
+
+	memset(mix->acc, 0, frames * OMAP_PCM_MIX_CHANNELS * sizeof(*mix->acc));
+
+	for (i = 0; i < mix->nstreams; i++) {
+		if (mix->streams[i].running && mix->streams[i].priority)
+			duck = true;
+	}
+
+	for (i = 0; i < mix->nstreams; i++) {
+		struct omap_pcm_mix_stream *s = &mix->streams[i];
+		int target = s->volume;
+
+		if (!s->running)
+			continue;
+
+		if (duck && !s->priority)
+			target = (target * mix->duck) >> 15;
+
+		if (omap_pcm_mix_resample(s, mix->acc, frames, target))
+			elapsed |= 1 << i;
+	}
+
+	for (i = 0; i < frames * OMAP_PCM_MIX_CHANNELS; i++)
+		dst[i] = clamp_t(s32, mix->acc[i], -32768, 32767);
+
+	return elapsed;
+}
+
+static void omap_pcm_mix_stats_update(struct omap_pcm_mix_stats *stats,
+				      ktime_t start)
+{
+	unsigned int ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	stats->periods++;
+	stats->total_ns += ns;
+	stats->last_ns = ns;
+	if (ns > stats->max_ns)
+		stats->max_ns = ns;
+}
+
+static void omap_pcm_mix_tasklet(unsigned long data)
+{
+	struct omap_pcm_mix *mix = (struct omap_pcm_mix *)data;
+	struct snd_pcm_runtime *runtime;
+	unsigned long elapsed = 0;
+	unsigned long flags;
+	unsigned int ahead;
+	unsigned int hwp;
+	unsigned int i;
+
+	spin_lock_irqsave(&mix->lock, flags);
+
+	if (!mix->be_running)
+		goto done;
+
+	runtime = mix->be->runtime;
+	hwp = (runtime->status->hw_ptr % runtime->buffer_size)
+	    / runtime->period_size;
+	ahead = (mix->be_next + runtime->periods - hwp) % runtime->periods;
+
+	/* The period being rendered is already playing, skip it. */
+	if (ahead == 0) {
+		mix->stats.late++;
+		mix->be_next = (hwp + 1) % runtime->periods;
+		ahead = 1;
+	}
+
+	for (; ahead <= OMAP_PCM_MIX_LEAD; ahead++) {
+		ktime_t start = ktime_get();
+		s16 *dst = (s16 *)(runtime->dma_area +
+			frames_to_bytes(runtime, mix->be_next *
+					runtime->period_size));
+
+		elapsed |= omap_pcm_mix_render(mix, dst, runtime->period_size);
+		mix->be_next = (mix->be_next + 1) % runtime->periods;
+
+		omap_pcm_mix_stats_update(&mix->stats, start);
+	}
+
+done:
+	spin_unlock_irqrestore(&mix->lock, flags);
+
+	for (i = 0; i < mix->nstreams; i++) {
+		if (elapsed & (1 << i))
+			snd_pcm_period_elapsed(mix->streams[i].substream);
+	}
+}
+
+/* Called by snd_pcm_period_elapsed() on the back-end substream. */
+static void omap_pcm_mix_ack(struct snd_pcm_substream *substream)
+{
+	if (omap_pcm_mix_dev)
+		tasklet_schedule(&omap_pcm_mix_dev->tasklet);
+}
+
+/* -----------------------------------------------------------------------------
+ * Back-end substream
+ */
+
+static void omap_pcm_mix_set_mask(struct snd_pcm_hw_params *params,
+				  snd_pcm_hw_param_t var, unsigned int val)
+{
+	struct snd_mask *mask = hw_param_mask(params, var);
+
+	snd_mask_none(mask);
+	snd_mask_set(mask, val);
+}
+
+static int omap_pcm_mix_set_interval(struct snd_pcm_hw_params *params,
+				     snd_pcm_hw_param_t var, unsigned int val)
+{
+	struct snd_interval t;
+
+	snd_interval_any(&t);
+	t.min = t.max = val;
+	t.integer = 1;
+	return snd_interval_refine(hw_param_interval(params, var), &t);
+}
+
+static int omap_pcm_mix_be_configure(struct omap_pcm_mix *mix)
+{
+	struct snd_pcm_runtime *runtime = mix->be->runtime;
+	struct snd_pcm_hw_params *params;
+	struct snd_pcm_sw_params sw;
+	int ret;
+
+	params = kmalloc(sizeof(*params), GFP_KERNEL);
+	if (params == NULL)
+		return -ENOMEM;
+
+	_snd_pcm_hw_params_any(params);
+	omap_pcm_mix_set_mask(params, SNDRV_PCM_HW_PARAM_ACCESS,
+			      SNDRV_PCM_ACCESS_MMAP_INTERLEAVED);
+	omap_pcm_mix_set_mask(params, SNDRV_PCM_HW_PARAM_FORMAT,
+			      SNDRV_PCM_FORMAT_S16_LE);
+	omap_pcm_mix_set_mask(params, SNDRV_PCM_HW_PARAM_SUBFORMAT,
+			      SNDRV_PCM_SUBFORMAT_STD);
+	omap_pcm_mix_set_interval(params, SNDRV_PCM_HW_PARAM_CHANNELS,
+				  OMAP_PCM_MIX_CHANNELS);
+	omap_pcm_mix_set_interval(params, SNDRV_PCM_HW_PARAM_RATE,
+				  OMAP_PCM_MIX_RATE);
+	omap_pcm_mix_set_interval(params, SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
+				  OMAP_PCM_MIX_PERIOD);
+	omap_pcm_mix_set_interval(params, SNDRV_PCM_HW_PARAM_PERIODS,
+				  OMAP_PCM_MIX_PERIODS);
+
+	ret = snd_pcm_kernel_ioctl(mix->be, SNDRV_PCM_IOCTL_HW_PARAMS, params);
+	kfree(params);
+	if (ret < 0)
+		return ret;
+
+	/*
+	 * The DMA buffer is refilled behind ALSA's back, never stop on
+	 * underrun.
+	 */
+	memset(&sw, 0, sizeof(sw));
+	sw.tstamp_mode = SNDRV_PCM_TSTAMP_NONE;
+	sw.period_step = 1;
+	sw.avail_min = runtime->period_size;
+	sw.start_threshold = 1;
+	sw.stop_threshold = runtime->boundary;
+
+	return snd_pcm_kernel_ioctl(mix->be, SNDRV_PCM_IOCTL_SW_PARAMS, &sw);
+}
+
+static int omap_pcm_mix_be_start(struct omap_pcm_mix *mix)
+{
+	struct snd_pcm *pcm = mix->rtd->pcm;
+	struct snd_pcm_runtime *runtime;
+	int ret;
+
+	if (pcm == NULL)
+		return -ENODEV;
+
+	mutex_lock(&pcm->open_mutex);
+	mix->be_file.f_flags = O_WRONLY;
+	ret = snd_pcm_open_substream(pcm, SNDRV_PCM_STREAM_PLAYBACK,
+				     &mix->be_file, &mix->be);
+	mutex_unlock(&pcm->open_mutex);
+	if (ret < 0)
+		return ret;
+
+	ret = omap_pcm_mix_be_configure(mix);
+	if (ret < 0)
+		goto error;
+
+	runtime = mix->be->runtime;
+	memset(runtime->dma_area, 0, frames_to_bytes(runtime,
+						     runtime->buffer_size));
+	runtime->transfer_ack_end = omap_pcm_mix_ack;
+
+	ret = snd_pcm_kernel_ioctl(mix->be, SNDRV_PCM_IOCTL_PREPARE, NULL);
+	if (ret < 0)
+		goto error;
+
+	spin_lock_irq(&mix->lock);
+	mix->be_next = OMAP_PCM_MIX_LEAD + 1;
+	mix->be_running = true;
+	spin_unlock_irq(&mix->lock);
+
+	ret = snd_pcm_kernel_ioctl(mix->be, SNDRV_PCM_IOCTL_START, NULL);
+	if (ret < 0)
+		goto error;
+
+	return 0;
+
+error:
+	dev_err(mix->rtd->card->dev, "mixer: can't start %s (%d)\n",
+		mix->rtd->dai_link->stream_name, ret);
+	spin_lock_irq(&mix->lock);
+	mix->be_running = false;
+	spin_unlock_irq(&mix->lock);
+
+	mutex_lock(&pcm->open_mutex);
+	snd_pcm_release_substream(mix->be);
+	mutex_unlock(&pcm->open_mutex);
+	mix->be = NULL;
+	return ret;
+}
+
+static void omap_pcm_mix_be_stop(struct omap_pcm_mix *mix)
+{
+	struct snd_pcm *pcm = mix->rtd->pcm;
+
+	spin_lock_irq(&mix->lock);
+	mix->be_running = false;
+	spin_unlock_irq(&mix->lock);
+
+	snd_pcm_kernel_ioctl(mix->be, SNDRV_PCM_IOCTL_DROP, NULL);
+	tasklet_kill(&mix->tasklet);
+	mix->be->runtime->transfer_ack_end = NULL;
+
+	mutex_lock(&pcm->open_mutex);
+	snd_pcm_release_substream(mix->be);
+	mutex_unlock(&pcm->open_mutex);
+	mix->be = NULL;
+
+	dev_dbg(mix->rtd->card->dev, "mixer: %lu periods, %lu late, "
+		"avg %llu ns max %u ns\n", mix->stats.periods, mix->stats.late,
+		mix->stats.periods ?
+		div_u64(mix->stats.total_ns, mix->stats.periods) : 0,
+		mix->stats.max_ns);
+}
+
+/* -----------------------------------------------------------------------------
+ * Front-end PCM operations
+ */
+
+static const struct snd_pcm_hardware omap_pcm_mix_hardware = {
+	.info			= SNDRV_PCM_INFO_MMAP |
+				  SNDRV_PCM_INFO_MMAP_VALID |
+				  SNDRV_PCM_INFO_INTERLEAVED |
+				  SNDRV_PCM_INFO_BLOCK_TRANSFER |
+				  SNDRV_PCM_INFO_PAUSE,
+	.formats		= SNDRV_PCM_FMTBIT_S16_LE,
+	.rates			= SNDRV_PCM_RATE_CONTINUOUS |
+				  SNDRV_PCM_RATE_8000_48000,
+	.rate_min		= 8000,
+	.rate_max		= OMAP_PCM_MIX_RATE,
+	.channels_min		= 1,
+	.channels_max		= 2,
+	.period_bytes_min	= 64,
+	.period_bytes_max	= 16 * 1024,
+	.periods_min		= 2,
+	.periods_max		= 64,
+	.buffer_bytes_max	= 64 * 1024,
+};
+
+static int omap_pcm_mix_open(struct snd_pcm_substream *substream)
+{
+	struct omap_pcm_mix *mix = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	int ret = 0;
+
+	snd_soc_set_runtime_hwparams(substream, &omap_pcm_mix_hardware);
+
+	if (snd_pcm_hw_constraint_integer(runtime,
+					  SNDRV_PCM_HW_PARAM_PERIODS) < 0)
+		return -EINVAL;
+
+	mutex_lock(&mix->mutex);
+	if (mix->users == 0) {
+		mix->stats.periods = 0;
+		mix->stats.late = 0;
+		mix->stats.total_ns = 0;
+		mix->stats.max_ns = 0;
+		ret = omap_pcm_mix_be_start(mix);
+	}
+	if (ret == 0)
+		mix->users++;
+	mutex_unlock(&mix->mutex);
+	if (ret < 0)
+		return ret;
+
+	mix->streams[substream->number].substream = substream;
+	runtime->private_data = &mix->streams[substream->number];
+	return 0;
+}
+
+static int omap_pcm_mix_close(struct snd_pcm_substream *substream)
+{
+	struct omap_pcm_mix *mix = snd_pcm_substream_chip(substream);
+
+	mutex_lock(&mix->mutex);
+	if (--mix->users == 0)
+		omap_pcm_mix_be_stop(mix);
+	mutex_unlock(&mix->mutex);
+
+	return 0;
+}
+
+static int omap_pcm_mix_hw_params(struct snd_pcm_substream *substream,
+				  struct snd_pcm_hw_params *params)
+{
+	return snd_pcm_lib_malloc_pages(substream,
+					params_buffer_bytes(params));
+}
+
+static int omap_pcm_mix_hw_free(struct snd_pcm_substream *substream)
+{
+	return snd_pcm_lib_free_pages(substream);
+}
+
+static int omap_pcm_mix_prepare(struct snd_pcm_substream *substream)
+{
+	struct omap_pcm_mix *mix = snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct omap_pcm_mix_stream *s = runtime->private_data;
+
+	spin_lock_irq(&mix->lock);
+	s->area = (const s16 *)runtime->dma_area;
+	s->buffer_size = runtime->buffer_size;
+	s->period_size = runtime->period_size;
+	s->channels = runtime->channels;
+	s->pos = 0;
+	s->period_pos = 0;
+	s->step = div_u64((u64)runtime->rate << 16, OMAP_PCM_MIX_RATE);
+	s->phase = 0;
+	s->head = 0;
+	memset(s->hist, 0, sizeof(s->hist));
+	s->gain = 0;
+	spin_unlock_irq(&mix->lock);
+
+	return 0;
+}
+
+static int omap_pcm_mix_trigger(struct snd_pcm_substream *substream, int cmd)
+{
+	struct omap_pcm_mix *mix = snd_pcm_substream_chip(substream);
+	struct omap_pcm_mix_stream *s = substream->runtime->private_data;
+	unsigned long flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&mix->lock, flags);
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_RESUME:
+	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+		s->running = 1;
+		break;
+
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+		s->running = 0;
+		s->gain = 0;
+		break;
+
+	default:
+		ret = -EINVAL;
+	}
+	spin_unlock_irqrestore(&mix->lock, flags);
+
+	return ret;
+}
+
+static snd_pcm_uframes_t omap_pcm_mix_pointer(struct snd_pcm_substream *substream)
+{
+	struct omap_pcm_mix *mix = snd_pcm_substream_chip(substream);
+	struct omap_pcm_mix_stream *s = substream->runtime->private_data;
+	snd_pcm_uframes_t pos;
+	unsigned long flags;
+
+	spin_lock_irqsave(&mix->lock, flags);
+	pos = s->pos;
+	spin_unlock_irqrestore(&mix->lock, flags);
+
+	return pos;
+}
+
+static struct snd_pcm_ops omap_pcm_mix_ops = {
+	.open		= omap_pcm_mix_open,
+	.close		= omap_pcm_mix_close,
+	.ioctl		= snd_pcm_lib_ioctl,
+	.hw_params	= omap_pcm_mix_hw_params,
+	.hw_free	= omap_pcm_mix_hw_free,
+	.prepare	= omap_pcm_mix_prepare,
+	.trigger	= omap_pcm_mix_trigger,
+	.pointer	= omap_pcm_mix_pointer,
+};
+
+/* -----------------------------------------------------------------------------
+ * Controls
+ */
+
+#define OMAP_PCM_MIX_CTRL_VOLUME	0
+#define OMAP_PCM_MIX_CTRL_PRIORITY	1
+#define OMAP_PCM_MIX_CTRL_DUCK		2
+
+#define OMAP_PCM_MIX_CTRL(type, index)	(((type) << 8) | (index))
+#define OMAP_PCM_MIX_CTRL_TYPE(pv)	((pv) >> 8)
+#define OMAP_PCM_MIX_CTRL_INDEX(pv)	((pv) & 0xff)
+
+static int omap_pcm_mix_ctrl_info(struct snd_kcontrol *kcontrol,
+				  struct snd_ctl_elem_info *uinfo)
+{
+	if (OMAP_PCM_MIX_CTRL_TYPE(kcontrol->private_value) ==
+	    OMAP_PCM_MIX_CTRL_PRIORITY) {
+		uinfo->type = SNDRV_CTL_ELEM_TYPE_BOOLEAN;
+		uinfo->value.integer.max = 1;
+	} else {
+		uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+		uinfo->value.integer.max = OMAP_PCM_MIX_GAIN_MAX;
+	}
+	uinfo->count = 1;
+	uinfo->value.integer.min = 0;
+	return 0;
+}
+
+static int *omap_pcm_mix_ctrl_value(struct omap_pcm_mix *mix,
+				    unsigned long pv, int *priority)
+{
+	struct omap_pcm_mix_stream *s;
+
+	if (OMAP_PCM_MIX_CTRL_TYPE(pv) == OMAP_PCM_MIX_CTRL_DUCK)
+		return &mix->duck;
+
+	s = &mix->streams[OMAP_PCM_MIX_CTRL_INDEX(pv)];
+	if (OMAP_PCM_MIX_CTRL_TYPE(pv) == OMAP_PCM_MIX_CTRL_VOLUME)
+		return &s->volume;
+
+	*priority = s->priority;
+	return priority;
+}
+
+static int omap_pcm_mix_ctrl_get(struct snd_kcontrol *kcontrol,
+				 struct snd_ctl_elem_value *ucontrol)
+{
+	struct omap_pcm_mix *mix = snd_kcontrol_chip(kcontrol);
+	int priority;
+
+	spin_lock_irq(&mix->lock);
+	ucontrol->value.integer.value[0] =
+		*omap_pcm_mix_ctrl_value(mix, kcontrol->private_value,
+					 &priority);
+	spin_unlock_irq(&mix->lock);
+
+	return 0;
+}
+
+static int omap_pcm_mix_ctrl_put(struct snd_kcontrol *kcontrol,
+				 struct snd_ctl_elem_value *ucontrol)
+{
+	struct omap_pcm_mix *mix = snd_kcontrol_chip(kcontrol);
+	unsigned long pv = kcontrol->private_value;
+	long val = ucontrol->value.integer.value[0];
+	int priority;
+	int *value;
+	int changed;
+
+	if (val < 0 || val > OMAP_PCM_MIX_GAIN_MAX)
+		return -EINVAL;
+
+	spin_lock_irq(&mix->lock);
+	value = omap_pcm_mix_ctrl_value(mix, pv, &priority);
+	changed = *value != val;
+	if (OMAP_PCM_MIX_CTRL_TYPE(pv) == OMAP_PCM_MIX_CTRL_PRIORITY)
+		mix->streams[OMAP_PCM_MIX_CTRL_INDEX(pv)].priority = !!val;
+	else
+		*value = val;
+	spin_unlock_irq(&mix->lock);
+
+	return changed;
+}
+
+static const char *omap_pcm_mix_ctrl_names[] = {
+	[OMAP_PCM_MIX_CTRL_VOLUME] = "Mix Playback Volume",
+	[OMAP_PCM_MIX_CTRL_PRIORITY] = "Mix Priority Playback Switch",
+	[OMAP_PCM_MIX_CTRL_DUCK] = "Mix Duck Playback Volume",
+};
+
+static int omap_pcm_mix_add_ctrl(struct omap_pcm_mix *mix, unsigned int type,
+				 unsigned int index)
+{
+	struct snd_kcontrol_new tmpl = {
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+		.name = omap_pcm_mix_ctrl_names[type],
+		.index = index,
+		.info = omap_pcm_mix_ctrl_info,
+		.get = omap_pcm_mix_ctrl_get,
+		.put = omap_pcm_mix_ctrl_put,
+		.private_value = OMAP_PCM_MIX_CTRL(type, index),
+	};
+
+	return snd_ctl_add(mix->rtd->card->snd_card, snd_ctl_new1(&tmpl, mix));
+}
+
+/* -----------------------------------------------------------------------------
+ * Statistics and benchmark
+ */
+
+static void omap_pcm_mix_proc_read(struct snd_info_entry *entry,
+				   struct snd_info_buffer *buffer)
+{
+	struct omap_pcm_mix *mix = entry->private_data;
+	struct omap_pcm_mix_stats stats;
+	unsigned int i;
+
+	spin_lock_irq(&mix->lock);
+	stats = mix->stats;
+	spin_unlock_irq(&mix->lock);
+
+	snd_iprintf(buffer, "users: %u\n", mix->users);
+	for (i = 0; i < mix->nstreams; i++) {
+		struct omap_pcm_mix_stream *s = &mix->streams[i];
+
+		snd_iprintf(buffer, "stream %u: %s step 0x%05x gain %d%s\n", i,
+			    s->running ? "running" : "stopped", s->step,
+			    s->gain, s->priority ? " priority" : "");
+	}
+	snd_iprintf(buffer, "periods: %lu\n", stats.periods);
+	snd_iprintf(buffer, "late: %lu\n", stats.late);
+	snd_iprintf(buffer, "last: %u ns\n", stats.last_ns);
+	snd_iprintf(buffer, "max: %u ns\n", stats.max_ns);
+	snd_iprintf(buffer, "avg: %llu ns\n", stats.periods ?
+		    div_u64(stats.total_ns, stats.periods) : 0);
+}
+
+#define OMAP_PCM_MIX_BENCH_PERIODS	500
+#define OMAP_PCM_MIX_BENCH_FRAMES	4096
+
+/*
+ * Mix three synthetic streams (8 kHz mono prompt, 22.05 kHz and 44.1 kHz
+ * stereo media) with ducking active and report the average CPU time spent
+ * per 10 ms period.
+ */
+static void omap_pcm_mix_benchmark(struct device *dev)
+{
+	static const unsigned int rates[] = { 8000, 22050, 44100 };
+	static const unsigned int channels[] = { 1, 2, 2 };
+	struct omap_pcm_mix *mix;
+	s16 *dst, *area;
+	ktime_t start;
+	u64 ns;
+	unsigned int i, j;
+
+	mix = kzalloc(sizeof(*mix), GFP_KERNEL);
+	dst = kmalloc(OMAP_PCM_MIX_PERIOD * OMAP_PCM_MIX_CHANNELS *
+		      sizeof(*dst), GFP_KERNEL);
+	area = kmalloc(ARRAY_SIZE(rates) * OMAP_PCM_MIX_BENCH_FRAMES * 2 *
+		       sizeof(*area), GFP_KERNEL);
+	if (mix == NULL || dst == NULL || area == NULL)
+		goto done;
+
+	for (i = 0; i < ARRAY_SIZE(rates) * OMAP_PCM_MIX_BENCH_FRAMES * 2; i++)
+		area[i] = (i * 1021) & 0x3fff;
+
+	mix->nstreams = ARRAY_SIZE(rates);
+	mix->duck = OMAP_PCM_MIX_GAIN_MAX / 4;
+	for (i = 0; i < mix->nstreams; i++) {
+		struct omap_pcm_mix_stream *s = &mix->streams[i];
+
+		s->running = 1;
+		s->priority = i == 0;
+		s->area = area + i * OMAP_PCM_MIX_BENCH_FRAMES * 2;
+		s->buffer_size = OMAP_PCM_MIX_BENCH_FRAMES;
+		s->period_size = OMAP_PCM_MIX_BENCH_FRAMES / 4;
+		s->channels = channels[i];
+		s->step = div_u64((u64)rates[i] << 16, OMAP_PCM_MIX_RATE);
+		s->volume = OMAP_PCM_MIX_GAIN_MAX;
+	}
+
+	start = ktime_get();
+	for (j = 0; j < OMAP_PCM_MIX_BENCH_PERIODS; j++)
+		omap_pcm_mix_render(mix, dst, OMAP_PCM_MIX_PERIOD);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	ns = div_u64(ns, OMAP_PCM_MIX_BENCH_PERIODS);
+
+	/* One period lasts 10 ms: 100000 ns is 1% of a CPU. */
+	dev_info(dev, "mixer: 3 streams, %llu ns per period (%llu.%02llu%% CPU)\n",
+		 ns, div_u64(ns, 100000), div_u64(ns, 1000) % 100);
+
+done:
+	kfree(area);
+	kfree(dst);
+	kfree(mix);
+}
+
+/* -----------------------------------------------------------------------------
+ * Registration
+ */
+
+static void omap_pcm_mix_free(struct snd_pcm *pcm)
+{
+	struct omap_pcm_mix *mix = pcm->private_data;
+
+	omap_pcm_mix_dev = NULL;
+	kfree(mix);
+}
+
+/**
+ * omap_pcm_mix_new - Create a mixing PCM on top of a DAI link
+ * @rtd: DAI link runtime whose playback substream is used as back-end
+ * @device: PCM device number of the mixer
+ * @nstreams: Number of mixed playback substreams
+ *
+ * Must be called from the DAI link init callback. The back-end substream is
+ * only opened when the first mixer substream is, and is then unavailable to
+ * userspace until the last one is closed.
+ */
+int omap_pcm_mix_new(struct snd_soc_pcm_runtime *rtd, int device,
+		     unsigned int nstreams)
+{
+	struct snd_card *card = rtd->card->snd_card;
+	struct snd_info_entry *entry;
+	struct omap_pcm_mix *mix;
+	struct snd_pcm *pcm;
+	unsigned int i;
+	int ret;
+
+	if (omap_pcm_mix_dev != NULL)
+		return -EBUSY;
+
+	if (nstreams == 0 || nstreams > OMAP_PCM_MIX_MAX_STREAMS)
+		return -EINVAL;
+
+	mix = kzalloc(sizeof(*mix), GFP_KERNEL);
+	if (mix == NULL)
+		return -ENOMEM;
+
+	mix->rtd = rtd;
+	mix->nstreams = nstreams;
+	mix->duck = OMAP_PCM_MIX_GAIN_MAX / 4;
+	mutex_init(&mix->mutex);
+	spin_lock_init(&mix->lock);
+	tasklet_init(&mix->tasklet, omap_pcm_mix_tasklet, (unsigned long)mix);
+	for (i = 0; i < nstreams; i++)
+		mix->streams[i].volume = OMAP_PCM_MIX_GAIN_MAX;
+
+	ret = snd_pcm_new(card, "Mixer", device, nstreams, 0, &pcm);
+	if (ret < 0) {
+		kfree(mix);
+		return ret;
+	}
+
+	snprintf(pcm->name, sizeof(pcm->name), "%s Mixer",
+		 rtd->dai_link->stream_name);
+	pcm->private_data = mix;
+	pcm->private_free = omap_pcm_mix_free;
+	mix->pcm = pcm;
+	omap_pcm_mix_dev = mix;
+
+	snd_pcm_set_ops(pcm, SNDRV_PCM_STREAM_PLAYBACK, &omap_pcm_mix_ops);
+	ret = snd_pcm_lib_preallocate_pages_for_all(pcm,
+			SNDRV_DMA_TYPE_CONTINUOUS,
+			snd_dma_continuous_data(GFP_KERNEL),
+			omap_pcm_mix_hardware.buffer_bytes_max,
+			omap_pcm_mix_hardware.buffer_bytes_max);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < nstreams; i++) {
+		ret = omap_pcm_mix_add_ctrl(mix, OMAP_PCM_MIX_CTRL_VOLUME, i);
+		if (ret < 0)
+			return ret;
+		ret = omap_pcm_mix_add_ctrl(mix, OMAP_PCM_MIX_CTRL_PRIORITY, i);
+		if (ret < 0)
+			return ret;
+	}
+	ret = omap_pcm_mix_add_ctrl(mix, OMAP_PCM_MIX_CTRL_DUCK, 0);
+	if (ret < 0)
+		return ret;
+
+	if (!snd_card_proc_new(card, "pcm-mix", &entry))
+		snd_info_set_text_ops(entry, mix, omap_pcm_mix_proc_read);
+
+	if (mix_benchmark)
+		omap_pcm_mix_benchmark(rtd->card->dev);
+
+	return 0;
+}
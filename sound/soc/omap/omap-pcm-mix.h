@@ -0,0 +1,36 @@
+/*
+ * omap-pcm-mix.h  --  Software mixing stage on top of an OMAP PCM link
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef __OMAP_PCM_MIX_H__
+#define __OMAP_PCM_MIX_H__
+
+struct snd_soc_pcm_runtime;
+
+#ifdef CONFIG_SND_OMAP_SOC_PCM_MIX
+int omap_pcm_mix_new(struct snd_soc_pcm_runtime *rtd, int device,
+		     unsigned int nstreams);
+#else
+static inline int omap_pcm_mix_new(struct snd_soc_pcm_runtime *rtd,
+				   int device, unsigned int nstreams)
+{
+	return 0;
+}
+#endif
+
+#endif
@@ -23,6 +23,8 @@
  */
 
 #include <linux/dma-mapping.h>
+#include <linux/hrtimer.h>
+#include <linux/module.h>
 #include <linux/slab.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
@@ -49,14 +51,94 @@ static const struct snd_pcm_hardware omap_pcm_hardware = {
 	.buffer_bytes_max	= 128 * 1024,
 };
 
+/*
+ * Low latency mode: when timer_us is not zero, DMA frame and block interrupts
+ * are disabled and period completion is detected by polling the DMA position
+ * from a high resolution timer firing every timer_us microseconds (clamped to
+ * the ALSA period time). Small periods then don't cost one DMA interrupt each,
+ * and the timer slack lets the kernel coalesce the wakeups.
+ */
+static unsigned int timer_us;
+module_param(timer_us, uint, 0644);
+MODULE_PARM_DESC(timer_us, "Period timer interval in us (0: DMA interrupts)");
+
+#define OMAP_PCM_TIMER_SLACK_NS		(100 * NSEC_PER_USEC)
+
 struct omap_runtime_data {
 	spinlock_t			lock;
 	struct omap_pcm_dma_data	*dma_data;
 	int				dma_ch;
 	int				period_index;
     int             steady_state;
+
+	/* Timer mode */
+	struct snd_pcm_substream	*substream;
+	struct hrtimer			timer;
+	ktime_t				timer_interval;
+	unsigned int			timer_us;
+	bool				timer_running;
+	snd_pcm_uframes_t		timer_period;
 };
 
+/*
+ * Return the current DMA position in frames. Must be called with interrupts
+ * disabled, see omap_get_dma_src_pos().
+ */
+static snd_pcm_uframes_t omap_pcm_dma_pos(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct omap_runtime_data *prtd = runtime->private_data;
+	snd_pcm_uframes_t offset;
+	dma_addr_t ptr;
+
+	if (cpu_is_omap1510()) {
+		offset = prtd->period_index * runtime->period_size;
+	} else if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
+		ptr = omap_get_dma_dst_pos(prtd->dma_ch);
+		offset = bytes_to_frames(runtime, ptr - runtime->dma_addr);
+	} else {
+		ptr = omap_get_dma_src_pos(prtd->dma_ch);
+		offset = bytes_to_frames(runtime, ptr - runtime->dma_addr);
+	}
+
+	/* The address registers are not valid before the first element has
+	 * been transferred.
+	 */
+	if (offset >= runtime->buffer_size)
+		offset = 0;
+
+	return offset;
+}
+
+static enum hrtimer_restart omap_pcm_timer(struct hrtimer *timer)
+{
+	struct omap_runtime_data *prtd =
+		container_of(timer, struct omap_runtime_data, timer);
+	struct snd_pcm_substream *substream = prtd->substream;
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_uframes_t period;
+	unsigned long flags;
+	bool elapsed;
+
+	spin_lock_irqsave(&prtd->lock, flags);
+	if (!prtd->timer_running) {
+		spin_unlock_irqrestore(&prtd->lock, flags);
+		return HRTIMER_NORESTART;
+	}
+
+	period = omap_pcm_dma_pos(substream) / runtime->period_size;
+	elapsed = period != prtd->timer_period;
+	prtd->timer_period = period;
+	hrtimer_forward_now(timer, prtd->timer_interval);
+	spin_unlock_irqrestore(&prtd->lock, flags);
+
+	/* This may stop the stream on xrun. */
+	if (elapsed)
+		snd_pcm_period_elapsed(substream);
+
+	return prtd->timer_running ? HRTIMER_RESTART : HRTIMER_NORESTART;
+}
+
 static void omap_pcm_dma_irq(int ch, u16 stat, void *data)
 {
 	struct snd_pcm_substream *substream = data;
@@ -95,6 +177,10 @@ static void omap_pcm_dma_irq(int ch, u16 stat, void *data)
 		spin_unlock_irqrestore(&prtd->lock, flags);
 	}
 
+	/* Periods are reported by the timer in low latency mode. */
+	if (prtd->timer_running)
+		return;
+
     ptr = omap_get_dma_src_pos(prtd->dma_ch);
     offset = bytes_to_frames(runtime, ptr - runtime->dma_addr);
     if (!prtd->steady_state && offset >= runtime->period_size)
@@ -149,6 +235,8 @@ static int omap_pcm_hw_free(struct snd_pcm_substream *substream)
 	if (prtd->dma_data == NULL)
 		return 0;
 
+	hrtimer_cancel(&prtd->timer);
+
 	omap_dma_unlink_lch(prtd->dma_ch, prtd->dma_ch);
 	omap_free_dma(prtd->dma_ch);
 	prtd->dma_data = NULL;
@@ -203,11 +291,22 @@ static int omap_pcm_prepare(struct snd_pcm_substream *substream)
 	dma_params.frame_count	= runtime->periods;
 	omap_set_dma_params(prtd->dma_ch, &dma_params);
 
-	if ((cpu_is_omap1510()))
+	if ((cpu_is_omap1510())) {
 		omap_enable_dma_irq(prtd->dma_ch, OMAP_DMA_FRAME_IRQ |
 			      OMAP_DMA_LAST_IRQ | OMAP_DMA_BLOCK_IRQ);
-	else
+	} else if (prtd->timer_us) {
+		u64 interval = (u64)runtime->period_size * USEC_PER_SEC;
+
+		/* Poll at least once per period. */
+		do_div(interval, runtime->rate);
+		interval = min_t(u64, interval, prtd->timer_us);
+		prtd->timer_interval = ns_to_ktime(interval * NSEC_PER_USEC);
+
+		omap_disable_dma_irq(prtd->dma_ch, OMAP_DMA_FRAME_IRQ |
+				     OMAP_DMA_BLOCK_IRQ);
+	} else {
 		omap_enable_dma_irq(prtd->dma_ch, OMAP_DMA_FRAME_IRQ);
+	}
 
 	if (!(cpu_class_is_omap1())) {
 		omap_set_dma_src_burst_mode(prtd->dma_ch,
@@ -239,12 +338,26 @@ static int omap_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 			dma_data->set_threshold(substream);
 
 		omap_start_dma(prtd->dma_ch);
+
+		if (prtd->timer_us && !cpu_is_omap1510()) {
+			prtd->timer_period = 0;
+			prtd->timer_running = true;
+			hrtimer_start_range_ns(&prtd->timer,
+					       prtd->timer_interval,
+					       OMAP_PCM_TIMER_SLACK_NS,
+					       HRTIMER_MODE_REL);
+		}
 		break;
 
 	case SNDRV_PCM_TRIGGER_STOP:
 	case SNDRV_PCM_TRIGGER_SUSPEND:
 	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
 		prtd->period_index = -1;
+		/* Can be called from the timer handler, don't wait. */
+		if (prtd->timer_running) {
+			prtd->timer_running = false;
+			hrtimer_try_to_cancel(&prtd->timer);
+		}
 		omap_stop_dma(prtd->dma_ch);
 		if (cpu_is_omap44xx()) {
 			/* Since we are using self linking, there is a
@@ -266,21 +379,15 @@ static snd_pcm_uframes_t omap_pcm_pointer(struct snd_pcm_substream *substream)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct omap_runtime_data *prtd = runtime->private_data;
-	dma_addr_t ptr;
 	snd_pcm_uframes_t offset;
+	unsigned long flags;
 
-	if (cpu_is_omap1510()) {
-		offset = prtd->period_index * runtime->period_size;
-	} else if (substream->stream == SNDRV_PCM_STREAM_CAPTURE) {
-		ptr = omap_get_dma_dst_pos(prtd->dma_ch);
-		offset = bytes_to_frames(runtime, ptr - runtime->dma_addr);
-	} else {
-		ptr = omap_get_dma_src_pos(prtd->dma_ch);
-		offset = bytes_to_frames(runtime, ptr - runtime->dma_addr);
-	}
-
-	if (offset >= runtime->buffer_size)
-		offset = 0;
+	/* Read the live DMA position, with interrupts disabled to avoid
+	 * racing the DMA interrupt handler.
+	 */
+	spin_lock_irqsave(&prtd->lock, flags);
+	offset = omap_pcm_dma_pos(substream);
+	spin_unlock_irqrestore(&prtd->lock, flags);
 
 	return offset;
 }
@@ -315,6 +422,10 @@ static int omap_pcm_open(struct snd_pcm_substream *substream)
 		goto out;
 	}
 	spin_lock_init(&prtd->lock);
+	prtd->substream = substream;
+	prtd->timer_us = timer_us;
+	hrtimer_init(&prtd->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	prtd->timer.function = omap_pcm_timer;
 	runtime->private_data = prtd;
 
 out:
@@ -324,8 +435,10 @@ out:
 static int omap_pcm_close(struct snd_pcm_substream *substream)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct omap_runtime_data *prtd = runtime->private_data;
 
-	kfree(runtime->private_data);
+	hrtimer_cancel(&prtd->timer);
+	kfree(prtd);
 	return 0;
 }
 